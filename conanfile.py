@@ -18,8 +18,8 @@ class ConcoreRecipe(ConanFile):
    settings = "os", "compiler", "build_type", "arch"
    build_policy = "missing"   # Some of the dependencies don't have builds for all our targets
 
-   options = {"shared": [True, False], "fPIC": [True, False], "no_tbb": [True, False]}
-   default_options = {"shared": False, "fPIC": True, "no_tbb": False, "catch2/*:with_main": True}
+   options = {"shared": [True, False], "fPIC": [True, False], "no_tbb": [True, False], "usdt": [True, False]}
+   default_options = {"shared": False, "fPIC": True, "no_tbb": False, "usdt": False, "catch2/*:with_main": True}
 
    exports = "LICENSE"
    exports_sources = ("src/*", "test/*", "CMakeLists.txt", "LICENSE")
@@ -57,6 +57,7 @@ class ConcoreRecipe(ConanFile):
    def generate(self):
       tc = CMakeToolchain(self)
       tc.variables["concore.no_tbb"] = self.options.no_tbb
+      tc.variables["concore.usdt"] = self.options.usdt
       if self.settings.os == "Windows" and is_msvc(self) and self.options.shared:
          tc.variables["CMAKE_WINDOWS_EXPORT_ALL_SYMBOLS"] = True
       tc.generate()
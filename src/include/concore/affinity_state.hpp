@@ -0,0 +1,89 @@
+/**
+ * @file    affinity_state.hpp
+ * @brief   Definition of @ref concore::v1::affinity_state "affinity_state"
+ *
+ * @see     @ref concore::v1::affinity_state "affinity_state", partition_method
+ */
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace concore {
+
+namespace detail {
+struct affinity_state_access;
+} // namespace detail
+
+inline namespace v1 {
+
+/**
+ * @brief      Records which worker processed each chunk of a range, to be replayed later
+ *
+ * @details
+ *
+ * Used with partition_method::affinity_partition. The user keeps this object alive between
+ * multiple calls of the same algorithm over the same data, and passes it through
+ * partition_hints::affinity_. In the first call, the algorithm records the worker that executed
+ * each chunk; in the subsequent calls, the chunks are sent to the same workers, so that they find
+ * their data in the cache.
+ *
+ * If the size of the range changes, or if the number of workers changes, the recorded mapping is
+ * discarded, and a new one is recorded.
+ *
+ * The object must not be used by two algorithms running at the same time.
+ *
+ * Example:
+ * @code
+ *      concore::affinity_state state;
+ *      concore::partition_hints hints;
+ *      hints.method_ = concore::partition_method::affinity_partition;
+ *      hints.affinity_ = &state;
+ *      for (int step = 0; step < num_steps; step++)
+ *          concore::conc_for(0, n, [&](int i) { update(i); }, hints);
+ * @endcode
+ *
+ * @see partition_method, partition_hints
+ */
+class affinity_state {
+public:
+    //! Returns the number of chunks for which we have recorded workers; 0 if nothing is recorded
+    std::size_t num_chunks() const { return workers_.size(); }
+    //! Returns the index of the worker that last executed the given chunk; -1 if not known
+    int worker_of(std::size_t chunk) const { return workers_[chunk]; }
+    //! Forgets the recorded mapping; the next call will record a new one
+    void clear() {
+        range_size_ = 0;
+        workers_.clear();
+    }
+
+private:
+    friend struct detail::affinity_state_access;
+
+    //! The size of the range for which the mapping was recorded
+    std::ptrdiff_t range_size_{0};
+    //! For each chunk, the index of the worker that executed it
+    std::vector<int> workers_;
+};
+
+} // namespace v1
+
+namespace detail {
+
+//! Gives the partitioning algorithms access to the recorded mapping
+struct affinity_state_access {
+    //! Makes sure the state is prepared for a range of `n` elements, divided into `num_chunks`
+    //! chunks; if the recorded mapping is for a different configuration, it is discarded.
+    //! Returns the worker index slots for the chunks.
+    static std::vector<int>& prepare(
+            affinity_state& st, std::ptrdiff_t n, std::ptrdiff_t num_chunks) {
+        if (st.range_size_ != n || st.workers_.size() != std::size_t(num_chunks)) {
+            st.range_size_ = n;
+            st.workers_.assign(std::size_t(num_chunks), -1);
+        }
+        return st.workers_;
+    }
+};
+
+} // namespace detail
+} // namespace concore
@@ -0,0 +1,235 @@
+/**
+ * @file    blocked_range.hpp
+ * @brief   Definition of @ref concore::v1::blocked_range "blocked_range", @ref
+ *          concore::v1::blocked_range2d "blocked_range2d" and @ref concore::v1::blocked_range3d
+ *          "blocked_range3d"
+ *
+ * @see     @ref concore::v1::blocked_range2d "blocked_range2d", @ref
+ *          concore::v1::blocked_range3d "blocked_range3d", conc_for()
+ */
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+namespace concore {
+
+inline namespace v1 {
+
+/**
+ * @brief      A one-dimensional range of integral values, that can be split down to a grain size
+ *
+ * @tparam     T     The type of the values in the range (integral type)
+ *
+ * @details
+ *
+ * Represents the values in `[begin(), end())`. The range can be split in two halves as long as
+ * its size is greater than the grain size.
+ *
+ * This is used to describe the dimensions of @ref blocked_range2d and @ref blocked_range3d.
+ *
+ * @see blocked_range2d, blocked_range3d
+ */
+template <typename T>
+class blocked_range {
+public:
+    //! The type of the values in the range
+    using value_type = T;
+
+    /**
+     * @brief      Constructor
+     *
+     * @param      begin  The first value in the range
+     * @param      end    One past the last value in the range
+     * @param      grain  The size below which the range is not split anymore
+     */
+    blocked_range(T begin, T end, size_t grain = 1)
+        : begin_(begin)
+        , end_(end)
+        , grain_(grain) {
+        assert(begin <= end);
+        assert(grain > 0);
+    }
+
+    //! The first value in the range
+    T begin() const { return begin_; }
+    //! One past the last value in the range
+    T end() const { return end_; }
+    //! The number of values in the range
+    size_t size() const { return size_t(end_ - begin_); }
+    //! The size below which the range is not split anymore
+    size_t grainsize() const { return grain_; }
+    //! Checks if the range is empty
+    bool empty() const { return begin_ == end_; }
+    //! Checks if the range can be split
+    bool is_divisible() const { return size() > grain_; }
+
+    //! Splits the range in two halves; this keeps the first half, and the second one is returned
+    blocked_range split() {
+        assert(is_divisible());
+        T mid = begin_ + T(size() / 2);
+        blocked_range res{mid, end_, grain_};
+        end_ = mid;
+        return res;
+    }
+
+private:
+    T begin_;
+    T end_;
+    size_t grain_;
+};
+
+/**
+ * @brief      A two-dimensional range, that can be split into tiles
+ *
+ * @tparam     RowT  The type of the row indices (integral type)
+ * @tparam     ColT  The type of the column indices (integral type)
+ *
+ * @details
+ *
+ * This describes a rectangular block of elements, for iterating over matrices and images. When
+ * given to conc_for(), the range is recursively split along its longest dimension (measured in
+ * grains), until reaching tiles that cannot be split anymore. This way, the body works on tiles
+ * that fit in the cache, instead of working on full rows.
+ *
+ * @see blocked_range, blocked_range3d, conc_for()
+ */
+template <typename RowT, typename ColT = RowT>
+class blocked_range2d {
+public:
+    //! Constructor from the ranges of the two dimensions
+    blocked_range2d(blocked_range<RowT> rows, blocked_range<ColT> cols)
+        : rows_(rows)
+        , cols_(cols) {}
+    /**
+     * @brief      Constructor
+     *
+     * @param      row_begin  The first row
+     * @param      row_end    One past the last row
+     * @param      row_grain  The number of rows below which we don't split anymore
+     * @param      col_begin  The first column
+     * @param      col_end    One past the last column
+     * @param      col_grain  The number of columns below which we don't split anymore
+     */
+    blocked_range2d(RowT row_begin, RowT row_end, size_t row_grain, ColT col_begin, ColT col_end,
+            size_t col_grain)
+        : rows_(row_begin, row_end, row_grain)
+        , cols_(col_begin, col_end, col_grain) {}
+    //! Constructor, with a grain size of 1 for both dimensions
+    blocked_range2d(RowT row_begin, RowT row_end, ColT col_begin, ColT col_end)
+        : rows_(row_begin, row_end)
+        , cols_(col_begin, col_end) {}
+
+    //! The range of rows
+    const blocked_range<RowT>& rows() const { return rows_; }
+    //! The range of columns
+    const blocked_range<ColT>& cols() const { return cols_; }
+
+    //! Checks if the range is empty
+    bool empty() const { return rows_.empty() || cols_.empty(); }
+    //! Checks if the range can be split
+    bool is_divisible() const { return rows_.is_divisible() || cols_.is_divisible(); }
+
+    //! Splits the range in two halves, along the longest dimension. This keeps the first half, and
+    //! the second one is returned.
+    blocked_range2d split() {
+        assert(is_divisible());
+        blocked_range2d res{*this};
+        bool split_rows = rows_.is_divisible() &&
+                          (!cols_.is_divisible() || num_grains(rows_) > num_grains(cols_));
+        if (split_rows)
+            res.rows_ = rows_.split();
+        else
+            res.cols_ = cols_.split();
+        return res;
+    }
+
+private:
+    blocked_range<RowT> rows_;
+    blocked_range<ColT> cols_;
+
+    template <typename T>
+    static double num_grains(const blocked_range<T>& r) {
+        return double(r.size()) / double(r.grainsize());
+    }
+};
+
+/**
+ * @brief      A three-dimensional range, that can be split into tiles
+ *
+ * @tparam     PageT  The type of the page indices (integral type)
+ * @tparam     RowT   The type of the row indices (integral type)
+ * @tparam     ColT   The type of the column indices (integral type)
+ *
+ * @details
+ *
+ * This is similar to @ref blocked_range2d, but for volumes. The range is recursively split along
+ * its longest dimension (measured in grains).
+ *
+ * @see blocked_range, blocked_range2d, conc_for()
+ */
+template <typename PageT, typename RowT = PageT, typename ColT = RowT>
+class blocked_range3d {
+public:
+    //! Constructor from the ranges of the three dimensions
+    blocked_range3d(blocked_range<PageT> pages, blocked_range<RowT> rows, blocked_range<ColT> cols)
+        : pages_(pages)
+        , rows_(rows)
+        , cols_(cols) {}
+    //! Constructor, giving the begin, end and grain size for each dimension
+    blocked_range3d(PageT page_begin, PageT page_end, size_t page_grain, RowT row_begin,
+            RowT row_end, size_t row_grain, ColT col_begin, ColT col_end, size_t col_grain)
+        : pages_(page_begin, page_end, page_grain)
+        , rows_(row_begin, row_end, row_grain)
+        , cols_(col_begin, col_end, col_grain) {}
+    //! Constructor, with a grain size of 1 for all dimensions
+    blocked_range3d(PageT page_begin, PageT page_end, RowT row_begin, RowT row_end,
+            ColT col_begin, ColT col_end)
+        : pages_(page_begin, page_end)
+        , rows_(row_begin, row_end)
+        , cols_(col_begin, col_end) {}
+
+    //! The range of pages
+    const blocked_range<PageT>& pages() const { return pages_; }
+    //! The range of rows
+    const blocked_range<RowT>& rows() const { return rows_; }
+    //! The range of columns
+    const blocked_range<ColT>& cols() const { return cols_; }
+
+    //! Checks if the range is empty
+    bool empty() const { return pages_.empty() || rows_.empty() || cols_.empty(); }
+    //! Checks if the range can be split
+    bool is_divisible() const {
+        return pages_.is_divisible() || rows_.is_divisible() || cols_.is_divisible();
+    }
+
+    //! Splits the range in two halves, along the longest dimension. This keeps the first half, and
+    //! the second one is returned.
+    blocked_range3d split() {
+        assert(is_divisible());
+        double p = pages_.is_divisible() ? num_grains(pages_) : 0.0;
+        double r = rows_.is_divisible() ? num_grains(rows_) : 0.0;
+        double c = cols_.is_divisible() ? num_grains(cols_) : 0.0;
+        blocked_range3d res{*this};
+        if (p >= r && p >= c && p > 0.0)
+            res.pages_ = pages_.split();
+        else if (r >= c && r > 0.0)
+            res.rows_ = rows_.split();
+        else
+            res.cols_ = cols_.split();
+        return res;
+    }
+
+private:
+    blocked_range<PageT> pages_;
+    blocked_range<RowT> rows_;
+    blocked_range<ColT> cols_;
+
+    template <typename T>
+    static double num_grains(const blocked_range<T>& r) {
+        return double(r.size()) / double(r.grainsize());
+    }
+};
+
+} // namespace v1
+} // namespace concore
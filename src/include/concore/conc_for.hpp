@@ -1,11 +1,12 @@
 /**
  * @file    conc_for.hpp
- * @brief   Definition of conc_for()
+ * @brief   Definition of conc_for() and conc_for_range()
  *
- * @see     conc_for()
+ * @see     conc_for(), conc_for_range()
  */
 #pragma once
 
+#include "concore/blocked_range.hpp"
 #include "concore/detail/partition_work.hpp"
 #include "concore/detail/except_utils.hpp"
 
@@ -38,33 +39,96 @@ struct conc_for_work {
     }
 };
 
-// Case where we have random-access iterators
-template <typename WorkType>
-inline void do_conc_for(typename WorkType::iterator first, typename WorkType::iterator last,
-        WorkType& work, task_group& grp, partition_hints hints, std::random_access_iterator_tag) {
+//! Work unit that passes entire chunks to the functor, given to the partition work functions.
+template <typename It, typename RangeFunction>
+struct conc_for_range_work {
+    const RangeFunction* ftor_{nullptr};
 
-    int n = static_cast<int>(last - first);
-    if (n == 0)
-        return;
-    int granularity = compute_granularity(n, hints);
+    using iterator = It;
+
+    conc_for_range_work() = default;
+    ~conc_for_range_work() = default;
+    conc_for_range_work(const conc_for_range_work&) = default;
+    conc_for_range_work& operator=(const conc_for_range_work&) = default;
+    // NOLINTNEXTLINE(performance-noexcept-move-constructor)
+    conc_for_range_work(conc_for_range_work&&) = default;
+    // NOLINTNEXTLINE(performance-noexcept-move-constructor)
+    conc_for_range_work& operator=(conc_for_range_work&&) = default;
+
+    explicit conc_for_range_work(const RangeFunction& f)
+        : ftor_(&f) {}
+
+    void exec(It first, It last) { (*ftor_)(first, last); }
+};
+
+//! Applies the partitioning method from the hints, for random-access iterators
+template <typename WorkType>
+inline void partition_conc_for(typename WorkType::iterator first, std::ptrdiff_t n, WorkType& work,
+        task_group& grp, partition_hints hints) {
+    auto last = static_cast<typename WorkType::iterator>(first + n);
+    std::ptrdiff_t granularity = compute_granularity(n, hints);
     switch (hints.method_) {
     case partition_method::upfront_partition: {
         int tasks_per_worker = hints.tasks_per_worker_ > 0 ? hints.tasks_per_worker_ : 2;
         detail::upfront_partition_work<false>(first, n, work, grp, tasks_per_worker);
         break;
     }
+    case partition_method::affinity_partition:
+        if (hints.affinity_) {
+            // More chunks than workers, so that stealing can balance the load
+            int tasks_per_worker = hints.tasks_per_worker_ > 0 ? hints.tasks_per_worker_ : 4;
+            detail::affinity_partition_work<false>(
+                    first, n, work, grp, tasks_per_worker, *hints.affinity_);
+        } else {
+            detail::auto_partition_work<false>(first, n, work, grp, granularity);
+        }
+        break;
     case partition_method::iterative_partition:
-        detail::iterative_partition_work<false>(first, last, work, grp, granularity);
+        detail::self_scheduled_partition_work<false>(
+                first, n, work, grp, granularity, detail::self_sched_part::schedule::fixed);
+        break;
+    case partition_method::guided_partition:
+        detail::self_scheduled_partition_work<false>(first, n, work, grp,
+                std::max(1, hints.granularity_), detail::self_sched_part::schedule::guided);
+        break;
+    case partition_method::factoring_partition:
+        detail::self_scheduled_partition_work<false>(first, n, work, grp,
+                std::max(1, hints.granularity_), detail::self_sched_part::schedule::factoring);
         break;
     case partition_method::naive_partition:
         detail::naive_partition_work(first, last, work, grp, granularity);
         break;
+    case partition_method::lazy_partition:
+        detail::lazy_partition_work<false>(first, n, work, grp, granularity);
+        break;
+    case partition_method::deterministic_partition:
+        detail::deterministic_partition_work<false>(
+                first, n, work, grp, detail::deterministic_granularity(n, hints));
+        break;
     case partition_method::auto_partition:
     default:
         detail::auto_partition_work<false>(first, n, work, grp, granularity);
         break;
     }
 }
+// Case where we have random-access iterators
+template <typename WorkType>
+inline void do_conc_for(typename WorkType::iterator first, typename WorkType::iterator last,
+        WorkType& work, task_group& grp, partition_hints hints, std::random_access_iterator_tag) {
+
+    auto n = static_cast<std::ptrdiff_t>(last - first);
+    if (n == 0)
+        return;
+    if (hints.tuner_) {
+        auto partition = [&grp](auto first, std::ptrdiff_t n, WorkType& work,
+                                 partition_hints hints) {
+            partition_conc_for(first, n, work, grp, hints);
+        };
+        detail::tuned_partition_work<false>(first, n, work, hints, partition);
+    } else {
+        partition_conc_for(first, n, work, grp, hints);
+    }
+}
 // Integral case: behave as we have random-access iterators
 template <typename WorkType>
 inline void do_conc_for(typename WorkType::iterator first, typename WorkType::iterator last,
@@ -119,6 +183,54 @@ inline void conc_for_fun(
     conc_for_impl(first, last, work, grp, hints);
 }
 
+template <typename It, typename RangeFunction>
+inline void conc_for_range_fun(
+        It first, It last, const RangeFunction& f, const task_group& grp, partition_hints hints) {
+    detail::conc_for_range_work<It, RangeFunction> work(f);
+    conc_for_impl(first, last, work, grp, hints);
+}
+
+//! Recursively splits the range, spawning tasks for the second halves, until the range cannot be
+//! split anymore; then calls the body for the remaining tile.
+//! The second halves are spawned from the largest to the smallest, so the worker that executes
+//! this will next take the tile right next to the one it just finished.
+//! Stops splitting, and doesn't call the body, if the group is cancelled.
+template <typename Range, typename F>
+inline void split_range_work(Range range, const F& f, const task_group& grp) {
+    while (range.is_divisible()) {
+        if (grp.is_cancelled())
+            return;
+        Range rhs = range.split();
+        spawn(task{[rhs, &f, grp] { split_range_work(rhs, f, grp); }, grp});
+    }
+    if (!range.empty() && !grp.is_cancelled())
+        f(range);
+}
+
+template <typename Range, typename F>
+inline void conc_for_blocked_range(const Range& range, const F& f, const task_group& grp) {
+    auto wait_grp = task_group::create(grp ? grp : task_group::current_task_group());
+    std::exception_ptr thrown_exception;
+    install_except_propagation_handler(thrown_exception, wait_grp);
+
+    // Make sure that all the spawned tasks will have this group
+    auto old_grp = task_group::set_current_task_group(wait_grp);
+
+    try {
+        split_range_work(range, f, wait_grp);
+    } catch (...) {
+        detail::task_group_access::on_task_exception(wait_grp, std::current_exception());
+    }
+    wait(wait_grp);
+
+    // Restore the old task group
+    task_group::set_current_task_group(old_grp);
+
+    // If we have an exception, re-throw it
+    if (thrown_exception)
+        std::rethrow_exception(thrown_exception);
+}
+
 } // namespace detail
 
 inline namespace v1 {
@@ -156,7 +268,9 @@ inline namespace v1 {
  * This can be a method of generating more work in the concurrent `for` loop.
  *
  * One can cancel the execution of the tasks by passing a @ref concore::v1::task_group "task_group"
- * in, and canceling that task_group.
+ * in, and canceling that task_group. The running tasks check for cancellation between chunks of
+ * iterations (see the granularity in @ref partition_hints); after cancellation, no new chunks are
+ * started, and the work is not split anymore. The iterations that were not executed are skipped.
  *
  * One can also provide hints to the implementation to fine-tune the algorithms to better fit the
  * data it operates on. Please note however that the implementation may completely ignore all the
@@ -231,5 +345,123 @@ inline void conc_for(
     detail::conc_for_impl(first, last, work, {}, {});
 }
 
+/**
+ * @brief      A concurrent `for` algorithm in which the functor is called for chunks of elements
+ *
+ * @param      first          Iterator pointing to the first element in a collection
+ * @param      last           Iterator pointing to the last element in a collection (1 past the end)
+ * @param      f              Functor called for each chunk, with the bounds of the chunk
+ * @param      grp            Group in which to execute the tasks
+ * @param      hints          Hints that may be passed to the partitioning algorithm
+ *
+ * @tparam     It             The type of the iterator to use (or an integral type)
+ * @tparam     RangeFunction  The type of the functor to be called for the chunks
+ *
+ * @details
+ *
+ * This is similar to conc_for(), but instead of calling the functor for each element, it calls
+ * the functor with the bounds of the chunks chosen by the partitioning algorithm: `f(b, e)`. The
+ * chunks cover the whole range, and they don't overlap.
+ *
+ * As the loop over the elements of a chunk is written in the functor, the compiler sees it
+ * entirely; simple arithmetic loops can be vectorized, and the per-element call overhead is
+ * avoided. This is the same as passing a work object to conc_for(), without the need to define a
+ * work type.
+ *
+ * If `first` and `last` are integers, the functor receives index bounds. Otherwise, the iterators
+ * need to be random-access; for other iterator categories the chunks are still formed, but the
+ * loop cannot be distributed as efficiently.
+ *
+ * Example:
+ * @code
+ *      concore::conc_for_range(0, n, [&](int b, int e) {
+ *          for (int i = b; i < e; i++)
+ *              y[i] = a * x[i] + y[i];
+ *      });
+ * @endcode
+ *
+ * @warning    If the iterations are not completely independent, this results in undefined behavior.
+ *
+ * @see     conc_for(), partition_hints, partition_method, task_group
+ */
+template <typename It, typename RangeFunction>
+inline void conc_for_range(
+        It first, It last, const RangeFunction& f, const task_group& grp, partition_hints hints) {
+    detail::conc_for_range_fun(first, last, f, grp, hints);
+}
+//! \overload
+template <typename It, typename RangeFunction>
+inline void conc_for_range(It first, It last, const RangeFunction& f, const task_group& grp) {
+    detail::conc_for_range_fun(first, last, f, grp, {});
+}
+//! \overload
+template <typename It, typename RangeFunction>
+inline void conc_for_range(It first, It last, const RangeFunction& f, partition_hints hints) {
+    detail::conc_for_range_fun(first, last, f, {}, hints);
+}
+//! \overload
+template <typename It, typename RangeFunction>
+inline void conc_for_range(It first, It last, const RangeFunction& f) {
+    detail::conc_for_range_fun(first, last, f, {}, {});
+}
+
+/**
+ * @brief      A concurrent `for` algorithm over multi-dimensional ranges, working on tiles
+ *
+ * @param      range  The range to iterate over
+ * @param      f      Functor called for each tile; receives a range of the same type
+ * @param      grp    Group in which to execute the tasks
+ *
+ * @tparam     RowT   The type of the row indices
+ * @tparam     ColT   The type of the column indices
+ * @tparam     F      The type of the functor
+ *
+ * @details
+ *
+ * The range is recursively split in halves, along its longest dimension (measured in grains),
+ * until it cannot be split anymore; i.e., until each dimension is smaller or equal to its grain
+ * size. The functor is called once for each of the resulting tiles, possibly on different
+ * threads. The tiles cover the whole range, and they don't overlap.
+ *
+ * This preserves the locality in all the dimensions. For example, for a stencil operation on a
+ * matrix, the tiles can be chosen such that the input and the output of a tile fit in the cache;
+ * splitting only by rows would process long rows, evicting the neighbor rows from the cache.
+ *
+ * Similar to the other conc_for() versions, the function doesn't return until all the tiles are
+ * processed, and exceptions are propagated to the caller.
+ *
+ * Example:
+ * @code
+ *      concore::blocked_range2d<int> range{1, n - 1, 64, 1, m - 1, 256};
+ *      concore::conc_for(range, [&](const concore::blocked_range2d<int>& tile) {
+ *          for (int i = tile.rows().begin(); i < tile.rows().end(); i++)
+ *              for (int j = tile.cols().begin(); j < tile.cols().end(); j++)
+ *                  out[i][j] = (in[i-1][j] + in[i+1][j] + in[i][j-1] + in[i][j+1]) / 4;
+ *      });
+ * @endcode
+ *
+ * @see blocked_range2d, blocked_range3d
+ */
+template <typename RowT, typename ColT, typename F>
+inline void conc_for(const blocked_range2d<RowT, ColT>& range, const F& f, const task_group& grp) {
+    detail::conc_for_blocked_range(range, f, grp);
+}
+//! \overload
+template <typename RowT, typename ColT, typename F>
+inline void conc_for(const blocked_range2d<RowT, ColT>& range, const F& f) {
+    detail::conc_for_blocked_range(range, f, {});
+}
+//! \overload
+template <typename PageT, typename RowT, typename ColT, typename F>
+inline void conc_for(
+        const blocked_range3d<PageT, RowT, ColT>& range, const F& f, const task_group& grp) {
+    detail::conc_for_blocked_range(range, f, grp);
+}
+//! \overload
+template <typename PageT, typename RowT, typename ColT, typename F>
+inline void conc_for(const blocked_range3d<PageT, RowT, ColT>& range, const F& f) {
+    detail::conc_for_blocked_range(range, f, {});
+}
+
 } // namespace v1
 } // namespace concore
@@ -0,0 +1,206 @@
+/**
+ * @file    conc_for_file.hpp
+ * @brief   Definition of conc_for_file() and conc_for_file_chunks()
+ *
+ * @see     conc_for_file(), conc_for_file_chunks(), @ref concore::v1::mapped_file "mapped_file"
+ */
+#pragma once
+
+#include "concore/conc_for.hpp"
+#include "concore/mapped_file.hpp"
+
+#include <cstring>
+#include <string_view>
+
+namespace concore {
+
+inline namespace v1 {
+
+/**
+ * @brief      Boundary finder for files in which the records are lines
+ *
+ * @details
+ *
+ * A boundary finder is called with the content of the file and a position, and returns the
+ * smallest position greater or equal to the given one at which a record starts. The beginning and
+ * the end of the file are always record boundaries.
+ *
+ * For this finder, the records start at the beginning of the file and after each newline
+ * character.
+ *
+ * @see conc_for_file_chunks()
+ */
+struct newline_boundary {
+    //! Returns the first record boundary at or after `pos`
+    size_t operator()(std::string_view content, size_t pos) const {
+        if (pos == 0 || pos >= content.size())
+            return pos == 0 ? 0 : content.size();
+        // pos is a boundary if the previous character is a newline
+        const char* start = content.data() + pos - 1;
+        const void* nl = std::memchr(start, '\n', content.size() - pos + 1);
+        return nl ? size_t(static_cast<const char*>(nl) - content.data()) + 1 : content.size();
+    }
+};
+
+/**
+ * @brief      Hints to alter the behavior of conc_for_file() and conc_for_file_chunks()
+ *
+ * @see conc_for_file(), conc_for_file_chunks(), partition_hints
+ */
+struct file_chunk_hints {
+    //! The approximate size of a chunk; the chunks are extended to the record boundaries
+    size_t chunk_size_{size_t(4) << 20};
+    //! The number of chunks after the current one that the OS is asked to read ahead
+    int prefetch_chunks_{2};
+    //! True if the memory of the processed chunks needs to be released right away
+    bool drop_consumed_{true};
+    //! The hints for partitioning the chunks between tasks
+    partition_hints partition_{};
+};
+
+} // namespace v1
+
+namespace detail {
+
+//! Work given to the partitioner to process the chunks of a mapped file.
+//! Chunk `i` starts at the first record boundary after `i * chunk_size`, so the chunks can be
+//! determined independently, by multiple tasks.
+template <typename F, typename BoundaryFinder>
+struct file_chunks_work {
+    const mapped_file* file_{nullptr};
+    const F* ftor_{nullptr};
+    const BoundaryFinder* finder_{nullptr};
+    file_chunk_hints hints_{};
+
+    using iterator = size_t;
+
+    size_t num_chunks() const {
+        return (file_->size() + hints_.chunk_size_ - 1) / hints_.chunk_size_;
+    }
+
+    void exec(size_t first, size_t last) {
+        auto content = file_->view();
+        size_t cs = hints_.chunk_size_;
+        size_t start = (*finder_)(content, first * cs);
+        for (size_t i = first; i < last; i++) {
+            // Ask the OS to read the next chunks, while we are processing this one
+            if (hints_.prefetch_chunks_ > 0)
+                file_->will_need((i + 1) * cs, hints_.prefetch_chunks_ * cs);
+
+            size_t end = (*finder_)(content, (i + 1) * cs);
+            if (start < end) {
+                (*ftor_)(content.substr(start, end - start));
+                if (hints_.drop_consumed_)
+                    file_->dont_need(start, end - start);
+            }
+            start = end;
+        }
+    }
+};
+
+template <typename F, typename BoundaryFinder>
+inline void conc_for_file_chunks_impl(const char* path, const F& f, const BoundaryFinder& finder,
+        file_chunk_hints hints, const task_group& grp) {
+    assert(hints.chunk_size_ > 0);
+    mapped_file file{path};
+    if (file.size() == 0)
+        return;
+    file_chunks_work<F, BoundaryFinder> work{&file, &f, &finder, hints};
+    if (hints.prefetch_chunks_ > 0)
+        file.will_need(0, hints.chunk_size_);
+    conc_for_impl(size_t(0), work.num_chunks(), work, grp, hints.partition_);
+}
+
+//! Calls the functor for each line of a chunk, without the newline character
+template <typename F>
+struct line_splitter {
+    const F* ftor_;
+
+    void operator()(std::string_view chunk) const {
+        while (!chunk.empty()) {
+            auto pos = chunk.find('\n');
+            if (pos == std::string_view::npos) {
+                (*ftor_)(chunk);
+                return;
+            }
+            (*ftor_)(chunk.substr(0, pos));
+            chunk.remove_prefix(pos + 1);
+        }
+    }
+};
+
+} // namespace detail
+
+inline namespace v1 {
+
+/**
+ * @brief      Concurrently processes the chunks of a file
+ *
+ * @param      path    The path of the file to be processed
+ * @param      f       Functor called for each chunk, with a `std::string_view` parameter
+ * @param      finder  Functor that finds the boundaries between records
+ * @param      hints   Hints for processing the file
+ * @param      grp     Group in which to execute the tasks
+ *
+ * @details
+ *
+ * The file is mapped into memory (see @ref mapped_file), and split into chunks of approximately
+ * `hints.chunk_size_` bytes. The chunk boundaries are moved forward to the record boundaries given
+ * by `finder`, so that each record is entirely contained in one chunk. The chunks are processed
+ * concurrently, using the same partitioning methods as conc_for().
+ *
+ * The finder is called with the content of the file and a position; it must return the smallest
+ * position greater or equal to the given one at which a record starts (see @ref newline_boundary).
+ * It may be called concurrently, from multiple threads.
+ *
+ * While processing a chunk, the OS is asked to read ahead the next `hints.prefetch_chunks_`
+ * chunks. After a chunk is processed, its memory is released (if `hints.drop_consumed_` is set),
+ * so that the resident memory remains bounded, even for files larger than the available memory.
+ * The string views given to `f` should not be used after `f` returns.
+ *
+ * Throws `std::system_error` if the file cannot be mapped. If `f` throws, the exception is
+ * propagated to the caller, similar to conc_for().
+ *
+ * @see conc_for_file(), newline_boundary, file_chunk_hints, mapped_file, conc_for()
+ */
+template <typename F, typename BoundaryFinder = newline_boundary>
+inline void conc_for_file_chunks(const char* path, const F& f,
+        const BoundaryFinder& finder = BoundaryFinder{}, file_chunk_hints hints = {},
+        const task_group& grp = {}) {
+    detail::conc_for_file_chunks_impl(path, f, finder, hints, grp);
+}
+
+/**
+ * @brief      Concurrently processes the lines of a file
+ *
+ * @param      path   The path of the file to be processed
+ * @param      f      Functor called for each line, with a `std::string_view` parameter
+ * @param      hints  Hints for processing the file
+ * @param      grp    Group in which to execute the tasks
+ *
+ * @details
+ *
+ * This calls `f` for each line of the file; the line given to `f` doesn't contain the newline
+ * character. The lines of a chunk are processed in order, by the same task; different chunks are
+ * processed concurrently. See conc_for_file_chunks() for more details.
+ *
+ * Example:
+ * @code
+ *      std::atomic<int> num_errors{0};
+ *      concore::conc_for_file("app.log", [&](std::string_view line) {
+ *          if (line.find("ERROR") != std::string_view::npos)
+ *              num_errors++;
+ *      });
+ * @endcode
+ *
+ * @see conc_for_file_chunks(), file_chunk_hints
+ */
+template <typename F>
+inline void conc_for_file(
+        const char* path, const F& f, file_chunk_hints hints = {}, const task_group& grp = {}) {
+    detail::line_splitter<F> splitter{&f};
+    detail::conc_for_file_chunks_impl(path, splitter, newline_boundary{}, hints, grp);
+}
+
+} // namespace v1
+} // namespace concore
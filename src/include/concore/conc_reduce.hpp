@@ -8,6 +8,7 @@
 
 #include "concore/detail/partition_work.hpp"
 #include "concore/detail/except_utils.hpp"
+#include "concore/detail/simd_kernels.hpp"
 
 namespace concore {
 
@@ -20,6 +21,8 @@ struct conc_reduce_work {
     Value value_;
     const BinaryOp* func_{nullptr};
     const ReductionOp* reduction_{nullptr};
+    //! If set, the floating-point kernels must not depend on the CPU
+    bool reproducible_{false};
 
     conc_reduce_work() = default;
     ~conc_reduce_work() = default;
@@ -36,32 +39,60 @@ struct conc_reduce_work {
         , reduction_(&reduction) {}
 
     void exec(It first, It last) {
-        for (; first != last; first++)
-            value_ = (*func_)(std::move(value_), safe_dereference(first, nullptr));
+        if constexpr (simd::reduce_kernel_for<It, Value, BinaryOp> != simd::reduce_kind::none) {
+            // Built-in operation over contiguous arithmetic elements; use the SIMD kernel
+            value_ = simd::apply_reduce_kernel<BinaryOp>(
+                    first, last, std::move(value_), reproducible_);
+        } else {
+            for (; first != last; first++)
+                value_ = (*func_)(std::move(value_), safe_dereference(first, nullptr));
+        }
     }
     void join(conc_reduce_work& rhs) {
         value_ = (*reduction_)(std::move(value_), std::move(rhs.value_));
     }
 };
 
-// Case where we have random-access iterators
+//! Applies the partitioning method from the hints, for random-access iterators
 template <typename WorkType>
-inline void do_conc_reduce(typename WorkType::iterator first, typename WorkType::iterator last,
-        WorkType& work, task_group& grp, partition_hints hints, std::random_access_iterator_tag) {
-
-    int n = static_cast<int>(last - first);
-    if (n == 0)
-        return;
-    int granularity = compute_granularity(n, hints);
+inline void partition_conc_reduce(typename WorkType::iterator first, std::ptrdiff_t n,
+        WorkType& work, task_group& grp, partition_hints hints) {
+    std::ptrdiff_t granularity = compute_granularity(n, hints);
     switch (hints.method_) {
     case partition_method::upfront_partition: {
         int tasks_per_worker = hints.tasks_per_worker_ > 0 ? hints.tasks_per_worker_ : 2;
         detail::upfront_partition_work<true>(first, n, work, grp, tasks_per_worker);
         break;
     }
+    case partition_method::affinity_partition:
+        if (hints.affinity_) {
+            // More chunks than workers, so that stealing can balance the load
+            int tasks_per_worker = hints.tasks_per_worker_ > 0 ? hints.tasks_per_worker_ : 4;
+            detail::affinity_partition_work<true>(
+                    first, n, work, grp, tasks_per_worker, *hints.affinity_);
+        } else {
+            detail::auto_partition_work<true>(first, n, work, grp, granularity);
+        }
+        break;
     case partition_method::naive_partition: // naive cannot be efficiently implemented for reduce
     case partition_method::iterative_partition:
-        detail::iterative_partition_work<true>(first, last, work, grp, granularity);
+        detail::self_scheduled_partition_work<true>(
+                first, n, work, grp, granularity, detail::self_sched_part::schedule::fixed);
+        break;
+    case partition_method::guided_partition:
+        detail::self_scheduled_partition_work<true>(first, n, work, grp,
+                std::max(1, hints.granularity_), detail::self_sched_part::schedule::guided);
+        break;
+    case partition_method::factoring_partition:
+        detail::self_scheduled_partition_work<true>(first, n, work, grp,
+                std::max(1, hints.granularity_), detail::self_sched_part::schedule::factoring);
+        break;
+    case partition_method::lazy_partition:
+        detail::lazy_partition_work<true>(first, n, work, grp, granularity);
+        break;
+    case partition_method::deterministic_partition:
+        detail::deterministic_partition_work<true>(
+                first, n, work, grp, detail::deterministic_granularity(n, hints));
         break;
     case partition_method::auto_partition:
     default:
@@ -69,6 +100,25 @@ inline void do_conc_reduce(typename WorkType::iterator first, typename WorkType:
         break;
     }
 }
+// Case where we have random-access iterators
+template <typename WorkType>
+inline void do_conc_reduce(typename WorkType::iterator first, typename WorkType::iterator last,
+        WorkType& work, task_group& grp, partition_hints hints, std::random_access_iterator_tag) {
+
+    auto n = static_cast<std::ptrdiff_t>(last - first);
+    if (n == 0)
+        return;
+    // The deterministic partition cannot depend on measured timings
+    if (hints.tuner_ && hints.method_ != partition_method::deterministic_partition) {
+        auto partition = [&grp](auto first, std::ptrdiff_t n, WorkType& work,
+                                 partition_hints hints) {
+            partition_conc_reduce(first, n, work, grp, hints);
+        };
+        detail::tuned_partition_work<true>(first, n, work, hints, partition);
+    } else {
+        partition_conc_reduce(first, n, work, grp, hints);
+    }
+}
 // Integral case: behave as we have random-access iterators
 template <typename WorkType>
 inline void do_conc_reduce(typename WorkType::iterator first, typename WorkType::iterator last,
@@ -79,6 +129,11 @@ inline void do_conc_reduce(typename WorkType::iterator first, typename WorkType:
 template <typename WorkType>
 inline void do_conc_reduce(typename WorkType::iterator first, typename WorkType::iterator last,
         WorkType& work, task_group& grp, partition_hints hints, ...) {
+    // We cannot split forward ranges in a deterministic way without traversing them first
+    if (hints.method_ == partition_method::deterministic_partition) {
+        work.exec(first, last);
+        return;
+    }
     int granularity = std::max(1, hints.granularity_);
     detail::iterative_partition_work<true>(first, last, work, grp, granularity);
 }
@@ -116,6 +171,7 @@ template <typename It, typename Value, typename BinaryOp, typename ReductionOp>
 inline Value conc_reduce_fun(It first, It last, Value identity, const BinaryOp& op,
         const ReductionOp& reduction, task_group grp, partition_hints hints) {
     detail::conc_reduce_work<It, Value, BinaryOp, ReductionOp> work(identity, op, reduction);
+    work.reproducible_ = hints.method_ == partition_method::deterministic_partition;
     conc_reduce_impl(first, last, work, grp, hints);
     return work.value_;
 }
@@ -154,11 +210,19 @@ inline namespace v1 {
  * The operation is called exactly once for each element. The reduction is called each time we need
  * to combine the results of two computations.
  *
+ * If the elements are contiguous in memory (pointers or `std::vector` iterators) and are of type
+ * `int32_t`, `int64_t`, `float` or `double`, some operations are recognized: `std::plus`
+ * (with `Value` being the element type), min_op, max_op, and minmax_op. For these, the
+ * elements are processed with SIMD kernels, chosen at runtime based on the instructions that the
+ * CPU supports. For floating-point sums, the kernels add the elements in a different order than
+ * one by one, so the result may differ slightly.
+ *
  * This generates internal tasks by spawning and waiting for those tasks to complete. If the user
  * spawns other tasks during the execution of an iteration, those tasks would also be waited on.
  *
  * One can cancel the execution of the tasks by passing a task_group object in, and canceling that
- * task_group.
+ * task_group. The running tasks check for cancellation between chunks of elements; after
+ * cancellation, the remaining elements are skipped, and the result is unspecified.
  *
  * One can also provide hints to the implementation to fine-tune the algorithms to better fit the
  * data it operates on. Please note however that the implementation may completely ignore all the
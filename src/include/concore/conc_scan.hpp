@@ -9,7 +9,9 @@
 #include "concore/partition_hints.hpp"
 #include "concore/task_group.hpp"
 #include "concore/detail/partition_work_scan.hpp"
+#include "concore/detail/algo_utils.hpp"
 #include "concore/detail/except_utils.hpp"
+#include "concore/detail/simd_kernels.hpp"
 
 namespace concore {
 
@@ -20,6 +22,8 @@ struct conc_scan_work {
     It first_;
     It2 d_first_;
     Value sum_;
+    //! For floating-point values, the sum of the elements of the line, in the final pass
+    Value line_sum_;
     const BinaryOp* func_{nullptr};
     int line_{-1};
 
@@ -35,28 +39,58 @@ struct conc_scan_work {
     conc_scan_work(It first, It2 d_first, Value id, const BinaryOp& func)
         : first_(std::move(first))
         , d_first_(std::move(d_first))
-        , sum_(std::move(id))
+        , sum_(id)
+        , line_sum_(std::move(id))
         , func_(&func) {}
 
     void exec(It first, It last, work_stage stage) {
+        if constexpr (simd::has_scan_kernel<It, It2, Value, BinaryOp>) {
+            exec_kernel(first, last, stage);
+            return;
+        }
         Value cur_val = sum_;
-        // auto first_save = first;
         if (stage == work_stage::initial) {
             for (; first != last; first++)
                 cur_val = (*func_)(std::move(cur_val), *first);
             sum_ = std::move(cur_val);
+        } else if (std::is_floating_point<Value>::value && stage == work_stage::final) {
+            // Add the sum of the previous lines to the sums inside the line. The last result of
+            // the line is then exactly the sum that the next line starts from, and the results
+            // are monotonic at the boundaries of the lines
+            auto diff = first - first_;
+            for (; first != last; first++, diff++) {
+                line_sum_ = (*func_)(std::move(line_sum_), *first);
+                *(d_first_ + diff) = (*func_)(cur_val, line_sum_);
+            }
         } else {
             auto diff = first - first_;
             for (; first != last; first++, diff++) {
                 cur_val = (*func_)(std::move(cur_val), *first);
                 *(d_first_ + diff) = cur_val;
             }
-            if (stage == work_stage::both)
-                sum_ = std::move(cur_val);
+            // Keep the sum for the next sub-range of the same line
+            sum_ = std::move(cur_val);
         }
     }
 
     void join(conc_scan_work& rhs) { rhs.sum_ = (*func_)(sum_, std::move(rhs.sum_)); }
+
+    //! Executes the work with the SIMD kernels, for sums over contiguous integer elements.
+    //!
+    //! Both stages must use the kernels, or none of them: the totals of the first stage become the
+    //! starting sums of the lines in the final stage, so they must be computed in the same way.
+    void exec_kernel(It first, It last, work_stage stage) {
+        auto n = static_cast<std::ptrdiff_t>(last - first);
+        if (n == 0)
+            return;
+        simd::isa target = simd::best_isa();
+        if (stage == work_stage::initial) {
+            sum_ = simd::reduce_sum(target, simd::to_pointer(first), n, sum_);
+        } else {
+            auto d_first = simd::to_pointer(d_first_ + (first - first_));
+            sum_ = simd::inclusive_sum(target, simd::to_pointer(first), n, d_first, sum_);
+        }
+    }
 };
 
 template <typename It, typename It2, typename Value, typename BinaryOp>
@@ -77,10 +111,19 @@ inline Value conc_scan_it(It first, It last, It2 d_first, Value identity, const
     // Check if it's worth doing it in parallel
     // As the parallel algorithm creates twice as much total work, we need to ensure that we have
     // enough elements to sum
-    int granularity = std::max(1, hints.granularity_);
-    int n = static_cast<int>(last - first);
-    if (n / granularity <= detail::num_worker_threads(ctx) * 2)
+    std::ptrdiff_t granularity = std::max(1, hints.granularity_);
+    auto n = static_cast<std::ptrdiff_t>(last - first);
+    std::ptrdiff_t max_tasks = -1;
+    if (hints.method_ == partition_method::deterministic_partition) {
+        // The division of the range must not depend on the number of workers
+        std::ptrdiff_t num_chunks = n / detail::deterministic_granularity(n, hints);
+        max_tasks = std::min(num_chunks, detail::deterministic_num_chunks);
+        granularity = 1;
+        if (max_tasks < 2)
+            return linear_scan(first, last, d_first, identity, op);
+    } else if (n / granularity <= detail::num_worker_threads(ctx) * 2) {
         return linear_scan(first, last, d_first, identity, op);
+    }
 
     auto worker_data = detail::enter_worker(ctx);
 
@@ -93,7 +136,7 @@ inline Value conc_scan_it(It first, It last, It2 d_first, Value identity, const
     // Get the task to be run
     Value res;
     conc_scan_work<It, It2, Value, BinaryOp> work(first, d_first, std::move(identity), op);
-    detail::auto_partition_work_scan(first, n, work, ex_grp, granularity);
+    detail::auto_partition_work_scan(first, n, work, ex_grp, granularity, max_tasks);
     res = std::move(work.sum_);
 
     detail::exit_worker(ctx, worker_data);
@@ -152,9 +195,23 @@ inline namespace v1 {
  * all the sums in parallel. In the process of parallelizing, this will create twice as much work as
  * the serial algorithm
  *
+ * If the input and the output elements are contiguous in memory (pointers or `std::vector`
+ * iterators), of the same integer type (`int32_t` or `int64_t`), and the operation is `std::plus`
+ * with `Value` being the element type, the sums are computed with SIMD kernels, chosen at runtime.
+ * Floating-point values are always added one by one: the SIMD prefix sums add the elements in a
+ * tree-like order, and the results would not be monotonic, even for non-negative values. In the
+ * parallel algorithm, a floating-point result is obtained by adding the sum of the previous blocks
+ * to the sum of the elements in its block, so summing non-negative values always gives a
+ * non-decreasing sequence; the results may still differ slightly from the serial algorithm.
+ *
+ * If the given task_group is canceled, the tasks stop early, checking for cancellation between
+ * blocks of elements; the results written to the destination are then unspecified.
+ *
  * One can also provide hints to the implementation to fine-tune the algorithms to better fit the
  * data it operates on. Please note however that the implementation may completely ignore all the
- * hints it was provided.
+ * hints it was provided. With partition_method::deterministic_partition, the range is divided
+ * independently of the number of workers, so that the results are reproducible even if the
+ * operation is not associative.
  *
  * The operation needs to be able to be called in parallel.
  *
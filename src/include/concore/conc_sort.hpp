@@ -12,6 +12,7 @@
 #include "concore/detail/except_utils.hpp"
 
 #include <algorithm>
+#include <cstddef>
 #include <type_traits>
 
 namespace concore {
@@ -21,30 +22,31 @@ namespace detail {
 static constexpr int size_threshold = 500;
 
 template <typename It, typename Comp>
-inline int median3(It it, int l, int m, int r, const Comp& comp) {
+inline std::ptrdiff_t median3(
+        It it, std::ptrdiff_t l, std::ptrdiff_t m, std::ptrdiff_t r, const Comp& comp) {
     return comp(it[l], it[m]) ? (comp(it[m], it[r]) ? m : (comp(it[l], it[r]) ? r : l))
                               : (comp(it[r], it[m]) ? m : (comp(it[l], it[l]) ? r : l));
 }
 
 template <typename It, typename Comp>
-inline int median9(It it, int n, const Comp& comp) {
+inline std::ptrdiff_t median9(It it, std::ptrdiff_t n, const Comp& comp) {
     assert(n >= 8);
-    int stride = n / 8;
-    int m1 = median3(it, 0, stride, stride * 2, comp);
-    int m2 = median3(it, stride * 3, stride * 4, stride * 5, comp);
-    int m3 = median3(it, stride * 6, stride * 7, n - 1, comp);
+    std::ptrdiff_t stride = n / 8;
+    std::ptrdiff_t m1 = median3(it, 0, stride, stride * 2, comp);
+    std::ptrdiff_t m2 = median3(it, stride * 3, stride * 4, stride * 5, comp);
+    std::ptrdiff_t m3 = median3(it, stride * 6, stride * 7, n - 1, comp);
     return median3(it, m1, m2, m3, comp);
 }
 
 template <typename It, typename Comp>
-inline int partition(It begin, int n, const Comp& comp) {
-    int m = median9(begin, n, comp);
+inline std::ptrdiff_t partition(It begin, std::ptrdiff_t n, const Comp& comp) {
+    std::ptrdiff_t m = median9(begin, n, comp);
     if (m != 0)
         std::swap(begin[0], begin[m]);
     auto& pivot = begin[0];
 
-    int i = 0;
-    int j = n;
+    std::ptrdiff_t i = 0;
+    std::ptrdiff_t j = n;
     while (true) {
         assert(i < j);
         do {
@@ -63,8 +65,12 @@ inline int partition(It begin, int n, const Comp& comp) {
 }
 
 template <typename It, typename Comp>
-inline void conc_quicksort(It begin, int n, const Comp& comp, task_group grp) {
+inline void conc_quicksort(It begin, std::ptrdiff_t n, const Comp& comp, task_group grp) {
     while (n > size_threshold) {
+        // Bail out if the sorting was cancelled
+        if (grp.is_cancelled())
+            return;
+
         // Partition the data; elements [0, mid) < [mid] <= [mid+1, n)
         auto mid = partition(begin, n, comp);
 
@@ -80,12 +86,13 @@ inline void conc_quicksort(It begin, int n, const Comp& comp, task_group grp) {
         n = mid;
     }
     // It doesn't make sense to do this concurrently anymore; run the serial sort
-    std::sort(begin, begin + n, comp);
+    if (!grp.is_cancelled())
+        std::sort(begin, begin + n, comp);
 }
 
 template <typename It, typename Comp>
 inline void conc_sort(It begin, It end, const Comp& comp, task_group grp) {
-    int n = static_cast<int>(end - begin);
+    auto n = static_cast<std::ptrdiff_t>(end - begin);
     if (n <= size_threshold) {
         std::sort(begin, end, comp);
         return;
@@ -126,6 +133,10 @@ inline void conc_sort(It begin, It end, const Comp& comp, task_group grp) {
  *
  * Sorts the given collection of elements concurrently. The comparison function must be able to be
  * called in parallel without causing any data races.
+ *
+ * If the given task_group is canceled, the sorting stops early: the tasks stop partitioning the
+ * elements, and don't start sorting the small ranges. The elements are then left in an unspecified
+ * order.
  */
 template <typename It, typename Comp>
 inline void conc_sort(It begin, It end, const Comp& comp, task_group grp) {
@@ -0,0 +1,152 @@
+/**
+ * @file    dataflow.hpp
+ * @brief   Defines the @ref concore::v1::dataflow_graph "dataflow_graph" class, which infers the
+ *          dependencies between tasks from the data they access
+ *
+ * @see     @ref concore::v1::dataflow_graph "dataflow_graph", reads(), writes(), read_writes()
+ */
+#pragma once
+
+#include "task.hpp"
+#include "task_group.hpp"
+#include "any_executor.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace concore {
+
+inline namespace v1 {
+
+//! The way a task accesses a data object
+enum class access_mode {
+    read,       //!< The task only reads the object
+    write,      //!< The task writes the object (without reading the previous value)
+    read_write, //!< The task reads and writes the object
+};
+
+//! Describes an access of a task to a data object; the object is identified by its address
+struct data_access {
+    //! The address of the accessed object
+    const void* addr_;
+    //! The way the object is accessed
+    access_mode mode_;
+};
+
+//! A list of data accesses, as declared when submitting a task to a @ref dataflow_graph
+using access_list = std::vector<data_access>;
+
+//! Declares read accesses to the given objects
+template <typename... Ts>
+access_list reads(const Ts&... objs) {
+    return access_list{data_access{static_cast<const void*>(&objs), access_mode::read}...};
+}
+//! Declares write accesses to the given objects
+template <typename... Ts>
+access_list writes(const Ts&... objs) {
+    return access_list{data_access{static_cast<const void*>(&objs), access_mode::write}...};
+}
+//! Declares read-write accesses to the given objects
+template <typename... Ts>
+access_list read_writes(const Ts&... objs) {
+    return access_list{data_access{static_cast<const void*>(&objs), access_mode::read_write}...};
+}
+
+/**
+ * @brief      Executes tasks, inferring the dependencies between them from the data they access.
+ *
+ * When submitting a task, the user declares which objects the task reads and which objects it
+ * writes (see reads(), writes(), read_writes()). For each object, the graph keeps track of the
+ * last task that writes the object, and of the tasks that read the object after that. From this,
+ * it automatically creates the dependencies between the tasks:
+ *  - read-after-write: a task that reads an object waits for the last task that writes it
+ *  - write-after-read: a task that writes an object waits for all the tasks that read the
+ *    previous value of the object
+ *  - write-after-write: a task that writes an object waits for the previous task that writes it
+ *
+ * Multiple tasks that read the same object can be executed in parallel. The result of executing
+ * the tasks is the same as if the tasks were executed serially, in the order of submission.
+ *
+ * The objects are identified by their addresses. Any object can be used as a handle for a larger
+ * piece of data (e.g., the first element of a matrix block), as long as all the tasks use the same
+ * handle for the same data.
+ *
+ * Tasks can be submitted from any thread, including from tasks executed by the graph. Submitting
+ * tasks concurrently from multiple threads will order them in an unspecified order.
+ *
+ * Example:
+ * @code{.cpp}
+ *      concore::dataflow_graph graph;
+ *      graph.submit([&] { a = make_a(); }, concore::writes(a));
+ *      graph.submit([&] { b = make_b(); }, concore::writes(b));
+ *      graph.submit([&] { c = combine(a, b); }, concore::reads(a, b), concore::writes(c));
+ *      graph.submit([&] { log(a); }, concore::reads(a));
+ *      graph.wait();
+ * @endcode
+ *
+ * @see dataflow_task, rw_serializer
+ */
+class dataflow_graph {
+public:
+    /**
+     * @brief      Constructor
+     *
+     * @param      grp   The group in which the tasks are executed (optional)
+     * @param      exe   The executor used to execute the tasks (optional)
+     *
+     * @details
+     *
+     * If no executor is given, the @ref spawn_executor will be used.
+     *
+     * The tasks will be executed in a task group that is a child of the given task group.
+     */
+    dataflow_graph();
+    //! @overload
+    explicit dataflow_graph(task_group grp);
+    //! @overload
+    dataflow_graph(task_group grp, any_executor exe);
+    //! @overload
+    explicit dataflow_graph(any_executor exe);
+
+    /**
+     * @brief      Submits a task to be executed
+     *
+     * @param      f         The function to be executed
+     * @param      accesses  Lists of accesses of the task (see reads(), writes(), read_writes())
+     *
+     * @details
+     *
+     * The task will be executed after all the previously submitted tasks with conflicting accesses
+     * are executed.
+     *
+     * If the same object appears multiple times in the access lists, the accesses are combined.
+     */
+    template <typename... AccessLists>
+    void submit(task_function f, const AccessLists&... accesses) {
+        access_list all;
+        all.reserve((size_t(0) + ... + accesses.size()));
+        (all.insert(all.end(), accesses.begin(), accesses.end()), ...);
+        do_submit(std::move(f), std::move(all));
+    }
+
+    /**
+     * @brief      Waits for all the submitted tasks to be executed
+     *
+     * @details
+     *
+     * This is a busy-wait; the calling thread will try to execute tasks while waiting. This should
+     * not be called while other threads are submitting tasks.
+     */
+    void wait();
+
+private:
+    struct impl;
+    //! The implementation object of the graph
+    std::shared_ptr<impl> impl_;
+
+    //! Creates the task and its dependencies, and starts it
+    void do_submit(task_function f, access_list accesses);
+};
+
+} // namespace v1
+} // namespace concore
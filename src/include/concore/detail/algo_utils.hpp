@@ -5,6 +5,7 @@
 
 #include <iterator>
 #include <algorithm>
+#include <cstddef>
 
 namespace concore {
 namespace detail {
@@ -48,13 +49,27 @@ It it_next(It it) {
     return it;
 }
 
-inline int compute_granularity(int n, partition_hints hints) {
-    int granularity = std::max(1, hints.granularity_);
+//! Computes the granularity to be used for partitioning `n` elements.
+//! The partitioning algorithms use 64-bit indices, so that they can handle more than 2^31 elements
+inline std::ptrdiff_t compute_granularity(std::ptrdiff_t n, partition_hints hints) {
+    std::ptrdiff_t granularity = std::max(1, hints.granularity_);
     int max_tasks_per_worker = hints.tasks_per_worker_ > 0 ? hints.tasks_per_worker_ : 20;
-    int min_granularity =
+    std::ptrdiff_t min_granularity =
             n / (detail::num_worker_threads(detail::get_exec_context()) * max_tasks_per_worker);
     return std::max(granularity, min_granularity);
 }
 
+//! The default number of chunks for partition_method::deterministic_partition
+constexpr std::ptrdiff_t deterministic_num_chunks = 256;
+
+//! Computes the granularity for the deterministic partition of `n` elements; this doesn't depend
+//! on the number of workers
+inline std::ptrdiff_t deterministic_granularity(std::ptrdiff_t n, partition_hints hints) {
+    if (hints.granularity_ > 0)
+        return hints.granularity_;
+    return std::max(std::ptrdiff_t(1),
+            (n + deterministic_num_chunks - 1) / deterministic_num_chunks);
+}
+
 } // namespace detail
 } // namespace concore
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "concore/data/concurrent_queue.hpp"
 
+#include <utility>
+
 namespace concore {
 
 namespace detail {
@@ -70,6 +72,45 @@ struct consumer_bounded_queue {
         return desired.fields.active != old.fields.active;
     }
 
+    /**
+     * @brief      Try to acquire the processing of an item, without pushing it into our structure
+     *
+     * @return     True if there was a free slot, and the caller can process its item directly
+     *
+     * This succeeds only if the number of active items is below the limit. In this case there are
+     * no waiting items, so processing the caller's item first doesn't break the ordering.
+     *
+     * If this returns true, the user should have exactly one call to @ref release_and_acquire(),
+     * when the item is done processing. If this returns false, nothing is changed.
+     */
+    bool try_acquire() {
+        count_bits old{}, desired{};
+        old.int_value = combined_count_.load();
+        do {
+            if (old.fields.active >= max_active_)
+                return false;
+            desired.int_value = old.int_value;
+            desired.fields.total++;
+            desired.fields.active++;
+        } while (!combined_count_.compare_exchange_weak(old.int_value, desired.int_value));
+        return true;
+    }
+
+    //! Checks if there is a free slot for processing an item; the result can be highly volatile
+    bool has_free_slot() const {
+        count_bits cur{};
+        cur.int_value = combined_count_.load(std::memory_order_relaxed);
+        return cur.fields.active < max_active_;
+    }
+
+    //! Returns the number of active items and the total number of items; the result can be highly
+    //! volatile
+    std::pair<int, int> counts() const {
+        count_bits cur{};
+        cur.int_value = combined_count_.load(std::memory_order_relaxed);
+        return {int(cur.fields.active), int(cur.fields.total)};
+    }
+
     /**
      * @brief      Extracts one item to be processed
      *
@@ -89,6 +130,18 @@ struct consumer_bounded_queue {
         return elem;
     }
 
+    /**
+     * @brief      Pops an item that was not extracted for processing
+     *
+     * @param      elem  Where to put the popped item
+     *
+     * @return     True if an item was popped, false if there are no more waiting items
+     *
+     * This doesn't change the counts; it's meant to be used when discarding the queue, to get
+     * back the items that never started processing.
+     */
+    bool try_pop_waiting(T& elem) { return waiting_.try_pop(elem); }
+
     /**
      * @brief      Called when an item is done processing
      *
@@ -6,6 +6,7 @@
 #include "concore/data/concurrent_queue.hpp"
 #include "concore/detail/worker_tasks.hpp"
 #include "concore/detail/task_priority.hpp"
+#include "concore/detail/usdt_probes.hpp"
 
 #include <array>
 #include <vector>
@@ -42,6 +43,8 @@ struct worker_thread_data {
     binary_semaphore has_data_;
     //! The stack of tasks spawned by this worker
     worker_tasks local_tasks_;
+    //! The index of this worker in the execution context; reserved slots come after the workers
+    int index_{-1};
 };
 
 //! The task system, corresponding to a global executor.
@@ -67,6 +70,7 @@ public:
 
         // Push the task in the global queue, corresponding to the given prio
         on_task_added();
+        CONCORE_USDT_PROBE3(enqueue, &t, P, num_global_tasks_.load(std::memory_order_relaxed));
         enqueued_tasks_[P].push(std::forward<T>(t));
         num_global_tasks_++;
         wakeup_workers();
@@ -80,10 +84,20 @@ public:
     //! task.
     void spawn(task&& t, bool wake_workers = true);
 
+    //! Adds the given task to the local work queue of the given worker thread, and wakes it up if
+    //! needed. The other workers can steal the task if they run out of work.
+    void spawn_to(int worker_idx, task&& t);
+
+    //! Checks if the tasks spawned from the current thread were all taken; see
+    //! has_demand_for_tasks()
+    bool has_demand_for_tasks() const;
+
     //! Wait until the given task group is not active anymore.
     //! This is going to be a busy wait, meaning that the caller will try to execute tasks.
     //! We hope that, this way we'll make progress towards finishing early.
     void busy_wait_on(task_group& grp);
+    //! Wait until the given predicate returns true; the caller will try to execute tasks meanwhile.
+    void busy_wait_until(const std::function<bool()>& done);
 
     //! Called when spanning tasks and waiting for them to ensure we have a worker_thread_data.
     //! This is used when spawn_and_wait is called outside of our workers. If possible, we prepare
@@ -162,6 +176,8 @@ private:
 
     //! Called when adding a new task to wakeup the workers
     void wakeup_workers();
+    //! Called when adding a task for a particular worker, to make sure that worker is woken up
+    static void wakeup_worker(worker_thread_data& worker_data);
 
     //! Execute the given task
     void execute_task(task& t) const;
@@ -2,6 +2,8 @@
 
 #include "concore/detail/task_priority.hpp"
 
+#include <functional>
+
 namespace concore {
 
 inline namespace v1 {
@@ -105,6 +107,56 @@ void do_spawn(exec_context& ctx, task&& t, bool wake_workers = true);
  */
 void do_spawn_noexcept(exec_context& ctx, task&& t, bool wake_workers = true) noexcept;
 
+/**
+ * @brief Spawns a task in the local queue of the given worker thread.
+ *
+ * @param ctx        The execution context object in which we spawn the task
+ * @param worker_idx The index of the worker that should execute the task
+ * @param t          The task to be spawned
+ *
+ * This is similar to @ref do_spawn(), but the task is added to the queue of the given worker,
+ * instead of the queue of the current worker. The target worker is woken up if needed. The other
+ * workers can still steal the task, if they have nothing else to do.
+ *
+ * This is useful for sending work to the worker that has the corresponding data in its cache.
+ *
+ * The worker index must be in the range [0, num_worker_threads()).
+ *
+ * This can throw. If that happens, the task object passed in is not moved from.
+ *
+ * @see  do_spawn(), current_worker_index()
+ */
+void do_spawn_to(exec_context& ctx, int worker_idx, task&& t);
+
+/**
+ * @brief Returns the index of the worker thread that calls this.
+ *
+ * @return int The index of the current worker; -1 if this is not a worker thread
+ *
+ * The regular worker threads have indices in the range [0, num_worker_threads()). External threads
+ * that temporarily join the execution context (see @ref enter_worker()) get indices after the
+ * regular workers.
+ *
+ * @see  do_spawn_to()
+ */
+int current_worker_index();
+
+/**
+ * @brief Checks if there is demand for more tasks, from the point of view of the current thread.
+ *
+ * @param ctx  The execution context object to query
+ * @return     True if the tasks spawned from the current thread were all taken
+ *
+ * For worker threads, this returns true if the local queue of the current worker is empty; i.e.,
+ * all the tasks previously spawned by this worker were executed or stolen by other workers. For
+ * other threads, this checks the global queue, as that's where their spawned tasks go.
+ *
+ * This is meant to be a cheap check; the result is only a hint, as it can change at any time.
+ *
+ * @see  do_spawn()
+ */
+bool has_demand_for_tasks(const exec_context& ctx);
+
 /**
  * @brief Busy-wait until the given task group is not active anymore.
  *
@@ -126,6 +178,23 @@ void do_spawn_noexcept(exec_context& ctx, task&& t, bool wake_workers = true) no
  */
 void busy_wait_on(exec_context& ctx, task_group& grp);
 
+/**
+ * @brief Wait until the given predicate returns true, trying to execute tasks meanwhile
+ *
+ * @param ctx  The execution context object that is executing the tasks
+ * @param done Predicate that tells if we can stop waiting
+ *
+ * This is similar to @ref busy_wait_on(), but the condition for stopping the wait is given by the
+ * caller. The predicate is checked between executing tasks; it must be cheap, and it must
+ * eventually become true as a result of the tasks being executed.
+ *
+ * @note The calling thread must be a worker thread of the execution context. An external thread can
+ * always be added to the execution context with @ref enter_worker().
+ *
+ * @see  busy_wait_on(), exec_context
+ */
+void busy_wait_until(exec_context& ctx, const std::function<bool()>& done);
+
 /**
  * @brief Ensures that the caling thread is a part of the execution context
  *
@@ -2,15 +2,24 @@
 
 #include "concore/task_group.hpp"
 #include "concore/spawn.hpp"
+#include "concore/affinity_state.hpp"
+#include "concore/granularity_tuner.hpp"
 #include "concore/detail/platform.hpp"
 #include "concore/detail/algo_utils.hpp"
 #include "concore/low_level/spin_mutex.hpp"
 
 #include <vector>
+#include <algorithm>
 #include <array>
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <mutex>
 #include <cassert>
+#include <cstddef>
+#include <chrono>
+#include <limits>
+#include <utility>
 
 namespace concore {
 namespace detail {
@@ -26,42 +35,133 @@ namespace detail {
 //     void join(conc_reduce_work& rhs);
 // };
 
+//! Executes the work over `[first, last)` in blocks of `block_size` elements. Before each block,
+//! checks if the group was cancelled; if so, the remaining elements are not processed.
+//! Used by the partitions that divide the range into chunks upfront; these use the granularity
+//! that the auto partition would compute as block size, so that they check for cancellation as
+//! often as the auto partition would.
+template <typename WorkType, typename RandomIt>
+inline void exec_cancellable(WorkType& work, RandomIt first, RandomIt last,
+        std::ptrdiff_t block_size, const task_group& grp) {
+    auto n = static_cast<std::ptrdiff_t>(last - first);
+    for (std::ptrdiff_t i = 0; i < n; i += block_size) {
+        if (grp.is_cancelled())
+            return;
+        work.exec(first + i, first + std::min(n, i + block_size));
+    }
+}
+
 namespace auto_part {
 
+/**
+ * @brief      Storage for the work intervals of one call of the auto partitioner
+ *
+ * @details
+ *
+ * The intervals are carved from a buffer that is allocated once, at the beginning of the call; the
+ * splits don't allocate memory. The intervals are referenced by the spawned tasks, so they are all
+ * destroyed together, after the caller has waited for all the tasks to complete.
+ *
+ * If the buffer is exhausted, create() returns null; the caller is expected to stop splitting.
+ */
+template <typename Interval>
+class interval_arena {
+public:
+    explicit interval_arena(std::ptrdiff_t capacity)
+        : slots_(new slot[size_t(capacity)])
+        , constructed_(new bool[size_t(capacity)]())
+        , capacity_(capacity) {}
+    ~interval_arena() {
+        std::ptrdiff_t cnt = std::min(used_.load(std::memory_order_relaxed), capacity_);
+        for (std::ptrdiff_t i = 0; i < cnt; i++) {
+            if (constructed_[i])
+                std::launder(reinterpret_cast<Interval*>(slots_[i].storage_))->~Interval();
+        }
+    }
+
+    interval_arena(const interval_arena&) = delete;
+    interval_arena& operator=(const interval_arena&) = delete;
+
+    //! Creates a new interval, with the given constructor arguments; returns null if we don't have
+    //! space for it
+    template <typename... Args>
+    Interval* create(Args&&... args) {
+        std::ptrdiff_t idx = used_.fetch_add(1, std::memory_order_relaxed);
+        if (idx >= capacity_)
+            return nullptr;
+        auto* res = new (slots_[idx].storage_) Interval(std::forward<Args>(args)...);
+        constructed_[idx] = true;
+        return res;
+    }
+
+private:
+    //! Raw memory for an interval; not initialized, so that we only touch the slots that we use
+    struct slot {
+        alignas(Interval) unsigned char storage_[sizeof(Interval)];
+    };
+
+    std::unique_ptr<slot[]> slots_;
+    //! Indicates which slots contain constructed intervals; the constructors may throw
+    std::unique_ptr<bool[]> constructed_;
+    const std::ptrdiff_t capacity_;
+    std::atomic<std::ptrdiff_t> used_{0};
+};
+
+//! The number of intervals to reserve for a range of `n` elements. Each interval keeps at least
+//! half of a chunk for itself, so we need about 4 intervals per chunk; we add some slack for the
+//! splits of the stolen intervals. If we run out of intervals, we stop splitting.
+inline std::ptrdiff_t max_intervals(std::ptrdiff_t n, std::ptrdiff_t granularity) {
+    constexpr std::ptrdiff_t max_chunks = std::ptrdiff_t(1) << 14;
+    std::ptrdiff_t num_chunks = n / std::max(granularity, std::ptrdiff_t(1)) + 1;
+    return 4 * std::min(num_chunks, max_chunks) + 64;
+}
+
 template <typename WorkType, bool needs_join>
-struct work_interval : std::enable_shared_from_this<work_interval<WorkType, needs_join>> {
+struct work_interval {
     using iterator = typename WorkType::iterator;
-
-    using ptr_type = std::shared_ptr<work_interval>;
+    using arena_type = interval_arena<work_interval>;
 
     std::atomic<int> join_predecessors_;
     const iterator first_;
-    const int count_;
-    std::atomic<int> start_idx_;
+    const std::ptrdiff_t count_;
+    std::atomic<std::ptrdiff_t> start_idx_;
+    //! Each interval has its own copy of the work, so the work may keep state between the calls
+    //! to `exec`, even if there are no joins
     WorkType work_;
-    const int granularity_;
-    ptr_type parent_;
-    ptr_type next_;
+    const std::ptrdiff_t granularity_;
+    arena_type& arena_;
+    //! The group of the algorithm; checked for cancellation
+    const task_group& grp_;
+    work_interval* parent_;
+    work_interval* next_;
 
-    work_interval(iterator first, int start_idx, int cnt, WorkType work, int granularity)
+    work_interval(arena_type& arena, const task_group& grp, iterator first,
+            std::ptrdiff_t start_idx, std::ptrdiff_t cnt, WorkType work,
+            std::ptrdiff_t granularity)
         : join_predecessors_(1)
         , first_(first)
         , count_(cnt)
         , start_idx_(start_idx)
         , work_(std::move(work))
         , granularity_(granularity)
+        , arena_(arena)
+        , grp_(grp)
         , parent_(nullptr)
         , next_(nullptr) {}
 
-    void run(int start_idx = 0);
+    void run(std::ptrdiff_t start_idx = 0);
     void run_as_right();
     void release();
 };
 
 template <typename WorkType, bool needs_join>
-void work_interval<WorkType, needs_join>::run(int start_idx) {
+void work_interval<WorkType, needs_join>::run(std::ptrdiff_t start_idx) {
     auto first = first_ + start_idx;
-    int n = count_ - start_idx;
+    std::ptrdiff_t n = count_ - start_idx;
+
+    // If the group was cancelled, there is nothing to do anymore
+    if (grp_.is_cancelled())
+        return;
 
     if (n <= granularity_) {
         // Cannot split anymore; just execute work
@@ -69,21 +169,29 @@ void work_interval<WorkType, needs_join>::run(int start_idx) {
         return;
     }
 
-    static constexpr int max_num_splits = 32;
-    std::array<ptr_type, max_num_splits> right_intervals{};
+    // We halve the interval at each split; at most 63 splits for 64-bit sizes
+    static constexpr int max_num_splits = 64;
+    std::array<work_interval*, max_num_splits> right_intervals{};
     right_intervals.fill(nullptr);
 
     // Iterate down, at each step splitting the range into half; stop when we reached the desired
     // granularity
     int level = 0;
-    int end = n;
+    std::ptrdiff_t end = n;
     while (end > granularity_) {
         // Current interval: [first, first+end)
 
+        // Don't create new tasks if the group was cancelled
+        if (grp_.is_cancelled())
+            break;
+
         // Create a task to handle the right side
-        int start_right = (end + 1) / 2;
-        auto right = std::make_shared<work_interval>(
-                first_, start_idx + start_right, start_idx + end, work_, granularity_);
+        std::ptrdiff_t start_right = (end + 1) / 2;
+        work_interval* right = arena_.create(arena_, grp_, first_, start_idx + start_right,
+                start_idx + end, work_, granularity_);
+        // If we are out of intervals, execute the rest of the range directly
+        if (!right)
+            break;
         right->join_predecessors_++;
         right_intervals[level] = right;
 
@@ -109,8 +217,8 @@ void work_interval<WorkType, needs_join>::run(int start_idx) {
             right_intervals[l]->join_predecessors_.store(3, std::memory_order_relaxed);
         }
         for (int l = 0; l <= max_level; l++) {
-            auto& cur = right_intervals[l];
-            cur->parent_ = this->shared_from_this();
+            work_interval* cur = right_intervals[l];
+            cur->parent_ = this;
             spawn([cur]() { cur->run_as_right(); });
         }
     }
@@ -121,9 +229,12 @@ void work_interval<WorkType, needs_join>::run(int start_idx) {
         // Now, left-to-right start executing the work
         // At each step, update the corresponding atomic to make sure other tasks are not executing
         // the same tasks. If right-hand tasks did not start, steal iterations from them
-        int our_max = end;
-        int i = 0;
+        std::ptrdiff_t our_max = end;
+        std::ptrdiff_t i = 0;
         while (i < n) {
+            // Stop if the group was cancelled; checked once per chunk
+            if (grp_.is_cancelled())
+                break;
             // Run as many iterations as we can
             work_.exec(first + i, first + our_max);
             i = our_max;
@@ -131,9 +242,9 @@ void work_interval<WorkType, needs_join>::run(int start_idx) {
                 break;
             // If we can, try to steal some more from the right-hand task
             work_interval& right = *right_intervals[level];
-            int lvl_end = right.count_;
-            int steal_end = std::min(our_max + granularity_, lvl_end);
-            int old_val = our_max;
+            std::ptrdiff_t lvl_end = right.count_;
+            std::ptrdiff_t steal_end = std::min(our_max + granularity_, lvl_end);
+            std::ptrdiff_t old_val = our_max;
             if (!right.start_idx_.compare_exchange_strong(
                         old_val, steal_end, std::memory_order_acq_rel))
                 break;
@@ -150,38 +261,33 @@ void work_interval<WorkType, needs_join>::run(int start_idx) {
 
     // Ensure that we release all the non-null levels
     // To prevent race conditions, this needs to be done after we've done touching 'work_'
-    for (int lvl = max_level; lvl >= 0; lvl--) {
+    for (int lvl = max_level; lvl >= 0; lvl--)
         right_intervals[lvl]->release();
-        right_intervals[lvl].reset();
-    }
 
     // If we have an exception, re-throw it
     if (thrown_exception)
         std::rethrow_exception(thrown_exception);
 
-    // For deletion, we use shared_pointers to properly delete our work intervals whenever needed;
+    // The interval objects are owned by the arena, and are deleted at the end of the algorithm;
     // please note that we may have more interval objects than actually tasks. On exceptions, some
     // of the tasks will not run, but the objects still need to be cleaned up.
 
     // The logic for joins:
     //  - general considerations
-    //      - typically it follows the reference counts of the shared_ptrs (if we don't have
-    //      exceptions)
     //      - we use a join_predecessors_ counter to determine the number of predecessors
     //      - the join operation is typcailly the last operation that is done on an interval
     //  - we have join_predecessors_ of 3, plus the number of sub-intervals
     //      - 1 in the parent
     //      - one the task that is running
     //      - one the task that need to join before the current one (smaller right interval)
-    //      - and also, each children keeps a reference to the parent
-    //  - the joins are executed in the order of deleting the intervals, so we control it
+    //  - the joins are executed when the counter reaches zero, so we control the order
     //  - we want that smaller intervals are joining before larger ones
 }
 
 template <typename WorkType, bool needs_join>
 void work_interval<WorkType, needs_join>::run_as_right() {
     // Pick up where the previous part ended
-    int cur_start = start_idx_.load(std::memory_order_relaxed);
+    std::ptrdiff_t cur_start = start_idx_.load(std::memory_order_relaxed);
     while (cur_start < count_) {
         if (start_idx_.compare_exchange_weak(cur_start, -1, std::memory_order_acq_rel))
             break;
@@ -217,8 +323,6 @@ void work_interval<WorkType, needs_join>::release() {
             // If we have an exception, re-throw it
             if (thrown_exception)
                 std::rethrow_exception(thrown_exception);
-
-            // soon after this, the shared_ptr destructor will delete our object
         }
     }
 }
@@ -244,22 +348,145 @@ void work_interval<WorkType, needs_join>::release() {
  * Specifying a greater granularity will make tasks considered in bulk. For example, if granularity
  * is 10, we always execute chunk of 10 elements.
  *
+ * The intervals resulting from the splits are taken from an arena allocated once per call, so the
+ * splits don't allocate memory. Each interval works on its own copy of the work object.
+ *
  * This is the default partitioning algorithm. It works well if the work is not well-balanced
  * between different values in the given range.
  *
  * This only works for random-access iterators.
  */
 template <bool needs_join, typename WorkType>
-inline void auto_partition_work(typename WorkType::iterator first, int n, WorkType& work,
-        task_group& grp, int granularity) {
+inline void auto_partition_work(typename WorkType::iterator first, std::ptrdiff_t n,
+        WorkType& work, task_group& grp, std::ptrdiff_t granularity) {
     assert(task_group::current_task_group());
-    auto all = std::make_shared<auto_part::work_interval<WorkType, needs_join>>(
-            first, 0, n, std::move(work), granularity);
-    all->run();
+    using interval = auto_part::work_interval<WorkType, needs_join>;
+    auto_part::interval_arena<interval> arena{auto_part::max_intervals(n, granularity)};
+    interval* all = arena.create(arena, grp, first, 0, n, std::move(work), granularity);
+    try {
+        all->run();
+    } catch (...) {
+        // The spawned tasks use the intervals from the arena; they need to finish before we exit
+        wait(grp);
+        throw;
+    }
     wait(grp);
     work = std::move(all->work_);
 }
 
+namespace lazy_part {
+
+//! The data shared by all the tasks of a lazy partitioning
+template <typename WorkType, bool needs_join>
+struct shared_data {
+    using iterator = typename WorkType::iterator;
+
+    const iterator first_;
+    const std::ptrdiff_t granularity_;
+    exec_context& ctx_;
+    task_group grp_;
+    //! Placeholder for the prototype, when we don't need joins
+    struct no_prototype {};
+    //! Work object in its initial state; the split-off parts start from copies of this. Only kept
+    //! for joins; otherwise, all the parts use the same work object, which doesn't need to be
+    //! copyable.
+    const std::conditional_t<needs_join, WorkType, no_prototype> prototype_;
+
+    //! The work objects of the split-off parts (for joins), with the index where each part starts
+    std::vector<std::pair<std::ptrdiff_t, std::unique_ptr<WorkType>>> parts_;
+    spin_mutex bottleneck_;
+
+    shared_data(iterator first, std::ptrdiff_t granularity, exec_context& ctx, task_group grp,
+            const WorkType& work)
+        : first_(first)
+        , granularity_(granularity)
+        , ctx_(ctx)
+        , grp_(std::move(grp))
+        , prototype_(make_prototype(work)) {}
+
+    //! Returns the work object to be used for a part starting at `start`
+    WorkType& new_part(std::ptrdiff_t start, WorkType& cur_work) {
+        if constexpr (needs_join) {
+            auto part = std::make_unique<WorkType>(prototype_);
+            WorkType& res = *part;
+            std::lock_guard<spin_mutex> lock{bottleneck_};
+            parts_.emplace_back(start, std::move(part));
+            return res;
+        } else {
+            return cur_work;
+        }
+    }
+
+    //! Creates the prototype for the split-off parts; copies the work object only for joins
+    static auto make_prototype(const WorkType& work) {
+        if constexpr (needs_join)
+            return work;
+        else
+            return no_prototype{};
+    }
+
+    //! Joins the work of all the parts into `work`, in the order of the parts
+    void join_parts(WorkType& work) {
+        std::sort(parts_.begin(), parts_.end(),
+                [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+        for (auto& p : parts_)
+            work.join(*p.second);
+    }
+
+    //! Processes [start, end) chunk by chunk; splits off the right half of the remaining range only
+    //! when the tasks previously spawned from this thread were taken. Stops if the group is
+    //! cancelled.
+    void run(std::ptrdiff_t start, std::ptrdiff_t end, WorkType& work) {
+        while (start < end && !grp_.is_cancelled()) {
+            std::ptrdiff_t chunk_end = std::min(start + granularity_, end);
+            work.exec(first_ + start, first_ + chunk_end);
+            start = chunk_end;
+
+            if (end - start > granularity_ && has_demand_for_tasks(ctx_)) {
+                std::ptrdiff_t mid = start + (end - start) / 2;
+                WorkType& right_work = new_part(mid, work);
+                spawn(task{[this, mid, end, &right_work] { run(mid, end, right_work); }, grp_});
+                end = mid;
+            }
+        }
+    }
+};
+
+} // namespace lazy_part
+
+/**
+ * @brief      Partitions the work lazily, splitting only when other workers need tasks
+ *
+ * The range is processed sequentially, in chunks of `granularity` elements. After each chunk, if
+ * the local queue of the current worker is empty (all the tasks spawned before were executed or
+ * stolen), the remaining range is split in two halves: a task is spawned for the right half, and
+ * the current worker continues with the left half. The spawned tasks follow the same algorithm.
+ *
+ * If all the workers are busy (e.g., for nested parallelism), there are no splits, and the range
+ * is processed by a single task. This way, the number of tasks follows the demand, and not the
+ * granularity; a small granularity only adds the cost of a cheap check per chunk.
+ *
+ * For joins, each split-off part gets its own work object; at the end, they are joined in order.
+ *
+ * This only works for random-access iterators.
+ */
+template <bool needs_join, typename WorkType>
+inline void lazy_partition_work(typename WorkType::iterator first, std::ptrdiff_t n,
+        WorkType& work, task_group& grp, std::ptrdiff_t granularity) {
+    lazy_part::shared_data<WorkType, needs_join> data{
+            first, granularity, detail::get_exec_context(), grp, work};
+    try {
+        data.run(0, n, work);
+    } catch (...) {
+        // The spawned tasks use the shared data; they need to finish before we exit
+        wait(grp);
+        throw;
+    }
+    wait(grp);
+    if constexpr (needs_join)
+        data.join_parts(work);
+}
+
 /**
  * @brief      Tries to partition the work upfront
  *
@@ -275,13 +502,14 @@ inline void auto_partition_work(typename WorkType::iterator first, int n, WorkTy
  * This only works for random-access iterators.
  */
 template <bool needs_join, typename RandomIt, typename WorkType>
-inline void upfront_partition_work(
-        RandomIt first, int n, WorkType& work, task_group& wait_grp, int tasks_per_worker) {
+inline void upfront_partition_work(RandomIt first, std::ptrdiff_t n, WorkType& work,
+        task_group& wait_grp, int tasks_per_worker) {
     const auto& ctx = detail::get_exec_context();
     int num_tasks = detail::num_worker_threads(ctx) * tasks_per_worker;
 
-    int num_iter = num_tasks < n ? num_tasks : n;
+    int num_iter = num_tasks < n ? num_tasks : int(n);
     std::vector<WorkType> work_objs;
+    std::ptrdiff_t block_size = compute_granularity(n, partition_hints{});
 
     if (needs_join && num_iter > 1)
         work_objs.resize(num_iter - 1, work);
@@ -291,10 +519,13 @@ inline void upfront_partition_work(
             auto start = first + (n * i / num_tasks);
             auto end = first + (n * (i + 1) / num_tasks);
             auto& work_obj = (needs_join && i > 0) ? work_objs[i - 1] : work;
-            spawn(task{[&work_obj, start, end] { work_obj.exec(start, end); }, wait_grp});
+            spawn(task{[&work_obj, start, end, block_size, &wait_grp] {
+                           exec_cancellable(work_obj, start, end, block_size, wait_grp);
+                       },
+                    wait_grp});
         }
     } else {
-        for (int i = 0; i < n; i++) {
+        for (int i = 0; i < num_iter; i++) {
             auto& work_obj = (needs_join && i > 0) ? work_objs[i - 1] : work;
             spawn(task{
                     [&work_obj, first, i] { work_obj.exec(first + i, first + i + 1); }, wait_grp});
@@ -311,6 +542,139 @@ inline void upfront_partition_work(
     }
 }
 
+/**
+ * @brief      Partitions the work upfront, replaying the chunk-to-worker mapping of previous calls
+ *
+ * This divides the range into a fixed number of chunks (`tasks_per_worker` per worker). Each chunk
+ * records in `state` the index of the worker that executes it. If the state contains the mapping
+ * from a previous call over the same range, the chunks are spawned directly to the workers that
+ * executed them last time. The chunks for which we don't know the worker are spawned normally.
+ *
+ * Workers that run out of work may steal chunks from the other workers; this way we still balance
+ * the load if the work is not evenly distributed. The mapping will follow the steals.
+ *
+ * This only works for random-access iterators.
+ */
+template <bool needs_join, typename RandomIt, typename WorkType>
+inline void affinity_partition_work(RandomIt first, std::ptrdiff_t n, WorkType& work,
+        task_group& wait_grp, int tasks_per_worker, affinity_state& state) {
+    auto& ctx = detail::get_exec_context();
+    int num_workers = detail::num_worker_threads(ctx);
+    std::ptrdiff_t num_chunks = std::min(n, std::ptrdiff_t(num_workers) * tasks_per_worker);
+
+    std::vector<int>& workers = affinity_state_access::prepare(state, n, num_chunks);
+
+    std::vector<WorkType> work_objs;
+    if (needs_join && num_chunks > 1)
+        work_objs.resize(num_chunks - 1, work);
+    std::ptrdiff_t block_size = compute_granularity(n, partition_hints{});
+
+    for (std::ptrdiff_t i = 0; i < num_chunks; i++) {
+        auto start = first + (n * i / num_chunks);
+        auto end = first + (n * (i + 1) / num_chunks);
+        auto& work_obj = (needs_join && i > 0) ? work_objs[i - 1] : work;
+        int* worker_slot = &workers[size_t(i)];
+        int target = *worker_slot;
+        task t{[&work_obj, start, end, worker_slot, block_size, &wait_grp] {
+                   // Each chunk writes only its own slot
+                   *worker_slot = current_worker_index();
+                   exec_cancellable(work_obj, start, end, block_size, wait_grp);
+               },
+                wait_grp};
+        if (0 <= target && target < num_workers)
+            do_spawn_to(ctx, target, std::move(t));
+        else
+            spawn(std::move(t));
+    }
+
+    // Wait for all the spawned tasks to be completed
+    wait(wait_grp);
+
+    // Join all the work items, in the order of the chunks
+    if constexpr (needs_join) {
+        for (auto& w : work_objs)
+            work.join(w);
+    }
+}
+
+namespace tuned_part {
+
+//! Executes the first iterations on the current thread, measuring their cost; the chunks are
+//! doubled in size until they take a significant part of the target duration. We don't consume
+//! more than a fraction of the range, to leave enough work for the other workers.
+//! Returns the number of iterations executed.
+template <typename WorkType>
+inline std::ptrdiff_t measure(typename WorkType::iterator first, std::ptrdiff_t n, WorkType& work,
+        granularity_tuner& tuner) {
+    using clock = std::chrono::steady_clock;
+    auto target = tuner.target_task_duration();
+    int num_workers = num_worker_threads(get_exec_context());
+    std::ptrdiff_t max_probe = std::max(std::ptrdiff_t(1), n / (2 * std::ptrdiff_t(num_workers)));
+
+    std::ptrdiff_t done = 0;
+    std::ptrdiff_t chunk = 1;
+    auto start = clock::now();
+    clock::duration elapsed{0};
+    while (done < max_probe && elapsed < target / 2) {
+        chunk = std::min(chunk, max_probe - done);
+        work.exec(first + done, first + done + chunk);
+        done += chunk;
+        chunk *= 2;
+        elapsed = clock::now() - start;
+    }
+    granularity_tuner_access::record(
+            tuner, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed), done);
+    return done;
+}
+
+//! Returns the granularity that makes a chunk take about the target duration
+inline int granularity(const granularity_tuner& tuner) {
+    double g = double(tuner.target_task_duration().count()) / tuner.cost_per_item_ns();
+    return int(std::clamp(g, 1.0, double(std::numeric_limits<int>::max())));
+}
+
+} // namespace tuned_part
+
+/**
+ * @brief      Partitions the work with the granularity chosen by the tuner from the hints
+ *
+ * If the tuner doesn't have an estimate of the cost of an iteration yet, this first executes a
+ * few iterations on the current thread, measuring their cost, and records it in the tuner. Then,
+ * the granularity is set so that a chunk takes about the target task duration of the tuner, and
+ * the rest of the range is given to `partition`, which applies the partitioning method.
+ *
+ * For joins, the rest of the range starts with a copy of the initial work object; it is joined
+ * into `work` at the end.
+ *
+ * This only works for random-access iterators.
+ */
+template <bool needs_join, typename WorkType, typename PartitionFun>
+inline void tuned_partition_work(typename WorkType::iterator first, std::ptrdiff_t n,
+        WorkType& work, partition_hints hints, const PartitionFun& partition) {
+    granularity_tuner& tuner = *hints.tuner_;
+    if (tuner.has_estimate()) {
+        hints.granularity_ = tuned_part::granularity(tuner);
+        partition(first, n, work, hints);
+        return;
+    }
+
+    if constexpr (needs_join) {
+        WorkType rest_work = work;
+        std::ptrdiff_t done = tuned_part::measure(first, n, work, tuner);
+        if (done < n) {
+            hints.granularity_ = tuned_part::granularity(tuner);
+            partition(first + done, n - done, rest_work, hints);
+            work.join(rest_work);
+        }
+    } else {
+        std::ptrdiff_t done = tuned_part::measure(first, n, work, tuner);
+        if (done < n) {
+            hints.granularity_ = tuned_part::granularity(tuner);
+            partition(first + done, n - done, work, hints);
+        }
+    }
+}
+
 //! Helper class that can spawn "next" work for a range of elements. Uses locking to access the
 //! iterators.
 template <typename It, typename WorkType>
@@ -326,6 +690,9 @@ struct iterative_spawner {
         , grp_(std::move(grp)) {}
 
     void spawn_task_1(WorkType& work, bool cont = false) {
+        // Don't spawn new tasks if the group was cancelled
+        if (grp_.is_cancelled())
+            return;
         // Atomically take the first element from our range
         It it = take_1();
         if (it != last_) {
@@ -339,7 +706,10 @@ struct iterative_spawner {
         }
     }
 
-    void spawn_task_n(WorkType& work, int count, bool cont = false) {
+    void spawn_task_n(WorkType& work, std::ptrdiff_t count, bool cont = false) {
+        // Don't spawn new tasks if the group was cancelled
+        if (grp_.is_cancelled())
+            return;
         // Atomically take the first elements from our range
         auto itp = take_n(count);
         auto begin = itp.first;
@@ -363,11 +733,11 @@ struct iterative_spawner {
         return first_ == last_ ? last_ : first_++;
     }
 
-    std::pair<It, It> take_n(int count) {
+    std::pair<It, It> take_n(std::ptrdiff_t count) {
         std::lock_guard<spin_mutex> lock(bottleneck_);
         It begin = first_;
         It end = begin;
-        for (int i = 0; i < count && end != last_; i++)
+        for (std::ptrdiff_t i = 0; i < count && end != last_; i++)
             end++;
         first_ = end;
         return std::make_pair(begin, end);
@@ -387,11 +757,12 @@ struct iterative_spawner {
  * threads. This tries to limit the number of tasks that are in flight (as opposed to naive
  * implementation).
  *
- * This can work for forward iterators too.
+ * This can work for forward iterators too. For random-access iterators, the algorithms use
+ * self_scheduled_partition_work() instead, which doesn't need locking.
  */
 template <bool needs_join, typename It, typename WorkType>
 inline void iterative_partition_work(
-        It first, It last, WorkType& work, task_group& wait_grp, int granularity) {
+        It first, It last, WorkType& work, task_group& wait_grp, std::ptrdiff_t granularity) {
     const auto& ctx = detail::get_exec_context();
     int num_tasks = detail::num_worker_threads(ctx) * 2;
 
@@ -423,6 +794,279 @@ inline void iterative_partition_work(
     }
 }
 
+namespace self_sched_part {
+
+//! The way of choosing the size of the chunks claimed from a @ref chunk_cursor
+enum class schedule {
+    //! All the chunks have the size given by the granularity
+    fixed,
+    //! Each chunk takes a fraction of the remaining iterations, like OpenMP's `schedule(guided)`
+    guided,
+    //! The chunks are claimed in batches of equal chunks; each batch takes half of the remaining
+    //! iterations
+    factoring,
+};
+
+//! A shared cursor over the iterations `[0, n)`, from which the tasks claim chunks of iterations,
+//! without locking
+struct chunk_cursor {
+    const std::ptrdiff_t n_;
+    const std::ptrdiff_t granularity_;
+    const std::ptrdiff_t num_workers_;
+    const schedule sched_;
+    std::atomic<std::ptrdiff_t> next_{0};
+
+    chunk_cursor(std::ptrdiff_t n, std::ptrdiff_t granularity, int num_workers, schedule sched)
+        : n_(n)
+        , granularity_(std::max(granularity, std::ptrdiff_t(1)))
+        , num_workers_(std::max(num_workers, 1))
+        , sched_(sched) {}
+
+    //! Claims the next chunk of iterations; returns an empty chunk if there is nothing left
+    std::pair<std::ptrdiff_t, std::ptrdiff_t> claim() {
+        if (sched_ == schedule::fixed) {
+            // The chunk size doesn't depend on the position; a simple increment is enough
+            std::ptrdiff_t begin = next_.fetch_add(granularity_, std::memory_order_relaxed);
+            begin = std::min(begin, n_);
+            return {begin, std::min(begin + granularity_, n_)};
+        }
+        std::ptrdiff_t begin = next_.load(std::memory_order_relaxed);
+        while (begin < n_) {
+            std::ptrdiff_t end = std::min(begin + chunk_size(begin), n_);
+            if (next_.compare_exchange_weak(begin, end, std::memory_order_relaxed))
+                return {begin, end};
+        }
+        return {n_, n_};
+    }
+
+    //! Returns the size of the chunk that starts at `pos`
+    std::ptrdiff_t chunk_size(std::ptrdiff_t pos) const {
+        if (sched_ == schedule::guided) {
+            std::ptrdiff_t remaining = n_ - pos;
+            return std::max(granularity_, (remaining + num_workers_ - 1) / num_workers_);
+        }
+        if (sched_ == schedule::factoring) {
+            // Walk over the batches until we find the one containing `pos`. The number of batches
+            // is logarithmic in the number of iterations.
+            std::ptrdiff_t batch_start = 0;
+            for (;;) {
+                std::ptrdiff_t remaining = n_ - batch_start;
+                std::ptrdiff_t chunk = std::max(
+                        granularity_, (remaining + 2 * num_workers_ - 1) / (2 * num_workers_));
+                std::ptrdiff_t batch_end = batch_start + chunk * num_workers_;
+                // Once we reach the granularity, all the remaining chunks have the same size
+                if (pos < batch_end || chunk == granularity_)
+                    return chunk;
+                batch_start = batch_end;
+            }
+        }
+        return granularity_;
+    }
+};
+
+} // namespace self_sched_part
+
+/**
+ * @brief      Partitions the work by letting the tasks claim chunks from a shared cursor
+ *
+ * This creates two tasks per worker; each task repeatedly claims a chunk of iterations from a
+ * shared atomic cursor, and executes it, until the range is exhausted. Claiming a chunk is a
+ * single atomic operation; there is no locking, and no task is spawned per chunk.
+ *
+ * The size of the chunks is given by the schedule:
+ *  - fixed: chunks of `granularity` iterations
+ *  - guided: each chunk takes `1/num_workers` of the remaining iterations; the chunks decrease in
+ *  size towards the end of the range
+ *  - factoring: the chunks are taken in batches of `num_workers` equal chunks; a batch takes half
+ *  of the remaining iterations
+ *
+ * With the last two schedules, there are few claims at the beginning of the range, while the small
+ * chunks at the end balance the load between the workers. The chunks are never smaller than
+ * `granularity`.
+ *
+ * For joins, each task has its own work object; the order in which the chunks are joined is not
+ * the order of the range.
+ *
+ * This only works for random-access iterators.
+ */
+template <bool needs_join, typename WorkType>
+inline void self_scheduled_partition_work(typename WorkType::iterator first, std::ptrdiff_t n,
+        WorkType& work, task_group& wait_grp, std::ptrdiff_t granularity,
+        self_sched_part::schedule sched) {
+    const auto& ctx = detail::get_exec_context();
+    int num_workers = detail::num_worker_threads(ctx);
+    int num_tasks = int(std::min(std::ptrdiff_t(num_workers) * 2, n));
+
+    std::vector<WorkType> work_objs;
+    if (needs_join && num_tasks > 1)
+        work_objs.resize(num_tasks - 1, work);
+
+    self_sched_part::chunk_cursor cursor{n, granularity, num_workers, sched};
+    for (int i = 0; i < num_tasks; i++) {
+        auto& work_obj = (needs_join && i > 0) ? work_objs[i - 1] : work;
+        spawn(task{[&work_obj, &cursor, first, &wait_grp] {
+                       // Stop claiming chunks once the group is cancelled
+                       while (!wait_grp.is_cancelled()) {
+                           auto chunk = cursor.claim();
+                           if (chunk.first == chunk.second)
+                               break;
+                           work_obj.exec(first + chunk.first, first + chunk.second);
+                       }
+                   },
+                wait_grp});
+    }
+
+    // Wait for all the spawned tasks to be completed
+    wait(wait_grp);
+
+    // Join all the work items
+    if constexpr (needs_join) {
+        for (auto& w : work_objs)
+            work.join(w);
+    }
+}
+
+namespace det_part {
+
+//! An inner node of the fixed reduction tree; joins the leaves `[first_leaf_, mid_leaf_)` with the
+//! leaves `[mid_leaf_, ...)`. The result of a node is kept in the work object of its first leaf.
+struct tree_node {
+    std::ptrdiff_t first_leaf_{0};
+    std::ptrdiff_t mid_leaf_{0};
+    //! The index of the parent node; -1 for the root
+    std::ptrdiff_t parent_{-1};
+    //! The number of children that are not yet complete
+    std::atomic<int> pending_{2};
+};
+
+//! The fixed reduction tree over the leaves (chunks) of the range. The shape of the tree depends
+//! only on the number of leaves, and the order of the joins within the tree is fixed; only the
+//! moment at which the joins happen depends on the scheduling.
+template <typename WorkType>
+struct reduction_tree {
+    //! The inner nodes of the tree; there are `num_leaves - 1` of them
+    std::unique_ptr<tree_node[]> nodes_;
+    //! For each leaf, the index of its parent node
+    std::vector<std::ptrdiff_t> leaf_parents_;
+    //! The work object of the first leaf
+    WorkType& first_work_;
+    //! The work objects of the other leaves
+    std::vector<WorkType> other_works_;
+    std::ptrdiff_t num_nodes_{0};
+
+    reduction_tree(std::ptrdiff_t num_leaves, WorkType& work)
+        : nodes_(new tree_node[size_t(std::max(num_leaves - 1, std::ptrdiff_t(1)))])
+        , leaf_parents_(size_t(num_leaves), -1)
+        , first_work_(work)
+        , other_works_(size_t(num_leaves - 1), work) {
+        build(0, num_leaves, -1);
+    }
+
+    //! The work object of the given leaf
+    WorkType& leaf_work(std::ptrdiff_t leaf) {
+        return leaf == 0 ? first_work_ : other_works_[size_t(leaf - 1)];
+    }
+
+    //! Called after a leaf is executed; performs all the joins that become possible
+    void complete_leaf(std::ptrdiff_t leaf) {
+        std::ptrdiff_t node = leaf_parents_[size_t(leaf)];
+        while (node >= 0) {
+            tree_node& nd = nodes_[node];
+            // The last of the two children does the join
+            if (nd.pending_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            leaf_work(nd.first_leaf_).join(leaf_work(nd.mid_leaf_));
+            node = nd.parent_;
+        }
+    }
+
+private:
+    //! Builds the sub-tree for the leaves `[first, last)`, by halving the range of leaves
+    void build(std::ptrdiff_t first, std::ptrdiff_t last, std::ptrdiff_t parent) {
+        if (last - first == 1) {
+            leaf_parents_[size_t(first)] = parent;
+            return;
+        }
+        std::ptrdiff_t idx = num_nodes_++;
+        std::ptrdiff_t mid = first + (last - first) / 2;
+        tree_node& nd = nodes_[idx];
+        nd.first_leaf_ = first;
+        nd.mid_leaf_ = mid;
+        nd.parent_ = parent;
+        build(first, mid, idx);
+        build(mid, last, idx);
+    }
+};
+
+} // namespace det_part
+
+/**
+ * @brief      Partitions the work in a way that doesn't depend on the scheduling
+ *
+ * The range is divided into `ceil(n / granularity)` chunks of (almost) equal size, but into at
+ * most `deterministic_num_chunks` chunks, so that we don't create too many work objects. The
+ * chunks are
+ * executed in parallel, each one with its own work object, starting from the initial state of
+ * `work`. For joins, the results of the chunks are combined following a fixed binary tree, built
+ * by recursively halving the sequence of chunks. A join is performed as soon as its two sides are
+ * complete, so the joins are also done in parallel.
+ *
+ * The chunks and the tree depend only on `n` and `granularity`; the number of workers and the
+ * order in which the tasks are executed don't influence the result. With the same inputs, the
+ * results are bit-identical between runs, even for operations that are not associative (e.g.,
+ * floating-point additions).
+ *
+ * This only works for random-access iterators.
+ */
+template <bool needs_join, typename WorkType>
+inline void deterministic_partition_work(typename WorkType::iterator first, std::ptrdiff_t n,
+        WorkType& work, task_group& wait_grp, std::ptrdiff_t granularity) {
+    const auto& ctx = detail::get_exec_context();
+    int num_workers = detail::num_worker_threads(ctx);
+    granularity = std::max(granularity, std::ptrdiff_t(1));
+    // The maximum number of leaves is a constant, so that it doesn't depend on the workers
+    std::ptrdiff_t num_leaves =
+            std::min((n + granularity - 1) / granularity, deterministic_num_chunks);
+    int num_tasks = int(std::min(std::ptrdiff_t(num_workers) * 2, num_leaves));
+
+    // Boundaries of the leaves; they don't depend on the granularity directly, so that all the
+    // leaves have almost the same size. The first `rem` leaves get one more element.
+    std::ptrdiff_t leaf_size = n / num_leaves;
+    std::ptrdiff_t rem = n % num_leaves;
+    auto leaf_start = [leaf_size, rem](std::ptrdiff_t leaf) {
+        return leaf * leaf_size + std::min(leaf, rem);
+    };
+
+    std::unique_ptr<det_part::reduction_tree<WorkType>> tree;
+    if constexpr (needs_join)
+        tree = std::make_unique<det_part::reduction_tree<WorkType>>(num_leaves, work);
+
+    // The tasks claim the leaves one by one; the order doesn't matter
+    self_sched_part::chunk_cursor cursor{
+            num_leaves, 1, num_workers, self_sched_part::schedule::fixed};
+    for (int i = 0; i < num_tasks; i++) {
+        spawn(task{[&, first] {
+                       while (!wait_grp.is_cancelled()) {
+                           std::ptrdiff_t leaf = cursor.claim().first;
+                           if (leaf >= num_leaves)
+                               break;
+                           auto start = first + leaf_start(leaf);
+                           auto end = first + leaf_start(leaf + 1);
+                           if constexpr (needs_join) {
+                               tree->leaf_work(leaf).exec(start, end);
+                               tree->complete_leaf(leaf);
+                           } else {
+                               work.exec(start, end);
+                           }
+                       }
+                   },
+                wait_grp});
+    }
+
+    // Wait for all the spawned tasks to be completed; the result is in `work`
+    wait(wait_grp);
+}
+
 /**
  * @brief      Naive partition of work; a task for each chunk of work.
  *
@@ -439,17 +1083,18 @@ inline void iterative_partition_work(
  */
 template <typename It, typename WorkType>
 inline void naive_partition_work(
-        It first, It last, WorkType& work, const task_group& wait_grp, int granularity) {
+        It first, It last, WorkType& work, const task_group& wait_grp, std::ptrdiff_t granularity) {
+    // Stop spawning tasks once the group is cancelled
     if (granularity <= 1) {
-        for (; first != last; first++) {
+        for (; first != last && !wait_grp.is_cancelled(); first++) {
             spawn(task{[&work, first]() { work.exec(first, it_next(first)); }, wait_grp});
         }
     } else {
         auto it = first;
         auto ite = it;
-        while (ite != last) {
+        while (ite != last && !wait_grp.is_cancelled()) {
             // find the end of the stride
-            for (int i = 0; i < granularity && ite != last; i++) {
+            for (std::ptrdiff_t i = 0; i < granularity && ite != last; i++) {
                 ite++;
             }
             // spawn a task to cover the current stride
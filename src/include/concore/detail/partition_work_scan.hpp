@@ -5,6 +5,8 @@
 #include "concore/task_graph.hpp"
 #include "concore/spawn.hpp"
 
+#include <algorithm>
+#include <cstddef>
 #include <vector>
 
 namespace concore {
@@ -13,8 +15,7 @@ namespace detail {
 //! The work stage.
 //! Constraints:
 //!     - initial phase work cannot be done in parallel with any other work
-//!     - final work (but not 'both') can be done in parallel with 'join'
-//!     - two joins with the same left side can be done in parallel
+//!     - final work (but not 'both') can be done in parallel with a 'join' that reads the same work
 enum class work_stage {
     initial,
     final,
@@ -25,14 +26,32 @@ enum class work_stage {
 //
 // template <typename It>
 // struct GenericWorkType {
+//     // may be called multiple times, for consecutive sub-ranges
 //     void exec(It first, It last, work_stage stage);
 //     void join(GenericWorkType& rhs);
 // };
 
 namespace scan_auto_impl {
 
+//! The number of blocks in which we divide the work of a task, to check for cancellation
+static constexpr std::ptrdiff_t num_cancel_check_blocks = 16;
+
+//! Executes the work for [first, last), block by block; stops if the group was cancelled.
+//! The work carries its state from one block to the next, so this is equivalent to a single call.
+template <typename RandomIt, typename WorkType>
+inline void exec_cancellable(WorkType& work, RandomIt first, RandomIt last, work_stage stage,
+        std::ptrdiff_t granularity, const task_group& grp) {
+    auto n = static_cast<std::ptrdiff_t>(last - first);
+    std::ptrdiff_t block_size = std::max(granularity, n / num_cancel_check_blocks);
+    for (std::ptrdiff_t i = 0; i < n; i += block_size) {
+        if (grp.is_cancelled())
+            return;
+        work.exec(first + i, first + std::min(n, i + block_size), stage);
+    }
+}
+
 //! Given number of elements, find the number of levels needed for a perfect power-of-two division.
-inline int get_num_levels(int n, int granularity) {
+inline int get_num_levels(std::ptrdiff_t n, std::ptrdiff_t granularity) {
     int res = 1;
     while (n > 2 * granularity) {
         res++;
@@ -51,22 +70,20 @@ struct line {
     chained_task first_task_;
     //! The last task added for the line.
     chained_task last_task_;
-    //! Last task that reads from the line; used to prevent writes to the line while others are
-    //! reading from it.
-    chained_task read_dep_task_;
 };
 
 //! Create a task that executes the first pass on the work of a line.
 template <typename RandomIt, typename WorkType>
-inline void create_first_pass_task(
-        line<WorkType>& line, RandomIt first, RandomIt last, bool left_most, task_group grp) {
-    auto f = [&line, first, last, left_most] {
-        line.work_.exec(first, last, left_most ? work_stage::both : work_stage::initial);
+inline void create_first_pass_task(line<WorkType>& line, RandomIt first, RandomIt last,
+        bool left_most, std::ptrdiff_t granularity, task_group grp) {
+    auto f = [&line, first, last, left_most, granularity, grp] {
+        auto stage = left_most ? work_stage::both : work_stage::initial;
+        exec_cancellable(line.work_, first, last, stage, granularity, grp);
     };
     line.first_task_ = chained_task{task{std::move(f), grp}};
     line.last_task_ = line.first_task_;
 }
-//! Creates a join work between two lines.
+//! Creates a join work between two consecutive lines.
 //! The result is added to the right line.
 template <typename WorkType>
 inline void create_join_task(line<WorkType>& lhs, line<WorkType>& rhs, task_group grp) {
@@ -74,17 +91,19 @@ inline void create_join_task(line<WorkType>& lhs, line<WorkType>& rhs, task_grou
     auto join = chained_task{task{std::move(f), grp}};
     add_dependency(lhs.last_task_, join);
     add_dependency(rhs.last_task_, join);
-    if (rhs.read_dep_task_)
-        add_dependency(rhs.read_dep_task_, join);
-    lhs.read_dep_task_ = join;
     rhs.last_task_ = std::move(join);
 }
 //! Create a task that executes the final pass work for a line.
 //! Note: the elements passed here are the ones that correspond to the next line.
 template <typename RandomIt, typename WorkType>
 inline void create_final_pass_task(line<WorkType>& line, RandomIt first, RandomIt last,
-        task_group grp, chained_task& final_task) {
-    auto f = [&line, first, last] { line.work_.exec(first, last, work_stage::final); };
+        std::ptrdiff_t granularity, task_group grp, chained_task& final_task) {
+    auto f = [&line, first, last, granularity, grp] {
+        // Joins may read the line while we are executing; work on a copy, as the work may update
+        // its state from one block to the next
+        WorkType work = line.work_;
+        exec_cancellable(work, first, last, work_stage::final, granularity, grp);
+    };
     auto t = chained_task{task{std::move(f), grp}};
     add_dependency(t, final_task);
     add_dependency(line.last_task_, t);
@@ -92,12 +111,15 @@ inline void create_final_pass_task(line<WorkType>& line, RandomIt first, RandomI
 
 //! The main algo.
 //! Creates the tasks in a task graph, and executes the task graph.
+//! If `max_tasks` is not positive, it is derived from the number of workers.
 template <typename RandomIt, typename WorkType>
-inline void algo(RandomIt first, int n, WorkType& work, task_group grp, int granularity) {
+inline void algo(RandomIt first, std::ptrdiff_t n, WorkType& work, task_group grp,
+        std::ptrdiff_t granularity, std::ptrdiff_t max_tasks) {
     // If 'n' is far bigger than the the number of workers, we will make too many divisions, and
     // create more work; try to limit the number of divisions
-    const auto& ctx = detail::get_exec_context();
-    int n2 = std::min(detail::num_worker_threads(ctx) * 2, n);
+    if (max_tasks <= 0)
+        max_tasks = detail::num_worker_threads(detail::get_exec_context()) * 2;
+    std::ptrdiff_t n2 = std::min(max_tasks, n);
     int num_tasks = 0;
 
     // Determine the number of divisions we need -- power of 2
@@ -113,24 +135,16 @@ inline void algo(RandomIt first, int n, WorkType& work, task_group grp, int gran
         auto start = first + (n * i / num_div);
         auto end = first + (n * (i + 1) / num_div);
         lines[i].work_.line_ = i;
-        create_first_pass_task(lines[i], start, end, i == 0, grp);
+        create_first_pass_task(lines[i], start, end, i == 0, granularity, grp);
         num_tasks++;
     }
-    // Create the first-pass join tasks
-    for (int lvl = 0; lvl < num_levels; lvl++) {
-        int stride = 1 << (lvl + 1);
-        for (int i = stride - 1; i < num_div - 1; i += stride) {
-            create_join_task(lines[i - stride / 2], lines[i], grp);
-            num_tasks++;
-        }
-    }
-    // Create the second-pass join tasks
-    for (int lvl = num_levels - 2; lvl >= 0; lvl--) {
-        int stride = 1 << (lvl + 1);
-        for (int i = stride - 1; i < num_div - stride / 2; i += stride) {
-            create_join_task(lines[i], lines[i + stride / 2], grp);
-            num_tasks++;
-        }
+    // Create the join tasks. They are chained from left to right, so that the sum at the end of a
+    // line is always obtained by adding the sum of the line to the sum at the end of the previous
+    // line; the final pass can use the same additions, and the results are consistent at the
+    // boundaries of the lines. The joins are cheap, so the chain doesn't add much latency.
+    for (int i = 1; i < num_div - 1; i++) {
+        create_join_task(lines[i - 1], lines[i], grp);
+        num_tasks++;
     }
 
     // The task to wait on
@@ -141,7 +155,7 @@ inline void algo(RandomIt first, int n, WorkType& work, task_group grp, int gran
     for (int i = 1; i < num_div; i++) {
         auto start = first + (n * i / num_div);
         auto end = first + (n * (i + 1) / num_div);
-        create_final_pass_task(lines[i - 1], start, end, grp, wait_task);
+        create_final_pass_task(lines[i - 1], start, end, granularity, grp, wait_task);
         num_tasks++;
     }
     // Start the first task in each line
@@ -166,23 +180,26 @@ inline void algo(RandomIt first, int n, WorkType& work, task_group grp, int gran
  * Unlike other algorithms, to implement a scan, one cannot fully parallelize the work. The
  * dependencies between the tasks will create unbalanced work graphs.
  *
- * The general idea is the following (See
- * https://en.wikipedia.org/wiki/Prefix_sum#/media/File:Prefix_sum_16.svg):
+ * The general idea is the following:
  *  - divide the range into a power-of-two intervals
  *  - run the initial phase for each interval
- *  - perform initial set of joins
- *  - perform the second set of joins
- *  - run the final phase for each interval
+ *  - join the sums of the intervals, from left to right; the sum of an interval is joined as soon
+ *    as the sums of all the previous intervals are known
+ *  - run the final phase for each interval, starting from the sum of the previous intervals
  *
  * The algorithm creates tasks for all these, aggregate them into a task graph, and then runs the
  * graph.
  *
+ * The division of the range and the order of the joins depend only on `n`, `granularity` and
+ * `max_tasks`. By default, `max_tasks` is derived from the number of workers; passing a fixed
+ * value makes the results independent of the machine.
+ *
  * This only works for random-access iterators.
  */
 template <typename RandomIt, typename WorkType>
-inline void auto_partition_work_scan(
-        RandomIt first, int n, WorkType& work, task_group grp, int granularity) {
-    scan_auto_impl::algo(first, n, work, grp, granularity);
+inline void auto_partition_work_scan(RandomIt first, std::ptrdiff_t n, WorkType& work,
+        task_group grp, std::ptrdiff_t granularity, std::ptrdiff_t max_tasks = -1) {
+    scan_auto_impl::algo(first, n, work, grp, granularity, max_tasks);
 }
 
 } // namespace detail
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "concore/reduce_ops.hpp"
+#include "concore/detail/platform.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace concore {
+namespace detail {
+namespace simd {
+
+//! The instruction sets for which we have kernels
+enum class isa {
+    scalar, //!< No vector instructions
+    sse2,   //!< 128-bit vectors; the baseline for x86-64
+    avx2,   //!< 256-bit vectors
+    avx512, //!< 512-bit vectors (AVX-512F)
+    neon,   //!< 128-bit vectors; the baseline for ARM64
+};
+
+//! Returns the best instruction set supported by the current CPU; detected once
+isa best_isa();
+
+//! Returns the instruction set that is used on all the CPUs of the current architecture
+isa baseline_isa();
+
+//! Returns the instruction set to be used for elements of type T. With different instruction
+//! sets, the floating-point operations are done in different orders; if `reproducible` is set,
+//! the floating-point kernels use the baseline instruction set, so that the results don't depend
+//! on the CPU on which the program runs.
+template <typename T>
+inline isa kernel_isa(bool reproducible) {
+    return reproducible && std::is_floating_point<T>::value ? baseline_isa() : best_isa();
+}
+
+// The kernels. They are instantiated for int32_t, int64_t, float and double. If the given
+// instruction set is not supported by the CPU, a supported one is used instead.
+//
+// Floating-point sums are not done in the order of the elements; the results may differ from the
+// ones obtained by adding the elements one by one, and may depend on the instruction set.
+
+//! Returns `init + first[0] + ... + first[n-1]`
+template <typename T>
+T reduce_sum(isa target, const T* first, std::ptrdiff_t n, T init);
+//! Returns the minimum between `init` and the elements, following `min_op`
+template <typename T>
+T reduce_min(isa target, const T* first, std::ptrdiff_t n, T init);
+//! Returns the maximum between `init` and the elements, following `max_op`
+template <typename T>
+T reduce_max(isa target, const T* first, std::ptrdiff_t n, T init);
+//! Updates `init` (minimum, maximum) with the given elements, following `minmax_op`
+template <typename T>
+std::pair<T, T> reduce_minmax(isa target, const T* first, std::ptrdiff_t n, std::pair<T, T> init);
+//! Writes the inclusive prefix sums of the elements to `d_first`, starting from `init`; returns the
+//! last sum (`init` if there are no elements)
+template <typename T>
+T inclusive_sum(isa target, const T* first, std::ptrdiff_t n, T* d_first, T init);
+
+//! The element types for which we have kernels
+template <typename T>
+struct is_kernel_type
+    : std::integral_constant<bool, std::is_same<T, int32_t>::value ||
+                                           std::is_same<T, int64_t>::value ||
+                                           std::is_same<T, float>::value ||
+                                           std::is_same<T, double>::value> {};
+
+//! The std::vector type that holds the elements pointed by the iterator
+template <typename It>
+using vector_of = std::vector<typename std::iterator_traits<It>::value_type>;
+
+//! Checks if the iterator points to elements that are contiguous in memory
+template <typename It, typename = void>
+struct is_contiguous_iterator : std::false_type {};
+template <typename T>
+struct is_contiguous_iterator<T*> : std::true_type {};
+//! Iterators of std::vector; pointers are excluded here, as they can be the vector iterators
+template <typename It>
+struct is_contiguous_iterator<It,
+        std::enable_if_t<!std::is_pointer<It>::value &&
+                         (std::is_same<It, typename vector_of<It>::iterator>::value ||
+                                 std::is_same<It, typename vector_of<It>::const_iterator>::value)>>
+    : std::true_type {};
+
+//! The element type of a contiguous iterator; void if the iterator is not contiguous
+template <typename It, bool = is_contiguous_iterator<It>::value>
+struct contiguous_element {
+    using type = void;
+};
+template <typename It>
+struct contiguous_element<It, true> {
+    using type = std::remove_cv_t<typename std::iterator_traits<It>::value_type>;
+};
+template <typename It>
+using contiguous_element_t = typename contiguous_element<It>::type;
+
+//! Returns a pointer to the element referred by a contiguous iterator
+template <typename It>
+inline auto to_pointer(It it) {
+    return std::addressof(*it);
+}
+
+//! The reduction kernels that we have
+enum class reduce_kind { none, sum, min, max, minmax };
+
+//! Finds the kernel for accumulating elements of type T into a Value, with the operation Op
+template <typename Op, typename Value, typename T, typename = void>
+struct reduce_kernel_of : std::integral_constant<reduce_kind, reduce_kind::none> {};
+template <typename T>
+struct reduce_kernel_of<std::plus<T>, T, T, std::enable_if_t<is_kernel_type<T>::value>>
+    : std::integral_constant<reduce_kind, reduce_kind::sum> {};
+template <typename T>
+struct reduce_kernel_of<std::plus<>, T, T, std::enable_if_t<is_kernel_type<T>::value>>
+    : std::integral_constant<reduce_kind, reduce_kind::sum> {};
+template <typename T>
+struct reduce_kernel_of<min_op, T, T, std::enable_if_t<is_kernel_type<T>::value>>
+    : std::integral_constant<reduce_kind, reduce_kind::min> {};
+template <typename T>
+struct reduce_kernel_of<max_op, T, T, std::enable_if_t<is_kernel_type<T>::value>>
+    : std::integral_constant<reduce_kind, reduce_kind::max> {};
+template <typename T>
+struct reduce_kernel_of<minmax_op, std::pair<T, T>, T, std::enable_if_t<is_kernel_type<T>::value>>
+    : std::integral_constant<reduce_kind, reduce_kind::minmax> {};
+
+//! The kernel for accumulating the elements pointed by It into a Value, with the operation Op;
+//! reduce_kind::none if we don't have a kernel for this combination
+template <typename It, typename Value, typename Op>
+constexpr reduce_kind reduce_kernel_for =
+        reduce_kernel_of<Op, Value, contiguous_element_t<It>>::value;
+
+//! Accumulates the elements in [first, last) into `value`, using the appropriate kernel.
+//! The kernel must exist (`reduce_kernel_for<It, Value, Op> != reduce_kind::none`).
+template <typename Op, typename It, typename Value>
+inline Value apply_reduce_kernel(It first, It last, Value value, bool reproducible) {
+    using T = contiguous_element_t<It>;
+    constexpr reduce_kind kind = reduce_kernel_for<It, Value, Op>;
+    static_assert(kind != reduce_kind::none, "no SIMD kernel for this reduction");
+    auto n = static_cast<std::ptrdiff_t>(last - first);
+    if (n == 0)
+        return value;
+    const T* p = to_pointer(first);
+    isa target = kernel_isa<T>(reproducible);
+    if constexpr (kind == reduce_kind::sum)
+        return reduce_sum(target, p, n, value);
+    else if constexpr (kind == reduce_kind::min)
+        return reduce_min(target, p, n, value);
+    else if constexpr (kind == reduce_kind::max)
+        return reduce_max(target, p, n, value);
+    else
+        return reduce_minmax(target, p, n, value);
+}
+
+//! Checks if a scan over the elements pointed by It, written to It2, with the operation Op, can be
+//! done with the prefix-sum kernel. This is only done for integers, where the order of the
+//! additions doesn't change the results.
+template <typename It, typename It2, typename Value, typename Op>
+constexpr bool has_scan_kernel =
+        reduce_kernel_for<It, Value, Op> == reduce_kind::sum &&
+        std::is_integral<contiguous_element_t<It>>::value &&
+        std::is_same<contiguous_element_t<It>, contiguous_element_t<It2>>::value &&
+        !std::is_const<std::remove_reference_t<decltype(*std::declval<It2>())>>::value;
+
+} // namespace simd
+} // namespace detail
+} // namespace concore
@@ -0,0 +1,89 @@
+#pragma once
+
+// Static tracing probes (USDT), compatible with SystemTap SDT.
+//
+// If the library is configured with `concore.usdt`, CONCORE_ENABLE_USDT is defined, and we place
+// static probe points in the hot paths of the scheduler. These probes can be attached to from
+// `perf`, `bpftrace`, `stap`, etc., without rebuilding the application. Each probe has a
+// semaphore, that the tracer increments when it attaches to the probe; the arguments of the probe
+// are only evaluated if the semaphore is set. When no tracer is attached, a probe costs one load
+// and a predicted branch.
+//
+// All the probes are in the `concore` provider. Available probes:
+//  - enqueue(task*, prio, num_global_tasks)            -- task enqueued in the global queue
+//  - spawn(task*, worker_idx, num_tasks)               -- task spawned in the worker's local queue
+//  - steal_success(task*, thief_idx, victim_idx)       -- a worker stole a task from another
+//  - steal_failure(thief_idx, num_tasks)               -- a full stealing pass found nothing
+//  - worker_sleep(worker_idx, num_global_tasks)        -- a worker is going to sleep
+//  - worker_wake(worker_idx, num_global_tasks)         -- a worker was woken up
+//  - task_begin(task*, worker_idx, num_tasks)          -- a task is about to be executed
+//  - task_end(task*, worker_idx, num_tasks)            -- a task finished execution
+//  - serializer_handoff(impl*, num_tasks)              -- serializer starts its next task
+//  - n_serializer_handoff(impl*)                       -- n_serializer starts its next task
+//  - pipeline_handoff(pipeline_data*, stage_idx, order_idx) -- line moves to a pipeline stage
+//
+// The task pointer is the address of the task object at the probe site. Tasks are moved into the
+// queues and out of them, so this is not an identifier of the task: the pointer given to enqueue
+// and spawn is the caller's object, and cannot be matched with the pointer of the later probes.
+// Only task_begin and task_end (and steal_success, just before them) see the same object, so they
+// can be matched for measuring the execution of a task. The worker index is -1 for threads that are
+// not workers of the execution context. The number of tasks is the value of the corresponding
+// counter at the time of the probe, and can be used as a measure of queue depth.
+//
+// Example: bpftrace -e 'usdt:./app:concore:steal_success { @[arg2] = count(); }'
+
+#if CONCORE_ENABLE_USDT
+
+// Use semaphores for the probes, to skip the evaluation of the arguments when there is no tracer
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+//! Calls X for all the probes of the library
+#define CONCORE_USDT_FOR_EACH_PROBE(X)                                                             \
+    X(enqueue)                                                                                     \
+    X(spawn)                                                                                       \
+    X(steal_success)                                                                               \
+    X(steal_failure)                                                                               \
+    X(worker_sleep)                                                                                \
+    X(worker_wake)                                                                                 \
+    X(task_begin)                                                                                  \
+    X(task_end)                                                                                    \
+    X(serializer_handoff)                                                                          \
+    X(n_serializer_handoff)                                                                        \
+    X(pipeline_handoff)
+
+//! The semaphore of a probe; the name is the one expected by 'sys/sdt.h'
+#define CONCORE_USDT_SEMAPHORE(name) concore_##name##_semaphore
+
+// The semaphores are defined in the library
+#define CONCORE_USDT_DECLARE_SEMAPHORE(name)                                                       \
+    extern "C" volatile unsigned short CONCORE_USDT_SEMAPHORE(name);
+CONCORE_USDT_FOR_EACH_PROBE(CONCORE_USDT_DECLARE_SEMAPHORE)
+#undef CONCORE_USDT_DECLARE_SEMAPHORE
+
+//! Checks if a tracer is attached to the given probe
+#define CONCORE_USDT_ENABLED(name) __builtin_expect(CONCORE_USDT_SEMAPHORE(name) != 0, 0)
+
+#define CONCORE_USDT_PROBE1(name, a1)                                                              \
+    do {                                                                                           \
+        if (CONCORE_USDT_ENABLED(name))                                                            \
+            DTRACE_PROBE1(concore, name, a1);                                                      \
+    } while (false)
+#define CONCORE_USDT_PROBE2(name, a1, a2)                                                          \
+    do {                                                                                           \
+        if (CONCORE_USDT_ENABLED(name))                                                            \
+            DTRACE_PROBE2(concore, name, a1, a2);                                                  \
+    } while (false)
+#define CONCORE_USDT_PROBE3(name, a1, a2, a3)                                                      \
+    do {                                                                                           \
+        if (CONCORE_USDT_ENABLED(name))                                                            \
+            DTRACE_PROBE3(concore, name, a1, a2, a3);                                              \
+    } while (false)
+
+#else
+
+#define CONCORE_USDT_PROBE1(name, a1)         /*nothing*/
+#define CONCORE_USDT_PROBE2(name, a1, a2)     /*nothing*/
+#define CONCORE_USDT_PROBE3(name, a1, a2, a3) /*nothing*/
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "concore/task.hpp"
 #include "concore/profiling.hpp"
+#include "concore/data/concurrent_queue.hpp"
 #include "concore/data/detail/nodes.hpp"
 #include "concore/low_level/spin_mutex.hpp"
 
@@ -25,6 +26,10 @@ namespace detail {
  *
  * Implemented as a synchronized double-linked list.
  * Using a node_factory to cache the nodes storage.
+ *
+ * Other threads can also add tasks targeted at this worker; these are kept in a separate inbox, so
+ * that the pushes of the owning worker don't need to synchronize with them. The inbox tasks are
+ * taken after the tasks from the list.
  */
 class worker_tasks {
 public:
@@ -41,7 +46,8 @@ public:
     worker_tasks& operator=(worker_tasks&&) = delete;
 
     //! Pushes a task on the top of the stack
-    //! Cannot be called in parallel with try_pop(), but can be called in parallel with try_steal()
+    //! Only called by the owning worker. Cannot be called in parallel with try_pop(), but can be
+    //! called in parallel with try_steal() and push_remote()
     void push(task&& t) {
         // Get a new node and construct the task in it
         // NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
@@ -58,8 +64,17 @@ public:
         root_.next_.store(node, std::memory_order_relaxed);
     }
 
-    //! Pops one tasks from the top of the stack
-    //! Cannot be called in parallel with push(), but can be called in parallel with try_steal()
+    //! Pushes a task targeted at this worker, from another thread
+    //! Can be run in parallel with all the other operations.
+    void push_remote(task&& t) {
+        // Count the task first, so that the emptiness checks never miss it
+        inbox_size_++;
+        inbox_.push(std::forward<task>(t));
+    }
+
+    //! Pops one tasks from the top of the stack; if the stack is empty, takes a task from the inbox
+    //! Only called by the owning worker. Cannot be called in parallel with push(), but can be
+    //! called in parallel with try_steal() and push_remote()
     bool try_pop(task& t) {
         node_ptr first{nullptr};
         // Synchronized access: get the first element from the list
@@ -81,12 +96,12 @@ public:
             factory_.release(first);
             return true;
         } else
-            return false;
+            return try_pop_inbox(t);
     }
 
-    //! Steal one task from the bottom of the stack.
+    //! Steal one task from the bottom of the stack; if the stack is empty, steals from the inbox.
     //! We steal from the bottom, to take the task with lowest locality.
-    //! Can be run in parallel with push() and try_pop().
+    //! Can be run in parallel with all the other operations.
     bool try_steal(task& t) {
         CONCORE_PROFILING_FUNCTION();
 
@@ -109,10 +124,33 @@ public:
             factory_.release(last);
             return true;
         } else
+            return try_pop_inbox(t);
+    }
+
+    //! Checks if there are no tasks in the list
+    //! Can be run in parallel with the other operations; the result may be outdated immediately.
+    bool empty() {
+        if (inbox_size_.load() > 0)
             return false;
+        std::lock_guard<spin_mutex> lock{access_bottleneck_};
+        return root_.next_.load(std::memory_order_relaxed) == &root_;
+    }
+
+    //! Quick check if the list looks empty, without taking the lock. The result is only a hint.
+    bool looks_empty() const {
+        return root_.next_.load(std::memory_order_relaxed) == &root_ &&
+               inbox_size_.load(std::memory_order_relaxed) <= 0;
     }
 
 private:
+    //! Takes a task from the inbox, if there is one
+    bool try_pop_inbox(task& t) {
+        if (inbox_size_.load(std::memory_order_relaxed) <= 0 || !inbox_.try_pop(t))
+            return false;
+        inbox_size_--;
+        return true;
+    }
+
     //! The root node representing the double-linked list of nodes
     //! First elem == top of the stack, last elem == bottom of the stack
     detail::bidir_node_base root_{};
@@ -122,6 +160,11 @@ private:
 
     //! Object that creates nodes, and keeps track of the freed nodes.
     node_factory<task, detail::bidir_node_base> factory_;
+
+    //! The tasks pushed by other threads (see push_remote())
+    concurrent_queue<task> inbox_;
+    //! The number of tasks in the inbox; incremented before the task is added to the inbox
+    std::atomic<int> inbox_size_{0};
 };
 
 } // namespace detail
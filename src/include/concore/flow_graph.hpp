@@ -0,0 +1,583 @@
+/**
+ * @file    flow_graph.hpp
+ * @brief   Typed message-passing graphs
+ *
+ * @see     @ref concore::v1::flow_graph "flow_graph",
+ *          @ref concore::v1::function_node "function_node",
+ *          @ref concore::v1::broadcast_node "broadcast_node",
+ *          @ref concore::v1::buffer_node "buffer_node",
+ *          @ref concore::v1::limiter_node "limiter_node",
+ *          @ref concore::v1::join_node "join_node", make_edge()
+ */
+#pragma once
+
+#include "task.hpp"
+#include "task_group.hpp"
+#include "task_cancelled.hpp"
+#include "any_executor.hpp"
+#include "spawn.hpp"
+#include "data/concurrent_queue.hpp"
+#include "low_level/spin_mutex.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace concore {
+
+inline namespace v1 {
+template <typename T>
+class flow_sender;
+}
+
+namespace detail {
+
+//! Makes a copy of the given message; throws if the message type cannot be copied
+template <typename T, std::enable_if_t<std::is_copy_constructible<T>::value, int> = 0>
+T copy_flow_msg(const T& msg) {
+    return msg;
+}
+template <typename T, std::enable_if_t<!std::is_copy_constructible<T>::value, int> = 0>
+T copy_flow_msg(const T&) {
+    throw std::logic_error("move-only messages cannot be sent to multiple successors");
+}
+
+} // namespace detail
+
+inline namespace v1 {
+
+//! Special value meaning that a node can have an unlimited number of concurrent executions
+constexpr int flow_unlimited = std::numeric_limits<int>::max();
+
+/**
+ * @brief      A graph of nodes that pass typed messages between them.
+ *
+ * This object holds the context in which the nodes of the graph execute: the task group and the
+ * executor. The nodes are created with a reference to the graph, and connected with make_edge().
+ *
+ * Messages are passed to the graph by calling `try_put()` on the input nodes. The nodes that
+ * execute user functions (@ref function_node) do so in tasks created in the graph's task group,
+ * and executed with the graph's executor. The other nodes (@ref broadcast_node, @ref buffer_node,
+ * @ref limiter_node, @ref join_node) just route the messages, synchronously.
+ *
+ * The graph and the nodes must outlive the processing of the messages; call @ref wait_for_all()
+ * before destroying them.
+ *
+ * The edges must be created before passing messages through the graph.
+ *
+ * @see function_node, broadcast_node, buffer_node, limiter_node, join_node, make_edge()
+ */
+class flow_graph {
+public:
+    /**
+     * @brief      Constructor
+     *
+     * @param      grp   The group in which the tasks of the graph are executed (optional)
+     * @param      exe   The executor used to execute the tasks of the graph (optional)
+     *
+     * @details
+     *
+     * If no executor is given, the @ref spawn_executor will be used.
+     *
+     * The graph will use a task group that is a child of the given task group.
+     */
+    flow_graph()
+        : flow_graph(task_group{}, any_executor{}) {}
+    //! @overload
+    explicit flow_graph(const task_group& grp, any_executor exe = {})
+        : group_(task_group::create(grp))
+        , executor_(exe ? std::move(exe) : any_executor{spawn_executor{}}) {}
+    //! @overload
+    explicit flow_graph(any_executor exe)
+        : flow_graph(task_group{}, std::move(exe)) {}
+
+    flow_graph(const flow_graph&) = delete;
+    flow_graph& operator=(const flow_graph&) = delete;
+
+    //! Waits for all the tasks of the graph to complete. This is a busy-wait.
+    void wait_for_all() { concore::wait(group_); }
+
+    //! Returns the task group used by the graph
+    const task_group& get_task_group() const noexcept { return group_; }
+    //! Returns the executor used by the graph
+    const any_executor& get_executor() const noexcept { return executor_; }
+
+private:
+    //! The group in which the tasks are executed
+    task_group group_;
+    //! The executor used to execute the tasks
+    any_executor executor_;
+};
+
+/**
+ * @brief      Interface for the nodes that can receive messages of type T.
+ *
+ * A receiver can reject messages (see @ref limiter_node). If a message is rejected, and the sender
+ * can keep the message (see @ref buffer_node), the receiver will try later to get the message from
+ * the sender, when it can accept more messages.
+ *
+ * @see flow_sender
+ */
+template <typename T>
+class flow_receiver {
+public:
+    //! The type of messages received by this node
+    using input_type = T;
+
+    virtual ~flow_receiver() = default;
+
+    //! Tries to put a message into this node; returns false if the message was rejected.
+    bool try_put(const T& msg) {
+        T copy{msg};
+        return do_try_put(copy, nullptr);
+    }
+    //! @overload
+    bool try_put(T&& msg) { return do_try_put(msg, nullptr); }
+
+protected:
+    /**
+     * @brief      Tries to put a message into this node.
+     *
+     * @param      msg   The message; can be moved from, if the message is accepted
+     * @param      pred  The sender that keeps the message if rejected; can be null
+     *
+     * @return     True if the message is accepted, false if it's rejected
+     *
+     * @details
+     *
+     * If the message is rejected and `pred` is not null, the receiver will later call `try_get()`
+     * on `pred` when it's ready to accept messages.
+     */
+    virtual bool do_try_put(T& msg, flow_sender<T>* pred) = 0;
+
+    friend class flow_sender<T>;
+};
+
+/**
+ * @brief      Base class for the nodes that send messages of type T.
+ *
+ * The messages are sent to the successors of the node, as added by make_edge(). If a node has
+ * multiple successors, each of them will get a copy of the message. If there is only one
+ * successor, the message is moved into the successor; thus, move-only messages can be used on
+ * linear paths.
+ *
+ * @see flow_receiver, make_edge()
+ */
+template <typename T>
+class flow_sender {
+public:
+    //! The type of messages sent by this node
+    using output_type = T;
+
+    virtual ~flow_sender() = default;
+
+    //! Adds a successor to this node; this should not be called concurrently with sending messages
+    void add_successor(flow_receiver<T>& r) { succs_.push_back(&r); }
+
+    //! Tries to get a message from this node; used by receivers that rejected messages.
+    virtual bool try_get(T& /*msg*/) { return false; }
+
+protected:
+    //! Sends the message to all the successors; returns true if any successor accepted it
+    bool broadcast(T& msg) {
+        bool accepted = false;
+        auto n = succs_.size();
+        for (size_t i = 0; i + 1 < n; i++) {
+            T copy{detail::copy_flow_msg(msg)};
+            accepted = succs_[i]->do_try_put(copy, nullptr) || accepted;
+        }
+        if (n > 0)
+            accepted = succs_[n - 1]->do_try_put(msg, nullptr) || accepted;
+        return accepted;
+    }
+
+    //! Sends the message to the first successor that accepts it. The rejecting successors are
+    //! informed that they can get the message from this node later.
+    bool send_to_one(T& msg) {
+        for (auto* s : succs_)
+            if (s->do_try_put(msg, this))
+                return true;
+        return false;
+    }
+
+    //! The successors of this node
+    std::vector<flow_receiver<T>*> succs_;
+};
+
+//! Creates an edge between two nodes; the messages sent by `s` will be received by `r`
+template <typename T>
+inline void make_edge(flow_sender<T>& s, flow_receiver<T>& r) {
+    s.add_successor(r);
+}
+
+/**
+ * @brief      Node that executes a function for each received message, and sends the result to its
+ *             successors.
+ *
+ * @tparam     In    The type of the input messages
+ * @tparam     Out   The type of the output messages
+ *
+ * The function is executed in tasks created by the graph. At most `concurrency` instances of the
+ * function are executed in parallel; use @ref flow_unlimited for no limit, or 1 for serial
+ * execution. The messages that cannot be processed immediately are queued in the node; this node
+ * never rejects messages.
+ *
+ * The incoming messages are stored in a typed concurrent queue, and the tasks executing the
+ * function only hold a pointer to the node; no type-erased allocations are needed per message.
+ *
+ * If the function throws, the exception is reported to the task group of the graph, and nothing
+ * is sent to the successors for that message. If the successors reject the output, the output is
+ * dropped; place a @ref buffer_node between this node and its successors to avoid that.
+ *
+ * The input type needs to be default-constructible and movable.
+ *
+ * @see flow_graph, make_edge()
+ */
+template <typename In, typename Out>
+class function_node : public flow_receiver<In>, public flow_sender<Out> {
+public:
+    /**
+     * @brief      Constructor
+     *
+     * @param      g            The graph this node belongs to
+     * @param      concurrency  The maximum number of concurrent executions of the function
+     * @param      f            The function to be called for each message; `Out(In)`
+     */
+    template <typename F>
+    function_node(flow_graph& g, int concurrency, F&& f)
+        : graph_(g)
+        , concurrency_(concurrency)
+        , fun_(std::forward<F>(f)) {
+        assert(concurrency > 0);
+    }
+
+    function_node(const function_node&) = delete;
+    function_node& operator=(const function_node&) = delete;
+
+protected:
+    bool do_try_put(In& msg, flow_sender<In>* /*pred*/) override {
+        inputs_.push(std::move(msg));
+        if (count_.fetch_add(1, std::memory_order_acq_rel) < concurrency_)
+            start_worker();
+        return true;
+    }
+
+private:
+    //! The graph to which this node belongs
+    flow_graph& graph_;
+    //! The maximum number of concurrent executions of the function
+    int concurrency_;
+    //! The function to be executed for each message
+    std::function<Out(In)> fun_;
+    //! The messages that need to be processed
+    concurrent_queue<In> inputs_;
+    //! The number of messages that are queued or being processed
+    std::atomic<int> count_{0};
+
+    //! The function of the tasks; processes one message
+    struct worker_fun {
+        function_node* node_;
+        void operator()() const { node_->process_one(); }
+    };
+    //! The continuation of the tasks; starts processing the next message, if needed
+    struct worker_cont {
+        function_node* node_;
+        void operator()(std::exception_ptr ex) const noexcept { node_->on_processed(ex); }
+    };
+
+    void start_worker() {
+        const auto& grp = graph_.get_task_group();
+        graph_.get_executor().execute(task{worker_fun{this}, grp, worker_cont{this}});
+    }
+
+    void process_one() {
+        In msg;
+        if (!inputs_.try_pop(msg))
+            return;
+        Out res = fun_(std::move(msg));
+        this->broadcast(res);
+    }
+
+    void on_processed(std::exception_ptr ex) noexcept {
+        // If the task was cancelled, it didn't consume its message; drop it
+        if (ex && graph_.get_task_group().is_cancelled()) {
+            try {
+                std::rethrow_exception(ex);
+            } catch (const task_cancelled&) {
+                In msg;
+                inputs_.try_pop(msg);
+            } catch (...) {
+            }
+        }
+        // If there are messages not covered by other tasks, start a new task
+        if (count_.fetch_sub(1, std::memory_order_acq_rel) > concurrency_) {
+            try {
+                start_worker();
+            } catch (...) {
+            }
+        }
+    }
+};
+
+/**
+ * @brief      Node that sends each received message to all its successors.
+ *
+ * The messages are not buffered; if a successor rejects a message, that successor will not
+ * receive it.
+ *
+ * @see flow_graph, make_edge()
+ */
+template <typename T>
+class broadcast_node : public flow_receiver<T>, public flow_sender<T> {
+public:
+    //! Constructor
+    explicit broadcast_node(flow_graph& /*g*/) {}
+
+    broadcast_node(const broadcast_node&) = delete;
+    broadcast_node& operator=(const broadcast_node&) = delete;
+
+protected:
+    bool do_try_put(T& msg, flow_sender<T>* /*pred*/) override {
+        this->broadcast(msg);
+        return true;
+    }
+};
+
+/**
+ * @brief      Node that stores the received messages until they are accepted by a successor.
+ *
+ * Each message is sent to only one successor: the first successor that accepts it. If all the
+ * successors reject a message, the message is kept in the buffer, and the successors will try to
+ * get it later (when they are ready to accept messages). If the node doesn't have successors, the
+ * messages can be extracted with @ref try_get().
+ *
+ * The messages are sent roughly in the order in which they are received.
+ *
+ * The graph should not contain cycles that go through a buffer node.
+ *
+ * @see flow_graph, limiter_node, make_edge()
+ */
+template <typename T>
+class buffer_node : public flow_receiver<T>, public flow_sender<T> {
+public:
+    //! Constructor
+    explicit buffer_node(flow_graph& /*g*/) {}
+
+    buffer_node(const buffer_node&) = delete;
+    buffer_node& operator=(const buffer_node&) = delete;
+
+    //! Tries to extract a message from the buffer
+    bool try_get(T& msg) override {
+        std::lock_guard<spin_mutex> lock{bottleneck_};
+        if (items_.empty())
+            return false;
+        msg = std::move(items_.front());
+        items_.pop_front();
+        return true;
+    }
+
+protected:
+    bool do_try_put(T& msg, flow_sender<T>* /*pred*/) override {
+        // Note: we keep the lock while sending the message; this way, a successor that rejects
+        // the message will find it in the buffer when trying to get it later.
+        std::lock_guard<spin_mutex> lock{bottleneck_};
+        if (!items_.empty() || !this->send_to_one(msg))
+            items_.emplace_back(std::move(msg));
+        return true;
+    }
+
+private:
+    //! The messages not yet accepted by a successor
+    std::deque<T> items_;
+    //! Protects the buffer
+    spin_mutex bottleneck_;
+};
+
+/**
+ * @brief      Node that limits the number of messages that pass through it.
+ *
+ * At most `limit` messages are passed to the successors before @ref decrement() is called. After
+ * the limit is reached, the messages are rejected; if the senders keep the messages (e.g.,
+ * @ref buffer_node), the messages will be requested from the senders each time @ref decrement()
+ * is called.
+ *
+ * This is typically used to limit the number of messages in flight in a part of the graph: the
+ * limiter is placed at the start, and @ref decrement() is called when a message exits that part of
+ * the graph.
+ *
+ * @see flow_graph, buffer_node, make_edge()
+ */
+template <typename T>
+class limiter_node : public flow_receiver<T>, public flow_sender<T> {
+public:
+    //! Constructor
+    limiter_node(flow_graph& /*g*/, int limit)
+        : limit_(limit) {
+        assert(limit > 0);
+    }
+
+    limiter_node(const limiter_node&) = delete;
+    limiter_node& operator=(const limiter_node&) = delete;
+
+    //! Allows one more message to pass through the limiter
+    void decrement() {
+        std::unique_lock<spin_mutex> lock{bottleneck_};
+        assert(count_ > 0);
+        count_--;
+        // Try to get messages from the predecessors that had messages rejected
+        while (count_ < limit_ && !preds_.empty()) {
+            auto* pred = preds_.back();
+            count_++;
+            lock.unlock();
+            T msg;
+            bool got = pred->try_get(msg);
+            if (got)
+                this->broadcast(msg);
+            lock.lock();
+            if (!got) {
+                count_--;
+                auto it = std::find(preds_.begin(), preds_.end(), pred);
+                if (it != preds_.end())
+                    preds_.erase(it);
+            }
+        }
+    }
+
+protected:
+    bool do_try_put(T& msg, flow_sender<T>* pred) override {
+        {
+            std::lock_guard<spin_mutex> lock{bottleneck_};
+            if (count_ >= limit_) {
+                if (pred && std::find(preds_.begin(), preds_.end(), pred) == preds_.end())
+                    preds_.push_back(pred);
+                return false;
+            }
+            count_++;
+        }
+        this->broadcast(msg);
+        return true;
+    }
+
+private:
+    //! The maximum number of messages that can pass through, before calling decrement()
+    int limit_;
+    //! The number of messages that passed through, and were not yet decremented
+    int count_{0};
+    //! The senders that have messages for us, that we rejected
+    std::vector<flow_sender<T>*> preds_;
+    //! Protects the state of the limiter
+    spin_mutex bottleneck_;
+};
+
+/**
+ * @brief      Node that joins messages from multiple inputs into tuples.
+ *
+ * @tparam     Ts    The types of the inputs
+ *
+ * The node has one input port for each of the types; use @ref input_port() to connect nodes to
+ * them. The messages are queued at each port. Whenever all the ports have at least one message, the
+ * first message from each port is extracted, and the resulting tuple is sent to the successors.
+ *
+ * @see flow_graph, make_edge()
+ */
+template <typename... Ts>
+class join_node : public flow_sender<std::tuple<Ts...>> {
+public:
+    //! The type of the output messages
+    using tuple_type = std::tuple<Ts...>;
+
+    //! Constructor
+    explicit join_node(flow_graph& /*g*/)
+        : ports_(make_ports(std::index_sequence_for<Ts...>{})) {}
+
+    join_node(const join_node&) = delete;
+    join_node& operator=(const join_node&) = delete;
+
+    //! Returns the input port with the given index
+    template <size_t I>
+    flow_receiver<std::tuple_element_t<I, tuple_type>>& input_port() {
+        return std::get<I>(ports_);
+    }
+
+private:
+    //! Input port of the join node
+    template <size_t I>
+    class port : public flow_receiver<std::tuple_element_t<I, tuple_type>> {
+    public:
+        explicit port(join_node* parent)
+            : parent_(parent) {}
+
+    protected:
+        using msg_type = std::tuple_element_t<I, tuple_type>;
+        bool do_try_put(msg_type& msg, flow_sender<msg_type>* /*pred*/) override {
+            parent_->template on_input<I>(msg);
+            return true;
+        }
+
+    private:
+        join_node* parent_;
+    };
+
+    template <size_t... Is>
+    std::tuple<port<Is>...> make_ports(std::index_sequence<Is...>) {
+        return std::tuple<port<Is>...>{port<Is>{this}...};
+    }
+
+    template <typename Seq>
+    struct ports_of;
+    template <size_t... Is>
+    struct ports_of<std::index_sequence<Is...>> {
+        using type = std::tuple<port<Is>...>;
+    };
+
+    //! The input ports
+    typename ports_of<std::index_sequence_for<Ts...>>::type ports_;
+    //! The queued messages, for each port
+    std::tuple<std::deque<Ts>...> queues_;
+    //! Protects the queues
+    spin_mutex bottleneck_;
+
+    template <size_t I>
+    void on_input(std::tuple_element_t<I, tuple_type>& msg) {
+        // The input types don't need to be default-constructible; the tuple is built directly
+        // from the fronts of the queues
+        std::optional<tuple_type> res;
+        {
+            std::lock_guard<spin_mutex> lock{bottleneck_};
+            std::get<I>(queues_).emplace_back(std::move(msg));
+            if (!all_have_items(std::index_sequence_for<Ts...>{}))
+                return;
+            res.emplace(pop_all(std::index_sequence_for<Ts...>{}));
+        }
+        this->broadcast(*res);
+    }
+
+    template <size_t... Is>
+    bool all_have_items(std::index_sequence<Is...>) const {
+        bool non_empty[] = {!std::get<Is>(queues_).empty()...};
+        for (bool b : non_empty)
+            if (!b)
+                return false;
+        return true;
+    }
+
+    template <size_t... Is>
+    tuple_type pop_all(std::index_sequence<Is...>) {
+        tuple_type res{std::move(std::get<Is>(queues_).front())...};
+        (std::get<Is>(queues_).pop_front(), ...);
+        return res;
+    }
+};
+
+} // namespace v1
+} // namespace concore
@@ -0,0 +1,90 @@
+/**
+ * @file    granularity_tuner.hpp
+ * @brief   Definition of @ref concore::v1::granularity_tuner "granularity_tuner"
+ *
+ * @see     @ref concore::v1::granularity_tuner "granularity_tuner", partition_hints
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+
+namespace concore {
+
+namespace detail {
+struct granularity_tuner_access;
+} // namespace detail
+
+inline namespace v1 {
+
+/**
+ * @brief      Chooses the granularity of an algorithm from the measured cost of its iterations
+ *
+ * @details
+ *
+ * Choosing a good granularity by hand is hard: it depends on the cost of each iteration, which
+ * can change with the inputs. With a tuner given in partition_hints::tuner_, the first call of the
+ * algorithm measures the cost of the first few iterations (executed on the calling thread), and
+ * then picks a granularity such that each chunk of iterations takes about
+ * target_task_duration(). The estimated cost is cached in the tuner, and the later calls use it
+ * directly, without measuring again.
+ *
+ * The tuner identifies the call site; the typical usage is to declare it as a static object next
+ * to the algorithm call:
+ * @code
+ *      static concore::granularity_tuner tuner;
+ *      concore::partition_hints hints;
+ *      hints.tuner_ = &tuner;
+ *      concore::conc_for(0, n, [&](int i) { process(i); }, hints);
+ * @endcode
+ *
+ * If the iterations change their cost significantly, call reset() to measure them again.
+ *
+ * The tuner can be used by multiple algorithms at the same time.
+ *
+ * @see partition_hints, conc_for(), conc_reduce()
+ */
+class granularity_tuner {
+public:
+    //! Constructor, with the target duration of a task
+    explicit granularity_tuner(
+            std::chrono::nanoseconds target_task_duration = std::chrono::microseconds(30))
+        : target_task_duration_(target_task_duration) {}
+
+    //! The duration that we want a chunk of iterations to take
+    std::chrono::nanoseconds target_task_duration() const { return target_task_duration_; }
+    //! Checks if we have an estimate of the cost of an iteration
+    bool has_estimate() const { return cost_per_item_ns() > 0.0; }
+    //! The estimated cost of an iteration, in nanoseconds; 0 if not measured yet
+    double cost_per_item_ns() const { return cost_per_item_ns_.load(std::memory_order_relaxed); }
+    //! Forgets the estimated cost; the next call of the algorithm will measure it again
+    void reset() { cost_per_item_ns_.store(0.0, std::memory_order_relaxed); }
+
+private:
+    friend struct detail::granularity_tuner_access;
+
+    //! The duration that we want a chunk of iterations to take
+    std::chrono::nanoseconds target_task_duration_;
+    //! The estimated cost of an iteration, in nanoseconds
+    std::atomic<double> cost_per_item_ns_{0.0};
+};
+
+} // namespace v1
+
+namespace detail {
+
+//! Gives the partitioning algorithms access to the tuner
+struct granularity_tuner_access {
+    //! Records the measured duration of executing `count` iterations
+    static void record(granularity_tuner& tuner, std::chrono::nanoseconds elapsed,
+            std::ptrdiff_t count) {
+        // Avoid 0, which means that we don't have an estimate
+        double cost = std::max(double(elapsed.count()), 1.0) / double(count);
+        tuner.cost_per_item_ns_.store(cost, std::memory_order_relaxed);
+    }
+};
+
+} // namespace detail
+} // namespace concore
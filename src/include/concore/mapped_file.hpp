@@ -0,0 +1,81 @@
+/**
+ * @file    mapped_file.hpp
+ * @brief   Definition of @ref concore::v1::mapped_file "mapped_file"
+ *
+ * @see     @ref concore::v1::mapped_file "mapped_file", conc_for_file()
+ */
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace concore {
+
+inline namespace v1 {
+
+/**
+ * @brief      A read-only view of the content of a file, mapped into memory
+ *
+ * @details
+ *
+ * On POSIX platforms, the file is mapped with `mmap`; the content is loaded lazily, as it is
+ * accessed. The user can tell the OS which parts of the file will be needed soon (will_need()),
+ * and which parts are no longer needed (dont_need()); this allows processing files larger than
+ * the available memory while keeping the resident memory bounded.
+ *
+ * On other platforms, the whole content of the file is read into memory; the hints are ignored.
+ *
+ * The object is movable, but not copyable.
+ *
+ * @see conc_for_file(), conc_for_file_chunks()
+ */
+class mapped_file {
+public:
+    //! Constructs an empty object, without a file
+    mapped_file() = default;
+    /**
+     * @brief      Maps the file with the given path into memory
+     *
+     * @param      path  The path of the file to be mapped
+     *
+     * @details
+     *
+     * Throws `std::system_error` if the file cannot be opened or mapped.
+     */
+    explicit mapped_file(const char* path);
+    ~mapped_file();
+
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    //! Returns the pointer to the content of the file
+    const char* data() const { return data_; }
+    //! Returns the size of the file
+    size_t size() const { return size_; }
+    //! Returns the content of the file, as a string view
+    std::string_view view() const { return {data_, size_}; }
+
+    //! Hints that the given range of the file will be accessed soon; the OS can start reading it
+    void will_need(size_t offset, size_t len) const noexcept;
+    //! Hints that the given range of the file is no longer needed; the OS can free its memory.
+    //! Only the pages fully contained in the range are released; accessing them again is valid,
+    //! but the content needs to be read again from the file.
+    void dont_need(size_t offset, size_t len) const noexcept;
+
+private:
+    //! The content of the file; null for empty files
+    const char* data_{nullptr};
+    //! The size of the file
+    size_t size_{0};
+    //! True if the data is mapped into memory; false if it is held in a memory buffer
+    bool mapped_{false};
+
+    //! Releases the memory used for the content of the file
+    void release() noexcept;
+};
+
+} // namespace v1
+} // namespace concore
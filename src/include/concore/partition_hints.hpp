@@ -10,6 +10,9 @@ namespace concore {
 
 inline namespace v1 {
 
+class affinity_state;
+class granularity_tuner;
+
 /**
  * @brief      The method of dividing the work for concurrent algorithms on ranges
  *
@@ -62,6 +65,9 @@ enum class partition_method {
      * preserved, as nearby elements typically end up on different threads. This method tries to
      * always have tasks to be executed. When a task finished, a new task is spawned.
      *
+     * For random-access iterators, the tasks claim the chunks of iterations from a shared atomic
+     * cursor, without locking.
+     *
      * This method works for forward iterators.
      *
      * This is the default method for non-random-access iterators.
@@ -78,6 +84,78 @@ enum class partition_method {
      * in the best possible way.
      */
     naive_partition,
+    /**
+     * Partitions the data upfront, sending the chunks to the same workers as in previous calls.
+     *
+     * This is useful when the same algorithm is run repeatedly over the same data (e.g., once per
+     * time step). The range is divided into a fixed number of chunks (a few per worker). The
+     * @ref affinity_state object given in partition_hints::affinity_ records which worker
+     * executed each chunk; in the next calls, each chunk is spawned directly to the worker that
+     * executed it before, so that the data is likely to be found in that worker's cache. Idle
+     * workers can still steal chunks, to balance the load; the mapping is then updated.
+     *
+     * If no affinity_state is given, this behaves like auto_partition.
+     *
+     * This method only works for random-access iterators.
+     */
+    affinity_partition,
+    /**
+     * Lazy binary splitting: splits the work only when other workers need tasks.
+     *
+     * A task processes its range sequentially, in chunks of `granularity` elements. After each
+     * chunk, if all the tasks that the current worker spawned were taken, the remaining range is
+     * split in half, and a task is spawned for the right half.
+     *
+     * When all the workers are busy (e.g., nested parallelism, or a loaded system), this creates
+     * very few tasks, regardless of the granularity. This makes the performance less sensitive to
+     * the granularity hint; a small granularity can be safely used.
+     *
+     * This method only works for random-access iterators.
+     */
+    lazy_partition,
+    /**
+     * Guided self-scheduling, similar to OpenMP's `schedule(guided)`.
+     *
+     * A few tasks are created for each worker; the tasks repeatedly claim chunks of iterations
+     * from a shared atomic cursor. Each chunk takes `1/num_workers` of the remaining iterations,
+     * so the chunks are large at the beginning of the range, and small towards the end. This gives
+     * a low overhead, while the small chunks at the end balance the load for irregular loops.
+     *
+     * The chunks are not smaller than the granularity. Locality is preserved within a chunk.
+     *
+     * This method only works for random-access iterators.
+     */
+    guided_partition,
+    /**
+     * Factoring self-scheduling.
+     *
+     * Similar to guided_partition, but the chunks are claimed in batches: each batch divides half
+     * of the remaining iterations into `num_workers` equal chunks. The chunk size decreases slower
+     * than for guided_partition, which is better when the first iterations are much more
+     * expensive than the rest.
+     *
+     * The chunks are not smaller than the granularity.
+     *
+     * This method only works for random-access iterators.
+     */
+    factoring_partition,
+    /**
+     * Deterministic partition; gives reproducible results for conc_reduce() and conc_scan().
+     *
+     * The range is divided into chunks that depend only on the size of the range and on the
+     * granularity. The chunks have about the granularity in size, but there are at most 256 of
+     * them (if the granularity is not given, the range is divided into 256 chunks). For
+     * conc_reduce(), the results of the chunks are combined following a fixed binary tree over
+     * the chunks. The chunks and the joins are still executed in parallel, but the number of
+     * workers and the order in which the tasks are executed don't influence the result: for
+     * operations that are not associative (e.g., floating-point additions), the result is
+     * bit-identical between runs and between machines with different numbers of cores.
+     *
+     * This can be slower than the other methods, as it doesn't adapt to the available workers.
+     *
+     * For non-random-access iterators, conc_reduce() runs serially with this method.
+     */
+    deterministic_partition,
 };
 
 /**
@@ -103,7 +181,7 @@ struct partition_hints {
     //! algorithm to not place less than the value here. This can be used when the iterations are
     //! really small, and the task management overhead can become significant.
     //!
-    //! Does not apply to the upfront_partition method
+    //! Does not apply to the upfront_partition method. Ignored if `tuner_` is set.
     int granularity_{-1};
 
     //! The (maximum) number of tasks to create per worker
@@ -114,6 +192,15 @@ struct partition_hints {
     //! If, for example, this is set to 10, and we have 8 workers, then the upfront partition will
     //! create maximum 80 tasks. The auto partition will not create more than 80 tasks.
     int tasks_per_worker_{-1};
+
+    //! The state used by the affinity_partition method; needs to be kept alive by the user
+    //! between calls. Ignored by the other methods.
+    affinity_state* affinity_{nullptr};
+
+    //! If set, the granularity is chosen based on the measured cost of the iterations, instead of
+    //! using `granularity_`. The tuner caches the measurements between calls; it is typically a
+    //! static object at the call site. Only used for random-access iterators.
+    granularity_tuner* tuner_{nullptr};
 };
 
 } // namespace v1
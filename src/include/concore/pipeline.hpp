@@ -4,15 +4,20 @@
  *
  * @see     @ref concore::v1::pipeline "pipeline", @ref concore::v1::pipeline_builder
  *          "pipeline_builder", @ref concore::v1::pipeline_end_t "pipeline_end_t", pipeline_end,
- *          stage_ordering
+ *          stage_ordering, @ref concore::v1::pipeline_stats "pipeline_stats"
  */
 #pragma once
 
 #include "concore/task_group.hpp"
 #include "concore/any_executor.hpp"
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <functional>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 namespace concore {
 
@@ -25,31 +30,118 @@ enum class stage_ordering {
     concurrent,   //!< No constraints; all items can be processed concurrently.
 };
 
+/**
+ * @brief      Statistics collected for one stage of a pipeline
+ *
+ * @details
+ *
+ * Dividing the busy time by the number of processed items gives the average latency of the stage
+ * function; comparing the busy time of the stages shows which stage is the bottleneck. A large
+ * backlog or a large in-order wait time indicate that the stage cannot keep up with the lines
+ * coming from the previous stages.
+ *
+ * @see pipeline_stats
+ */
+struct pipeline_stage_stats {
+    //! The ordering of the stage
+    stage_ordering ordering_{stage_ordering::concurrent};
+    //! The number of times the stage function was executed
+    uint64_t num_processed_{0};
+    //! The total time spent executing the stage function
+    std::chrono::nanoseconds busy_time_{0};
+    //! The total time the lines waited for their turn in an `in_order` stage
+    std::chrono::nanoseconds in_order_wait_time_{0};
+    //! The number of lines waiting to be executed in this stage
+    int backlog_{0};
+};
+
+/**
+ * @brief      Statistics collected for a pipeline
+ *
+ * @details
+ *
+ * The per-stage statistics are only collected while collecting stats is enabled for the pipeline;
+ * the number of lines is always available.
+ *
+ * @see pipeline::stats(), pipeline_stage_stats
+ */
+struct pipeline_stats {
+    //! The statistics for each stage of the pipeline, in the order of the stages
+    std::vector<pipeline_stage_stats> stages_;
+    //! The number of lines currently being processed (limited by the concurrency of the pipeline)
+    int num_active_lines_{0};
+    //! The number of lines pushed into the pipeline, waiting to start processing
+    int num_waiting_lines_{0};
+};
+
 } // namespace v1
 
 namespace detail {
-// Forward declaration; see .cpp file
+// Forward declarations; see .cpp file
 struct pipeline_data;
+struct emitted_lines;
 
 //! Main attributes for a line; keeps track of the execution of the linee.
 struct line_base {
-    int stage_idx_ : 31; //!< The stage in which the line is/
+    int stage_idx_ : 28; //!< The stage in which the line is/
     int stopped_ : 1;    //!< Set to true if exceptions appear and later stages should be skipped
+    int last_ : 1;       //!< Set to true for the last line with the given order_idx_
+    int owns_slot_ : 1;  //!< Set to true if the line holds a processing slot of the pipeline
+    int queued_ : 1;     //!< Set to true if the line is counted in the backlog of its stage
     int order_idx_{0};   //!< The order index of the line; used for ordered stages.
+    int sub_idx_{0};     //!< Order of the line among the lines emitted from the same line.
+
+    //! The lines emitted together with this line, if it's emitted by a flat-map stage
+    emitted_lines* group_{nullptr};
+    //! The time (in ns) at which the line entered the reorder window; 0 if not measured
+    int64_t pending_since_{0};
+
+    //! Destroys the data of the line, without releasing the line object
+    void (*destroy_data_)(line_base*){nullptr};
+    //! Releases the memory of the line object (after the data is destroyed)
+    void (*free_line_)(line_base*){nullptr};
 
     line_base()
         : stage_idx_(0)
-        , stopped_(0) {}
+        , stopped_(0)
+        , last_(1)
+        , owns_slot_(1)
+        , queued_(0) {}
 };
 
-//! A types line data, to contain the actual data passed in by the user.
+/**
+ * @brief      A typed line data, to contain the actual data passed in by the user.
+ *
+ * @details
+ *
+ * The line objects are reused by the pipeline. When a line finishes all the stages, its data is
+ * destroyed, but the object is kept, so that the next line can be constructed in the same memory.
+ */
 template <typename T>
 struct typed_line : line_base {
-    //! The line data passed in by the user
-    T data_;
+    union {
+        //! The line data passed in by the user; only valid between construct() and destroy_data()
+        T data_;
+    };
+
+    typed_line() {
+        destroy_data_ = &destroy_data;
+        free_line_ = &free_line;
+    }
+    ~typed_line() {}
 
-    explicit typed_line(T line_data)
-        : data_(std::move(line_data)) {}
+    typed_line(const typed_line&) = delete;
+    typed_line& operator=(const typed_line&) = delete;
+
+    //! Constructs the line data
+    template <typename... Args>
+    void construct(Args&&... args) {
+        new (&data_) T(std::forward<Args>(args)...);
+    }
+
+private:
+    static void destroy_data(line_base* line) { static_cast<typed_line*>(line)->data_.~T(); }
+    static void free_line(line_base* line) { delete static_cast<typed_line*>(line); }
 };
 
 //! Function describing the processing to be done for a stage.
@@ -66,6 +158,40 @@ inline stage_fun create_stage_fun(F&& work) {
     };
 }
 
+/**
+ * @brief      Emits the lines produced by a flat-map stage
+ *
+ * @details
+ *
+ * Each emitted line continues with the stage after the flat-map stage. The emitted lines take the
+ * place of the line they are emitted from: `in_order` stages see them in the order of their
+ * parent lines, and then in the order in which they were emitted.
+ */
+struct line_emitter {
+    //! The pipeline in which we emit lines
+    pipeline_data* data_;
+    //! The line from which we emit lines
+    line_base* parent_;
+    //! The number of lines emitted so far
+    int count_{0};
+    //! Keeps track of the emitted lines that are in flight; created at the first emitted line
+    emitted_lines* group_{nullptr};
+
+    //! Starts processing an emitted line, from the stage after the parent's stage
+    void emit(line_base* child);
+};
+
+//! Function describing the processing to be done for a flat-map stage.
+using expand_fun = std::function<void(line_base*, line_emitter&)>;
+
+//! Returns a line object that can be reused (without data), or null if there is none.
+line_base* try_reuse_line(pipeline_data& data);
+//! Gives back a line object without data; used if constructing the data fails.
+void release_line_memory(pipeline_data& data, line_base* line);
+
+//! Function that creates a new line for the pipeline, or returns null if there are no more lines
+using line_source_fun = std::function<line_base*(pipeline_data&)>;
+
 //! Untyped implementation details for the pipeline.
 //! Using this to perform type erasure.
 struct pipeline_impl {
@@ -86,10 +212,233 @@ struct pipeline_impl {
 
     //! Called to add a stage into the pipeline.
     void do_add_stage(stage_ordering ord, stage_fun&& f);
+    //! Called to add a flat-map stage into the pipeline.
+    void do_add_expand_stage(stage_ordering ord, expand_fun&& f);
+
+    //! Called to start processing a new line; the line must have its data constructed.
+    void do_start_line(line_base* line);
+
+    //! Try to acquire a processing slot for a new line; succeeds if the line can start right away.
+    bool try_acquire_slot();
+    //! Releases a slot acquired with try_acquire_slot(), without starting a line.
+    void release_slot();
+    //! Starts processing a new line, for which we have already acquired a slot.
+    void do_start_acquired_line(line_base* line);
+    //! Waits until there is a free processing slot, executing tasks meanwhile.
+    void wait_for_free_slot();
+
+    //! Makes the pipeline pull lines from the given source, as processing slots become free.
+    void do_pull_from(line_source_fun&& source);
+
+    //! Enables or disables collecting the per-stage stats.
+    void set_collect_stats(bool val);
+    //! Returns a snapshot of the stats of the pipeline.
+    pipeline_stats get_stats() const;
+};
 
-    //! Called to start processing a new line.
-    void do_start_line(std::shared_ptr<line_base>&& line);
+//! Creates a line with data constructed from the given args, reusing line objects from the
+//! pipeline if possible
+template <typename T, typename... Args>
+inline line_base* create_line(pipeline_data& data, Args&&... args) {
+    auto* line = static_cast<typed_line<T>*>(try_reuse_line(data));
+    if (!line)
+        line = new typed_line<T>;
+    try {
+        line->construct(std::forward<Args>(args)...);
+    } catch (...) {
+        release_line_memory(data, line);
+        throw;
+    }
+    return line;
+}
+
+//! Starts a line created by `make_line`, only if the line can start processing right away.
+//! Returns false (without calling `make_line`) if all the processing slots are busy.
+template <typename F>
+inline bool try_start_line(pipeline_impl& impl, F&& make_line) {
+    if (!impl.try_acquire_slot())
+        return false;
+    line_base* line{nullptr};
+    try {
+        line = make_line(*impl.data_);
+    } catch (...) {
+        impl.release_slot();
+        throw;
+    }
+    impl.do_start_acquired_line(line);
+    return true;
+}
+
+//! Creates a source function for the pipeline from a generator of optional values
+template <typename G, typename F>
+inline line_source_fun create_line_source(G&& gen, F make_line) {
+    return [gen = std::forward<G>(gen), make_line](pipeline_data& data) mutable -> line_base* {
+        auto val = gen();
+        return val ? make_line(data, std::move(*val)) : nullptr;
+    };
+}
+
+//! Wrapper for the functor of a filter stage
+template <typename F>
+struct filter_stage_t {
+    F fun_;
 };
+//! Wrapper for the functor of a flat-map stage; `Out` is `void` if the type doesn't change
+template <typename Out, typename F>
+struct flat_map_stage_t {
+    using out_type = Out;
+    F fun_;
+};
+
+template <typename F>
+struct is_filter_stage : std::false_type {};
+template <typename F>
+struct is_filter_stage<filter_stage_t<F>> : std::true_type {};
+template <typename F>
+struct is_flat_map_stage : std::false_type {};
+template <typename Out, typename F>
+struct is_flat_map_stage<flat_map_stage_t<Out, F>> : std::true_type {};
+
+} // namespace detail
+
+inline namespace v1 {
+
+/**
+ * @brief      Object used by flat-map stages to emit lines
+ *
+ * @tparam     T     The type of the data of the emitted lines
+ *
+ * @details
+ *
+ * Each call emits a new line, that continues with the stage after the flat-map stage. The line
+ * objects are taken from the pool of lines of the pipeline, so, in the steady state, emitting a
+ * line does not allocate memory.
+ *
+ * @see flat_map_stage()
+ */
+template <typename T>
+class pipeline_emitter {
+public:
+    //! The type of the function that creates a line for the emitted data
+    using make_line_fun = detail::line_base* (*)(detail::pipeline_data&, T&&);
+
+    //! Constructor; used by the pipeline when executing flat-map stages
+    pipeline_emitter(detail::line_emitter& em, make_line_fun make_line)
+        : em_(em)
+        , make_line_(make_line) {}
+
+    //! Emits a new line with the given data
+    void operator()(T&& val) { em_.emit(make_line_(*em_.data_, std::move(val))); }
+    //! @overload
+    void operator()(const T& val) { (*this)(T(val)); }
+
+private:
+    //! The untyped emitter
+    detail::line_emitter& em_;
+    //! The function that creates the lines
+    make_line_fun make_line_;
+};
+
+/**
+ * @brief      Creates a filter stage, to be added to a pipeline
+ *
+ * @param      f     The filter functor; returns false if the line needs to be dropped
+ *
+ * @return     Object that can be passed to `add_stage()` or to the `|` operator of the builders
+ *
+ * @details
+ *
+ * The functor receives the line data, and returns a boolean value. If the returned value is false,
+ * the line is dropped: the next stages will not be executed for it. Similar to the lines for which
+ * stages throw exceptions, dropping a line does not block the following lines in `in_order`
+ * stages.
+ *
+ * @see flat_map_stage(), pipeline, pipeline_builder
+ */
+template <typename F>
+detail::filter_stage_t<std::decay_t<F>> filter_stage(F&& f) {
+    return {std::forward<F>(f)};
+}
+
+/**
+ * @brief      Creates a flat-map stage, to be added to a pipeline
+ *
+ * @param      f     The functor that emits 0 or more lines for each input line
+ *
+ * @tparam     Out   The type of the emitted data; `void` means the same type as the input
+ *
+ * @return     Object that can be passed to `add_stage()` or to the `|` operator of the builders
+ *
+ * @details
+ *
+ * The functor receives the line data and a @ref pipeline_emitter object; it can emit any number
+ * of lines through the emitter. The emitted lines continue with the next stage of the pipeline,
+ * and the input line is dropped.
+ *
+ * The `in_order` stages after this stage see the emitted lines in the order of the input lines,
+ * and, for the same input line, in the order in which they were emitted.
+ *
+ * Emitted lines don't count towards the concurrency limit of the pipeline; only the input lines
+ * do. Instead, for each input line, at most `max_concurrency` emitted lines are processed at once;
+ * the other emitted lines wait until some of these finish all the stages. The functor never waits
+ * when emitting lines.
+ *
+ * Limitation: if this stage is not `in_order`, there needs to be an `in_order` stage between this
+ * and any previous flat-map stage.
+ *
+ * Example:
+ * @code
+ *      auto my_pipeline = concore::pipeline_builder<std::string>()
+ *          | concore::stage_ordering::concurrent
+ *          | concore::flat_map_stage([](std::string& chunk, auto& emit) {
+ *              for (auto& rec : split_records(chunk))
+ *                  emit(std::move(rec));
+ *          })
+ *          | concore::stage_ordering::in_order
+ *          | [&](const std::string& rec) { out << rec; }
+ *          | concore::pipeline_end;
+ * @endcode
+ *
+ * @see filter_stage(), pipeline_emitter, pipeline, pipeline_builder
+ */
+template <typename Out = void, typename F>
+detail::flat_map_stage_t<Out, std::decay_t<F>> flat_map_stage(F&& f) {
+    return {std::forward<F>(f)};
+}
+
+} // namespace v1
+
+namespace detail {
+
+//! Creates a line with the given data; used for the emitted lines
+template <typename T>
+inline line_base* make_plain_line(pipeline_data& data, T&& val) {
+    return create_line<T>(data, std::move(val));
+}
+
+//! Adds to the pipeline a stage operating on lines with data of type `T`.
+//! The stage can be a regular stage, a filter stage or a flat-map stage.
+template <typename T, typename F>
+inline void add_stage_to(pipeline_impl& impl, stage_ordering ord, F&& work) {
+    using fun_t = std::decay_t<F>;
+    if constexpr (is_filter_stage<fun_t>::value) {
+        impl.do_add_stage(ord, [f = std::forward<F>(work).fun_](line_base* line) {
+            if (!f(static_cast<typed_line<T>*>(line)->data_))
+                line->stopped_ = 1;
+        });
+    } else if constexpr (is_flat_map_stage<fun_t>::value) {
+        using out_t = typename fun_t::out_type;
+        static_assert(std::is_void_v<out_t> || std::is_same_v<out_t, T>,
+                "The lines emitted in a pipeline<T> must have the type T");
+        impl.do_add_expand_stage(
+                ord, [f = std::forward<F>(work).fun_](line_base* line, line_emitter& em) {
+                    pipeline_emitter<T> emitter{em, &make_plain_line<T>};
+                    f(static_cast<typed_line<T>*>(line)->data_, emitter);
+                });
+    } else {
+        impl.do_add_stage(ord, create_stage_fun<T>(std::forward<F>(work)));
+    }
+}
 
 } // namespace detail
 
@@ -203,7 +552,8 @@ public:
      * @details
      *
      * This takes a functor of type `void (T)` and an ordering and
-     * constructs a stage in the pipeline with them.
+     * constructs a stage in the pipeline with them. The work can also be the result of
+     * filter_stage() or flat_map_stage().
      *
      * This must be called before any of the @ref push() calls are made
      *
@@ -211,7 +561,7 @@ public:
      */
     template <typename F>
     void add_stage(stage_ordering ord, F&& work) {
-        impl_.do_add_stage(ord, detail::create_stage_fun<T>(std::forward<F>(work)));
+        detail::add_stage_to<T>(impl_, ord, std::forward<F>(work));
     }
 
     /**
@@ -224,11 +574,124 @@ public:
      * This will start processing from the first stage and will iteratively pass through all the
      * stages of the pipeline. The same line data is passed to the functors registered with each
      * stage of the pipeline; i.e., all the stages of the pipeline work on the same line.
+     *
+     * The line data is moved into the pipeline if given as an rvalue; this allows using move-only
+     * types for the line data. The objects that hold the lines are reused between lines, so, in
+     * the steady state, pushing a line does not allocate memory.
      */
-    void push(T line_data) {
-        impl_.do_start_line(std::make_shared<detail::typed_line<T>>(line_data));
+    void push(T&& line_data) {
+        impl_.do_start_line(detail::create_line<T>(*impl_.data_, std::move(line_data)));
+    }
+    //! @overload
+    void push(const T& line_data) {
+        impl_.do_start_line(detail::create_line<T>(*impl_.data_, line_data));
     }
 
+    /**
+     * @brief      Tries to push a new item (line) through the pipeline, without exceeding the
+     *             concurrency limit
+     *
+     * @param      line_data  The data associated with the line
+     *
+     * @return     True if the line was started; false if the pipeline is at its concurrency limit
+     *
+     * @details
+     *
+     * As opposed to @ref push(), this will never queue the line to be started later. If the number
+     * of lines being processed is equal to the concurrency limit, this returns false, and the line
+     * data is not moved from.
+     *
+     * @see push(), blocking_push()
+     */
+    bool try_push(T&& line_data) {
+        return detail::try_start_line(impl_, [&](detail::pipeline_data& data) {
+            return detail::create_line<T>(data, std::move(line_data));
+        });
+    }
+
+    /**
+     * @brief      Pushes a new item (line) through the pipeline, waiting for the number of lines in
+     *             flight to be below the concurrency limit
+     *
+     * @param      line_data  The data associated with the line
+     *
+     * @details
+     *
+     * This allows a fast producer to be throttled by the pipeline: the number of lines that exist
+     * at any time is bounded by the concurrency limit of the pipeline.
+     *
+     * The wait is an active wait: the calling thread will execute tasks while waiting. It is safe
+     * to call this from within tasks, as long as they are not part of this pipeline.
+     *
+     * @see push(), try_push()
+     */
+    void blocking_push(T&& line_data) {
+        while (!try_push(std::move(line_data)))
+            impl_.wait_for_free_slot();
+    }
+
+    /**
+     * @brief      Makes the pipeline pull its items from the given generator
+     *
+     * @param      gen   The generator of items; must return `std::optional<T>`
+     *
+     * @tparam     G     The type of the generator
+     *
+     * @details
+     *
+     * The pipeline calls the generator each time it can start processing a new line; i.e., when
+     * the number of lines being processed is below the concurrency limit. This way, the pipeline
+     * never creates more lines than it can process; the producer is throttled by the pipeline.
+     *
+     * The generator is called from tasks executed by the pipeline, one call at a time. When the
+     * generator returns an empty optional, the pipeline stops calling it. If the generator throws,
+     * the exception is reported to the task group of the pipeline, and the generator is not called
+     * again.
+     *
+     * This returns immediately. To wait for all the items to be processed, one can wait on the task
+     * group of the pipeline.
+     *
+     * A new generator can be set only after the previous one is exhausted.
+     */
+    template <typename G>
+    void pull_from(G&& gen) {
+        impl_.do_pull_from(detail::create_line_source(
+                std::forward<G>(gen), [](detail::pipeline_data& data, T&& val) {
+                    return detail::create_line<T>(data, std::move(val));
+                }));
+    }
+
+    /**
+     * @brief      Enables or disables collecting per-stage stats
+     *
+     * @param      val   True if we need to collect stats
+     *
+     * @details
+     *
+     * By default, the pipeline doesn't collect per-stage stats. Collecting them adds a small
+     * overhead to the execution of each stage: reading the clock twice and updating a few atomic
+     * counters shared by all the lines. This can be changed at any time; the stats are kept when
+     * disabling the collection.
+     *
+     * @see stats()
+     */
+    void set_collect_stats(bool val) { impl_.set_collect_stats(val); }
+
+    /**
+     * @brief      Returns a snapshot of the pipeline stats
+     *
+     * @return     The stats of the pipeline and of each of its stages
+     *
+     * @details
+     *
+     * The per-stage stats are accumulated while collecting stats is enabled (see
+     * set_collect_stats()). As lines are being processed while the stats are read, the values
+     * for different stages are not necessarily consistent with each other.
+     *
+     * @see pipeline_stats, pipeline_stage_stats
+     */
+    pipeline_stats stats() const { return impl_.get_stats(); }
+
 private:
     //! Implementation details of the pipeline; with type erasure
     detail::pipeline_impl impl_;
@@ -322,13 +785,14 @@ public:
      * @details
      *
      * This takes a functor of type `void (T)` and an ordering and
-     * constructs a stage in the pipeline with them.
+     * constructs a stage in the pipeline with them. The work can also be the result of
+     * filter_stage() or flat_map_stage().
      *
      * @see        stage_ordering
      */
     template <typename F>
     pipeline_builder& add_stage(stage_ordering ord, F&& work) {
-        impl_.do_add_stage(ord, detail::create_stage_fun<T>(std::forward<F>(work)));
+        detail::add_stage_to<T>(impl_, ord, std::forward<F>(work));
         return *this;
     }
 
@@ -388,7 +852,7 @@ public:
      */
     template <typename F>
     pipeline_builder& operator|(F&& work) {
-        impl_.do_add_stage(next_ordering_, detail::create_stage_fun<T>(std::forward<F>(work)));
+        detail::add_stage_to<T>(impl_, next_ordering_, std::forward<F>(work));
         return *this;
     }
 
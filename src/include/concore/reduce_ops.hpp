@@ -0,0 +1,90 @@
+/**
+ * @file    reduce_ops.hpp
+ * @brief   Function objects for common reductions: min_op, max_op, minmax_op
+ *
+ * @see     conc_reduce(), conc_scan()
+ */
+#pragma once
+
+#include <utility>
+
+namespace concore {
+
+inline namespace v1 {
+
+/**
+ * @brief      Function object that returns the minimum of two values
+ *
+ * Behaves like `std::min`: if the values are equivalent, returns the first one.
+ *
+ * Can be used both as the operation and as the reduction of conc_reduce(). For contiguous ranges
+ * of `int32_t`, `int64_t`, `float` or `double`, conc_reduce() recognizes this operation and uses
+ * SIMD kernels to process the elements.
+ *
+ * Example:
+ * @code
+ *      float m = concore::conc_reduce(v.begin(), v.end(),
+ *              std::numeric_limits<float>::max(), concore::min_op{}, concore::min_op{});
+ * @endcode
+ *
+ * @see max_op, minmax_op, conc_reduce()
+ */
+struct min_op {
+    template <typename T>
+    constexpr T operator()(const T& lhs, const T& rhs) const {
+        return rhs < lhs ? rhs : lhs;
+    }
+};
+
+/**
+ * @brief      Function object that returns the maximum of two values
+ *
+ * Behaves like `std::max`: if the values are equivalent, returns the first one.
+ *
+ * Can be used both as the operation and as the reduction of conc_reduce(). For contiguous ranges
+ * of `int32_t`, `int64_t`, `float` or `double`, conc_reduce() recognizes this operation and uses
+ * SIMD kernels to process the elements.
+ *
+ * @see min_op, minmax_op, conc_reduce()
+ */
+struct max_op {
+    template <typename T>
+    constexpr T operator()(const T& lhs, const T& rhs) const {
+        return lhs < rhs ? rhs : lhs;
+    }
+};
+
+/**
+ * @brief      Function object that computes the minimum and the maximum of a range in one pass
+ *
+ * The accumulated value is a `std::pair<T, T>` holding the minimum and the maximum. The object
+ * can be called with an element (as the operation of conc_reduce()), or with another pair (as the
+ * reduction of conc_reduce()).
+ *
+ * For contiguous ranges of `int32_t`, `int64_t`, `float` or `double`, conc_reduce() recognizes
+ * this operation and uses SIMD kernels to process the elements.
+ *
+ * Example:
+ * @code
+ *      using lim = std::numeric_limits<int>;
+ *      auto [lo, hi] = concore::conc_reduce(v.begin(), v.end(),
+ *              std::make_pair(lim::max(), lim::min()), concore::minmax_op{},
+ *              concore::minmax_op{});
+ * @endcode
+ *
+ * @see min_op, max_op, conc_reduce()
+ */
+struct minmax_op {
+    template <typename T>
+    constexpr std::pair<T, T> operator()(const std::pair<T, T>& acc, const T& x) const {
+        return {min_op{}(acc.first, x), max_op{}(acc.second, x)};
+    }
+    template <typename T>
+    constexpr std::pair<T, T> operator()(
+            const std::pair<T, T>& lhs, const std::pair<T, T>& rhs) const {
+        return {min_op{}(lhs.first, rhs.first), max_op{}(lhs.second, rhs.second)};
+    }
+};
+
+} // namespace v1
+} // namespace concore
@@ -268,6 +268,18 @@ public:
      */
     task_continuation_function get_continuation() const noexcept { return cont_fun_; }
 
+    /**
+     * @brief Gives access to the continuation function stored in this task, without copying it
+     * @details
+     *
+     * This can be used to check which continuation is set (e.g., with `target()`), in places where
+     * copying the continuation would be too expensive. The reference is invalidated when the
+     * continuation is changed.
+     *
+     * @see     get_continuation()
+     */
+    const task_continuation_function& peek_continuation() const noexcept { return cont_fun_; }
+
     /**
      * @brief Sets the continuation function for this task
      *
@@ -2,17 +2,25 @@
  * @file    task_graph.hpp
  * @brief   Utilities for creating graphs of tasks
  *
- * @see     @ref concore::v1::chained_task "chained_task", add_dependency(), add_dependencies()
+ * @see     @ref concore::v1::chained_task "chained_task", add_dependency(), add_dependencies(),
+ *          @ref concore::v1::dataflow_task "dataflow_task",
+ *          @ref concore::v1::task_graph "task_graph",
+ *          @ref concore::v1::task_graph_builder "task_graph_builder"
  */
 #pragma once
 
 #include "task.hpp"
 #include "any_executor.hpp"
 #include "except_fun_type.hpp"
+#include "_cpo/_cpo_set_value.hpp"
+#include "_cpo/_cpo_set_error.hpp"
+#include "_cpo/_cpo_set_done.hpp"
+#include "detail/extra_type_traits.hpp"
 
 #include <memory>
 #include <atomic>
 #include <vector>
+#include <utility>
 #include <initializer_list>
 
 namespace concore {
@@ -23,6 +31,72 @@ class chained_task;
 
 namespace detail {
 struct chained_task_impl;
+struct dataflow_task_impl;
+struct task_graph_data;
+
+//! Interface used to get notified when one run of a task_graph is complete
+struct task_graph_listener {
+    virtual ~task_graph_listener() = default;
+
+    //! Called after all the nodes of the graph were executed (or cancelled).
+    //! `ex` is the first exception thrown by a node of the graph, if any.
+    virtual void on_graph_done(bool cancelled, std::exception_ptr ex) noexcept = 0;
+};
+
+//! Starts one run of the graph; the listener (can be null) is notified at the end of the run.
+void start_task_graph(
+        const std::shared_ptr<task_graph_data>& data, task_graph_listener* listener) noexcept;
+
+//! Listener that forwards the completion of a task_graph run to a receiver.
+//! Allocated when the operation is started, and deletes itself after notifying the receiver.
+template <typename R>
+struct task_graph_receiver_listener : task_graph_listener {
+    R receiver_;
+
+    explicit task_graph_receiver_listener(R&& r)
+        : receiver_((R &&) r) {}
+
+    void on_graph_done(bool cancelled, std::exception_ptr ex) noexcept override {
+        if (cancelled)
+            concore::set_done((R &&) receiver_);
+        else if (ex)
+            concore::set_error((R &&) receiver_, std::move(ex));
+        else {
+            try {
+                concore::set_value((R &&) receiver_);
+            } catch (...) {
+                concore::set_error((R &&) receiver_, std::current_exception());
+            }
+        }
+        delete this;
+    }
+};
+
+//! The operation state returned when connecting a task_graph (as a sender) to a receiver.
+//! The operation state doesn't need to outlive the call to start(); the receiver is moved into a
+//! listener object that lives until the end of the graph run.
+template <typename R>
+struct task_graph_oper {
+    std::shared_ptr<task_graph_data> data_;
+    R receiver_;
+
+    task_graph_oper(std::shared_ptr<task_graph_data> data, R r)
+        : data_(std::move(data))
+        , receiver_((R &&) r) {}
+
+    void start() noexcept {
+        task_graph_listener* listener{nullptr};
+        try {
+            listener = new task_graph_receiver_listener<R>((R &&) receiver_);
+        } catch (...) {
+            concore::set_error((R &&) receiver_, std::current_exception());
+            return;
+        }
+        // From this point on, the listener is responsible for notifying the receiver
+        start_task_graph(data_, listener);
+    }
+};
+
 } // namespace detail
 
 inline namespace v1 {
@@ -182,5 +256,415 @@ void add_dependencies(chained_task prev, std::initializer_list<chained_task> nex
  */
 void add_dependencies(std::initializer_list<chained_task> prevs, chained_task next);
 
+/**
+ * @brief      A task that can be part of a graph that is built concurrently with its execution.
+ *
+ * Similar to @ref chained_task, but dependencies can be added from any thread, at any time, even
+ * while the predecessor task is executing, or after it has completed. This is useful for dataflow
+ * engines, in which the dependencies are discovered on the fly.
+ *
+ * A dataflow_task is executed only once. After creating the task, one can add dependencies to it
+ * (with @ref add_dependency() or @ref add_dependencies()), and then call @ref start() to indicate
+ * that the task can be executed as soon as all its predecessors are complete. If the task doesn't
+ * have any active predecessors, @ref start() will immediately pass the task to its executor.
+ *
+ * When adding a dependency to a predecessor that already completed, the dependency is already
+ * satisfied: the successor doesn't need to wait for it. Adding a dependency to a predecessor that
+ * is still running (or not yet started) will make the successor wait for the predecessor.
+ *
+ * New predecessors can be added to a task only while the task is not yet released for execution:
+ * either before calling @ref start(), or from a context in which one of the predecessors of the
+ * task is guaranteed to not be completed (e.g., from the body of a predecessor).
+ *
+ * Adding a dependency is lock-free: it increments the number of predecessors of the successor, and
+ * pushes the successor in a lock-free list of successors of the predecessor (one allocation).
+ *
+ * The task is executed with the executor given at construction (by default, the @ref
+ * spawn_executor).
+ *
+ * If a task throws an exception, the handler in the associated @ref task_group is called (if set)
+ * and the execution of the graph will continue. Similarly, if a task from the graph is canceled,
+ * the successors are still released.
+ *
+ * The graph must be acyclic. Cyclic graphs will never be executed.
+ *
+ * Copying a dataflow_task object creates a new handle to the same task.
+ *
+ * @see chained_task, add_dependency(), add_dependencies()
+ */
+class dataflow_task {
+public:
+    /**
+     * Default constructor. Constructs an invalid @ref dataflow_task.
+     * Such a task cannot be placed in a graph of tasks.
+     */
+    dataflow_task() = default;
+
+    /**
+     * @brief      Constructor
+     *
+     * @param      t         The task to be executed
+     * @param      executor  The executor used to execute the task (optional)
+     *
+     * @details
+     *
+     * If no executor is given, the @ref spawn_executor will be used.
+     */
+    explicit dataflow_task(task t, any_executor executor = {});
+    //! @overload
+    template <typename F>
+    explicit dataflow_task(F f, any_executor executor = {})
+        : dataflow_task(task{std::forward<F>(f)}, executor) {}
+
+    /**
+     * @brief      Allows the task to be executed once all its predecessors are complete.
+     *
+     * @details
+     *
+     * This must be called exactly once for each task. If the task doesn't have any uncompleted
+     * predecessors, this will execute the task with the executor given at construction.
+     */
+    void start() noexcept;
+
+    //! Returns true if the task was executed (and the successors were released)
+    bool is_done() const noexcept;
+
+    //! Bool conversion operator; indicates if this is a valid task.
+    explicit operator bool() const noexcept { return static_cast<bool>(impl_); }
+
+private:
+    //! Implementation data for the task
+    std::shared_ptr<detail::dataflow_task_impl> impl_;
+
+    friend void add_dependency(dataflow_task, dataflow_task);
+    friend void add_dependencies(dataflow_task, std::initializer_list<dataflow_task>);
+    friend void add_dependencies(std::initializer_list<dataflow_task>, dataflow_task);
+};
+
+/**
+ * @brief      Add a dependency between two dataflow tasks.
+ *
+ * @param      prev  The task dependent on
+ * @param      next  The task that depends on `prev`
+ *
+ * @details
+ *
+ * This can be called from any thread, concurrently with the execution of `prev` and with other
+ * calls that add dependencies. If `prev` is already complete, this has no effect on `next`.
+ *
+ * `next` must not be already released for execution.
+ *
+ * @see dataflow_task
+ */
+void add_dependency(dataflow_task prev, dataflow_task next);
+
+/**
+ * @brief      Add a dependency from a dataflow task to a list of dataflow tasks
+ *
+ * @param      prev   The task dependent on
+ * @param      nexts  A set of tasks that all depend on `prev`
+ *
+ * @see dataflow_task, add_dependency(dataflow_task, dataflow_task)
+ */
+void add_dependencies(dataflow_task prev, std::initializer_list<dataflow_task> nexts);
+
+/**
+ * @brief      Add a dependency from list of dataflow tasks to a dataflow task
+ *
+ * @param      prevs  The list of tasks that `next` is dependent on
+ * @param      next   The task that depends on all the `prevs` tasks
+ *
+ * @see dataflow_task, add_dependency(dataflow_task, dataflow_task)
+ */
+void add_dependencies(std::initializer_list<dataflow_task> prevs, dataflow_task next);
+
+class task_graph_builder;
+
+/**
+ * @brief      Optimizations that can be applied when building a @ref task_graph
+ *
+ * These optimizations reduce the number of tasks created when running the graph, and the number
+ * of dependencies that need to be tracked. The execution of the graph remains semantically
+ * equivalent: a node is still executed only after all its predecessors were executed.
+ *
+ * The following optimizations are available:
+ *  - removing the edges that are implied by other paths in the graph (transitive edges)
+ *  - merging sibling nodes (nodes with the same predecessors and same successors) that have a
+ *    small cost; the merged nodes are executed sequentially in the same task
+ *  - fusing chains of nodes: if a node has only one successor, and the successor has only one
+ *    predecessor, the two nodes are executed sequentially in the same task
+ *
+ * When nodes are executed in the same task, an exception thrown by one node is reported to the task
+ * group, and the execution continues with the following nodes, just as if they were executed as
+ * separate tasks. Cancellation is checked before executing each node.
+ *
+ * @see task_graph_builder::set_optimizations()
+ */
+struct task_graph_optimizations {
+    //! Indicates whether we should fuse chains of nodes into one task
+    bool fuse_chains_{true};
+    //! Indicates whether we should remove the edges that are implied by other paths in the graph
+    bool remove_transitive_edges_{true};
+    //! Sibling nodes with costs below this threshold are merged; 0 means never merge siblings
+    double merge_threshold_{0.0};
+};
+
+/**
+ * @brief      A graph of tasks that is built once and can be executed multiple times.
+ *
+ * As opposed to graphs made of @ref chained_task objects, which can be executed only once, this
+ * graph is built upfront with a @ref task_graph_builder, and then it can be run any number of
+ * times. At build time, the graph is flattened into arrays: the node functions, the successor lists
+ * (in compressed sparse row format) and the initial predecessor counts for each node. Running the
+ * graph only resets the predecessor counters and starts the nodes without predecessors; no memory
+ * allocation is needed for the graph structure itself.
+ *
+ * A node will be executed only after all its predecessors are executed. The nodes are executed
+ * through the executor given to the builder (by default, the @ref spawn_executor).
+ *
+ * Only one run of the graph can be active at a given time. Starting a new run while the graph is
+ * still running is undefined behavior.
+ *
+ * To reduce the time needed to run the whole graph, the nodes on the critical path are prioritized.
+ * At build time, we compute the upward rank of each node: the cost of the longest path from the
+ * node to a node without successors. If multiple nodes become ready at the same time, the ones
+ * with higher rank are started first. The cost of each node can be given when adding the node to
+ * the builder, or it can be measured while running the graph (see
+ * @ref task_graph_builder::set_measure_costs()).
+ *
+ * If a node throws an exception, the exception handler of the task group is called (if set) and
+ * the execution of the graph continues. If the task group of the graph is cancelled, the remaining
+ * nodes are skipped, but the run still completes.
+ *
+ * This is also a sender that sends no values. Starting the operation obtained by connecting the
+ * graph to a receiver will run the graph. At the end of the run, `set_value()` is called if all
+ * nodes completed successfully, `set_error()` is called with the first exception thrown by a node,
+ * and `set_done()` is called if the task group was cancelled.
+ *
+ * Copying a task_graph object creates a new handle to the same graph.
+ *
+ * @see task_graph_builder, chained_task
+ */
+class task_graph {
+public:
+    //! The value types that defines the values that this sender sends to receivers
+    template <template <typename...> class Tuple, template <typename...> class Variant>
+    using value_types = Variant<Tuple<>>;
+    //! The type of error that this sender sends to receiver
+    template <template <typename...> class Variant>
+    using error_types = Variant<std::exception_ptr>;
+    //! Indicates that this sender can send a done signal (if the graph is cancelled)
+    static constexpr bool sends_done = true;
+
+    //! Default constructor. Creates an invalid graph; use @ref task_graph_builder to create graphs.
+    task_graph() = default;
+
+    /**
+     * @brief      Starts executing the graph.
+     *
+     * @details
+     *
+     * This resets the predecessor counts for all the nodes and starts executing the nodes that
+     * don't have any predecessors. It returns immediately, without waiting for the nodes to be
+     * executed.
+     *
+     * @see wait(), run_and_wait()
+     */
+    void run();
+
+    /**
+     * @brief      Wait for the current run of the graph to complete.
+     *
+     * @details
+     *
+     * This is a busy-wait; the calling thread will try to execute tasks while waiting.
+     *
+     * @see run(), run_and_wait()
+     */
+    void wait();
+
+    //! Runs the graph, and waits for it to complete.
+    void run_and_wait();
+
+    //! Returns the number of nodes in the graph (as added to the builder)
+    int num_nodes() const noexcept;
+
+    //! Returns the number of tasks created for each run of the graph. If optimizations were
+    //! applied when building the graph, this may be smaller than the number of nodes.
+    int num_tasks() const noexcept;
+
+    /**
+     * @brief      Returns the upward rank of the given node.
+     *
+     * @param      node  The index of the node, as returned by @ref task_graph_builder::add_node()
+     *
+     * @return     The cost of the longest path from the node to a node without successors
+     *
+     * @details
+     *
+     * The rank of a node is its cost plus the maximum rank of its successors. If the costs are
+     * measured, the ranks are updated at the end of each run. This should not be called while the
+     * graph is running.
+     *
+     * If the node was merged with other nodes when optimizing the graph, this returns the rank of
+     * the task that executes the node.
+     */
+    double node_rank(int node) const noexcept;
+
+    //! Bool conversion operator; indicates if this is a valid graph.
+    explicit operator bool() const noexcept { return static_cast<bool>(data_); }
+
+    //! The connect CPO that returns an operation state object
+    template <typename R>
+    detail::task_graph_oper<detail::remove_cvref_t<R>> connect(R&& r) const {
+        return {data_, (R &&) r};
+    }
+
+private:
+    //! The data of the graph; shared between all the copies of the graph
+    std::shared_ptr<detail::task_graph_data> data_;
+
+    friend task_graph_builder;
+
+    //! Private constructor, used by the builder
+    explicit task_graph(std::shared_ptr<detail::task_graph_data> data)
+        : data_(std::move(data)) {}
+};
+
+/**
+ * @brief      Builder for @ref task_graph objects.
+ *
+ * Use @ref add_node() to add the nodes in the graph, @ref add_edge() to add dependencies between
+ * nodes, and then call @ref build() to obtain the graph. The nodes are identified by the indices
+ * returned by @ref add_node().
+ *
+ * The graph must be acyclic. If the graph contains cycles, @ref build() will throw.
+ *
+ * Example:
+ * @code{.cpp}
+ *      concore::task_graph_builder builder;
+ *      int a = builder.add_node([] { do_a(); });
+ *      int b = builder.add_node([] { do_b(); });
+ *      int c = builder.add_node([] { do_c(); });
+ *      builder.add_edge(a, c);
+ *      builder.add_edge(b, c);
+ *      concore::task_graph graph = builder.build();
+ *      for (int i = 0; i < num_frames; i++)
+ *          graph.run_and_wait();
+ * @endcode
+ *
+ * @see task_graph
+ */
+class task_graph_builder {
+public:
+    /**
+     * @brief      Constructor
+     *
+     * @param      grp   The group in which the tasks of the graph are executed (optional)
+     * @param      exe   The executor used to execute the nodes of the graph (optional)
+     *
+     * @details
+     *
+     * If no executor is given, the @ref spawn_executor will be used.
+     *
+     * The graph will use a task group that is a child of the given task group. Cancelling the
+     * given group will cancel the execution of the graph.
+     */
+    task_graph_builder();
+    //! @overload
+    explicit task_graph_builder(task_group grp);
+    //! @overload
+    task_graph_builder(task_group grp, any_executor exe);
+    //! @overload
+    explicit task_graph_builder(any_executor exe);
+
+    /**
+     * @brief      Adds a node in the graph.
+     *
+     * @param      f     The function to be executed for this node
+     * @param      cost  The estimated cost of executing the node (optional)
+     *
+     * @return     The index of the added node
+     *
+     * @details
+     *
+     * The costs are used to determine the critical path of the graph. Only the relative values
+     * matter. If no cost is given, all nodes are considered to have the same cost.
+     */
+    int add_node(task_function f, double cost = 1.0);
+
+    /**
+     * @brief      Adds a dependency between two nodes.
+     *
+     * @param      prev  The index of the node dependent on
+     * @param      next  The index of the node that depends on `prev`
+     *
+     * @details
+     *
+     * `next` will be executed only after `prev` is completed.
+     */
+    void add_edge(int prev, int next);
+
+    /**
+     * @brief      Sets whether to measure the execution time of the nodes
+     *
+     * @param      val   True if we need to measure the execution time of the nodes
+     *
+     * @details
+     *
+     * If this is set, the graph measures the duration of each node while running, and uses these
+     * durations as node costs for the subsequent runs (replacing the costs given to
+     * @ref add_node()). This adds a small overhead to the execution of each node.
+     *
+     * The measured costs are in nanoseconds. After the first measurement, the given costs of the
+     * nodes that were not measured (e.g., nodes that threw) are scaled to the same unit, with the
+     * ratio between the measured durations and the given costs of the measured nodes.
+     */
+    void set_measure_costs(bool val);
+
+    /**
+     * @brief      Sets the optimizations to be applied when building the graph
+     *
+     * @param      opts  The optimizations to be applied
+     *
+     * @details
+     *
+     * By default, no optimizations are applied; each node is executed in its own task. The
+     * indices of the nodes remain valid after optimizations.
+     *
+     * @see task_graph_optimizations
+     */
+    void set_optimizations(task_graph_optimizations opts);
+
+    /**
+     * @brief      Builds the graph.
+     *
+     * @return     The task graph that can be run multiple times
+     *
+     * @details
+     *
+     * After this call the builder is left empty.
+     *
+     * Throws `std::invalid_argument` if the graph contains cycles.
+     */
+    task_graph build();
+
+private:
+    //! The group in which the graph is executed
+    task_group group_;
+    //! The executor used for executing the nodes
+    any_executor executor_;
+    //! The functions for each of the nodes
+    std::vector<task_function> node_funs_;
+    //! The estimated costs for each of the nodes
+    std::vector<double> node_costs_;
+    //! Indicates whether we should measure the costs of the nodes while running
+    bool measure_costs_{false};
+    //! The optimizations to be applied when building the graph (none by default)
+    task_graph_optimizations optimizations_{false, false, 0.0};
+    //! The edges of the graph, as (prev, next) pairs
+    std::vector<std::pair<int, int>> edges_;
+};
+
 } // namespace v1
-} // namespace concore
\ No newline at end of file
+} // namespace concore
@@ -0,0 +1,530 @@
+/**
+ * @file    typed_pipeline.hpp
+ * @brief   Pipelines in which each stage can change the type of the line data
+ *
+ * @see     @ref concore::v1::typed_pipeline "typed_pipeline", @ref
+ *          concore::v1::typed_pipeline_builder "typed_pipeline_builder"
+ */
+#pragma once
+
+#include "concore/pipeline.hpp"
+
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace concore {
+
+namespace detail {
+
+/**
+ * @brief      Describes one stage of a typed pipeline
+ *
+ * @tparam     In      The type of the data that enters the stage
+ * @tparam     Out     The type of the data produced by the stage
+ * @tparam     F       The type of the functor of the stage
+ * @tparam     InIdx   The index of the input type in the line data variant
+ * @tparam     OutIdx  The index of the output type in the line data variant
+ *
+ * @details
+ *
+ * If the functor returns void, the stage modifies the data in place, and `Out` is the same as
+ * `In`; in this case `OutIdx == InIdx`.
+ */
+template <typename In, typename Out, typename F, size_t InIdx, size_t OutIdx>
+struct typed_stage {
+    //! The type of the data that enters the stage
+    using input_type = In;
+    //! The type of the data produced by the stage
+    using output_type = Out;
+    //! The index of the input type in the line data variant
+    static constexpr size_t in_idx = InIdx;
+    //! The index of the output type in the line data variant
+    static constexpr size_t out_idx = OutIdx;
+
+    //! The ordering of the stage
+    stage_ordering ord_;
+    //! The functor to be called for the stage
+    F fun_;
+};
+
+//! The result of calling stage functor `F` with an input of type `In`.
+//! The input is passed as an rvalue if the functor accepts it, so that it can be transformed
+//! without copies.
+template <typename F, typename In, typename = void>
+struct stage_call_result {
+    using type = std::invoke_result_t<const F&, In&>;
+    static constexpr bool pass_rvalue = false;
+};
+template <typename F, typename In>
+struct stage_call_result<F, In,
+        std::enable_if_t<std::is_invocable_v<const F&, In&&> &&
+                         !std::is_void_v<std::invoke_result_t<const F&, In&&>>>> {
+    using type = std::invoke_result_t<const F&, In&&>;
+    static constexpr bool pass_rvalue = true;
+};
+
+//! Given the line data types so far, `std::tuple<Ts...>`, computes the stage to be added for a
+//! functor of type `F`, and the new list of data types
+template <typename Types, typename F>
+struct add_typed_stage;
+template <typename... Ts, typename F>
+struct add_typed_stage<std::tuple<Ts...>, F> {
+    static constexpr size_t in_idx = sizeof...(Ts) - 1;
+    using in_type = std::tuple_element_t<in_idx, std::tuple<Ts...>>;
+    using res_type = typename stage_call_result<F, in_type>::type;
+    static constexpr bool in_place = std::is_void_v<res_type>;
+    using out_type = std::conditional_t<in_place, in_type, std::decay_t<res_type>>;
+
+    using types = std::conditional_t<in_place, std::tuple<Ts...>, std::tuple<Ts..., out_type>>;
+    using stage = typed_stage<in_type, out_type, F, in_idx, in_place ? in_idx : in_idx + 1>;
+};
+//! A filter stage doesn't change the type of the data
+template <typename... Ts, typename G>
+struct add_typed_stage<std::tuple<Ts...>, filter_stage_t<G>> {
+    static constexpr size_t in_idx = sizeof...(Ts) - 1;
+    using in_type = std::tuple_element_t<in_idx, std::tuple<Ts...>>;
+
+    using types = std::tuple<Ts...>;
+    using stage = typed_stage<in_type, in_type, filter_stage_t<G>, in_idx, in_idx>;
+};
+//! A flat-map stage emits lines of type `Out` (or of the input type, if `Out` is void)
+template <typename... Ts, typename Out, typename G>
+struct add_typed_stage<std::tuple<Ts...>, flat_map_stage_t<Out, G>> {
+    static constexpr size_t in_idx = sizeof...(Ts) - 1;
+    using in_type = std::tuple_element_t<in_idx, std::tuple<Ts...>>;
+    using out_type = std::conditional_t<std::is_void_v<Out>, in_type, Out>;
+
+    using types = std::tuple<Ts..., out_type>;
+    using stage = typed_stage<in_type, out_type, flat_map_stage_t<Out, G>, in_idx, in_idx + 1>;
+};
+
+//! The type of the line data for a typed pipeline with the given data types (`std::tuple<Ts...>`)
+template <typename Types>
+struct typed_pipeline_data;
+template <typename... Ts>
+struct typed_pipeline_data<std::tuple<Ts...>> {
+    using type = std::variant<Ts...>;
+};
+template <typename Types>
+using typed_pipeline_data_t = typename typed_pipeline_data<Types>::type;
+
+//! Creates a line holding the data of a typed pipeline, for the alternative `Idx` of `V`
+template <typename V, size_t Idx>
+inline line_base* make_typed_line(pipeline_data& data, std::variant_alternative_t<Idx, V>&& val) {
+    return create_line<V>(data, std::in_place_index<Idx>, std::move(val));
+}
+
+//! Calls the functor of a typed stage (other than flat-map) for the given line; the line data is of
+//! type `V` (a variant). Returns false if the line was filtered out by the stage.
+template <typename V, typename Stage, typename Fun>
+inline bool call_typed_stage(const Fun& work, line_base* line) {
+    auto& data = static_cast<typed_line<V>*>(line)->data_;
+    // Previous stages were successful, so we know exactly what the data holds
+    auto& in = *std::get_if<Stage::in_idx>(&data);
+    if constexpr (is_filter_stage<Fun>::value) {
+        if (!work.fun_(in)) {
+            line->stopped_ = 1;
+            return false;
+        }
+    } else {
+        using call_res = stage_call_result<Fun, typename Stage::input_type>;
+        if constexpr (Stage::in_idx == Stage::out_idx)
+            work(in);
+        else if constexpr (call_res::pass_rvalue)
+            data.template emplace<Stage::out_idx>(work(std::move(in)));
+        else
+            data.template emplace<Stage::out_idx>(work(in));
+    }
+    return true;
+}
+
+//! Adds a typed stage to the pipeline; the line data is of type `V` (a variant)
+template <typename V, typename Stage>
+inline void add_typed_stage_to(pipeline_impl& impl, Stage&& stage) {
+    using stage_t = std::decay_t<Stage>;
+    using fun_t = decltype(stage.fun_);
+    if constexpr (is_flat_map_stage<fun_t>::value) {
+        using out_t = typename stage_t::output_type;
+        impl.do_add_expand_stage(stage.ord_,
+                [work = std::move(stage.fun_.fun_)](line_base* line, line_emitter& em) {
+                    auto& data = static_cast<typed_line<V>*>(line)->data_;
+                    pipeline_emitter<out_t> emitter{em, &make_typed_line<V, stage_t::out_idx>};
+                    work(*std::get_if<stage_t::in_idx>(&data), emitter);
+                });
+    } else {
+        impl.do_add_stage(stage.ord_, [work = std::move(stage.fun_)](line_base* line) {
+            call_typed_stage<V, stage_t>(work, line);
+        });
+    }
+}
+
+//! Checks if a typed stage can be fused with the neighboring stages: it must be concurrent, and it
+//! must not emit new lines
+template <typename Stage>
+inline bool is_fusable_stage(const Stage& stage) {
+    return stage.ord_ == stage_ordering::concurrent &&
+           !is_flat_map_stage<decltype(stage.fun_)>::value;
+}
+
+//! Returns the number of consecutive stages, starting with stage `I`, that can be fused
+template <size_t I, typename Stages>
+inline size_t count_fusable_stages(const Stages& stages) {
+    if constexpr (I < std::tuple_size_v<Stages>) {
+        if (is_fusable_stage(std::get<I>(stages)))
+            return 1 + count_fusable_stages<I + 1>(stages);
+    }
+    return 0;
+}
+
+//! Calls the functors of `count` consecutive stages, starting with stage `I`, for the given line;
+//! stops if a stage filters out the line. The stages must be fusable.
+template <typename V, size_t I, typename Stages>
+inline void call_typed_stages(const Stages& stages, line_base* line, size_t count) {
+    if constexpr (I < std::tuple_size_v<Stages>) {
+        using stage_t = std::tuple_element_t<I, Stages>;
+        if constexpr (!is_flat_map_stage<decltype(stage_t::fun_)>::value) {
+            if (count > 0 && call_typed_stage<V, stage_t>(std::get<I>(stages).fun_, line))
+                call_typed_stages<V, I + 1>(stages, line, count - 1);
+        }
+    }
+}
+
+//! Adds the typed stages to the pipeline, starting with stage `I`, and skipping the first `skip`
+//! stages. Consecutive concurrent stages are fused into one pipeline stage, which calls their
+//! functors directly, so that a line goes through one type-erased call for all of them.
+template <typename V, size_t I, typename Stages>
+inline void add_typed_stages_from(
+        pipeline_impl& impl, const std::shared_ptr<Stages>& stages, size_t skip) {
+    if constexpr (I < std::tuple_size_v<Stages>) {
+        if (skip == 0) {
+            size_t count = count_fusable_stages<I>(*stages);
+            if (count > 1) {
+                // The fused stage shares the stage functors with the other fused stages
+                impl.do_add_stage(stage_ordering::concurrent, [stages, count](line_base* line) {
+                    call_typed_stages<V, I>(*stages, line, count);
+                });
+                skip = count;
+            } else {
+                add_typed_stage_to<V>(impl, std::move(std::get<I>(*stages)));
+                skip = 1;
+            }
+        }
+        add_typed_stages_from<V, I + 1>(impl, stages, skip - 1);
+    }
+}
+
+} // namespace detail
+
+inline namespace v1 {
+
+template <typename In, typename Types, typename... Stages>
+class typed_pipeline_builder;
+
+/**
+ * @brief      A pipeline in which stages can change the type of the line data
+ *
+ * @tparam     In    The type of the items pushed into the pipeline
+ *
+ * @details
+ *
+ * This is similar to @ref pipeline, with the difference that each stage receives the output of the
+ * previous stage, which can have a different type. For example, the stages of a pipeline can
+ * transform raw bytes into parsed records, then into enriched records, and then into serialized
+ * output.
+ *
+ * The objects of this type are created with @ref typed_pipeline_builder. The type of the pipeline
+ * only depends on the input type; the types of the intermediate data are erased.
+ *
+ * @see        typed_pipeline_builder, pipeline
+ */
+template <typename In>
+class typed_pipeline {
+public:
+    /**
+     * @brief      Pushes a new item (line) through the pipeline
+     *
+     * @param      line_data  The data associated with the line
+     *
+     * @details
+     *
+     * This will start processing from the first stage and will iteratively pass through all the
+     * stages of the pipeline. The first stage receives the given data, and each of the following
+     * stages receives the output of the stage before it.
+     */
+    void push(In&& line_data) {
+        impl_.do_start_line(make_line_(*impl_.data_, std::move(line_data)));
+    }
+    //! @overload
+    void push(const In& line_data) { push(In(line_data)); }
+
+    /**
+     * @brief      Tries to push a new item, without exceeding the concurrency limit
+     *
+     * @param      line_data  The data associated with the line
+     *
+     * @return     True if the line was started; false if the pipeline is at its concurrency limit
+     *
+     * @see        pipeline::try_push()
+     */
+    bool try_push(In&& line_data) {
+        return detail::try_start_line(impl_, [&](detail::pipeline_data& data) {
+            return make_line_(data, std::move(line_data));
+        });
+    }
+    //! @overload
+    bool try_push(const In& line_data) {
+        // Copy the data only if the line can be started
+        return detail::try_start_line(impl_, [&](detail::pipeline_data& data) {
+            return make_line_(data, In(line_data));
+        });
+    }
+
+    /**
+     * @brief      Pushes a new item, waiting for the number of lines in flight to be below the
+     *             concurrency limit
+     *
+     * @param      line_data  The data associated with the line
+     *
+     * @see        pipeline::blocking_push()
+     */
+    void blocking_push(In&& line_data) {
+        while (!try_push(std::move(line_data)))
+            impl_.wait_for_free_slot();
+    }
+    //! @overload
+    void blocking_push(const In& line_data) {
+        while (!try_push(line_data))
+            impl_.wait_for_free_slot();
+    }
+
+    /**
+     * @brief      Makes the pipeline pull its items from the given generator
+     *
+     * @param      gen   The generator of items; must return `std::optional<In>`
+     *
+     * @see        pipeline::pull_from()
+     */
+    template <typename G>
+    void pull_from(G&& gen) {
+        impl_.do_pull_from(detail::create_line_source(std::forward<G>(gen), make_line_));
+    }
+
+    /**
+     * @brief      Enables or disables collecting per-stage stats
+     *
+     * @param      val   True if we need to collect stats
+     *
+     * @see        pipeline::set_collect_stats()
+     */
+    void set_collect_stats(bool val) { impl_.set_collect_stats(val); }
+
+    /**
+     * @brief      Returns a snapshot of the pipeline stats
+     *
+     * @return     The stats of the pipeline and of each of its stages
+     *
+     * @see        pipeline::stats()
+     */
+    pipeline_stats stats() const { return impl_.get_stats(); }
+
+private:
+    //! Type of the function that creates a line for the given input
+    using make_line_fun = detail::line_base* (*)(detail::pipeline_data&, In&&);
+
+    //! Implementation details of the pipeline; with type erasure
+    detail::pipeline_impl impl_;
+    //! Function that creates a line with the right data type for the given input
+    make_line_fun make_line_;
+
+    template <typename, typename, typename...>
+    friend class typed_pipeline_builder;
+
+    //! Private constructor
+    typed_pipeline(detail::pipeline_impl&& impl, make_line_fun make_line)
+        : impl_(std::move(impl))
+        , make_line_(make_line) {}
+};
+
+/**
+ * @brief      Front-end to create @ref typed_pipeline objects, where stages can change the type
+ *             of the line data
+ *
+ * @tparam     In      The type of the items pushed into the pipeline
+ * @tparam     Types   The types of the line data so far, as `std::tuple<Ts...>`
+ * @tparam     Stages  The stages added so far
+ *
+ * @details
+ *
+ * Users only need to name the first template parameter; the others are deduced while adding
+ * stages. Each time a stage is added, a new builder object is returned, having the new stage as
+ * part of its type. This way, the chain of stages is a compile-time list, and the type of the data
+ * between any two stages is known at compile time. When the pipeline is created, consecutive
+ * `concurrent` stages (including filter stages) are fused into one stage of the underlying
+ * pipeline, which calls their functors directly, with their exact input types; a line goes
+ * through one type-erased call for all of them. The other stages are wrapped in type-erased
+ * function objects, one per stage, like the stages of @ref pipeline. The stats of the pipeline
+ * report the fused stages as one stage.
+ *
+ * A stage functor receives the output of the previous stage (or the pushed item, for the first
+ * stage). If it returns a value, the value is the input of the next stage; the input is passed as
+ * an rvalue, if the functor accepts it. If it returns void, the stage is considered to modify the
+ * data in place, and the next stage receives the same (possibly modified) object.
+ *
+ * Stages can also be created with filter_stage() and flat_map_stage(). For flat-map stages, the
+ * type of the emitted data needs to be given explicitly, e.g., `flat_map_stage<record>(f)`, unless
+ * it is the same as the input type; the functor receives a `pipeline_emitter<record>&`.
+ *
+ * Example:
+ * @code
+ *      auto my_pipeline = concore::typed_pipeline_builder<std::string>()
+ *          | concore::stage_ordering::concurrent
+ *          | [](std::string raw) { return parse(raw); }
+ *          | [](record r) { return enrich(std::move(r)); }
+ *          | concore::stage_ordering::in_order
+ *          | [&](const enriched_record& r) { out << serialize(r); }
+ *          | concore::pipeline_end;
+ *      for (auto& line : lines)
+ *          my_pipeline.push(line);
+ * @endcode
+ *
+ * @see     typed_pipeline, pipeline_builder
+ */
+template <typename In, typename Types = std::tuple<In>, typename... Stages>
+class typed_pipeline_builder {
+public:
+    /**
+     * @brief      Constructs a pipeline builder object
+     *
+     * @param      max_concurrency  The concurrency limit for the pipeline
+     */
+    explicit typed_pipeline_builder(int max_concurrency = 0xffff)
+        : impl_(max_concurrency) {}
+    /**
+     * @brief      Constructs a pipeline builder object
+     *
+     * @param      max_concurrency  The concurrency limit for the pipeline
+     * @param      grp              The group in which tasks need to be executed
+     */
+    typed_pipeline_builder(int max_concurrency, task_group grp)
+        : impl_(max_concurrency, std::move(grp)) {}
+    /**
+     * @brief      Constructs a pipeline builder object
+     *
+     * @param      max_concurrency  The concurrency limit for the pipeline
+     * @param      grp              The group in which tasks need to be executed
+     * @param      exe              The executor to be used by the pipeline
+     */
+    typed_pipeline_builder(int max_concurrency, task_group grp, any_executor exe)
+        : impl_(max_concurrency, std::move(grp), std::move(exe)) {}
+    /**
+     * @brief      Constructs a pipeline builder object
+     *
+     * @param      max_concurrency  The concurrency limit for the pipeline
+     * @param      exe              The executor to be used by the pipeline
+     */
+    typed_pipeline_builder(int max_concurrency, any_executor exe)
+        : impl_(max_concurrency, std::move(exe)) {}
+
+    /**
+     * @brief      Adds a stage to the pipeline
+     *
+     * @param      ord   The ordering for the stage
+     * @param      work  The work to be done in this stage
+     *
+     * @tparam     F     The type of the work
+     *
+     * @return     A new builder object, that also contains the new stage
+     *
+     * @details
+     *
+     * The functor will be called with the output of the previous stage. After this call, this
+     * builder object can no longer be used.
+     */
+    template <typename F>
+    auto add_stage(stage_ordering ord, F&& work) && {
+        using add_t = detail::add_typed_stage<Types, std::decay_t<F>>;
+        using next_builder_t =
+                typed_pipeline_builder<In, typename add_t::types, Stages..., typename add_t::stage>;
+        typename add_t::stage stage{ord, std::forward<F>(work)};
+        return next_builder_t(std::move(impl_),
+                std::tuple_cat(std::move(stages_), std::make_tuple(std::move(stage))), ord);
+    }
+
+    /**
+     * @brief      Creates the actual pipeline object, ready to process items
+     *
+     * @return     Resulting @ref typed_pipeline object.
+     *
+     * @details
+     *
+     * After calling this, the builder object cannot be used anymore.
+     */
+    typed_pipeline<In> build() && {
+        using line_data_t = detail::typed_pipeline_data_t<Types>;
+        auto stages = std::make_shared<std::tuple<Stages...>>(std::move(stages_));
+        detail::add_typed_stages_from<line_data_t, 0>(impl_, stages, 0);
+        return typed_pipeline<In>(std::move(impl_), &detail::make_typed_line<line_data_t, 0>);
+    }
+
+    /**
+     * @brief      Pipe operator to specify the ordering for the next stages
+     *
+     * @param      ord   The ordering to be applied to next stages
+     *
+     * @return     The same builder object
+     */
+    typed_pipeline_builder&& operator|(stage_ordering ord) && {
+        next_ordering_ = ord;
+        return std::move(*this);
+    }
+
+    /**
+     * @brief      Pipe operator to add new stages to the pipeline
+     *
+     * @param      work  The work corresponding to the stage
+     *
+     * @tparam     F     The type of the functor
+     *
+     * @return     A new builder object, that also contains the new stage
+     *
+     * @details
+     *
+     * This adds a new stage to the pipeline, using the latest specified stage ordering. If no stage
+     * ordering is specified, before adding this stage, the `in_order` is used.
+     */
+    template <typename F>
+    auto operator|(F&& work) && {
+        return std::move(*this).add_stage(next_ordering_, std::forward<F>(work));
+    }
+
+    /**
+     * @brief      Pipe operator to a tag that tells us that we are done building the pipeline
+     *
+     * @return     The @ref typed_pipeline object built by this builder.
+     */
+    typed_pipeline<In> operator|(pipeline_end_t) && { return std::move(*this).build(); }
+
+private:
+    //! Implementation details of the pipeline; with type erasure
+    detail::pipeline_impl impl_;
+    //! The stages added so far; they will be added to `impl_` when building the pipeline
+    std::tuple<Stages...> stages_;
+    //! The next stage ordering to apply
+    stage_ordering next_ordering_{stage_ordering::in_order};
+
+    template <typename, typename, typename...>
+    friend class typed_pipeline_builder;
+
+    //! Constructor used when adding a new stage
+    typed_pipeline_builder(
+            detail::pipeline_impl&& impl, std::tuple<Stages...>&& stages, stage_ordering ord)
+        : impl_(std::move(impl))
+        , stages_(std::move(stages))
+        , next_ordering_(ord) {}
+};
+
+} // namespace v1
+} // namespace concore
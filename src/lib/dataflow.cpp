@@ -0,0 +1,109 @@
+#include "concore/dataflow.hpp"
+#include "concore/task_graph.hpp"
+#include "concore/spawn.hpp"
+#include "concore/profiling.hpp"
+#include "concore/low_level/spin_mutex.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace concore {
+
+inline namespace v1 {
+
+//! The implementation details of a dataflow_graph
+struct dataflow_graph::impl {
+    //! The history of accesses for one object
+    struct access_history {
+        //! The last task that writes the object
+        dataflow_task last_writer_;
+        //! The tasks that read the object after the last write
+        std::vector<dataflow_task> readers_;
+    };
+
+    //! The group in which the tasks are executed
+    task_group group_;
+    //! The executor used to execute the tasks
+    any_executor executor_;
+    //! Protects the access histories
+    spin_mutex bottleneck_;
+    //! The access history for each object
+    std::unordered_map<const void*, access_history> histories_;
+
+    impl(const task_group& grp, any_executor exe)
+        : group_(task_group::create(grp))
+        , executor_(exe ? std::move(exe) : any_executor{spawn_executor{}}) {}
+
+    //! Adds the dependencies of task `t` for the given access, and updates the history
+    static void add_access(access_history& h, const dataflow_task& t, access_mode mode) {
+        if (mode == access_mode::read) {
+            // read-after-write
+            if (h.last_writer_)
+                add_dependency(h.last_writer_, t);
+            // From time to time, drop the readers that are already done
+            auto n = h.readers_.size();
+            if (n >= 16 && (n & (n - 1)) == 0)
+                h.readers_.erase(std::remove_if(h.readers_.begin(), h.readers_.end(),
+                                         [](const dataflow_task& r) { return r.is_done(); }),
+                        h.readers_.end());
+            h.readers_.push_back(t);
+        } else {
+            if (!h.readers_.empty()) {
+                // write-after-read; the readers already depend on the last writer
+                for (const auto& r : h.readers_)
+                    add_dependency(r, t);
+                h.readers_.clear();
+            } else if (h.last_writer_) {
+                // write-after-write
+                add_dependency(h.last_writer_, t);
+            }
+            h.last_writer_ = t;
+        }
+    }
+};
+
+dataflow_graph::dataflow_graph()
+    : impl_(std::make_shared<impl>(task_group{}, any_executor{})) {}
+dataflow_graph::dataflow_graph(task_group grp)
+    : impl_(std::make_shared<impl>(grp, any_executor{})) {}
+dataflow_graph::dataflow_graph(task_group grp, any_executor exe)
+    : impl_(std::make_shared<impl>(grp, std::move(exe))) {}
+dataflow_graph::dataflow_graph(any_executor exe)
+    : impl_(std::make_shared<impl>(task_group{}, std::move(exe))) {}
+
+void dataflow_graph::do_submit(task_function f, access_list accesses) {
+    CONCORE_PROFILING_SCOPE_N("dataflow_graph.submit");
+
+    // Combine the accesses to the same object; any write makes the access a write access
+    std::sort(accesses.begin(), accesses.end(),
+            [](const data_access& l, const data_access& r) { return l.addr_ < r.addr_; });
+    auto out = accesses.begin();
+    for (auto it = accesses.begin(); it != accesses.end(); ++it) {
+        if (out != accesses.begin() && (out - 1)->addr_ == it->addr_) {
+            if ((out - 1)->mode_ != it->mode_)
+                (out - 1)->mode_ = access_mode::read_write;
+        } else
+            *out++ = *it;
+    }
+    accesses.erase(out, accesses.end());
+
+    dataflow_task t{task{std::move(f), impl_->group_}, impl_->executor_};
+    {
+        std::lock_guard<spin_mutex> lock{impl_->bottleneck_};
+        for (const auto& a : accesses)
+            impl::add_access(impl_->histories_[a.addr_], t, a.mode_);
+    }
+    t.start();
+}
+
+void dataflow_graph::wait() {
+    concore::wait(impl_->group_);
+
+    // All the tasks are done; we don't need to keep the histories anymore
+    std::lock_guard<spin_mutex> lock{impl_->bottleneck_};
+    impl_->histories_.clear();
+}
+
+} // namespace v1
+} // namespace concore
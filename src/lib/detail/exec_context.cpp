@@ -29,6 +29,11 @@ exec_context::exec_context(const init_data& config)
     // Mark all the extra slots as being invalid
     for (auto& w : reserved_worker_slots_)
         w.state_.store(worker_thread_data::invalid);
+    // Give each worker an index; reserved slots come after the regular workers
+    for (int i = 0; i < count_; i++)
+        workers_data_[i].index_ = i;
+    for (int i = 0; i < reserved_slots_; i++)
+        reserved_worker_slots_[i].index_ = count_ + i;
     // Start the worker threads
     std::function<void()> worker_start_fun = config.worker_start_fun_;
     for (int i = 0; i < count_; i++) {
@@ -64,6 +69,7 @@ void exec_context::enqueue(task&& t, task_priority prio) {
     assert(p < num_priorities);
 
     // Push the task in the global queue, corresponding to the given prio
+    CONCORE_USDT_PROBE3(enqueue, &t, p, num_global_tasks_.load(std::memory_order_relaxed));
     enqueued_tasks_[p].push(std::move(t));
     on_task_added();
     num_global_tasks_++;
@@ -82,6 +88,7 @@ void exec_context::spawn(task&& t, bool wake_workers) {
     }
 
     // Add the task to the worker's queue
+    CONCORE_USDT_PROBE3(spawn, &t, data->index_, num_tasks_.load(std::memory_order_relaxed));
     data->local_tasks_.push(std::forward<task>(t));
     on_task_added();
 
@@ -90,7 +97,38 @@ void exec_context::spawn(task&& t, bool wake_workers) {
         wakeup_workers();
 }
 
+void exec_context::spawn_to(int worker_idx, task&& t) {
+    CONCORE_PROFILING_FUNCTION();
+    assert(0 <= worker_idx && worker_idx < count_);
+    auto& data = workers_data_[worker_idx];
+
+    // Add the task to the target worker's queue; only the worker itself can push directly to its
+    // list of tasks
+    CONCORE_USDT_PROBE3(spawn, &t, data.index_, num_tasks_.load(std::memory_order_relaxed));
+    if (&data == g_worker_data)
+        data.local_tasks_.push(std::forward<task>(t));
+    else
+        data.local_tasks_.push_remote(std::forward<task>(t));
+    on_task_added();
+
+    // Make sure the target worker will see the task; if it's the current worker, it will
+    if (&data != g_worker_data)
+        wakeup_worker(data);
+}
+
+bool exec_context::has_demand_for_tasks() const {
+    const worker_thread_data* data = g_worker_data;
+    if (data)
+        return data->local_tasks_.looks_empty();
+    else
+        return num_global_tasks_.load(std::memory_order_relaxed) == 0;
+}
+
 void exec_context::busy_wait_on(task_group& grp) {
+    busy_wait_until([&grp] { return !grp.is_active(); });
+}
+
+void exec_context::busy_wait_until(const std::function<bool()>& done) {
     worker_thread_data* data = g_worker_data;
 
     on_worker_active();
@@ -101,7 +139,7 @@ void exec_context::busy_wait_on(task_group& grp) {
     auto cur_pause = min_pause;
     while (true) {
         // Did we reach our goal?
-        if (!grp.is_active())
+        if (done())
             break;
 
         // Try to execute a task -- if we have a worker data
@@ -202,6 +240,7 @@ bool exec_context::try_extract_execute_task(worker_thread_data& worker_data) {
     for (int i = 0; i < count_; i++) {
         if (&workers_data_[i] != &worker_data) {
             if (workers_data_[i].local_tasks_.try_steal(t)) {
+                CONCORE_USDT_PROBE3(steal_success, &t, worker_data.index_, i);
                 execute_task(t);
                 return true;
             }
@@ -212,12 +251,16 @@ bool exec_context::try_extract_execute_task(worker_thread_data& worker_data) {
     if (num_active_extra_slots_.load(std::memory_order_acquire) > 0) {
         for (auto& wd : reserved_worker_slots_) {
             if (wd.local_tasks_.try_steal(t)) {
+                CONCORE_USDT_PROBE3(steal_success, &t, worker_data.index_, wd.index_);
                 execute_task(t);
                 return true;
             }
         }
     }
 
+    CONCORE_USDT_PROBE2(
+            steal_failure, worker_data.index_, num_tasks_.load(std::memory_order_relaxed));
+
     return false;
 }
 
@@ -225,7 +268,11 @@ void exec_context::try_sleep(worker_thread_data& worker_data) {
     on_worker_inactive();
     worker_data.state_.store(worker_thread_data::waiting);
     if (before_sleep(worker_data)) {
+        CONCORE_USDT_PROBE2(worker_sleep, worker_data.index_,
+                num_global_tasks_.load(std::memory_order_relaxed));
         worker_data.has_data_.wait();
+        CONCORE_USDT_PROBE2(worker_wake, worker_data.index_,
+                num_global_tasks_.load(std::memory_order_relaxed));
     }
     on_worker_active();
     worker_data.state_.store(worker_thread_data::running);
@@ -243,6 +290,11 @@ bool exec_context::before_sleep(worker_thread_data& worker_data) {
     for (int i = 0; i < new_active_wait_iterations; i++) {
         if (num_global_tasks_.load() > 0 || done_)
             return false;
+        // Tasks can also be added to our local queue by other threads (see spawn_to()). This is
+        // checked after setting the 'waiting' state, so these tasks either are seen here, or the
+        // thread adding them will see our state and wake us.
+        if (!worker_data.local_tasks_.empty())
+            return false;
         spinner.pause();
     }
 
@@ -316,12 +368,33 @@ void exec_context::wakeup_workers() {
     // If we are here, it means that all workers are woken up.
 }
 
+void exec_context::wakeup_worker(worker_thread_data& worker_data) {
+    // If the worker is spinning, it will check its queue again
+    int old = worker_thread_data::waiting;
+    if (worker_data.state_.compare_exchange_strong(old, worker_thread_data::running))
+        return;
+    // If it's sleeping, wake it up
+    if (old == worker_thread_data::idle &&
+            worker_data.state_.compare_exchange_strong(old, worker_thread_data::running))
+        worker_data.has_data_.signal();
+    // If the worker is running, it will pick the task after finishing its current work; if it's
+    // about to go to sleep, the task can still be stolen by any of the active workers.
+}
+
 // cppcheck-suppress constParameter
 void exec_context::execute_task(task& t) const {
     CONCORE_PROFILING_FUNCTION();
 
+#if CONCORE_ENABLE_USDT
+    int worker_idx = g_worker_data ? g_worker_data->index_ : -1;
+    CONCORE_USDT_PROBE3(task_begin, &t, worker_idx, num_tasks_.load(std::memory_order_relaxed));
     t();
     on_task_removed();
+    CONCORE_USDT_PROBE3(task_end, &t, worker_idx, num_tasks_.load(std::memory_order_relaxed));
+#else
+    t();
+    on_task_removed();
+#endif
 }
 
 void exec_context::on_worker_active() const {
@@ -393,7 +466,16 @@ void do_spawn_noexcept(exec_context& ctx, task&& t, bool wake_workers) noexcept
     }
 }
 
+void do_spawn_to(exec_context& ctx, int worker_idx, task&& t) {
+    ctx.spawn_to(worker_idx, std::move(t));
+}
+bool has_demand_for_tasks(const exec_context& ctx) { return ctx.has_demand_for_tasks(); }
+int current_worker_index() { return g_worker_data ? g_worker_data->index_ : -1; }
+
 void busy_wait_on(exec_context& ctx, task_group& grp) { ctx.busy_wait_on(grp); }
+void busy_wait_until(exec_context& ctx, const std::function<bool()>& done) {
+    ctx.busy_wait_until(done);
+}
 worker_thread_data* enter_worker(exec_context& ctx) { return ctx.enter_worker(); }
 void exit_worker(exec_context& ctx, worker_thread_data* worker_data) {
     ctx.exit_worker(worker_data);
@@ -0,0 +1,330 @@
+#include "concore/detail/simd_kernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// The kernels are written with the vector extensions of GCC and Clang; the same code is compiled
+// for each instruction set, by using the `target` attribute. The instruction set is chosen at
+// runtime, based on what the CPU supports.
+#if (CONCORE_CPP_COMPILER(gcc) || CONCORE_CPP_COMPILER(clang)) &&                                  \
+        (CONCORE_CPU_ARCH(x86_64) || defined(__aarch64__))
+#define CONCORE_SIMD_VECTOR_EXT 1
+#else
+#define CONCORE_SIMD_VECTOR_EXT 0
+#endif
+
+#if CONCORE_SIMD_VECTOR_EXT
+#define CONCORE_SIMD_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace concore {
+namespace detail {
+namespace simd {
+
+namespace {
+
+//! The scalar kernels; these process the elements one by one, exactly as the generic algorithms.
+template <typename T>
+struct scalar_kernels {
+    static T sum(const T* first, std::ptrdiff_t n, T init) {
+        for (std::ptrdiff_t i = 0; i < n; i++)
+            init = init + first[i];
+        return init;
+    }
+    static T min(const T* first, std::ptrdiff_t n, T init) {
+        for (std::ptrdiff_t i = 0; i < n; i++)
+            init = min_op{}(init, first[i]);
+        return init;
+    }
+    static T max(const T* first, std::ptrdiff_t n, T init) {
+        for (std::ptrdiff_t i = 0; i < n; i++)
+            init = max_op{}(init, first[i]);
+        return init;
+    }
+    static std::pair<T, T> minmax(const T* first, std::ptrdiff_t n, std::pair<T, T> init) {
+        for (std::ptrdiff_t i = 0; i < n; i++)
+            init = minmax_op{}(init, first[i]);
+        return init;
+    }
+    static T inclusive_sum(const T* first, std::ptrdiff_t n, T* d_first, T init) {
+        for (std::ptrdiff_t i = 0; i < n; i++) {
+            init = init + first[i];
+            d_first[i] = init;
+        }
+        return init;
+    }
+};
+
+#if CONCORE_SIMD_VECTOR_EXT
+
+//! A vector of `Bytes` bytes, with elements of type T
+template <typename T, int Bytes>
+struct vec {
+    typedef T type __attribute__((vector_size(Bytes)));
+    static constexpr std::ptrdiff_t lanes = Bytes / sizeof(T);
+};
+
+template <typename V, typename T>
+CONCORE_SIMD_INLINE V load(const T* p) {
+    V v;
+    std::memcpy(&v, p, sizeof(V));
+    return v;
+}
+template <typename V, typename T>
+CONCORE_SIMD_INLINE void store(T* p, V v) {
+    std::memcpy(p, &v, sizeof(V));
+}
+
+//! Moves the lanes of `x` up by `S` positions, filling the first lanes with zeros
+template <int S, typename V, std::size_t... I>
+CONCORE_SIMD_INLINE V shift_up(V x, std::index_sequence<I...>) {
+    constexpr int lanes = sizeof...(I);
+    return __builtin_shufflevector(x, V{}, (int(I) >= S ? int(I) - S : lanes + int(I))...);
+}
+
+//! Computes the inclusive prefix sums of the lanes of `x`, in log2(L) steps
+template <int S, int L, typename V>
+CONCORE_SIMD_INLINE V scan_lanes(V x) {
+    if constexpr (S < L)
+        return scan_lanes<S * 2, L>(x + shift_up<S>(x, std::make_index_sequence<L>{}));
+    else
+        return x;
+}
+
+//! The operations of the reduction kernels, on scalars and on vectors
+struct sum_kernel_op {
+    template <typename V, typename T>
+    static CONCORE_SIMD_INLINE V start(T) {
+        return V{};
+    }
+    template <typename U>
+    static CONCORE_SIMD_INLINE U combine(U acc, U x) {
+        return acc + x;
+    }
+};
+struct min_kernel_op {
+    template <typename V, typename T>
+    static CONCORE_SIMD_INLINE V start(T init) {
+        return V{} + init;
+    }
+    template <typename U>
+    static CONCORE_SIMD_INLINE U combine(U acc, U x) {
+        return x < acc ? x : acc;
+    }
+};
+struct max_kernel_op {
+    template <typename V, typename T>
+    static CONCORE_SIMD_INLINE V start(T init) {
+        return V{} + init;
+    }
+    template <typename U>
+    static CONCORE_SIMD_INLINE U combine(U acc, U x) {
+        return acc < x ? x : acc;
+    }
+};
+
+//! The vector kernels, for vectors of `Bytes` bytes
+template <typename T, int Bytes>
+struct vector_kernels {
+    using V = typename vec<T, Bytes>::type;
+    static constexpr std::ptrdiff_t L = vec<T, Bytes>::lanes;
+
+    //! Generic reduction, with 4 independent accumulators, to hide the latency of the operations
+    template <typename Op>
+    static CONCORE_SIMD_INLINE T reduce(const T* first, std::ptrdiff_t n, T init) {
+        V a0 = Op::template start<V>(init);
+        V a1 = a0;
+        V a2 = a0;
+        V a3 = a0;
+        std::ptrdiff_t i = 0;
+        for (; i + 4 * L <= n; i += 4 * L) {
+            a0 = Op::combine(a0, load<V>(first + i));
+            a1 = Op::combine(a1, load<V>(first + i + L));
+            a2 = Op::combine(a2, load<V>(first + i + 2 * L));
+            a3 = Op::combine(a3, load<V>(first + i + 3 * L));
+        }
+        for (; i + L <= n; i += L)
+            a0 = Op::combine(a0, load<V>(first + i));
+        V acc = Op::combine(Op::combine(a0, a1), Op::combine(a2, a3));
+        T res = init;
+        for (std::ptrdiff_t l = 0; l < L; l++)
+            res = Op::combine(res, T(acc[l]));
+        for (; i < n; i++)
+            res = Op::combine(res, first[i]);
+        return res;
+    }
+
+    static CONCORE_SIMD_INLINE std::pair<T, T> minmax(
+            const T* first, std::ptrdiff_t n, std::pair<T, T> init) {
+        V lo0 = V{} + init.first;
+        V lo1 = lo0;
+        V hi0 = V{} + init.second;
+        V hi1 = hi0;
+        std::ptrdiff_t i = 0;
+        for (; i + 2 * L <= n; i += 2 * L) {
+            V x0 = load<V>(first + i);
+            V x1 = load<V>(first + i + L);
+            lo0 = min_kernel_op::combine(lo0, x0);
+            lo1 = min_kernel_op::combine(lo1, x1);
+            hi0 = max_kernel_op::combine(hi0, x0);
+            hi1 = max_kernel_op::combine(hi1, x1);
+        }
+        V lo = min_kernel_op::combine(lo0, lo1);
+        V hi = max_kernel_op::combine(hi0, hi1);
+        for (std::ptrdiff_t l = 0; l < L; l++)
+            init = minmax_op{}(init, std::pair<T, T>{lo[l], hi[l]});
+        for (; i < n; i++)
+            init = minmax_op{}(init, first[i]);
+        return init;
+    }
+
+    static CONCORE_SIMD_INLINE T inclusive_sum(
+            const T* first, std::ptrdiff_t n, T* d_first, T init) {
+        V carry = V{} + init;
+        std::ptrdiff_t i = 0;
+        for (; i + L <= n; i += L) {
+            V x = scan_lanes<1, L>(load<V>(first + i)) + carry;
+            store(d_first + i, x);
+            carry = V{} + x[L - 1];
+        }
+        init = carry[0];
+        for (; i < n; i++) {
+            init = init + first[i];
+            d_first[i] = init;
+        }
+        return init;
+    }
+};
+
+// Instantiates the kernels for an instruction set, with the given `target` attribute.
+#define CONCORE_SIMD_KERNELS(name, target_attr, bytes)                                            \
+    template <typename T>                                                                          \
+    struct name {                                                                                  \
+        using impl = vector_kernels<T, bytes>;                                                     \
+        target_attr static T sum(const T* first, std::ptrdiff_t n, T init) {                       \
+            return impl::template reduce<sum_kernel_op>(first, n, init);                           \
+        }                                                                                          \
+        target_attr static T min(const T* first, std::ptrdiff_t n, T init) {                       \
+            return impl::template reduce<min_kernel_op>(first, n, init);                           \
+        }                                                                                          \
+        target_attr static T max(const T* first, std::ptrdiff_t n, T init) {                       \
+            return impl::template reduce<max_kernel_op>(first, n, init);                           \
+        }                                                                                          \
+        target_attr static std::pair<T, T> minmax(                                                 \
+                const T* first, std::ptrdiff_t n, std::pair<T, T> init) {                          \
+            return impl::minmax(first, n, init);                                                   \
+        }                                                                                          \
+        target_attr static T inclusive_sum(const T* first, std::ptrdiff_t n, T* d_first, T init) { \
+            return impl::inclusive_sum(first, n, d_first, init);                                   \
+        }                                                                                          \
+    };
+
+#if CONCORE_CPU_ARCH(x86_64)
+CONCORE_SIMD_KERNELS(sse2_kernels, , 16)
+CONCORE_SIMD_KERNELS(avx2_kernels, __attribute__((target("avx2"))), 32)
+CONCORE_SIMD_KERNELS(avx512_kernels, __attribute__((target("avx512f"))), 64)
+#else
+// NEON is always available on ARM64
+CONCORE_SIMD_KERNELS(neon_kernels, , 16)
+#endif
+
+#undef CONCORE_SIMD_KERNELS
+
+#endif
+
+isa detect_isa() {
+#if CONCORE_SIMD_VECTOR_EXT && CONCORE_CPU_ARCH(x86_64)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return isa::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return isa::avx2;
+    return isa::sse2;
+#elif CONCORE_SIMD_VECTOR_EXT
+    return isa::neon;
+#else
+    return isa::scalar;
+#endif
+}
+
+//! Calls `f` with the kernels of the given instruction set (or of the closest supported one)
+template <typename T, typename F>
+auto with_kernels(isa target, F&& f) {
+#if CONCORE_SIMD_VECTOR_EXT && CONCORE_CPU_ARCH(x86_64)
+    if (target != isa::scalar)
+        target = std::min(target, best_isa());
+    switch (target) {
+    case isa::avx512:
+        return f(avx512_kernels<T>{});
+    case isa::avx2:
+        return f(avx2_kernels<T>{});
+    case isa::scalar:
+        return f(scalar_kernels<T>{});
+    default:
+        return f(sse2_kernels<T>{});
+    }
+#elif CONCORE_SIMD_VECTOR_EXT
+    if (target == isa::scalar)
+        return f(scalar_kernels<T>{});
+    return f(neon_kernels<T>{});
+#else
+    return f(scalar_kernels<T>{});
+#endif
+}
+
+} // namespace
+
+isa best_isa() {
+    static const isa res = detect_isa();
+    return res;
+}
+
+isa baseline_isa() {
+#if CONCORE_SIMD_VECTOR_EXT && CONCORE_CPU_ARCH(x86_64)
+    return isa::sse2;
+#elif CONCORE_SIMD_VECTOR_EXT
+    return isa::neon;
+#else
+    return isa::scalar;
+#endif
+}
+
+template <typename T>
+T reduce_sum(isa target, const T* first, std::ptrdiff_t n, T init) {
+    return with_kernels<T>(target, [=](auto k) { return k.sum(first, n, init); });
+}
+template <typename T>
+T reduce_min(isa target, const T* first, std::ptrdiff_t n, T init) {
+    return with_kernels<T>(target, [=](auto k) { return k.min(first, n, init); });
+}
+template <typename T>
+T reduce_max(isa target, const T* first, std::ptrdiff_t n, T init) {
+    return with_kernels<T>(target, [=](auto k) { return k.max(first, n, init); });
+}
+template <typename T>
+std::pair<T, T> reduce_minmax(isa target, const T* first, std::ptrdiff_t n, std::pair<T, T> init) {
+    return with_kernels<T>(target, [=](auto k) { return k.minmax(first, n, init); });
+}
+template <typename T>
+T inclusive_sum(isa target, const T* first, std::ptrdiff_t n, T* d_first, T init) {
+    return with_kernels<T>(
+            target, [=](auto k) { return k.inclusive_sum(first, n, d_first, init); });
+}
+
+#define CONCORE_SIMD_INSTANTIATE(T)                                                                \
+    template T reduce_sum(isa, const T*, std::ptrdiff_t, T);                                       \
+    template T reduce_min(isa, const T*, std::ptrdiff_t, T);                                       \
+    template T reduce_max(isa, const T*, std::ptrdiff_t, T);                                       \
+    template std::pair<T, T> reduce_minmax(isa, const T*, std::ptrdiff_t, std::pair<T, T>);       \
+    template T inclusive_sum(isa, const T*, std::ptrdiff_t, T*, T);
+
+CONCORE_SIMD_INSTANTIATE(int32_t)
+CONCORE_SIMD_INSTANTIATE(int64_t)
+CONCORE_SIMD_INSTANTIATE(float)
+CONCORE_SIMD_INSTANTIATE(double)
+
+#undef CONCORE_SIMD_INSTANTIATE
+
+} // namespace simd
+} // namespace detail
+} // namespace concore
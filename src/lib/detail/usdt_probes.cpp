@@ -0,0 +1,15 @@
+#include "concore/detail/usdt_probes.hpp"
+
+#if CONCORE_ENABLE_USDT
+
+// The semaphores of the probes. They are placed in the `.probes` section, where the tracers expect
+// them; a tracer increments the semaphore of a probe while it is attached to it.
+#define CONCORE_USDT_DEFINE_SEMAPHORE(name)                                                        \
+    __attribute__((section(".probes"), used)) volatile unsigned short CONCORE_USDT_SEMAPHORE(      \
+            name) = 0;
+extern "C" {
+CONCORE_USDT_FOR_EACH_PROBE(CONCORE_USDT_DEFINE_SEMAPHORE)
+}
+#undef CONCORE_USDT_DEFINE_SEMAPHORE
+
+#endif
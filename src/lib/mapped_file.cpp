@@ -0,0 +1,142 @@
+#include "concore/mapped_file.hpp"
+#include "concore/detail/platform.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+
+#if CONCORE_PLATFORM_LINUX || CONCORE_PLATFORM_APPLE
+#define CONCORE_USE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define CONCORE_USE_MMAP 0
+#include <fstream>
+#endif
+
+namespace concore {
+
+inline namespace v1 {
+
+#if CONCORE_USE_MMAP
+
+namespace {
+//! Returns the size of a memory page
+size_t page_size() {
+    static const size_t res = size_t(sysconf(_SC_PAGESIZE));
+    return res;
+}
+
+//! Throws a system_error for the current errno value
+[[noreturn]] void throw_errno(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+} // namespace
+
+mapped_file::mapped_file(const char* path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        throw_errno("cannot open file");
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "cannot get the file size");
+    }
+    size_ = size_t(st.st_size);
+    if (size_ > 0) {
+        void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "cannot map file");
+        }
+        data_ = static_cast<const char*>(addr);
+        mapped_ = true;
+    }
+    // The mapping remains valid after closing the file
+    ::close(fd);
+}
+
+void mapped_file::release() noexcept {
+    if (mapped_)
+        ::munmap(const_cast<char*>(data_), size_);
+}
+
+void mapped_file::will_need(size_t offset, size_t len) const noexcept {
+    if (!mapped_ || offset >= size_)
+        return;
+    // Extend the range to page boundaries
+    size_t end = std::min(offset + len, size_);
+    size_t start = offset - offset % page_size();
+    ::madvise(const_cast<char*>(data_ + start), end - start, MADV_WILLNEED);
+}
+
+void mapped_file::dont_need(size_t offset, size_t len) const noexcept {
+    if (!mapped_ || offset >= size_)
+        return;
+    // Shrink the range to page boundaries; the partial pages may be used by the neighbor ranges.
+    // The last page of the file can be released entirely.
+    size_t ps = page_size();
+    size_t end = std::min(offset + len, size_);
+    size_t start = (offset + ps - 1) / ps * ps;
+    if (end != size_)
+        end -= end % ps;
+    if (start < end)
+        ::madvise(const_cast<char*>(data_ + start), end - start, MADV_DONTNEED);
+}
+
+#else
+
+mapped_file::mapped_file(const char* path) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f)
+        throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory),
+                "cannot open file");
+    size_ = size_t(f.tellg());
+    if (size_ > 0) {
+        char* buf = new char[size_];
+        f.seekg(0);
+        if (!f.read(buf, std::streamsize(size_))) {
+            delete[] buf;
+            throw std::system_error(std::make_error_code(std::errc::io_error), "cannot read file");
+        }
+        data_ = buf;
+    }
+}
+
+void mapped_file::release() noexcept { delete[] data_; }
+
+void mapped_file::will_need(size_t, size_t) const noexcept {}
+void mapped_file::dont_need(size_t, size_t) const noexcept {}
+
+#endif
+
+mapped_file::~mapped_file() { release(); }
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+    : data_(other.data_)
+    , size_(other.size_)
+    , mapped_(other.mapped_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.mapped_ = false;
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        release();
+        data_ = other.data_;
+        size_ = other.size_;
+        mapped_ = other.mapped_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.mapped_ = false;
+    }
+    return *this;
+}
+
+} // namespace v1
+} // namespace concore
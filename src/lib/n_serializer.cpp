@@ -4,6 +4,7 @@
 #include "concore/detail/consumer_bounded_queue.hpp"
 #include "concore/detail/utils.hpp"
 #include "concore/detail/enqueue_next.hpp"
+#include "concore/detail/usdt_probes.hpp"
 
 #include <atomic>
 #include <cassert>
@@ -63,6 +64,7 @@ struct n_serializer::impl : std::enable_shared_from_this<impl> {
     }
     //! Start executing the next task in our serializer
     void start_next_task(const any_executor& exec) {
+        CONCORE_USDT_PROBE1(n_serializer_handoff, this);
         auto t = processing_items_.extract_one();
         detail::enqueue_next(exec, std::move(t), except_fun_);
     }
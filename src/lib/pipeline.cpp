@@ -2,8 +2,16 @@
 #include "concore/pipeline.hpp"
 #include "concore/global_executor.hpp"
 #include "concore/serializer.hpp"
+#include "concore/task.hpp"
+#include "concore/task_cancelled.hpp"
 #include "concore/detail/consumer_bounded_queue.hpp"
+#include "concore/detail/exec_context_if.hpp"
+#include "concore/detail/library_data.hpp"
+#include "concore/detail/usdt_probes.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <utility>
 #include <vector>
 
 namespace concore {
@@ -11,40 +19,196 @@ namespace concore {
 namespace detail {
 
 //! The type of data needed to keep track of a line
-using line_ptr = std::shared_ptr<line_base>;
+using line_ptr = line_base*;
+
+//! Returns the current time, in nanoseconds; used for collecting stats
+inline int64_t now_ns() {
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+}
+
+//! The counters used to collect the stats for a stage; see pipeline_stage_stats
+struct stage_counters {
+    //! The number of times the stage function was executed
+    std::atomic<uint64_t> num_processed_{0};
+    //! The total time spent in the stage function, in nanoseconds
+    std::atomic<int64_t> busy_ns_{0};
+    //! The total time the lines spent in the reorder window, in nanoseconds
+    std::atomic<int64_t> wait_ns_{0};
+    //! The number of lines enqueued for this stage that haven't started executing it
+    std::atomic<int> backlog_{0};
+
+    stage_counters() = default;
+    //! Only used while adding stages, when nothing is executing
+    stage_counters(const stage_counters& other)
+        : num_processed_(other.num_processed_.load())
+        , busy_ns_(other.busy_ns_.load())
+        , wait_ns_(other.wait_ns_.load())
+        , backlog_(other.backlog_.load()) {}
+    stage_counters& operator=(const stage_counters&) = delete;
+};
+
+//! The lines waiting in the reorder window of an in_order stage, for one order index
+struct pending_lines {
+    //! The line with the `last_` flag set; the last line with this order index
+    line_ptr last_{nullptr};
+    //! The other lines (emitted from the same line), kept at index `sub_idx_ & (size-1)`; the size
+    //! is a power of two
+    std::vector<line_ptr> subs_;
+
+    //! Returns one of the lines kept here, or null if there are none
+    line_ptr any_line() const {
+        if (last_)
+            return last_;
+        for (auto line : subs_)
+            if (line)
+                return line;
+        return nullptr;
+    }
+};
 
 struct stage_data {
     //! The ordering to be applied in this stage
     const stage_ordering ord_;
     //! The function to be called for this stage (taking a line as parameter)
     const stage_fun fun_;
+    //! The function to be called for flat-map stages; empty for the other stages
+    const expand_fun expand_;
     //! The serializer to be used in the case of in_order and out_of_order execution
     serializer ser_;
 
-    //! A vector of pending lines, used in the case of in_order execution
-    //! The second element in the pair is the order_idx_ of the line.
-    std::vector<std::pair<line_ptr, int>> pending_lines_;
+    //! Reorder window for the lines that arrive too early in an in_order stage.
+    //! The lines are kept at index `order_idx_ & (size-1)`; the size is a power of two. The lines
+    //! with the same order_idx_ (emitted from the same line) are indexed by their sub_idx_.
+    std::vector<pending_lines> reorder_ring_;
     //! The next expected order_idx; used in in_order stages to ensure ordering
     int expected_order_idx_{0};
+    //! The next expected sub_idx, for lines with the expected order_idx
+    int expected_sub_idx_{0};
+    //! The order index given to the lines going out of an in_order stage
+    int next_out_order_idx_{0};
+    //! True if the next stage can be executed in the same task as this stage; this is the case for
+    //! consecutive concurrent stages
+    bool fuse_next_{false};
+    //! The counters used for the stats of this stage
+    stage_counters counters_;
 
-    stage_data(stage_ordering ord, stage_fun&& f, any_executor exe)
+    stage_data(stage_ordering ord, stage_fun&& f, expand_fun&& ef, any_executor exe)
         : ord_(ord)
         , fun_(std::move(f))
+        , expand_(std::move(ef))
         , ser_(exe) {}
 
-    //! Add a line in our pending list.
-    //! Keep the list sorted by order_idx.
+    //! Checks if the given line is the next line to be executed in an in_order stage
+    bool is_expected(line_ptr line) const {
+        return line->order_idx_ == expected_order_idx_ && line->sub_idx_ == expected_sub_idx_;
+    }
+
+    //! Called when the expected line starts executing in an in_order stage. Advances to the next
+    //! expected line, and gives the line a new order index, so that the lines going out of the
+    //! stage have consecutive order indices.
+    void advance(line_ptr line) {
+        if (line->last_) {
+            expected_order_idx_++;
+            expected_sub_idx_ = 0;
+        } else {
+            expected_sub_idx_++;
+        }
+        line->order_idx_ = next_out_order_idx_++;
+        line->sub_idx_ = 0;
+        line->last_ = 1;
+    }
+
+    //! Add a line in the reorder window.
     //! Note: access to this needs to be serialized
     void add_pending(line_ptr line) {
-        int order_idx = line->order_idx_;
-        auto comp = [](const std::pair<line_ptr, int>& p, int order_idx) {
-            return p.second < order_idx;
-        };
-        auto it = std::lower_bound(pending_lines_.begin(), pending_lines_.end(), order_idx, comp);
-        pending_lines_.insert(it, std::make_pair(std::move(line), order_idx));
+        // The distance to the expected line is bounded by the number of lines in flight
+        unsigned dist = unsigned(line->order_idx_) - unsigned(expected_order_idx_);
+        assert(dist < (1u << 30));
+        if (dist >= reorder_ring_.size())
+            grow_ring(dist + 1);
+        auto mask = unsigned(reorder_ring_.size() - 1);
+        pending_lines& slot = reorder_ring_[unsigned(line->order_idx_) & mask];
+        if (line->last_) {
+            assert(!slot.last_);
+            slot.last_ = line;
+            return;
+        }
+
+        // The lines emitted from the same line that didn't pass this stage are consecutive,
+        // starting from the expected sub_idx_; their number is limited by the emitter
+        bool is_cur = line->order_idx_ == expected_order_idx_;
+        unsigned sub_dist = unsigned(line->sub_idx_) - unsigned(is_cur ? expected_sub_idx_ : 0);
+        assert(sub_dist < (1u << 30));
+        if (sub_dist >= slot.subs_.size())
+            grow_subs(slot, sub_dist + 1);
+        line_ptr& pos = slot.subs_[unsigned(line->sub_idx_) & unsigned(slot.subs_.size() - 1)];
+        assert(!pos);
+        pos = line;
+    }
+
+    //! Extract the expected line from the reorder window, if present.
+    //! Note: access to this needs to be serialized
+    line_ptr take_expected() {
+        if (reorder_ring_.empty())
+            return nullptr;
+        auto mask = unsigned(reorder_ring_.size() - 1);
+        pending_lines& slot = reorder_ring_[unsigned(expected_order_idx_) & mask];
+        if (!slot.subs_.empty()) {
+            auto sub_mask = unsigned(slot.subs_.size() - 1);
+            line_ptr& pos = slot.subs_[unsigned(expected_sub_idx_) & sub_mask];
+            if (pos && is_expected(pos))
+                return std::exchange(pos, nullptr);
+        }
+        if (slot.last_ && is_expected(slot.last_))
+            return std::exchange(slot.last_, nullptr);
+        return nullptr;
+    }
+
+private:
+    //! Grows the reorder window so that it can hold at least `min_size` order indices.
+    //! We start small and double the size; the window never gets larger than twice the maximum
+    //! distance between the order indices of the lines in flight.
+    void grow_ring(unsigned min_size) {
+        size_t new_size = std::max(reorder_ring_.size(), size_t(16));
+        while (new_size < min_size)
+            new_size *= 2;
+        std::vector<pending_lines> new_ring(new_size);
+        auto new_mask = unsigned(new_size - 1);
+        for (auto& slot : reorder_ring_)
+            if (line_ptr line = slot.any_line())
+                new_ring[unsigned(line->order_idx_) & new_mask] = std::move(slot);
+        reorder_ring_.swap(new_ring);
+    }
+
+    //! Grows the part of a reorder window slot that keeps the emitted lines, so that it can hold
+    //! at least `min_size` consecutive sub-indices
+    static void grow_subs(pending_lines& slot, unsigned min_size) {
+        size_t new_size = std::max(slot.subs_.size(), size_t(4));
+        while (new_size < min_size)
+            new_size *= 2;
+        std::vector<line_ptr> new_subs(new_size, nullptr);
+        auto new_mask = unsigned(new_size - 1);
+        for (auto line : slot.subs_)
+            if (line)
+                new_subs[unsigned(line->sub_idx_) & new_mask] = line;
+        slot.subs_.swap(new_subs);
     }
 };
 
+//! The lines emitted from a line by a flat-map stage. Limits the number of emitted lines being
+//! processed; the other emitted lines wait here until some of the processed ones finish.
+struct emitted_lines {
+    //! The emitted lines that didn't finish processing, with a limit on the active ones
+    consumer_bounded_queue<line_ptr> lines_;
+    //! The number of emitted lines that didn't finish, plus one while the emitter is in use; the
+    //! object is deleted when this reaches zero
+    std::atomic<int> num_refs_{1};
+
+    explicit emitted_lines(int max_active)
+        : lines_(max_active) {}
+};
+
 //! All the data needed for the pipeline to run
 struct pipeline_data : std::enable_shared_from_this<pipeline_data> {
     //! The group to be used for all the tasks that we create here
@@ -59,27 +223,137 @@ struct pipeline_data : std::enable_shared_from_this<pipeline_data> {
     //! lines at a time
     consumer_bounded_queue<line_ptr> processing_items_;
 
+    //! The maximum number of lines to be processed at once; also the maximum number of lines
+    //! emitted from the same line that are processed at once
+    const int max_concurrency_;
+
     //! The current order index; used to assign each line a unique number
     std::atomic<int> cur_order_idx_{0};
 
+    //! False if lines can have sub-indices at the end of the stages added so far (i.e., there is a
+    //! flat-map stage that is not followed by an in_order stage)
+    bool flat_order_{true};
+
+    //! The line objects that finished processing, kept to be reused by new lines
+    concurrent_queue<line_ptr> free_lines_;
+
+    //! The source from which we pull new lines, when processing slots become free
+    line_source_fun source_;
+    //! Set when the current source is exhausted, or when we don't have a source
+    std::atomic<bool> source_done_{true};
+    //! The number of requests to pull lines from the source; used to serialize the pulls
+    std::atomic<int> pull_requests_{0};
+
+    //! True if we need to collect the per-stage stats
+    std::atomic<bool> collect_stats_{false};
+
     pipeline_data(int max_concurrency, task_group grp, any_executor exe)
         : group_(std::move(grp))
         , executor_(std::move(exe))
-        , processing_items_(max_concurrency) {}
+        , processing_items_(max_concurrency)
+        , max_concurrency_(max_concurrency) {}
+
+    ~pipeline_data() {
+        // Normally, all the lines end up in free_lines_. But if the pipeline is abandoned with
+        // lines in flight, some lines may still wait in the reorder windows, or for a processing
+        // slot; these still hold their data.
+        auto destroy_line = [](line_ptr line) {
+            line->destroy_data_(line);
+            line->free_line_(line);
+        };
+        for (auto& stage : stages_) {
+            for (auto& slot : stage.reorder_ring_) {
+                if (slot.last_)
+                    destroy_line(slot.last_);
+                for (auto line : slot.subs_)
+                    if (line)
+                        destroy_line(line);
+            }
+        }
+        line_ptr line{nullptr};
+        while (processing_items_.try_pop_waiting(line))
+            destroy_line(line);
+        while (free_lines_.try_pop(line))
+            line->free_line_(line);
+    }
 
+    pipeline_data(const pipeline_data&) = delete;
+    pipeline_data& operator=(const pipeline_data&) = delete;
+
+    //! Prepares a new line to go through the stages; assigns its order index
+    void init_line(line_ptr line);
     //! Start processing a line; from the first stage, and go up to the last one
     void start(line_ptr line);
     //! Enqueue a task to run the current needed task for a line
     void enqueue_line_work(line_ptr line);
 
-    //! Called to execute the work item for the given stage onto the given line
-    void execute_stage_task(int stage_idx, line_ptr line);
+    //! Called on the serializer of an in_order stage when a line arrives at the stage; runs the
+    //! line if it's the expected one, or keeps it in the reorder window
+    void on_in_order_arrival(line_ptr line);
+    //! Called to execute the work item for the current stage onto the given line; continues with
+    //! the next stages, as long as they are fused with the current one
+    void execute_stage_task(line_ptr line);
+    //! Executes the function of the current stage of the line; measures it if collecting stats
+    void run_stage(line_ptr line);
+    //! Calls the function of the given stage for the line
+    void call_stage_fun(stage_data& stage, line_ptr line);
     //! Called when the task is done (successfully or with exception)
-    void on_task_cont(int stage_idx, line_ptr line, std::exception_ptr ex);
+    void on_task_cont(line_ptr line, std::exception_ptr ex);
+    //! Called when the line finished all the stages; keeps the line object for reuse
+    void recycle(line_ptr line);
+    //! Called when a line that was emitted from another line finishes processing; starts another
+    //! emitted line, if one is waiting
+    void on_emitted_line_done(emitted_lines* group);
+    //! Releases a reference to the given emitted lines; deletes the object when not used anymore
+    static void release_emitted_lines(emitted_lines* group);
+    //! Called when a processing slot is released; starts a waiting line or pulls a new one
+    void on_slot_released();
+    //! Requests pulling lines from the source; the pulls are executed in a task, one at a time
+    void request_pull();
+    //! Pulls lines from the source and starts them, while there are free processing slots
+    void pull_lines();
     //! Create a task to execute the current stage of the given line
     task make_task(line_ptr line);
 };
 
+//! The function of the task that executes a stage for a line
+struct line_task_fun {
+    pipeline_data* data_;
+    line_ptr line_;
+
+    void operator()() const { data_->execute_stage_task(line_); }
+};
+//! The continuation of the task that executes a stage for a line
+struct line_task_cont {
+    pipeline_data* data_;
+    line_ptr line_;
+
+    void operator()(std::exception_ptr ex) const { data_->on_task_cont(line_, std::move(ex)); }
+};
+
+//! Checks if the continuation of the current task is still the one we set, for the given line.
+//! If the stage function took over the continuation (to finish the stage asynchronously), we
+//! cannot continue executing the following stages in the same task.
+inline bool has_original_continuation(line_ptr line) {
+    task* cur_task = task::current_task();
+    if (!cur_task)
+        return false;
+    const auto* target = cur_task->peek_continuation().target<line_task_cont>();
+    return target && target->line_ == line;
+}
+
+void pipeline_data::init_line(line_ptr line) {
+    line->stage_idx_ = 0;
+    line->stopped_ = 0;
+    line->last_ = 1;
+    line->owns_slot_ = 1;
+    line->queued_ = 0;
+    line->order_idx_ = cur_order_idx_++;
+    line->sub_idx_ = 0;
+    line->group_ = nullptr;
+    line->pending_since_ = 0;
+}
+
 void pipeline_data::start(line_ptr line) {
     assert(line->stage_idx_ == 0);
     if (processing_items_.push_and_try_acquire(std::move(line))) {
@@ -89,77 +363,258 @@ void pipeline_data::start(line_ptr line) {
 
 void pipeline_data::enqueue_line_work(line_ptr line) {
     assert(line->stage_idx_ < int(stages_.size()));
+    CONCORE_USDT_PROBE3(pipeline_handoff, this, int(line->stage_idx_), line->order_idx_);
     auto& stage = stages_[line->stage_idx_];
+    if (collect_stats_.load(std::memory_order_relaxed)) {
+        line->queued_ = 1;
+        stage.counters_.backlog_.fetch_add(1, std::memory_order_relaxed);
+    }
     if (stage.ord_ == stage_ordering::concurrent) {
         // Enqueue the task in the given executor to be executed, without further constraints
-        executor_.execute(make_task(std::move(line)));
+        executor_.execute(make_task(line));
     } else if (stage.ord_ == stage_ordering::out_of_order) {
         // Ensure that this task is serialized with the other tasks on this stage (serial execution)
-        stage.ser_.execute(make_task(std::move(line)));
+        stage.ser_.execute(make_task(line));
     } else if (stage.ord_ == stage_ordering::in_order) {
-        // Create a task that will ensure an orderly execution of lines
-        auto push_task_fun = [this, line = std::move(line)]() mutable {
-            auto& stage = stages_[line->stage_idx_];
-            if (line->order_idx_ == stage.expected_order_idx_) {
-                // We are now at the expected line; create a task and execute it here
-                stage.expected_order_idx_++;
-                task t = make_task(std::move(line));
-                // To ensure that the continuation is always executed on the serializer, we need to
-                // push this as a new task in the serializer
-                stage.ser_.execute(std::move(t));
-            } else {
-                // We cannot run this line yet; we have to wait for other lines first
-                stage.add_pending(std::move(line));
+        // Create a task that will ensure an orderly execution of lines. If the task is cancelled,
+        // the line still needs to take its place in the order, so that the lines after it are not
+        // kept waiting forever; the continuation does that, and the stage tasks created from here
+        // are cancelled too, dropping the lines and releasing their slots.
+        auto push_task_fun = [this, line]() { on_in_order_arrival(line); };
+        auto push_task_cont = [this, line](std::exception_ptr ex) {
+            if (!ex)
+                return;
+            try {
+                std::rethrow_exception(ex);
+            } catch (const task_cancelled&) {
+                on_in_order_arrival(line);
+            } catch (...) {
+                // The push function ran and failed; don't try to place the line a second time
             }
         };
-        stage.ser_.execute(task{std::move(push_task_fun), group_});
+        stage.ser_.execute(task{std::move(push_task_fun), group_, std::move(push_task_cont)});
+    }
+}
+
+void pipeline_data::on_in_order_arrival(line_ptr line) {
+    auto& stage = stages_[line->stage_idx_];
+    if (stage.is_expected(line)) {
+        // We are now at the expected line; create a task and execute it here
+        stage.advance(line);
+        task t = make_task(line);
+        // To ensure that the continuation is always executed on the serializer, we need to push
+        // this as a new task in the serializer
+        stage.ser_.execute(std::move(t));
+    } else {
+        // We cannot run this line yet; we have to wait for other lines first
+        if (collect_stats_.load(std::memory_order_relaxed))
+            line->pending_since_ = now_ns();
+        stage.add_pending(line);
+    }
+}
+
+void pipeline_data::execute_stage_task(line_ptr line) {
+    assert(line->stage_idx_ < int(stages_.size()));
+    if (line->queued_) {
+        line->queued_ = 0;
+        stages_[line->stage_idx_].counters_.backlog_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (line->stopped_)
+        return;
+    run_stage(line);
+
+    // Run the following concurrent stages inline, while the line data is still in cache
+    while (!line->stopped_ && stages_[line->stage_idx_].fuse_next_ &&
+            !(group_ && group_.is_cancelled()) && has_original_continuation(line)) {
+        ++line->stage_idx_;
+        CONCORE_USDT_PROBE3(pipeline_handoff, this, int(line->stage_idx_), line->order_idx_);
+        run_stage(line);
+    }
+}
+
+void pipeline_data::run_stage(line_ptr line) {
+    auto& stage = stages_[line->stage_idx_];
+    if (!collect_stats_.load(std::memory_order_relaxed)) {
+        call_stage_fun(stage, line);
+        return;
     }
+
+    auto& counters = stage.counters_;
+    int64_t start = now_ns();
+    auto finish = [&counters, start] {
+        counters.busy_ns_.fetch_add(now_ns() - start, std::memory_order_relaxed);
+        counters.num_processed_.fetch_add(1, std::memory_order_relaxed);
+    };
+    try {
+        call_stage_fun(stage, line);
+    } catch (...) {
+        finish();
+        throw;
+    }
+    finish();
 }
 
-void pipeline_data::execute_stage_task(int stage_idx, line_ptr line) {
-    assert(stage_idx < int(stages_.size()));
-    if (!line->stopped_) {
-        stages_[stage_idx].fun_(line.get());
+void pipeline_data::call_stage_fun(stage_data& stage, line_ptr line) {
+    if (!stage.expand_) {
+        stage.fun_(line);
+        return;
+    }
+
+    // The emitted lines take the place of this line; this line continues as a dropped line, after
+    // all the emitted lines, so that in_order stages know when to move to the next order index
+    line_emitter em{this, line};
+    auto finish = [&em, line] {
+        line->sub_idx_ = em.count_;
+        line->last_ = 1;
+        line->stopped_ = 1;
+        if (em.group_)
+            release_emitted_lines(em.group_);
+    };
+    try {
+        stage.expand_(line, em);
+    } catch (...) {
+        finish();
+        throw;
     }
+    finish();
 }
 
-void pipeline_data::on_task_cont(int stage_idx, line_ptr line, std::exception_ptr ex) {
+void pipeline_data::on_task_cont(line_ptr line, std::exception_ptr ex) {
     // If we have an exception, mark the line as stopped
     if (ex)
         line->stopped_ = 1;
 
-    // assert(line->stage_idx_ == stage_idx);
-    stage_data& stage = stages_[stage_idx];
+    stage_data& stage = stages_[line->stage_idx_];
+
+    // If the task was cancelled before executing the stage, the line is no longer waiting for it
+    if (line->queued_) {
+        line->queued_ = 0;
+        stage.counters_.backlog_.fetch_sub(1, std::memory_order_relaxed);
+    }
 
-    // If we are in an `in_order` stage, check if we can start the next line
+    // If we are in an `in_order` stage, check if we can start the next line.
+    // We are still executing on the serializer of the stage, so we can start it directly.
     if (stage.ord_ == stage_ordering::in_order) {
-        if (!stage.pending_lines_.empty() &&
-                stage.pending_lines_.front().second == stage.expected_order_idx_) {
-            line_ptr next_line = std::move(stage.pending_lines_.front().first);
-            stage.pending_lines_.erase(stage.pending_lines_.begin());
-            enqueue_line_work(std::move(next_line));
+        line_ptr next_line = stage.take_expected();
+        if (next_line) {
+            if (next_line->pending_since_) {
+                int64_t waited = now_ns() - next_line->pending_since_;
+                stage.counters_.wait_ns_.fetch_add(waited, std::memory_order_relaxed);
+                next_line->pending_since_ = 0;
+            }
+            stage.advance(next_line);
+            stage.ser_.execute(make_task(next_line));
         }
     }
 
     // Move this line to the next stage
     if (++line->stage_idx_ < int(stages_.size())) {
-        enqueue_line_work(std::move(line)); // run the next stage
+        enqueue_line_work(line); // run the next stage
     } else {
-        // If we are at maximum capacity, try to start a new line (from first stage)
-        if (processing_items_.release_and_acquire()) {
-            enqueue_line_work(processing_items_.extract_one());
+        bool owns_slot = line->owns_slot_ != 0;
+        emitted_lines* group = line->group_;
+        recycle(line);
+        if (owns_slot)
+            on_slot_released();
+        else if (group)
+            on_emitted_line_done(group);
+    }
+}
+
+void line_emitter::emit(line_base* child) {
+    child->stage_idx_ = parent_->stage_idx_ + 1;
+    child->stopped_ = 0;
+    child->last_ = 0;
+    child->owns_slot_ = 0;
+    child->order_idx_ = parent_->order_idx_;
+    child->sub_idx_ = count_++;
+    child->queued_ = 0;
+    child->group_ = nullptr;
+    child->pending_since_ = 0;
+    if (child->stage_idx_ >= int(data_->stages_.size())) {
+        data_->recycle(child);
+        return;
+    }
+
+    // Limit the number of emitted lines being processed; this limits the size of the reorder
+    // windows of the in_order stages. The emitter never waits; the extra lines are kept until the
+    // processed lines finish.
+    if (!group_)
+        group_ = new emitted_lines(data_->max_concurrency_);
+    child->group_ = group_;
+    group_->num_refs_++;
+    if (group_->lines_.push_and_try_acquire(std::move(child)))
+        data_->enqueue_line_work(group_->lines_.extract_one());
+}
+
+void pipeline_data::on_emitted_line_done(emitted_lines* group) {
+    if (group->lines_.release_and_acquire())
+        enqueue_line_work(group->lines_.extract_one());
+    release_emitted_lines(group);
+}
+
+void pipeline_data::release_emitted_lines(emitted_lines* group) {
+    if (--group->num_refs_ == 0)
+        delete group;
+}
+
+void pipeline_data::on_slot_released() {
+    // If we are at maximum capacity, try to start a new line (from first stage)
+    if (processing_items_.release_and_acquire())
+        enqueue_line_work(processing_items_.extract_one());
+    else if (!source_done_.load(std::memory_order_acquire))
+        request_pull();
+}
+
+void pipeline_data::request_pull() {
+    // Only the first request creates a task; the task will see the other requests.
+    // If the task is cancelled or fails, forget the requests, so that the next one starts a new
+    // task.
+    if (pull_requests_++ == 0) {
+        auto cont = [this](std::exception_ptr ex) {
+            if (ex)
+                pull_requests_ = 0;
+        };
+        executor_.execute(task{[this] { pull_lines(); }, group_, std::move(cont)});
+    }
+}
+
+void pipeline_data::pull_lines() {
+    int num_requests = pull_requests_.load();
+    while (true) {
+        while (!source_done_.load(std::memory_order_acquire) && processing_items_.try_acquire()) {
+            line_ptr line{nullptr};
+            try {
+                line = source_(*this);
+            } catch (...) {
+                source_done_ = true;
+                on_slot_released();
+                throw;
+            }
+            if (!line) {
+                source_done_ = true;
+                on_slot_released();
+                break;
+            }
+            init_line(line);
+            enqueue_line_work(line);
         }
+        // Stop if nobody requested another pull while we were pulling
+        int remaining = pull_requests_.fetch_sub(num_requests) - num_requests;
+        if (remaining == 0)
+            break;
+        num_requests = remaining;
     }
 }
+
+void pipeline_data::recycle(line_ptr line) {
+    line->destroy_data_(line);
+    free_lines_.push(std::move(line));
+}
+
 task pipeline_data::make_task(line_ptr line) {
-    int stage_idx = line->stage_idx_;
-    auto fun = [this, stage_idx, line]() mutable {
-        execute_stage_task(stage_idx, std::move(line));
-    };
-    auto cont = [this, stage_idx, line = std::move(line)](std::exception_ptr ex) mutable {
-        on_task_cont(stage_idx, std::move(line), ex);
-    };
-    return task{std::move(fun), group_, std::move(cont)};
+    // Both the stage and the line are taken from the line object; keep the functors small
+    return task{line_task_fun{this, line}, group_, line_task_cont{this, line}};
 }
 
 pipeline_impl::~pipeline_impl() = default;
@@ -181,13 +636,99 @@ pipeline_impl::pipeline_impl(int max_concurrency, any_executor exe)
 
 void pipeline_impl::do_add_stage(stage_ordering ord, stage_fun&& f) {
     assert(data_);
-    data_->stages_.emplace_back(ord, std::move(f), data_->executor_);
+    auto& stages = data_->stages_;
+    if (!stages.empty() && stages.back().ord_ == stage_ordering::concurrent &&
+            ord == stage_ordering::concurrent)
+        stages.back().fuse_next_ = true;
+    stages.emplace_back(ord, std::move(f), expand_fun{}, data_->executor_);
+    if (ord == stage_ordering::in_order)
+        data_->flat_order_ = true;
+}
+
+void pipeline_impl::do_add_expand_stage(stage_ordering ord, expand_fun&& f) {
+    assert(data_);
+    // We only support one level of sub-indices; in_order stages remove the sub-indices
+    assert(ord == stage_ordering::in_order || data_->flat_order_);
+    auto& stages = data_->stages_;
+    if (!stages.empty() && stages.back().ord_ == stage_ordering::concurrent &&
+            ord == stage_ordering::concurrent)
+        stages.back().fuse_next_ = true;
+    stages.emplace_back(ord, stage_fun{}, std::move(f), data_->executor_);
+    data_->flat_order_ = false;
+}
+
+line_base* try_reuse_line(pipeline_data& data) {
+    line_base* line{nullptr};
+    return data.free_lines_.try_pop(line) ? line : nullptr;
+}
+
+void release_line_memory(pipeline_data& data, line_base* line) {
+    data.free_lines_.push(std::move(line));
+}
+
+void pipeline_impl::do_start_line(line_base* line) {
+    assert(data_);
+    data_->init_line(line);
+    data_->start(line);
+}
+
+bool pipeline_impl::try_acquire_slot() {
+    assert(data_);
+    return data_->processing_items_.try_acquire();
 }
 
-void pipeline_impl::do_start_line(std::shared_ptr<line_base>&& line) {
+void pipeline_impl::release_slot() {
     assert(data_);
-    line->order_idx_ = data_->cur_order_idx_++;
-    data_->start(std::move(line));
+    data_->on_slot_released();
+}
+
+void pipeline_impl::do_start_acquired_line(line_base* line) {
+    assert(data_);
+    data_->init_line(line);
+    data_->enqueue_line_work(line);
+}
+
+void pipeline_impl::wait_for_free_slot() {
+    assert(data_);
+    auto* data = data_.get();
+    auto& ctx = get_exec_context();
+    auto worker_data = enter_worker(ctx);
+    busy_wait_until(ctx, [data] { return data->processing_items_.has_free_slot(); });
+    exit_worker(ctx, worker_data);
+}
+
+void pipeline_impl::do_pull_from(line_source_fun&& source) {
+    assert(data_);
+    assert(data_->source_done_.load());
+    data_->source_ = std::move(source);
+    data_->source_done_.store(false, std::memory_order_release);
+    data_->request_pull();
+}
+
+void pipeline_impl::set_collect_stats(bool val) {
+    assert(data_);
+    data_->collect_stats_.store(val, std::memory_order_relaxed);
+}
+
+pipeline_stats pipeline_impl::get_stats() const {
+    assert(data_);
+    pipeline_stats res;
+    res.stages_.reserve(data_->stages_.size());
+    for (const auto& stage : data_->stages_) {
+        const auto& counters = stage.counters_;
+        pipeline_stage_stats st;
+        st.ordering_ = stage.ord_;
+        st.num_processed_ = counters.num_processed_.load(std::memory_order_relaxed);
+        st.busy_time_ = std::chrono::nanoseconds{counters.busy_ns_.load(std::memory_order_relaxed)};
+        st.in_order_wait_time_ =
+                std::chrono::nanoseconds{counters.wait_ns_.load(std::memory_order_relaxed)};
+        st.backlog_ = std::max(counters.backlog_.load(std::memory_order_relaxed), 0);
+        res.stages_.push_back(st);
+    }
+    auto counts = data_->processing_items_.counts();
+    res.num_active_lines_ = counts.first;
+    res.num_waiting_lines_ = counts.second - counts.first;
+    return res;
 }
 
 } // namespace detail
@@ -5,6 +5,7 @@
 #include "concore/data/concurrent_queue.hpp"
 #include "concore/detail/utils.hpp"
 #include "concore/detail/enqueue_next.hpp"
+#include "concore/detail/usdt_probes.hpp"
 
 #include <atomic>
 #include <cassert>
@@ -71,6 +72,7 @@ struct serializer::impl : std::enable_shared_from_this<impl> {
 
     //! Start executing the next task in our serializer
     void start_next_task(const any_executor& exec) {
+        CONCORE_USDT_PROBE2(serializer_handoff, this, count_.load(std::memory_order_relaxed));
         auto t = detail::pop_task(waiting_tasks_);
         detail::enqueue_next(exec, std::move(t), except_fun_);
     }
@@ -3,9 +3,14 @@
 #include "concore/profiling.hpp"
 #include "concore/detail/utils.hpp"
 #include "concore/detail/enqueue_next.hpp"
+#include "concore/detail/exec_context_if.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <map>
+#include <stdexcept>
 
 namespace concore {
 
@@ -54,6 +59,524 @@ struct chained_task_impl : public std::enable_shared_from_this<chained_task_impl
     }
 };
 
+//! The data for a dataflow_task
+struct dataflow_task_impl : public std::enable_shared_from_this<dataflow_task_impl> {
+    //! Node in the list of successors of a task
+    struct succ_node {
+        std::shared_ptr<dataflow_task_impl> task_;
+        succ_node* next_;
+    };
+
+    //! The number of reasons for which the task cannot be executed yet. Initially 1, as we wait for
+    //! start() to be called; each uncompleted predecessor adds one more.
+    std::atomic<int32_t> pred_count_{1};
+    //! The head of the list of successors; set to `closed_list()` after the task completes
+    std::atomic<succ_node*> succ_head_{nullptr};
+    //! The task to be executed
+    task task_;
+    //! The executor used to execute the task
+    any_executor executor_;
+
+    dataflow_task_impl(task t, any_executor executor)
+        : task_(std::move(t))
+        , executor_(std::move(executor)) {
+        if (!executor_)
+            executor_ = concore::spawn_executor{};
+    }
+
+    ~dataflow_task_impl() {
+        // If the task was never executed, we may still have successors in the list
+        auto* node = succ_head_.load(std::memory_order_acquire);
+        while (node && node != closed_list()) {
+            auto* next = node->next_;
+            delete node;
+            node = next;
+        }
+    }
+
+    //! Marker for the list of successors, indicating that the task is complete
+    static succ_node* closed_list() noexcept {
+        static succ_node marker{};
+        return &marker;
+    }
+
+    //! Adds a successor to this task; if this task is already complete, this has no effect.
+    void add_successor(const std::shared_ptr<dataflow_task_impl>& next) {
+        // Check if the task is already complete; avoid allocating in this case
+        auto* head = succ_head_.load(std::memory_order_acquire);
+        if (head == closed_list())
+            return;
+
+        int32_t old_count = next->pred_count_.fetch_add(1, std::memory_order_relaxed);
+        assert(old_count > 0); // the successor must not be released yet
+        (void)old_count;
+
+        auto* node = new succ_node{next, head};
+        while (!succ_head_.compare_exchange_weak(
+                node->next_, node, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            if (node->next_ == closed_list()) {
+                // Completed in the meantime; the dependency is already satisfied
+                delete node;
+                next->release();
+                return;
+            }
+        }
+    }
+
+    //! Decrements the number of reasons the task cannot execute; executes it when this reaches 0
+    void release() noexcept {
+        if (pred_count_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        // Execute the task, and then release the successors
+        task t = std::move(task_);
+        auto inner_cont = t.get_continuation();
+        t.set_continuation([inner_cont, p_this = shared_from_this()](std::exception_ptr ex) {
+            if (inner_cont)
+                inner_cont(ex);
+            p_this->on_done();
+        });
+        executor_.execute(std::move(t));
+    }
+
+    //! Called after the task is executed; releases all the successors
+    void on_done() noexcept {
+        CONCORE_PROFILING_SCOPE_N("dataflow_task.on_done");
+        auto* node = succ_head_.exchange(closed_list(), std::memory_order_acq_rel);
+        while (node) {
+            auto* next = node->next_;
+            node->task_->release();
+            delete node;
+            node = next;
+        }
+    }
+};
+
+//! The data for a task_graph. Built once, and reused for all the runs of the graph.
+struct task_graph_data : std::enable_shared_from_this<task_graph_data> {
+    //! The functions to be executed for each node.
+    //! After optimizations, a node can execute multiple nodes given to the builder.
+    std::vector<task_function> node_funs_;
+    //! The node in which each node given to the builder ends up being executed
+    std::vector<int32_t> node_to_task_;
+    //! The start of the successors list in `succ_indices_` for each node; one extra element at end
+    std::vector<int32_t> succ_offsets_;
+    //! The successors of all the nodes, grouped by node (CSR format)
+    std::vector<int32_t> succ_indices_;
+    //! The number of predecessors of each node, before starting the execution
+    std::vector<int32_t> initial_pred_counts_;
+    //! The nodes that don't have any predecessors; we start executing from these
+    std::vector<int32_t> roots_;
+    //! The nodes of the graph, in topological order
+    std::vector<int32_t> topo_order_;
+    //! The cost of each node; either given by the user, or measured in previous runs
+    std::vector<double> costs_;
+    //! The upward rank of each node: the cost of the longest path from the node to a sink
+    std::vector<double> ranks_;
+    //! The measured duration (in ns) of each node in the last run; 0 if not measured
+    std::unique_ptr<std::atomic<int64_t>[]> measured_ns_;
+    //! True if we measure the duration of the nodes and use it as costs for the next runs
+    bool measure_costs_{false};
+    //! True if we haven't yet replaced the user-given costs by the measured ones
+    bool first_measurement_{true};
+    //! True if we spawn the nodes directly, instead of using `executor_`
+    bool spawn_nodes_{false};
+    //! The number of predecessors of each node that are not yet completed, for the current run
+    std::unique_ptr<std::atomic<int32_t>[]> pred_counts_;
+    //! The number of nodes that are not yet completed in the current run
+    std::atomic<int32_t> num_remaining_{0};
+    //! Indicates whether we are currently running the graph
+    std::atomic<bool> running_{false};
+    //! Set when the first exception of the current run is stored
+    std::atomic<bool> has_exception_{false};
+    //! The first exception thrown by a node in the current run
+    std::exception_ptr first_exception_;
+    //! The group in which we are executing the tasks of the graph
+    task_group group_;
+    //! The executor used to execute the nodes
+    any_executor executor_;
+    //! The object to be notified when the current run is complete
+    task_graph_listener* listener_{nullptr};
+    //! Keeps this object alive while we have a run in progress
+    std::shared_ptr<task_graph_data> self_;
+
+    //! Computes the upward ranks of the nodes, and sorts the successors lists and the roots by rank
+    void compute_ranks() noexcept;
+    //! Updates the node costs with the durations measured in the last run, and recomputes the ranks
+    void update_costs_from_measurements() noexcept;
+    //! Starts a new run of the graph
+    void start(task_graph_listener* listener) noexcept;
+    //! Calls `f` for the given nodes (sorted by descending rank), in the order in which they should
+    //! be started, such that the nodes with higher rank are executed first
+    template <typename F>
+    void for_each_in_start_order(const int32_t* first, const int32_t* last, F f);
+    //! Executes the function of the given node
+    void exec_node(int32_t idx);
+    //! Called when a node that was fused with other nodes throws an exception
+    void on_fused_node_exception(std::exception_ptr ex) noexcept;
+    //! Starts executing the given node
+    void start_node(int32_t idx) noexcept;
+    //! Called whenever a node is done executing (successfully, with exception, or cancelled)
+    void on_node_done(int32_t idx, std::exception_ptr ex) noexcept;
+    //! Called when all the nodes of the graph are done
+    void on_run_done() noexcept;
+};
+
+//! The function of the task that executes a node of a task_graph.
+//! Small enough to not require allocations when stored in a task.
+struct task_graph_node_fun {
+    task_graph_data* data_;
+    int32_t idx_;
+
+    void operator()() const { data_->exec_node(idx_); }
+};
+//! The continuation of the task that executes a node of a task_graph.
+struct task_graph_node_cont {
+    task_graph_data* data_;
+    int32_t idx_;
+
+    void operator()(std::exception_ptr ex) const noexcept { data_->on_node_done(idx_, ex); }
+};
+
+//! Function that executes multiple nodes fused together (in order).
+//! Behaves as if the nodes were executed as separate tasks: exceptions are reported to the task
+//! group without stopping the execution of the next nodes, and cancellation is checked between
+//! nodes.
+struct task_graph_fused_fun {
+    task_graph_data* data_;
+    std::vector<task_function> funs_;
+
+    void operator()() const {
+        for (const auto& f : funs_) {
+            if (data_->group_.is_cancelled())
+                return;
+            try {
+                f();
+            } catch (...) {
+                data_->on_fused_node_exception(std::current_exception());
+            }
+        }
+    }
+};
+
+void task_graph_data::on_fused_node_exception(std::exception_ptr ex) noexcept {
+    task_group_access::on_task_exception(group_, ex);
+    task_group_access::on_starting_task(group_); // we continue executing in the same group
+    if (!has_exception_.exchange(true, std::memory_order_acq_rel))
+        first_exception_ = std::move(ex);
+}
+
+using adjacency_list = std::vector<std::vector<int32_t>>;
+
+//! Returns the nodes of the graph in topological order; throws if the graph contains cycles
+std::vector<int32_t> topological_order(const adjacency_list& succs) {
+    auto n = static_cast<int32_t>(succs.size());
+    std::vector<int32_t> counts(n, 0);
+    for (const auto& s : succs)
+        for (auto next : s)
+            counts[next]++;
+    std::vector<int32_t> order;
+    order.reserve(n);
+    for (int32_t i = 0; i < n; i++)
+        if (counts[i] == 0)
+            order.push_back(i);
+    for (size_t k = 0; k < order.size(); k++)
+        for (auto next : succs[order[k]])
+            if (--counts[next] == 0)
+                order.push_back(next);
+    if (static_cast<int32_t>(order.size()) != n)
+        throw std::invalid_argument("task graph contains cycles");
+    return order;
+}
+
+//! Removes the edges that are implied by other paths in the graph (and the duplicate edges).
+//! For each node, we search the nodes reachable through paths of length at least 2; we don't need
+//! to look past the last direct successor, in topological order.
+void remove_transitive_edges(adjacency_list& succs, const std::vector<int32_t>& order) {
+    auto n = static_cast<int32_t>(succs.size());
+    std::vector<int32_t> pos(n);
+    for (int32_t k = 0; k < n; k++)
+        pos[order[k]] = k;
+
+    std::vector<int32_t> mark(n, -1);
+    std::vector<int32_t> stack;
+    for (int32_t u = 0; u < n; u++) {
+        auto& s = succs[u];
+        std::sort(s.begin(), s.end());
+        s.erase(std::unique(s.begin(), s.end()), s.end());
+        if (s.size() < 2)
+            continue;
+
+        int32_t limit = 0;
+        for (auto v : s)
+            limit = std::max(limit, pos[v]);
+        auto visit = [&](int32_t x) {
+            for (auto y : succs[x]) {
+                if (pos[y] <= limit && mark[y] != u) {
+                    mark[y] = u;
+                    stack.push_back(y);
+                }
+            }
+        };
+        for (auto v : s)
+            visit(v);
+        while (!stack.empty()) {
+            int32_t x = stack.back();
+            stack.pop_back();
+            visit(x);
+        }
+        s.erase(std::remove_if(s.begin(), s.end(), [&](int32_t v) { return mark[v] == u; }),
+                s.end());
+    }
+}
+
+//! Merges sibling nodes (nodes with the same predecessors and the same successors) that have costs
+//! smaller than the threshold, such that the merged nodes have a total cost below the threshold.
+//! Returns the groups of nodes; nodes that are not merged end up in groups of their own.
+adjacency_list merge_small_siblings(
+        const adjacency_list& succs, const std::vector<double>& costs, double threshold) {
+    auto n = static_cast<int32_t>(succs.size());
+    adjacency_list preds(n);
+    for (int32_t i = 0; i < n; i++)
+        for (auto next : succs[i])
+            preds[next].push_back(i);
+
+    using key_t = std::pair<std::vector<int32_t>, std::vector<int32_t>>;
+    std::map<key_t, std::vector<int32_t>> siblings;
+    adjacency_list groups;
+    for (int32_t i = 0; i < n; i++) {
+        if (costs[i] < threshold) {
+            auto p = preds[i];
+            auto s = succs[i];
+            std::sort(p.begin(), p.end());
+            std::sort(s.begin(), s.end());
+            siblings[key_t{std::move(p), std::move(s)}].push_back(i);
+        } else
+            groups.push_back({i});
+    }
+    for (const auto& kv : siblings) {
+        double group_cost = threshold;
+        for (auto i : kv.second) {
+            if (group_cost + costs[i] > threshold) {
+                groups.emplace_back();
+                group_cost = 0.0;
+            }
+            groups.back().push_back(i);
+            group_cost += costs[i];
+        }
+    }
+    std::sort(groups.begin(), groups.end());
+    return groups;
+}
+
+//! Returns the graph between the given groups of nodes (without duplicate and self edges)
+adjacency_list contract_graph(const adjacency_list& succs, const adjacency_list& groups) {
+    std::vector<int32_t> group_of(succs.size());
+    for (size_t g = 0; g < groups.size(); g++)
+        for (auto i : groups[g])
+            group_of[i] = static_cast<int32_t>(g);
+
+    adjacency_list res(groups.size());
+    for (size_t g = 0; g < groups.size(); g++) {
+        auto& s = res[g];
+        for (auto i : groups[g])
+            for (auto next : succs[i])
+                if (group_of[next] != static_cast<int32_t>(g))
+                    s.push_back(group_of[next]);
+        std::sort(s.begin(), s.end());
+        s.erase(std::unique(s.begin(), s.end()), s.end());
+    }
+    return res;
+}
+
+//! Fuses chains of nodes: a node with a single predecessor that has a single successor will be
+//! executed together with its predecessor. Returns the groups of nodes, in execution order.
+adjacency_list fuse_chains(const adjacency_list& succs) {
+    auto n = static_cast<int32_t>(succs.size());
+    adjacency_list preds(n);
+    for (int32_t i = 0; i < n; i++)
+        for (auto next : succs[i])
+            preds[next].push_back(i);
+
+    std::vector<int32_t> group_of(n, -1);
+    adjacency_list groups;
+    for (auto i : topological_order(succs)) {
+        if (preds[i].size() == 1 && succs[preds[i][0]].size() == 1)
+            group_of[i] = group_of[preds[i][0]];
+        else {
+            group_of[i] = static_cast<int32_t>(groups.size());
+            groups.emplace_back();
+        }
+        groups[group_of[i]].push_back(i);
+    }
+    return groups;
+}
+
+//! Given groups of groups of nodes, returns the groups of nodes
+adjacency_list expand_groups(const adjacency_list& outer, const adjacency_list& inner) {
+    adjacency_list res(outer.size());
+    for (size_t g = 0; g < outer.size(); g++)
+        for (auto i : outer[g])
+            res[g].insert(res[g].end(), inner[i].begin(), inner[i].end());
+    return res;
+}
+
+void task_graph_data::compute_ranks() noexcept {
+    // Walk the nodes in reverse topological order; successors are visited before predecessors
+    for (auto it = topo_order_.rbegin(); it != topo_order_.rend(); ++it) {
+        int32_t idx = *it;
+        double max_succ_rank = 0.0;
+        for (int32_t i = succ_offsets_[idx]; i < succ_offsets_[idx + 1]; i++)
+            max_succ_rank = std::max(max_succ_rank, ranks_[succ_indices_[i]]);
+        ranks_[idx] = costs_[idx] + max_succ_rank;
+    }
+
+    // Sort the successors of each node, and the roots, by descending rank.
+    // This way, the nodes on the critical path are started first.
+    // Note: std::sort doesn't allocate memory, so this can be done between runs.
+    auto higher_rank = [this](int32_t lhs, int32_t rhs) {
+        return ranks_[lhs] > ranks_[rhs] || (ranks_[lhs] == ranks_[rhs] && lhs < rhs);
+    };
+    auto n = static_cast<int32_t>(node_funs_.size());
+    for (int32_t idx = 0; idx < n; idx++)
+        std::sort(succ_indices_.data() + succ_offsets_[idx],
+                succ_indices_.data() + succ_offsets_[idx + 1], higher_rank);
+    std::sort(roots_.begin(), roots_.end(), higher_rank);
+}
+
+void task_graph_data::update_costs_from_measurements() noexcept {
+    auto n = static_cast<int32_t>(node_funs_.size());
+    if (first_measurement_) {
+        // The measured durations replace the user-given costs, which may use any unit. Scale the
+        // costs of the nodes that were not measured (e.g., because they threw), so that all the
+        // costs are comparable.
+        double sum_ns = 0.0;
+        double sum_costs = 0.0;
+        for (int32_t i = 0; i < n; i++) {
+            if (measured_ns_[i].load(std::memory_order_relaxed) > 0) {
+                sum_ns += static_cast<double>(measured_ns_[i].load(std::memory_order_relaxed));
+                sum_costs += costs_[i];
+            }
+        }
+        double scale = sum_costs > 0.0 ? sum_ns / sum_costs : 1.0;
+        for (int32_t i = 0; i < n; i++) {
+            if (measured_ns_[i].load(std::memory_order_relaxed) <= 0)
+                costs_[i] *= scale;
+        }
+    }
+    for (int32_t i = 0; i < n; i++) {
+        auto ns = static_cast<double>(measured_ns_[i].load(std::memory_order_relaxed));
+        if (ns <= 0.0)
+            continue;
+        // Smooth out the measurements over multiple runs
+        costs_[i] = first_measurement_ ? ns : 0.5 * (costs_[i] + ns);
+    }
+    first_measurement_ = false;
+    compute_ranks();
+}
+
+void task_graph_data::start(task_graph_listener* listener) noexcept {
+    bool was_running = running_.exchange(true, std::memory_order_acq_rel);
+    assert(!was_running);
+    (void)was_running;
+
+    // Reset the state for the new run
+    listener_ = listener;
+    has_exception_.store(false, std::memory_order_relaxed);
+    first_exception_ = std::exception_ptr{};
+    auto n = static_cast<int32_t>(node_funs_.size());
+    for (int32_t i = 0; i < n; i++)
+        pred_counts_[i].store(initial_pred_counts_[i], std::memory_order_relaxed);
+    num_remaining_.store(n, std::memory_order_relaxed);
+    self_ = shared_from_this();
+
+    if (n == 0) {
+        on_run_done();
+        return;
+    }
+    // Start with the nodes that don't have predecessors
+    for_each_in_start_order(roots_.data(), roots_.data() + roots_.size(),
+            [this](int32_t idx) { start_node(idx); });
+}
+
+template <typename F>
+void task_graph_data::for_each_in_start_order(const int32_t* first, const int32_t* last, F f) {
+    if (spawn_nodes_ && current_worker_index() >= 0) {
+        // The local queue of the worker is LIFO: spawn the nodes in increasing order of their rank,
+        // so that the critical node is executed next by this worker, while the other workers steal
+        // the less critical nodes.
+        for (; last != first; --last)
+            f(*(last - 1));
+    } else {
+        // Most executors will roughly preserve the order of the tasks; this is also the case for
+        // the global queue, used when spawning from a thread that is not a worker
+        for (; first != last; ++first)
+            f(*first);
+    }
+}
+
+void task_graph_data::start_node(int32_t idx) noexcept {
+    task t{task_graph_node_fun{this, idx}, group_, task_graph_node_cont{this, idx}};
+    if (spawn_nodes_)
+        do_spawn_noexcept(get_exec_context(), std::move(t));
+    else
+        executor_.execute(std::move(t));
+}
+
+void task_graph_data::exec_node(int32_t idx) {
+    if (!measure_costs_) {
+        node_funs_[idx]();
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    node_funs_[idx]();
+    auto dur = std::chrono::steady_clock::now() - start;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(dur).count();
+    measured_ns_[idx].store(std::max<int64_t>(ns, 1), std::memory_order_relaxed);
+}
+
+void task_graph_data::on_node_done(int32_t idx, std::exception_ptr ex) noexcept {
+    CONCORE_PROFILING_SCOPE_N("task_graph.on_node_done");
+    // Keep track of the first exception
+    if (ex && !has_exception_.exchange(true, std::memory_order_acq_rel))
+        first_exception_ = std::move(ex);
+
+    // Release the successors; start the ones that don't have other active predecessors
+    const int32_t* first = succ_indices_.data() + succ_offsets_[idx];
+    const int32_t* last = succ_indices_.data() + succ_offsets_[idx + 1];
+    for_each_in_start_order(first, last, [this](int32_t next) {
+        if (pred_counts_[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            start_node(next);
+    });
+
+    // Check if this is the last node in the graph
+    if (num_remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        on_run_done();
+}
+
+void task_graph_data::on_run_done() noexcept {
+    // Collect everything we need before marking the run as complete; after that, a new run can
+    // start
+    auto listener = listener_;
+    listener_ = nullptr;
+    auto ex = std::move(first_exception_);
+    first_exception_ = std::exception_ptr{};
+    bool cancelled = group_.is_cancelled();
+    auto self = std::move(self_); // ensure we don't get destroyed while in this function
+    if (measure_costs_ && !cancelled)
+        update_costs_from_measurements();
+    running_.store(false, std::memory_order_release);
+
+    if (listener)
+        listener->on_graph_done(cancelled, std::move(ex));
+}
+
+void start_task_graph(
+        const std::shared_ptr<task_graph_data>& data, task_graph_listener* listener) noexcept {
+    assert(data);
+    data->start(listener);
+}
+
 } // namespace detail
 
 inline namespace v1 {
@@ -95,5 +618,166 @@ void add_dependencies(std::initializer_list<chained_task> prevs, chained_task ne
         p.impl_->next_tasks_.push_back(next);
 }
 
+dataflow_task::dataflow_task(task t, any_executor executor)
+    : impl_(std::make_shared<detail::dataflow_task_impl>(std::move(t), std::move(executor))) {}
+
+void dataflow_task::start() noexcept {
+    assert(impl_);
+    impl_->release();
+}
+
+bool dataflow_task::is_done() const noexcept {
+    return impl_ && impl_->succ_head_.load(std::memory_order_acquire) ==
+                            detail::dataflow_task_impl::closed_list();
+}
+
+void add_dependency(dataflow_task prev, dataflow_task next) {
+    assert(prev && next);
+    prev.impl_->add_successor(next.impl_);
+}
+void add_dependencies(dataflow_task prev, std::initializer_list<dataflow_task> nexts) {
+    for (const auto& n : nexts)
+        add_dependency(prev, n);
+}
+void add_dependencies(std::initializer_list<dataflow_task> prevs, dataflow_task next) {
+    for (const auto& p : prevs)
+        add_dependency(p, next);
+}
+
+void task_graph::run() { detail::start_task_graph(data_, nullptr); }
+
+void task_graph::wait() {
+    assert(data_);
+    concore::wait(data_->group_);
+}
+
+void task_graph::run_and_wait() {
+    run();
+    wait();
+}
+
+double task_graph::node_rank(int node) const noexcept {
+    assert(data_);
+    assert(0 <= node && node < num_nodes());
+    return data_->ranks_[data_->node_to_task_[node]];
+}
+
+int task_graph::num_nodes() const noexcept {
+    return data_ ? static_cast<int>(data_->node_to_task_.size()) : 0;
+}
+
+int task_graph::num_tasks() const noexcept {
+    return data_ ? static_cast<int>(data_->node_funs_.size()) : 0;
+}
+
+task_graph_builder::task_graph_builder() = default;
+task_graph_builder::task_graph_builder(task_group grp)
+    : group_(std::move(grp)) {}
+task_graph_builder::task_graph_builder(task_group grp, any_executor exe)
+    : group_(std::move(grp))
+    , executor_(std::move(exe)) {}
+task_graph_builder::task_graph_builder(any_executor exe)
+    : executor_(std::move(exe)) {}
+
+int task_graph_builder::add_node(task_function f, double cost) {
+    assert(f);
+    assert(cost >= 0.0);
+    node_funs_.emplace_back(std::move(f));
+    node_costs_.push_back(cost);
+    return static_cast<int>(node_funs_.size()) - 1;
+}
+
+void task_graph_builder::set_measure_costs(bool val) { measure_costs_ = val; }
+
+void task_graph_builder::set_optimizations(task_graph_optimizations opts) {
+    assert(opts.merge_threshold_ >= 0.0);
+    optimizations_ = opts;
+}
+
+void task_graph_builder::add_edge(int prev, int next) {
+    assert(0 <= prev && prev < static_cast<int>(node_funs_.size()));
+    assert(0 <= next && next < static_cast<int>(node_funs_.size()));
+    edges_.emplace_back(prev, next);
+}
+
+task_graph task_graph_builder::build() {
+    auto data = std::make_shared<detail::task_graph_data>();
+    auto num_user_nodes = static_cast<int32_t>(node_funs_.size());
+
+    // The successors of each node, as given by the user
+    detail::adjacency_list succs(num_user_nodes);
+    for (const auto& e : edges_)
+        succs[e.first].push_back(e.second);
+
+    // Check that the graph is acyclic
+    std::vector<int32_t> order = detail::topological_order(succs);
+
+    // Apply the optimizations; this will group the user nodes into the nodes of the final graph
+    detail::adjacency_list groups(num_user_nodes);
+    for (int32_t i = 0; i < num_user_nodes; i++)
+        groups[i].push_back(i);
+    if (optimizations_.remove_transitive_edges_)
+        detail::remove_transitive_edges(succs, order);
+    if (optimizations_.merge_threshold_ > 0.0) {
+        groups = detail::merge_small_siblings(succs, node_costs_, optimizations_.merge_threshold_);
+        succs = detail::contract_graph(succs, groups);
+    }
+    if (optimizations_.fuse_chains_) {
+        auto fused = detail::fuse_chains(succs);
+        succs = detail::contract_graph(succs, fused);
+        groups = detail::expand_groups(fused, groups);
+    }
+    auto n = static_cast<int32_t>(groups.size());
+
+    // Create the nodes of the final graph
+    data->node_funs_.resize(n);
+    data->costs_.assign(n, 0.0);
+    data->node_to_task_.resize(num_user_nodes);
+    for (int32_t i = 0; i < n; i++) {
+        std::vector<task_function> funs;
+        funs.reserve(groups[i].size());
+        for (auto idx : groups[i]) {
+            funs.emplace_back(std::move(node_funs_[idx]));
+            data->costs_[i] += node_costs_[idx];
+            data->node_to_task_[idx] = i;
+        }
+        if (funs.size() == 1)
+            data->node_funs_[i] = std::move(funs[0]);
+        else
+            data->node_funs_[i] = detail::task_graph_fused_fun{data.get(), std::move(funs)};
+    }
+
+    // Build the successor lists in CSR format, and count the predecessors
+    data->succ_offsets_.assign(n + 1, 0);
+    data->initial_pred_counts_.assign(n, 0);
+    for (int32_t i = 0; i < n; i++) {
+        data->succ_offsets_[i + 1] = data->succ_offsets_[i] + static_cast<int32_t>(succs[i].size());
+        data->succ_indices_.insert(data->succ_indices_.end(), succs[i].begin(), succs[i].end());
+        for (auto next : succs[i])
+            data->initial_pred_counts_[next]++;
+    }
+    data->topo_order_ = detail::topological_order(succs);
+    for (int32_t i = 0; i < n; i++)
+        if (data->initial_pred_counts_[i] == 0)
+            data->roots_.push_back(i);
+
+    // Compute the ranks of the nodes, to be able to prioritize the critical path
+    data->ranks_.assign(n, 0.0);
+    data->compute_ranks();
+    data->measure_costs_ = measure_costs_;
+    if (measure_costs_)
+        data->measured_ns_ = std::make_unique<std::atomic<int64_t>[]>(n);
+
+    data->pred_counts_ = std::make_unique<std::atomic<int32_t>[]>(n);
+    data->group_ = task_group::create(group_);
+    data->spawn_nodes_ = !executor_;
+    data->executor_ = executor_ ? std::move(executor_) : any_executor{spawn_executor{}};
+
+    node_funs_.clear();
+    node_costs_.clear();
+    edges_.clear();
+    return task_graph{std::move(data)};
+}
+
 } // namespace v1
 } // namespace concore
@@ -8,7 +8,12 @@ inline rc::Gen<concore::partition_method> arb_partition_method() {
     return gen::element(concore::partition_method::auto_partition,
             concore::partition_method::upfront_partition,
             concore::partition_method::iterative_partition,
-            concore::partition_method::naive_partition);
+            concore::partition_method::naive_partition,
+            concore::partition_method::affinity_partition,
+            concore::partition_method::lazy_partition,
+            concore::partition_method::guided_partition,
+            concore::partition_method::factoring_partition,
+            concore::partition_method::deterministic_partition);
 }
 DEFINE_RC_ARBITRARY(concore::partition_method, arb_partition_method())
 
@@ -28,6 +33,21 @@ inline std::ostream& operator<<(std::ostream& os, partition_method method) {
     case partition_method::naive_partition:
         os << "naive_partition";
         break;
+    case partition_method::affinity_partition:
+        os << "affinity_partition";
+        break;
+    case partition_method::lazy_partition:
+        os << "lazy_partition";
+        break;
+    case partition_method::guided_partition:
+        os << "guided_partition";
+        break;
+    case partition_method::factoring_partition:
+        os << "factoring_partition";
+        break;
+    case partition_method::deterministic_partition:
+        os << "deterministic_partition";
+        break;
     default:
         os << "unknown(" << static_cast<int>(method) << ")";
         break;
@@ -0,0 +1,114 @@
+#include <catch2/catch.hpp>
+#include <concore/detail/simd_kernels.hpp>
+#include "func/rapidcheck_utils.hpp"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+using namespace concore::detail::simd;
+
+namespace {
+const std::array<isa, 5> all_isas{isa::scalar, isa::sse2, isa::avx2, isa::avx512, isa::neon};
+
+//! Checks that the kernels give the same results as the element-by-element operations
+template <typename T>
+void check_kernels(const std::vector<T>& v) {
+    auto n = static_cast<std::ptrdiff_t>(v.size());
+    const T init = T(3);
+    const T lo = std::numeric_limits<T>::max();
+    const T hi = std::numeric_limits<T>::lowest();
+
+    T exp_sum = std::accumulate(v.begin(), v.end(), init);
+    T exp_min = std::accumulate(v.begin(), v.end(), lo, concore::min_op{});
+    T exp_max = std::accumulate(v.begin(), v.end(), hi, concore::max_op{});
+    std::vector<T> exp_scan(v.size());
+    std::partial_sum(v.begin(), v.end(), exp_scan.begin());
+    for (auto& x : exp_scan)
+        x += init;
+
+    for (isa target : all_isas) {
+        // The elements are small integers, so even the floating-point results are exact
+        RC_ASSERT(reduce_sum(target, v.data(), n, init) == exp_sum);
+        RC_ASSERT(reduce_min(target, v.data(), n, lo) == exp_min);
+        RC_ASSERT(reduce_max(target, v.data(), n, hi) == exp_max);
+        auto mm = reduce_minmax(target, v.data(), n, std::make_pair(lo, hi));
+        RC_ASSERT(mm == std::make_pair(exp_min, exp_max));
+
+        std::vector<T> res(v.size());
+        T last = inclusive_sum(target, v.data(), n, res.data(), init);
+        RC_ASSERT(res == exp_scan);
+        RC_ASSERT(last == (v.empty() ? init : exp_scan.back()));
+    }
+}
+
+template <typename T>
+std::vector<T> small_values() {
+    auto ints = *rc::gen::container<std::vector<int>>(rc::gen::inRange(-1000, 1000));
+    return std::vector<T>(ints.begin(), ints.end());
+}
+} // namespace
+
+TEST_CASE("SIMD kernels match the scalar operations", "[simd]") {
+    PROPERTY([]() { check_kernels(small_values<int32_t>()); });
+    PROPERTY([]() { check_kernels(small_values<int64_t>()); });
+    PROPERTY([]() { check_kernels(small_values<float>()); });
+    PROPERTY([]() { check_kernels(small_values<double>()); });
+}
+
+TEST_CASE("SIMD floating-point sums are close to the scalar ones", "[simd]") {
+    PROPERTY([](const std::vector<int>& ints) {
+        // Values that are not exactly representable, so that the order of the additions matters
+        std::vector<double> v(ints.size());
+        for (size_t i = 0; i < v.size(); i++)
+            v[i] = ints[i] / 7.0;
+        double scale = 0.0;
+        for (double x : v)
+            scale += std::abs(x);
+        double expected = std::accumulate(v.begin(), v.end(), 0.0);
+        auto n = static_cast<std::ptrdiff_t>(v.size());
+        for (isa target : all_isas) {
+            double res = reduce_sum(target, v.data(), n, 0.0);
+            RC_ASSERT(std::abs(res - expected) <= 1e-12 * scale);
+        }
+    });
+}
+
+TEST_CASE("SIMD min and max ignore NaN elements, like min_op and max_op", "[simd]") {
+    std::vector<float> v(100, 1.0f);
+    v[10] = -5.0f;
+    v[37] = std::numeric_limits<float>::quiet_NaN();
+    v[80] = 7.0f;
+    for (isa target : all_isas) {
+        CHECK(reduce_min(target, v.data(), 100, 100.0f) == -5.0f);
+        CHECK(reduce_max(target, v.data(), 100, -100.0f) == 7.0f);
+    }
+}
+
+TEST_CASE("SIMD kernels are recognized only for built-in ops on contiguous ranges", "[simd]") {
+    using vec_it = std::vector<float>::iterator;
+    using list_it = std::vector<bool>::iterator;
+    static_assert(reduce_kernel_for<vec_it, float, std::plus<>> == reduce_kind::sum);
+    static_assert(reduce_kernel_for<const int*, int, std::plus<int>> == reduce_kind::sum);
+    static_assert(reduce_kernel_for<vec_it, float, concore::min_op> == reduce_kind::min);
+    static_assert(reduce_kernel_for<vec_it, float, concore::max_op> == reduce_kind::max);
+    static_assert(reduce_kernel_for<vec_it, std::pair<float, float>, concore::minmax_op> ==
+                  reduce_kind::minmax);
+    // The value type must match the elements
+    static_assert(reduce_kernel_for<vec_it, double, std::plus<>> == reduce_kind::none);
+    // Unknown operations
+    static_assert(reduce_kernel_for<vec_it, float, std::multiplies<>> == reduce_kind::none);
+    // Not contiguous, or not arithmetic
+    static_assert(reduce_kernel_for<list_it, bool, std::plus<>> == reduce_kind::none);
+    static_assert(reduce_kernel_for<int, int, std::plus<>> == reduce_kind::none);
+    static_assert(reduce_kernel_for<const short*, short, std::plus<>> == reduce_kind::none);
+    // Scans must write to contiguous, non-const elements of the same integer type
+    using int_vec_it = std::vector<int32_t>::iterator;
+    static_assert(has_scan_kernel<int_vec_it, int32_t*, int32_t, std::plus<>>);
+    static_assert(!has_scan_kernel<int_vec_it, const int32_t*, int32_t, std::plus<>>);
+    static_assert(!has_scan_kernel<int_vec_it, int64_t*, int32_t, std::plus<>>);
+    static_assert(!has_scan_kernel<vec_it, float*, float, std::plus<>>);
+    SUCCEED();
+}
@@ -224,3 +224,53 @@ TEST_CASE("worker_tasks: can steal in parallel with push/pop", "[worker_tasks]")
     for (int i = 0; i < num_tasks; i++)
         REQUIRE(res[i]);
 }
+
+TEST_CASE("worker_tasks: other threads can push in parallel with the owner", "[worker_tasks]") {
+    constexpr int num_tasks = 2'000;
+
+    std::array<std::atomic<int>, 2 * num_tasks> res{};
+
+    task_countdown barrier{2};
+
+    concore::detail::worker_tasks tasks;
+    std::atomic<int> num_extracted_tasks{0};
+
+    // The owner pushes and pops its own tasks, and also executes the tasks from the other thread
+    std::thread owner = std::thread([&]() {
+        barrier.task_finished();
+        barrier.wait_for_all();
+
+        concore::task extracted_task;
+        for (int i = 0; i < num_tasks; i++) {
+            tasks.push(concore::task{[&res, i]() { res[i]++; }});
+            if (tasks.try_pop(extracted_task)) {
+                extracted_task();
+                num_extracted_tasks++;
+            }
+        }
+        concore::spin_backoff spinner;
+        while (num_extracted_tasks.load() < 2 * num_tasks) {
+            if (tasks.try_pop(extracted_task)) {
+                extracted_task();
+                num_extracted_tasks++;
+            } else
+                spinner.pause();
+        }
+    });
+
+    std::thread other = std::thread([&]() {
+        barrier.task_finished();
+        barrier.wait_for_all();
+
+        for (int i = num_tasks; i < 2 * num_tasks; i++)
+            tasks.push_remote(concore::task{[&res, i]() { res[i]++; }});
+    });
+
+    owner.join();
+    other.join();
+
+    // Each task was executed exactly once
+    for (const auto& r : res)
+        REQUIRE(r.load() == 1);
+    REQUIRE(tasks.empty());
+}
@@ -2,7 +2,9 @@
 #include <catch2/catch.hpp>
 #include "arb_partition_hints.hpp"
 #include <concore/conc_for.hpp>
+#include <concore/granularity_tuner.hpp>
 #include <concore/integral_iterator.hpp>
+#include "test_common/large_range.hpp"
 #include <concore/profiling.hpp>
 #include <concore/init.hpp>
 
@@ -11,6 +13,8 @@
 #include <chrono>
 #include <forward_list>
 #include <array>
+#include <algorithm>
+#include <vector>
 
 using namespace std::chrono_literals;
 
@@ -63,6 +67,28 @@ TEST_CASE("conc_for can be canceled", "[conc_for]") {
     });
 }
 
+TEST_CASE("conc_for stops executing iterations after cancellation", "[conc_for]") {
+    auto method = GENERATE(concore::partition_method::auto_partition,
+            concore::partition_method::upfront_partition,
+            concore::partition_method::iterative_partition,
+            concore::partition_method::naive_partition,
+            concore::partition_method::lazy_partition,
+            concore::partition_method::deterministic_partition);
+    constexpr int num_iter = 10'000;
+    auto grp = concore::task_group::create();
+    std::atomic<int> count{0};
+    concore::partition_hints hints;
+    hints.method_ = method;
+
+    // The iterations don't check for cancellation; the partitioning should stop them
+    auto iter_body = [&](int i) {
+        if (count++ == 0)
+            grp.cancel();
+    };
+    concore::conc_for(0, num_iter, iter_body, grp, hints);
+    REQUIRE(count.load() < num_iter);
+}
+
 TEST_CASE("conc_for is a blocking call", "[conc_for]") {
     PROPERTY([](concore::partition_hints hints) {
         constexpr int num_iter = 20;
@@ -141,3 +167,367 @@ TEST_CASE("conc_for can be used to implement transform", "[conc_for]") {
         RC_ASSERT(my_res == expected);
     });
 }
+
+TEST_CASE("conc_for with affinity_partition records the workers of the chunks", "[conc_for]") {
+    constexpr int num_iter = 1000;
+    concore::affinity_state state;
+    concore::partition_hints hints;
+    hints.method_ = concore::partition_method::affinity_partition;
+    hints.affinity_ = &state;
+
+    // Run multiple times, so that we replay the recorded mapping
+    for (int k = 0; k < 5; k++) {
+        std::array<std::atomic<int>, num_iter> counts{};
+        for (int i = 0; i < num_iter; i++)
+            counts[i] = 0;
+        concore::conc_for(0, num_iter, [&](int i) { counts[i]++; }, hints);
+
+        for (int i = 0; i < num_iter; i++)
+            REQUIRE(counts[i].load() == 1);
+        REQUIRE(state.num_chunks() > 0);
+        REQUIRE(state.num_chunks() <= size_t(num_iter));
+        // All the chunks were executed by some worker threads
+        for (size_t c = 0; c < state.num_chunks(); c++)
+            REQUIRE(state.worker_of(c) >= 0);
+    }
+
+    // A different range size discards the recorded mapping
+    concore::conc_for(0, 3, [&](int i) {}, hints);
+    REQUIRE(state.num_chunks() <= 3);
+    state.clear();
+    REQUIRE(state.num_chunks() == 0);
+}
+
+TEST_CASE("nested conc_for with lazy_partition covers all the iterations", "[conc_for]") {
+    constexpr int num_outer = 50;
+    constexpr int num_inner = 200;
+    concore::partition_hints hints;
+    hints.method_ = concore::partition_method::lazy_partition;
+    hints.granularity_ = 1;
+
+    std::vector<std::atomic<int>> counts(num_outer * num_inner);
+    concore::conc_for(
+            0, num_outer,
+            [&](int i) {
+                auto inner_body = [&](int b, int e) {
+                    for (int j = b; j < e; j++)
+                        counts[i * num_inner + j]++;
+                };
+                concore::conc_for_range(0, num_inner, inner_body, hints);
+            },
+            hints);
+
+    for (auto& c : counts)
+        REQUIRE(c.load() == 1);
+}
+
+namespace {
+//! Work that cannot be copied; counts the covered elements
+struct non_copyable_work {
+    using iterator = concore::integral_iterator<int>;
+
+    std::atomic<int> count_{0};
+
+    non_copyable_work() = default;
+    non_copyable_work(const non_copyable_work&) = delete;
+    non_copyable_work& operator=(const non_copyable_work&) = delete;
+
+    void exec(iterator first, iterator last) { count_ += int(last - first); }
+};
+} // namespace
+
+TEST_CASE("lazy partition doesn't copy the work object when there are no joins", "[conc_for]") {
+    constexpr int num_iter = 10'000;
+    non_copyable_work work;
+    auto grp = concore::task_group::create();
+    concore::detail::lazy_partition_work<false>(
+            concore::integral_iterator<int>(0), num_iter, work, grp, 1);
+    REQUIRE(work.count_.load() == num_iter);
+}
+
+namespace {
+//! Work that uses a scratch buffer while executing; checks that no other task uses the same buffer
+//! at the same time
+struct scratch_work {
+    using iterator = concore::integral_iterator<int>;
+
+    std::vector<int> scratch_;
+    std::atomic<int>* count_;
+    std::atomic<int>* num_conflicts_;
+
+    void exec(iterator first, iterator last) {
+        scratch_.clear();
+        for (int i = *first; i < *last; i++)
+            scratch_.push_back(i);
+        // Give other tasks the chance to overwrite the scratch buffer
+        std::this_thread::sleep_for(std::chrono::microseconds(10));
+        for (int i = *first; i < *last; i++) {
+            if (size_t(i - *first) >= scratch_.size() || scratch_[i - *first] != i) {
+                (*num_conflicts_)++;
+                break;
+            }
+        }
+        *count_ += int(*last - *first);
+    }
+};
+} // namespace
+
+TEST_CASE("auto partition gives each interval its own copy of the work", "[conc_for]") {
+    concore::init_data config;
+    config.num_workers_ = 4;
+    concore::shutdown();
+    concore::init(config);
+
+    constexpr int num_iter = 1000;
+    std::atomic<int> count{0};
+    std::atomic<int> num_conflicts{0};
+    scratch_work work{{}, &count, &num_conflicts};
+    auto grp = concore::task_group::create();
+    auto old_grp = concore::task_group::set_current_task_group(grp);
+    concore::detail::auto_partition_work<false>(
+            concore::integral_iterator<int>(0), num_iter, work, grp, 1);
+    concore::task_group::set_current_task_group(old_grp);
+    REQUIRE(count.load() == num_iter);
+    REQUIRE(num_conflicts.load() == 0);
+
+    // Let the next tests use the default configuration
+    concore::shutdown();
+}
+
+TEST_CASE("guided and factoring schedules claim decreasing chunks", "[conc_for]") {
+    PROPERTY(([](uint16_t n) {
+        using concore::detail::self_sched_part::schedule;
+        auto sched = *rc::gen::element(schedule::guided, schedule::factoring);
+        int granularity = *rc::gen::inRange(1, 20);
+        int num_workers = *rc::gen::inRange(1, 16);
+        concore::detail::self_sched_part::chunk_cursor cursor{n, granularity, num_workers, sched};
+
+        std::ptrdiff_t expected_begin = 0;
+        std::ptrdiff_t prev_size = n;
+        for (;;) {
+            auto chunk = cursor.claim();
+            if (chunk.first == chunk.second)
+                break;
+            // The chunks are contiguous, and they don't get larger
+            std::ptrdiff_t size = chunk.second - chunk.first;
+            RC_ASSERT(chunk.first == expected_begin);
+            RC_ASSERT(size <= prev_size);
+            // Only the last chunk may be smaller than the granularity
+            RC_ASSERT((size >= granularity || chunk.second == n));
+            expected_begin = chunk.second;
+            prev_size = size;
+        }
+        RC_ASSERT(expected_begin == std::ptrdiff_t(n));
+    }));
+}
+
+TEST_CASE("conc_for with a granularity tuner covers each element exactly once", "[conc_for]") {
+    PROPERTY(([](concore::partition_method method, uint16_t n) {
+        concore::granularity_tuner tuner{std::chrono::microseconds(10)};
+        concore::partition_hints hints;
+        hints.method_ = method;
+        hints.tuner_ = &tuner;
+
+        std::vector<std::atomic<int>> counts(n);
+        // First call measures the cost, the second one uses the cached estimate
+        for (int k = 0; k < 2; k++) {
+            concore::conc_for(0, int(n), [&](int i) { counts[i]++; }, hints);
+            RC_ASSERT(n == 0 || tuner.has_estimate());
+        }
+        for (auto& c : counts)
+            RC_ASSERT(c.load() == 2);
+    }));
+}
+
+TEST_CASE("granularity tuner measures the cost of the iterations", "[conc_for]") {
+    concore::granularity_tuner tuner{std::chrono::microseconds(200)};
+    concore::partition_hints hints;
+    hints.tuner_ = &tuner;
+    REQUIRE_FALSE(tuner.has_estimate());
+
+    auto body = [](int) { std::this_thread::sleep_for(20us); };
+    concore::conc_for(0, 200, body, hints);
+    REQUIRE(tuner.has_estimate());
+    double cost = tuner.cost_per_item_ns();
+    REQUIRE(cost >= 20'000.0);
+
+    // The estimate is cached; it's not measured again
+    concore::conc_for(0, 200, body, hints);
+    REQUIRE(tuner.cost_per_item_ns() == cost);
+
+    tuner.reset();
+    REQUIRE_FALSE(tuner.has_estimate());
+}
+
+TEST_CASE("conc_for_range covers each index exactly once", "[conc_for]") {
+    PROPERTY(([](concore::partition_hints hints) {
+        constexpr int num_iter = 1000;
+        std::array<std::atomic<int>, num_iter> counts{};
+        for (int i = 0; i < num_iter; i++)
+            counts[i] = 0;
+
+        auto range_body = [&](int b, int e) {
+            RC_ASSERT(0 <= b);
+            RC_ASSERT(b < e);
+            RC_ASSERT(e <= num_iter);
+            for (int i = b; i < e; i++)
+                counts[i]++;
+        };
+        concore::conc_for_range(0, num_iter, range_body, hints);
+
+        for (int i = 0; i < num_iter; i++)
+            RC_ASSERT(counts[i].load() == 1);
+    }));
+}
+
+TEST_CASE("conc_for_range can be used with random-access iterators", "[conc_for]") {
+    PROPERTY([](concore::partition_hints hints, std::vector<int> v) {
+        auto f = [](int x) { return x / 3 * 2; };
+        std::vector<int> expected(v.size());
+        std::transform(v.begin(), v.end(), expected.begin(), f);
+
+        using iter_t = std::vector<int>::iterator;
+        auto range_body = [&](iter_t b, iter_t e) { std::transform(b, e, b, f); };
+        concore::conc_for_range(v.begin(), v.end(), range_body, hints);
+
+        RC_ASSERT(v == expected);
+    });
+}
+
+TEST_CASE("conc_for_range forwards the exceptions", "[conc_for]") {
+    PROPERTY([](concore::partition_hints hints) {
+        auto range_body = [](int b, int e) {
+            if (b <= 50 && 50 < e)
+                throw std::runtime_error("some error");
+        };
+        try {
+            concore::conc_for_range(0, 100, range_body, hints);
+            RC_FAIL("Exception was not properly thrown");
+        } catch (const std::runtime_error& ex) {
+            RC_ASSERT(std::string(ex.what()) == std::string("some error"));
+        } catch (...) {
+            RC_FAIL("Exception does not match");
+        }
+    });
+}
+
+namespace {
+//! Work that records the covered indices; each call takes constant time
+struct coverage_work {
+    using iterator = large_iterator;
+
+    std::atomic<uint64_t>* count_;
+    std::atomic<uint64_t>* sum_;
+
+    void exec(iterator first, iterator last) {
+        range_coverage cov;
+        cov.add(*first, *last);
+        *count_ += cov.count_;
+        *sum_ += cov.sum_;
+    }
+};
+} // namespace
+
+TEST_CASE("conc_for can handle more than 2^31 elements", "[conc_for]") {
+    auto method = GENERATE(concore::partition_method::auto_partition,
+            concore::partition_method::upfront_partition,
+            concore::partition_method::lazy_partition,
+            concore::partition_method::iterative_partition,
+            concore::partition_method::guided_partition,
+            concore::partition_method::factoring_partition,
+            concore::partition_method::deterministic_partition);
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    coverage_work work{&count, &sum};
+
+    concore::partition_hints hints;
+    hints.method_ = method;
+    concore::conc_for(large_iterator(0), large_iterator(large_range_size), work, hints);
+
+    range_coverage cov{count.load(), sum.load()};
+    REQUIRE(cov.covers_exactly(large_range_size));
+}
+
+TEST_CASE("blocked_range2d splits along the longest dimension", "[conc_for]") {
+    concore::blocked_range2d<int> range{0, 1000, 10, 0, 100, 10};
+    auto rhs = range.split();
+    REQUIRE(range.rows().begin() == 0);
+    REQUIRE(range.rows().end() == 500);
+    REQUIRE(rhs.rows().begin() == 500);
+    REQUIRE(rhs.rows().end() == 1000);
+    REQUIRE(range.cols().size() == 100);
+    REQUIRE(rhs.cols().size() == 100);
+
+    // The lengths are measured in grains
+    concore::blocked_range2d<int> range2{0, 1000, 100, 0, 100, 1};
+    auto rhs2 = range2.split();
+    REQUIRE(range2.rows().size() == 1000);
+    REQUIRE(range2.cols().end() == 50);
+    REQUIRE(rhs2.cols().begin() == 50);
+}
+
+TEST_CASE("conc_for on a blocked_range2d covers each element exactly once", "[conc_for]") {
+    PROPERTY(([](uint8_t n_rows, uint8_t n_cols, uint8_t row_grain, uint8_t col_grain) {
+        size_t rg = std::max<size_t>(row_grain % 16, 1);
+        size_t cg = std::max<size_t>(col_grain % 16, 1);
+        std::vector<std::atomic<int>> counts(size_t(n_rows) * n_cols);
+        std::atomic<int> num_bad_tiles{0};
+
+        concore::blocked_range2d<int> range{0, n_rows, rg, 0, n_cols, cg};
+        concore::conc_for(range, [&](const concore::blocked_range2d<int>& tile) {
+            if (tile.rows().size() > rg || tile.cols().size() > cg || tile.empty())
+                num_bad_tiles++;
+            for (int i = tile.rows().begin(); i < tile.rows().end(); i++)
+                for (int j = tile.cols().begin(); j < tile.cols().end(); j++)
+                    counts[size_t(i) * n_cols + j]++;
+        });
+
+        RC_ASSERT(num_bad_tiles.load() == 0);
+        for (auto& c : counts)
+            RC_ASSERT(c.load() == 1);
+    }));
+}
+
+TEST_CASE("conc_for on a blocked_range3d covers each element exactly once", "[conc_for]") {
+    constexpr int n = 40;
+    std::vector<std::atomic<int>> counts(n * n * n);
+    std::atomic<int> num_tiles{0};
+
+    concore::blocked_range3d<int> range{0, n, 8, 0, n, 8, 0, n, 16};
+    concore::conc_for(range, [&](const concore::blocked_range3d<int>& tile) {
+        num_tiles++;
+        for (int p = tile.pages().begin(); p < tile.pages().end(); p++)
+            for (int i = tile.rows().begin(); i < tile.rows().end(); i++)
+                for (int j = tile.cols().begin(); j < tile.cols().end(); j++)
+                    counts[(p * n + i) * n + j]++;
+    });
+
+    for (auto& c : counts)
+        REQUIRE(c.load() == 1);
+    // 40 is split into 5 for grain 8 (8 tiles) and into 20 for grain 16 (4 tiles)
+    REQUIRE(num_tiles.load() == 8 * 8 * 4);
+}
+
+TEST_CASE("conc_for on blocked ranges forwards the exceptions", "[conc_for]") {
+    concore::blocked_range2d<int> range{0, 100, 4, 0, 100, 4};
+    auto body = [](const concore::blocked_range2d<int>& tile) {
+        if (tile.rows().begin() == 0 && tile.cols().begin() == 0)
+            throw std::runtime_error("some error");
+    };
+    REQUIRE_THROWS_AS(concore::conc_for(range, body), std::runtime_error);
+}
+
+TEST_CASE("conc_for on blocked ranges stops after cancellation", "[conc_for]") {
+    concore::blocked_range2d<int> range{0, 256, 4, 0, 256, 4};
+    constexpr int num_tiles = 64 * 64;
+    auto grp = concore::task_group::create();
+    std::atomic<int> count{0};
+
+    // The tiles don't check for cancellation; the splitting should stop them
+    auto body = [&](const concore::blocked_range2d<int>&) {
+        if (count++ == 0)
+            grp.cancel();
+    };
+    concore::conc_for(range, body, grp);
+    REQUIRE(count.load() < num_tiles);
+}
@@ -0,0 +1,156 @@
+#include <catch2/catch.hpp>
+#include <concore/conc_for_file.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+//! A file with the given content, created in the temporary directory; removed at destruction
+struct temp_file {
+    std::string path_;
+
+    explicit temp_file(const std::string& content) {
+        static std::atomic<int> counter{0};
+        auto name = "concore_test_" + std::to_string(counter++) + ".txt";
+        path_ = (std::filesystem::temp_directory_path() / name).string();
+        std::ofstream f(path_, std::ios::binary);
+        f << content;
+    }
+    ~temp_file() { std::filesystem::remove(path_); }
+
+    temp_file(const temp_file&) = delete;
+    temp_file& operator=(const temp_file&) = delete;
+};
+
+//! Generates lines with numbers; some of the lines are much longer than the others
+std::string make_lines(int num_lines) {
+    std::string res;
+    for (int i = 0; i < num_lines; i++) {
+        res += std::to_string(i);
+        if (i % 37 == 0)
+            res += std::string(200, ' ');
+        res += '\n';
+    }
+    return res;
+}
+} // namespace
+
+TEST_CASE("mapped_file gives access to the content of a file", "[conc_for_file]") {
+    std::string content = make_lines(10000);
+    temp_file f{content};
+
+    concore::mapped_file mf{f.path_.c_str()};
+    REQUIRE(mf.size() == content.size());
+    REQUIRE(mf.view() == content);
+
+    // The content can be accessed after hinting the OS
+    mf.will_need(0, mf.size());
+    mf.dont_need(0, mf.size() / 2);
+    REQUIRE(mf.view() == content);
+
+    // Moving the object moves the content
+    concore::mapped_file mf2{std::move(mf)};
+    REQUIRE(mf.size() == 0);
+    REQUIRE(mf2.view() == content);
+}
+
+TEST_CASE("mapped_file throws if the file cannot be opened", "[conc_for_file]") {
+    REQUIRE_THROWS_AS(concore::mapped_file{"/non/existent/file"}, std::system_error);
+}
+
+TEST_CASE("conc_for_file visits each line exactly once", "[conc_for_file]") {
+    constexpr int num_lines = 5000;
+    temp_file f{make_lines(num_lines)};
+    std::vector<std::atomic<int>> visits(num_lines);
+
+    concore::file_chunk_hints hints;
+    hints.chunk_size_ = 100; // smaller than some of the lines
+    concore::conc_for_file(
+            f.path_.c_str(), [&](std::string_view line) { visits[std::stoi(std::string(line))]++; },
+            hints);
+
+    for (int i = 0; i < num_lines; i++)
+        REQUIRE(visits[i].load() == 1);
+}
+
+TEST_CASE("conc_for_file handles files without a trailing newline", "[conc_for_file]") {
+    temp_file f{"first\nsecond\n\nlast"};
+    std::mutex bottleneck;
+    std::vector<std::string> lines;
+
+    concore::file_chunk_hints hints;
+    hints.chunk_size_ = 4;
+    concore::conc_for_file(
+            f.path_.c_str(),
+            [&](std::string_view line) {
+                std::lock_guard<std::mutex> lock{bottleneck};
+                lines.emplace_back(line);
+            },
+            hints);
+
+    std::sort(lines.begin(), lines.end());
+    REQUIRE(lines == std::vector<std::string>{"", "first", "last", "second"});
+}
+
+TEST_CASE("conc_for_file doesn't call the functor for empty files", "[conc_for_file]") {
+    temp_file f{""};
+    std::atomic<int> num_calls{0};
+    concore::conc_for_file(f.path_.c_str(), [&](std::string_view) { num_calls++; });
+    REQUIRE(num_calls.load() == 0);
+}
+
+TEST_CASE("conc_for_file_chunks aligns the chunks to the records", "[conc_for_file]") {
+    std::string content;
+    for (int i = 0; i < 3000; i++)
+        content += "rec" + std::to_string(i) + ";";
+    temp_file f{content};
+
+    // Records end with ';'
+    auto finder = [](std::string_view data, size_t pos) {
+        if (pos == 0 || pos >= data.size())
+            return std::min(pos, data.size());
+        auto p = data.find(';', pos - 1);
+        return p == std::string_view::npos ? data.size() : p + 1;
+    };
+
+    std::mutex bottleneck;
+    std::vector<std::string_view> chunks;
+    std::atomic<int> num_bad{0};
+    concore::file_chunk_hints hints;
+    hints.chunk_size_ = 256;
+    hints.drop_consumed_ = false;
+    concore::conc_for_file_chunks(
+            f.path_.c_str(),
+            [&](std::string_view chunk) {
+                if (chunk.substr(0, 3) != "rec" || chunk.back() != ';')
+                    num_bad++;
+                std::lock_guard<std::mutex> lock{bottleneck};
+                chunks.push_back(chunk);
+            },
+            finder, hints);
+    REQUIRE(num_bad.load() == 0);
+    REQUIRE(chunks.size() > 10);
+
+    // The chunks, in order, make up the whole file
+    std::sort(chunks.begin(), chunks.end(),
+            [](std::string_view l, std::string_view r) { return l.data() < r.data(); });
+    for (size_t i = 1; i < chunks.size(); i++)
+        REQUIRE(chunks[i - 1].data() + chunks[i - 1].size() == chunks[i].data());
+}
+
+TEST_CASE("conc_for_file propagates the exceptions", "[conc_for_file]") {
+    temp_file f{make_lines(1000)};
+    concore::file_chunk_hints hints;
+    hints.chunk_size_ = 512;
+    auto fun = [](std::string_view line) {
+        if (line == "500")
+            throw std::runtime_error("bad line");
+    };
+    REQUIRE_THROWS_AS(concore::conc_for_file(f.path_.c_str(), fun, hints), std::runtime_error);
+}
@@ -1,14 +1,22 @@
 
 #include <catch2/catch.hpp>
 #include <concore/conc_reduce.hpp>
+#include <concore/reduce_ops.hpp>
+#include <concore/granularity_tuner.hpp>
 #include "arb_partition_hints.hpp"
 #include <concore/integral_iterator.hpp>
+#include "test_common/large_range.hpp"
 #include <concore/profiling.hpp>
+#include <concore/init.hpp>
 
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <cmath>
 #include <forward_list>
+#include <limits>
+#include <random>
+#include <string>
 
 using namespace std::chrono_literals;
 
@@ -42,6 +50,80 @@ TEST_CASE("conc_reduce is equivalent to std::accumulate (forward_list)", "[conc_
         RC_ASSERT(res == expected);
     });
 }
+TEST_CASE("conc_reduce with built-in operations on contiguous ranges", "[conc_reduce]") {
+    PROPERTY([](concore::partition_hints hints, std::vector<int64_t> v) {
+        using lim = std::numeric_limits<int64_t>;
+        auto sum = concore::conc_reduce(
+                v.begin(), v.end(), int64_t(0), std::plus<>(), std::plus<>(), hints);
+        auto min = concore::conc_reduce(
+                v.begin(), v.end(), lim::max(), concore::min_op{}, concore::min_op{}, hints);
+        auto max = concore::conc_reduce(
+                v.begin(), v.end(), lim::min(), concore::max_op{}, concore::max_op{}, hints);
+        auto minmax = concore::conc_reduce(v.begin(), v.end(),
+                std::make_pair(lim::max(), lim::min()), concore::minmax_op{}, concore::minmax_op{},
+                hints);
+
+        RC_ASSERT(sum == std::accumulate(v.begin(), v.end(), int64_t(0)));
+        RC_ASSERT(min == std::accumulate(v.begin(), v.end(), lim::max(), concore::min_op{}));
+        RC_ASSERT(max == std::accumulate(v.begin(), v.end(), lim::min(), concore::max_op{}));
+        RC_ASSERT(minmax == std::make_pair(min, max));
+    });
+}
+TEST_CASE("conc_reduce with affinity_partition joins the chunks in order", "[conc_reduce]") {
+    concore::affinity_state state;
+    concore::partition_hints hints;
+    hints.method_ = concore::partition_method::affinity_partition;
+    hints.affinity_ = &state;
+
+    std::string v(1000, ' ');
+    for (size_t i = 0; i < v.size(); i++)
+        v[i] = char('a' + i % 26);
+    auto op = [](std::string s, char c) -> std::string { return s + c; };
+    auto reduction = [](std::string lhs, const std::string& rhs) { return lhs + rhs; };
+    // Run multiple times, so that we replay the recorded mapping
+    for (int k = 0; k < 3; k++) {
+        auto res = concore::conc_reduce(v.begin(), v.end(), std::string{}, op, reduction, hints);
+        REQUIRE(res == v);
+        REQUIRE(state.num_chunks() > 0);
+    }
+}
+TEST_CASE("conc_reduce with lazy_partition joins the parts in order", "[conc_reduce]") {
+    concore::partition_hints hints;
+    hints.method_ = concore::partition_method::lazy_partition;
+    hints.granularity_ = 1;
+
+    std::string v(1000, ' ');
+    for (size_t i = 0; i < v.size(); i++)
+        v[i] = char('a' + i % 26);
+    auto op = [](std::string s, char c) -> std::string {
+        // Give other workers the chance to ask for work
+        std::this_thread::sleep_for(1us);
+        return s + c;
+    };
+    auto reduction = [](std::string lhs, const std::string& rhs) { return lhs + rhs; };
+    auto res = concore::conc_reduce(v.begin(), v.end(), std::string{}, op, reduction, hints);
+    REQUIRE(res == v);
+}
+TEST_CASE("conc_reduce with a granularity tuner keeps the order of elements", "[conc_reduce]") {
+    PROPERTY([](std::string v) {
+        // Only the methods that keep the order of the chunks when joining
+        auto method = *rc::gen::element(concore::partition_method::auto_partition,
+                concore::partition_method::upfront_partition,
+                concore::partition_method::lazy_partition);
+        concore::granularity_tuner tuner{std::chrono::microseconds(5)};
+        concore::partition_hints hints;
+        hints.method_ = method;
+        hints.tuner_ = &tuner;
+
+        auto op = [](std::string s, char c) -> std::string { return s + c; };
+        auto reduction = [](std::string lhs, const std::string& rhs) { return lhs + rhs; };
+        for (int k = 0; k < 2; k++) {
+            auto res =
+                    concore::conc_reduce(v.begin(), v.end(), std::string{}, op, reduction, hints);
+            RC_ASSERT(res == v);
+        }
+    });
+}
 TEST_CASE("conc_reduce can be canceled", "[conc_reduce]") {
     PROPERTY([](concore::partition_hints hints) {
         auto grp = concore::task_group::create();
@@ -68,6 +150,82 @@ TEST_CASE("conc_reduce can be canceled", "[conc_reduce]") {
                 integral_iterator(0), integral_iterator(1000), 0, op, reduction, grp, hints);
     });
 }
+TEST_CASE("conc_reduce stops executing iterations after cancellation", "[conc_reduce]") {
+    auto method = GENERATE(concore::partition_method::auto_partition,
+            concore::partition_method::upfront_partition,
+            concore::partition_method::iterative_partition,
+            concore::partition_method::lazy_partition,
+            concore::partition_method::deterministic_partition);
+    constexpr int num_iter = 10'000;
+    auto grp = concore::task_group::create();
+    std::atomic<int> count{0};
+    concore::partition_hints hints;
+    hints.method_ = method;
+
+    // The operation doesn't check for cancellation; the partitioning should stop the iterations
+    auto op = [&](int id, int i) -> int {
+        if (count++ == 0)
+            grp.cancel();
+        return id + i;
+    };
+    auto reduction = [](int lhs, int rhs) -> int { return lhs + rhs; };
+    concore::conc_reduce(
+            integral_iterator(0), integral_iterator(num_iter), 0, op, reduction, grp, hints);
+    REQUIRE(count.load() < num_iter);
+}
+
+TEST_CASE("conc_reduce with deterministic_partition gives reproducible results", "[conc_reduce]") {
+    // Values of very different magnitudes, so that the order of the additions matters
+    std::vector<double> v(100'000);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    for (auto& x : v)
+        x = dist(gen) * std::pow(10.0, int(gen() % 20));
+
+    auto granularity = GENERATE(-1, 1, 1000);
+    concore::partition_hints hints;
+    hints.method_ = concore::partition_method::deterministic_partition;
+    hints.granularity_ = granularity;
+    auto op = [](double id, double x) { return id + x; };
+    auto reduction = [](double lhs, double rhs) { return lhs + rhs; };
+
+    // The result doesn't depend on the number of workers, or on the scheduling
+    double expected = 0.0;
+    for (int num_workers : {1, 3, 8}) {
+        concore::shutdown();
+        concore::init_data config;
+        config.num_workers_ = num_workers;
+        concore::init(config);
+        for (int k = 0; k < 5; k++) {
+            double res = concore::conc_reduce(v.begin(), v.end(), 0.0, op, reduction, hints);
+            if (num_workers == 1 && k == 0)
+                expected = res;
+            REQUIRE(res == expected);
+        }
+    }
+    // Let the next tests use the default configuration
+    concore::shutdown();
+}
+
+TEST_CASE("conc_reduce with deterministic_partition limits the number of chunks", "[conc_reduce]") {
+    constexpr int num_iter = 100'000;
+    concore::partition_hints hints;
+    hints.method_ = concore::partition_method::deterministic_partition;
+    hints.granularity_ = 1;
+
+    // Each chunk has its own value, that needs to be joined
+    std::atomic<int> num_joins{0};
+    auto op = [](long long id, int i) -> long long { return id + i; };
+    auto reduction = [&](long long lhs, long long rhs) -> long long {
+        num_joins++;
+        return lhs + rhs;
+    };
+    auto res = concore::conc_reduce(
+            integral_iterator(0), integral_iterator(num_iter), 0LL, op, reduction, hints);
+    REQUIRE(res == (long long)(num_iter - 1) * num_iter / 2);
+    REQUIRE(num_joins.load() < 256);
+}
+
 TEST_CASE("conc_reduce forwards the exceptions in the binary operation", "[conc_reduce]") {
     PROPERTY([](concore::partition_hints hints) {
         constexpr int num_iter = 100;
@@ -116,3 +274,32 @@ TEST_CASE("conc_reduce forwards the exceptions in the reduce operation", "[conc_
         RC_ASSERT(res < not_expected);
     });
 }
+
+namespace {
+//! Reduce work that records the covered indices; each call takes constant time
+struct coverage_reduce_work {
+    using iterator = large_iterator;
+
+    range_coverage cov_;
+
+    void exec(iterator first, iterator last) { cov_.add(*first, *last); }
+    void join(coverage_reduce_work& rhs) { cov_.add(rhs.cov_); }
+};
+} // namespace
+
+TEST_CASE("conc_reduce can handle more than 2^31 elements", "[conc_reduce]") {
+    auto method = GENERATE(concore::partition_method::auto_partition,
+            concore::partition_method::upfront_partition,
+            concore::partition_method::lazy_partition,
+            concore::partition_method::iterative_partition,
+            concore::partition_method::guided_partition,
+            concore::partition_method::factoring_partition,
+            concore::partition_method::deterministic_partition);
+    coverage_reduce_work work;
+
+    concore::partition_hints hints;
+    hints.method_ = method;
+    concore::conc_reduce(large_iterator(0), large_iterator(large_range_size), work, hints);
+
+    REQUIRE(work.cov_.covers_exactly(large_range_size));
+}
@@ -1,11 +1,15 @@
 
 #include <catch2/catch.hpp>
 #include <concore/conc_scan.hpp>
+#include <concore/init.hpp>
 #include "arb_partition_hints.hpp"
 #include <concore/integral_iterator.hpp>
+#include "test_common/large_range.hpp"
 
+#include <cmath>
 #include <forward_list>
 #include <numeric>
+#include <random>
 
 using concore::integral_iterator;
 
@@ -27,6 +31,44 @@ TEST_CASE("conc_scan is equivalent to std::partial_sum (vector)", "[conc_scan]")
     });
 }
 
+TEST_CASE("conc_scan with std::plus on contiguous ranges", "[conc_scan]") {
+    PROPERTY([](concore::partition_hints hints) {
+        const auto v = *rc::gen::container<std::vector<int32_t>>(rc::gen::inRange(0, 1000));
+        std::vector<int32_t> res1(v.size(), 0);
+        std::vector<int32_t> res2(v.size(), 0);
+
+        concore::conc_scan(v.data(), v.data() + v.size(), res1.data(), int32_t(0),
+                std::plus<int32_t>(), hints);
+        std::partial_sum(v.begin(), v.end(), res2.begin());
+
+        RC_ASSERT(res1 == res2);
+    });
+}
+
+TEST_CASE("conc_scan of non-negative floats is non-decreasing", "[conc_scan]") {
+    // Values that are not exactly representable, so that the order of the additions matters; the
+    // zeros make some results equal to the previous ones, so that any rounding difference between
+    // the lines, or between the lanes of a SIMD scan, makes the sequence decrease
+    std::vector<float> v(100'000);
+    std::mt19937 gen(42);
+    for (auto& x : v)
+        x = gen() % 3 == 0 ? 0.0f : float(gen() % 1000) / 7.0f;
+
+    auto granularity = GENERATE(-1, 10, 1000);
+    auto method = GENERATE(concore::partition_method::auto_partition,
+            concore::partition_method::deterministic_partition);
+    concore::partition_hints hints;
+    hints.method_ = method;
+    hints.granularity_ = granularity;
+
+    std::vector<float> res(v.size());
+    concore::conc_scan(v.data(), v.data() + v.size(), res.data(), 0.0f, std::plus<float>(), hints);
+    for (size_t i = 1; i < res.size(); i++) {
+        if (res[i] < res[i - 1])
+            FAIL("the result decreases at " << i << ": " << res[i - 1] << " -> " << res[i]);
+    }
+}
+
 TEST_CASE("conc_scan is equivalent to std::partial_sum (forward_list)", "[conc_scan]") {
     PROPERTY([](concore::partition_hints hints) {
         const auto v = *rc::gen::container<std::forward_list<int>>(rc::gen::inRange(0, 1000));
@@ -71,6 +113,57 @@ TEST_CASE("conc_scan forwards the exceptions", "[conc_scan]") {
     });
 }
 
+TEST_CASE("conc_scan stops early after cancellation", "[conc_scan]") {
+    constexpr int num_iter = 100'000;
+    std::vector<int> dest(num_iter, 0);
+    auto grp = concore::task_group::create();
+    std::atomic<int> count{0};
+
+    // The operation doesn't check for cancellation; the partitioning should stop the iterations
+    auto op = [&](int id, int i) -> int {
+        if (count++ == 0)
+            grp.cancel();
+        return id + i;
+    };
+    concore::conc_scan(
+            integral_iterator(0), integral_iterator(num_iter), dest.begin(), 0, op, grp, {});
+    // Without cancellation, the parallel algorithm calls the operation for each element twice
+    REQUIRE(count.load() < num_iter);
+}
+
+TEST_CASE("conc_scan with deterministic_partition gives reproducible results", "[conc_scan]") {
+    // Values of very different magnitudes, so that the order of the additions matters
+    std::vector<double> v(100'000);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    for (auto& x : v)
+        x = dist(gen) * std::pow(10.0, int(gen() % 20));
+
+    auto granularity = GENERATE(-1, 10, 1000);
+    concore::partition_hints hints;
+    hints.method_ = concore::partition_method::deterministic_partition;
+    hints.granularity_ = granularity;
+    auto op = [](double lhs, double rhs) { return lhs + rhs; };
+
+    // The results don't depend on the number of workers, or on the scheduling
+    std::vector<double> expected;
+    for (int num_workers : {1, 3, 8}) {
+        concore::shutdown();
+        concore::init_data config;
+        config.num_workers_ = num_workers;
+        concore::init(config);
+        for (int k = 0; k < 3; k++) {
+            std::vector<double> res(v.size());
+            concore::conc_scan(v.begin(), v.end(), res.begin(), 0.0, op, hints);
+            if (expected.empty())
+                expected = res;
+            REQUIRE(res == expected);
+        }
+    }
+    // Let the next tests use the default configuration
+    concore::shutdown();
+}
+
 TEST_CASE("conc_scan on non-commutative operations (static)", "[conc_scan]") {
     int sz = ('Z' - 'A' + 1) * 2;
     std::vector<std::string> v;
@@ -113,3 +206,38 @@ TEST_CASE("conc_scan on non-commutative operations", "[conc_scan]") {
         RC_ASSERT(res1 == res2);
     }));
 }
+
+namespace {
+//! Scan work in which each element adds 1 to the sum; in the final stage, the sum before each
+//! range must be equal to the index of the first element in the range. Each call takes constant
+//! time.
+struct counting_scan_work {
+    int64_t sum_{0};
+    std::atomic<int>* num_bad_{nullptr};
+    std::atomic<int64_t>* num_final_{nullptr};
+    int line_{-1};
+
+    void exec(large_iterator first, large_iterator last, concore::detail::work_stage stage) {
+        if (stage != concore::detail::work_stage::initial) {
+            if (sum_ != *first)
+                (*num_bad_)++;
+            *num_final_ += *last - *first;
+        }
+        sum_ += *last - *first;
+    }
+    void join(counting_scan_work& rhs) { rhs.sum_ += sum_; }
+};
+} // namespace
+
+TEST_CASE("conc_scan partitioning can handle more than 2^31 elements", "[conc_scan]") {
+    std::atomic<int> num_bad{0};
+    std::atomic<int64_t> num_final{0};
+    counting_scan_work work{0, &num_bad, &num_final, -1};
+
+    auto grp = concore::task_group::create();
+    concore::detail::auto_partition_work_scan(
+            large_iterator(0), large_range_size, work, grp, 1);
+
+    REQUIRE(num_bad.load() == 0);
+    REQUIRE(num_final.load() == large_range_size);
+}
@@ -3,6 +3,7 @@
 #include "rapidcheck_utils.hpp"
 #include <concore/conc_sort.hpp>
 
+#include <atomic>
 #include <forward_list>
 
 using namespace std::chrono_literals;
@@ -24,6 +25,25 @@ TEST_CASE("conc_sort properly sorts ranges", "[conc_sort]") {
         RC_ASSERT(std::is_sorted(v.begin(), v.end()));
     });
 }
+TEST_CASE("conc_sort bails out early after cancellation", "[conc_sort]") {
+    constexpr int num_elem = 100'000;
+    std::vector<int> v(num_elem);
+    for (int i = 0; i < num_elem; i++)
+        v[i] = (i * 7919) % num_elem;
+    auto grp = concore::task_group::create();
+    std::atomic<int> num_comparisons{0};
+
+    auto comp = [&](int lhs, int rhs) {
+        if (num_comparisons++ == 0)
+            grp.cancel();
+        return lhs < rhs;
+    };
+    concore::conc_sort(v.begin(), v.end(), comp, grp);
+    // The first partitioning step completes, but nothing after it; sorting the whole range would
+    // take about n*log2(n) comparisons
+    REQUIRE(num_comparisons.load() < 2 * num_elem);
+}
+
 TEST_CASE("conc_sort keeps the same elements", "[conc_sort]") {
     PROPERTY([](std::vector<int> v) {
         auto v_copy = v;
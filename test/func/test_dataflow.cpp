@@ -0,0 +1,134 @@
+#include <catch2/catch.hpp>
+#include <concore/dataflow.hpp>
+#include <concore/global_executor.hpp>
+
+#include "test_common/queue_executor.hpp"
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+namespace {
+//! Executes the first task in the queue
+void run_one(std::deque<concore::task>& tasks) {
+    REQUIRE(!tasks.empty());
+    auto t = std::move(tasks.front());
+    tasks.pop_front();
+    t();
+}
+} // namespace
+
+TEST_CASE("dataflow_graph orders writes before reads", "[dataflow]") {
+    int a = 0;
+    int b = 0;
+    int c = 0;
+    concore::dataflow_graph graph;
+    graph.submit([&] { a = 1; }, concore::writes(a));
+    graph.submit([&] { b = 2; }, concore::writes(b));
+    graph.submit([&] { c = a + b; }, concore::reads(a, b), concore::writes(c));
+    graph.submit([&] { a = c * 10; }, concore::read_writes(a), concore::reads(c));
+    graph.wait();
+    REQUIRE(b == 2);
+    REQUIRE(c == 3);
+    REQUIRE(a == 30);
+}
+
+TEST_CASE("dataflow_graph allows concurrent readers", "[dataflow]") {
+    std::deque<concore::task> tasks;
+    int a = 0;
+    int r1 = -1;
+    int r2 = -1;
+    concore::dataflow_graph graph{concore::any_executor{queue_executor{&tasks}}};
+    graph.submit([&] { a = 5; }, concore::writes(a));
+    graph.submit([&] { r1 = a; }, concore::reads(a));
+    graph.submit([&] { r2 = a; }, concore::reads(a));
+    graph.submit([&] { a = 7; }, concore::writes(a));
+
+    // Only the writer is ready
+    REQUIRE(tasks.size() == 1);
+    run_one(tasks);
+    // Both readers become ready at the same time
+    REQUIRE(tasks.size() == 2);
+    run_one(tasks);
+    // The second write needs to wait for both readers
+    REQUIRE(tasks.size() == 1);
+    run_one(tasks);
+    REQUIRE(tasks.size() == 1);
+    run_one(tasks);
+    REQUIRE(tasks.empty());
+
+    REQUIRE(r1 == 5);
+    REQUIRE(r2 == 5);
+    REQUIRE(a == 7);
+}
+
+TEST_CASE("dataflow_graph combines multiple accesses to the same object", "[dataflow]") {
+    std::deque<concore::task> tasks;
+    int a = 0;
+    concore::dataflow_graph graph{concore::any_executor{queue_executor{&tasks}}};
+    graph.submit([&] { a++; }, concore::reads(a), concore::writes(a));
+    graph.submit([&] { a++; }, concore::reads(a, a));
+    REQUIRE(tasks.size() == 1);
+    run_one(tasks);
+    REQUIRE(tasks.size() == 1);
+    run_one(tasks);
+    REQUIRE(a == 2);
+}
+
+TEST_CASE("dataflow_graph produces the same results as serial execution", "[dataflow]") {
+    constexpr int num_objs = 8;
+    constexpr int num_tasks = 2000;
+
+    // Generate a random sequence of tasks; each task reads and writes some objects
+    struct task_desc {
+        std::vector<int> reads_;
+        std::vector<int> writes_;
+    };
+    srand(0);
+    std::vector<task_desc> descs(num_tasks);
+    for (auto& d : descs) {
+        for (int i = 0; i < num_objs; i++) {
+            int r = rand() % 8;
+            if (r == 0)
+                d.writes_.push_back(i);
+            else if (r < 3)
+                d.reads_.push_back(i);
+        }
+    }
+
+    // Each task computes a value from the objects it reads, and writes it in the objects it writes
+    auto exec_task = [](const task_desc& d, int idx, std::array<int64_t, num_objs>& objs,
+                             int64_t& res) {
+        int64_t val = idx;
+        for (auto i : d.reads_)
+            val = (val * 31 + objs[i]) % 1000003;
+        for (auto i : d.writes_)
+            objs[i] = val + i;
+        res = val;
+    };
+
+    // Serial execution
+    std::array<int64_t, num_objs> expected_objs{};
+    std::vector<int64_t> expected_res(num_tasks, 0);
+    for (int k = 0; k < num_tasks; k++)
+        exec_task(descs[k], k, expected_objs, expected_res[k]);
+
+    // Execute with dataflow_graph
+    std::array<int64_t, num_objs> objs{};
+    std::vector<int64_t> res(num_tasks, 0);
+    concore::dataflow_graph graph{concore::global_executor{}};
+    for (int k = 0; k < num_tasks; k++) {
+        concore::access_list acc;
+        for (auto i : descs[k].reads_)
+            acc.push_back({&objs[i], concore::access_mode::read});
+        for (auto i : descs[k].writes_)
+            acc.push_back({&objs[i], concore::access_mode::write});
+        const auto& d = descs[k];
+        graph.submit([&, k] { exec_task(d, k, objs, res[k]); }, acc);
+    }
+    graph.wait();
+
+    REQUIRE(objs == expected_objs);
+    REQUIRE(res == expected_res);
+}
@@ -0,0 +1,231 @@
+#include <catch2/catch.hpp>
+#include <concore/flow_graph.hpp>
+#include <concore/global_executor.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+//! Keeps track of the maximum number of concurrent executions of a piece of code
+struct concurrency_tracker {
+    std::atomic<int> cur_{0};
+    std::atomic<int> max_{0};
+
+    void enter() {
+        int cur = ++cur_;
+        int old_max = max_.load();
+        while (cur > old_max && !max_.compare_exchange_weak(old_max, cur))
+            ;
+    }
+    void leave() { cur_--; }
+};
+} // namespace
+
+TEST_CASE("function_node processes all the messages", "[flow_graph]") {
+    constexpr int num_msgs = 1000;
+    concore::flow_graph g{concore::global_executor{}};
+    concurrency_tracker tracker;
+    int64_t sum = 0;
+
+    concore::function_node<int, int> doubler{
+            g, concore::flow_unlimited, [](int x) { return 2 * x; }};
+    concore::function_node<int, int> summer{g, 1, [&](int x) {
+                                                tracker.enter();
+                                                sum += x; // serial node; no need to synchronize
+                                                tracker.leave();
+                                                return x;
+                                            }};
+    concore::make_edge(doubler, summer);
+
+    for (int i = 0; i < num_msgs; i++)
+        doubler.try_put(i);
+    g.wait_for_all();
+
+    REQUIRE(sum == int64_t(num_msgs) * (num_msgs - 1));
+    REQUIRE(tracker.max_.load() == 1);
+}
+
+TEST_CASE("function_node respects the concurrency limit", "[flow_graph]") {
+    concore::flow_graph g{concore::global_executor{}};
+    concurrency_tracker tracker;
+    std::atomic<int> count{0};
+    concore::function_node<int, int> node{g, 2, [&](int x) {
+                                              tracker.enter();
+                                              std::this_thread::yield();
+                                              count++;
+                                              tracker.leave();
+                                              return x;
+                                          }};
+    for (int i = 0; i < 200; i++)
+        node.try_put(i);
+    g.wait_for_all();
+    REQUIRE(count.load() == 200);
+    REQUIRE(tracker.max_.load() <= 2);
+}
+
+TEST_CASE("broadcast_node sends the messages to all the successors", "[flow_graph]") {
+    concore::flow_graph g;
+    std::atomic<int> sum1{0};
+    std::atomic<int> sum2{0};
+    concore::broadcast_node<int> bcast{g};
+    concore::function_node<int, int> n1{
+            g, concore::flow_unlimited, [&](int x) { return sum1 += x; }};
+    concore::function_node<int, int> n2{
+            g, concore::flow_unlimited, [&](int x) { return sum2 += x; }};
+    concore::make_edge(bcast, n1);
+    concore::make_edge(bcast, n2);
+
+    for (int i = 1; i <= 10; i++)
+        bcast.try_put(i);
+    g.wait_for_all();
+    REQUIRE(sum1.load() == 55);
+    REQUIRE(sum2.load() == 55);
+}
+
+TEST_CASE("join_node combines messages from its inputs", "[flow_graph]") {
+    concore::flow_graph g;
+    concore::join_node<int, std::string> join{g};
+    std::vector<std::tuple<int, std::string>> results;
+    concore::function_node<std::tuple<int, std::string>, int> collect{
+            g, 1, [&](std::tuple<int, std::string> t) {
+                results.push_back(std::move(t));
+                return 0;
+            }};
+    concore::make_edge(join, collect);
+
+    join.input_port<0>().try_put(1);
+    join.input_port<0>().try_put(2);
+    join.input_port<1>().try_put(std::string{"one"});
+    join.input_port<0>().try_put(3);
+    join.input_port<1>().try_put(std::string{"two"});
+    g.wait_for_all();
+
+    REQUIRE(results.size() == 2);
+    REQUIRE(results[0] == std::make_tuple(1, std::string{"one"}));
+    REQUIRE(results[1] == std::make_tuple(2, std::string{"two"}));
+}
+
+TEST_CASE("join_node works with types that are not default-constructible", "[flow_graph]") {
+    struct no_default {
+        explicit no_default(int v)
+            : v_(v) {}
+        int v_;
+    };
+    using tuple_t = std::tuple<no_default, int>;
+    //! Receiver that keeps the sum of the values it gets, without queueing the messages
+    struct sum_receiver : concore::flow_receiver<tuple_t> {
+        std::vector<int> results_;
+
+    protected:
+        bool do_try_put(tuple_t& msg, concore::flow_sender<tuple_t>*) override {
+            results_.push_back(std::get<0>(msg).v_ + std::get<1>(msg));
+            return true;
+        }
+    };
+
+    concore::flow_graph g;
+    concore::join_node<no_default, int> join{g};
+    sum_receiver collect;
+    concore::make_edge(join, collect);
+
+    join.input_port<0>().try_put(no_default{10});
+    join.input_port<0>().try_put(no_default{20});
+    join.input_port<1>().try_put(1);
+    join.input_port<1>().try_put(2);
+    g.wait_for_all();
+
+    REQUIRE(collect.results_ == std::vector<int>{11, 22});
+}
+
+TEST_CASE("buffer_node and limiter_node limit the messages in flight", "[flow_graph]") {
+    constexpr int num_msgs = 100;
+    constexpr int limit = 3;
+    concore::flow_graph g{concore::global_executor{}};
+    concore::buffer_node<int> buffer{g};
+    concore::limiter_node<int> limiter{g, limit};
+    std::atomic<int> in_flight{0};
+    std::atomic<int> max_in_flight{0};
+    std::atomic<int> processed{0};
+
+    concore::function_node<int, int> enter{g, concore::flow_unlimited, [&](int x) {
+                                               int cur = ++in_flight;
+                                               int old_max = max_in_flight.load();
+                                               while (cur > old_max &&
+                                                       !max_in_flight.compare_exchange_weak(
+                                                               old_max, cur))
+                                                   ;
+                                               return x;
+                                           }};
+    concore::function_node<int, int> leave{g, concore::flow_unlimited, [&](int x) {
+                                               in_flight--;
+                                               processed++;
+                                               limiter.decrement();
+                                               return x;
+                                           }};
+    concore::make_edge(buffer, limiter);
+    concore::make_edge(limiter, enter);
+    concore::make_edge(enter, leave);
+
+    for (int i = 0; i < num_msgs; i++)
+        buffer.try_put(i);
+    g.wait_for_all();
+
+    REQUIRE(processed.load() == num_msgs);
+    REQUIRE(max_in_flight.load() <= limit);
+    int dummy = 0;
+    REQUIRE_FALSE(buffer.try_get(dummy));
+}
+
+TEST_CASE("buffer_node without successors keeps the messages", "[flow_graph]") {
+    concore::flow_graph g;
+    concore::buffer_node<int> buffer{g};
+    buffer.try_put(1);
+    buffer.try_put(2);
+    int val = 0;
+    REQUIRE(buffer.try_get(val));
+    REQUIRE(val == 1);
+    REQUIRE(buffer.try_get(val));
+    REQUIRE(val == 2);
+    REQUIRE_FALSE(buffer.try_get(val));
+}
+
+TEST_CASE("move-only messages can pass through linear flow graphs", "[flow_graph]") {
+    using ptr_t = std::unique_ptr<int>;
+    concore::flow_graph g;
+    std::atomic<int> sum{0};
+    concore::function_node<ptr_t, ptr_t> inc{g, concore::flow_unlimited, [](ptr_t p) {
+                                                 (*p)++;
+                                                 return p;
+                                             }};
+    concore::function_node<ptr_t, int> consume{
+            g, concore::flow_unlimited, [&](ptr_t p) { return sum += *p; }};
+    concore::make_edge(inc, consume);
+
+    for (int i = 0; i < 10; i++)
+        inc.try_put(std::make_unique<int>(i));
+    g.wait_for_all();
+    REQUIRE(sum.load() == 55);
+}
+
+TEST_CASE("exceptions in function_node are reported to the task group", "[flow_graph]") {
+    std::atomic<int> ex_count{0};
+    auto grp = concore::task_group::create();
+    grp.set_exception_handler([&](std::exception_ptr) { ex_count++; });
+    concore::flow_graph g{grp};
+    std::atomic<int> num_out{0};
+    concore::function_node<int, int> node{g, 1, [](int x) {
+                                              if (x % 2)
+                                                  throw std::logic_error("odd");
+                                              return x;
+                                          }};
+    concore::function_node<int, int> out{g, 1, [&](int x) { return ++num_out; }};
+    concore::make_edge(node, out);
+    for (int i = 0; i < 10; i++)
+        node.try_put(i);
+    g.wait_for_all();
+    REQUIRE(ex_count.load() == 5);
+    REQUIRE(num_out.load() == 5);
+}
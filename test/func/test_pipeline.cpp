@@ -4,6 +4,8 @@
 #include <concore/spawn.hpp>
 #include <concore/delegating_executor.hpp>
 
+#include <optional>
+
 #include "rapidcheck_utils.hpp"
 #include "test_common/task_utils.hpp"
 
@@ -11,9 +13,31 @@
 #include <atomic>
 #include <chrono>
 #include <array>
+#include <memory>
+#include <numeric>
+#include <vector>
 
 using namespace std::chrono_literals;
 
+namespace {
+//! Line data that counts the live objects
+struct counted {
+    std::atomic<int>* alive_;
+    explicit counted(std::atomic<int>* alive)
+        : alive_(alive) {
+        (*alive_)++;
+    }
+    counted(counted&& other) noexcept
+        : alive_(other.alive_) {
+        (*alive_)++;
+    }
+    counted(const counted&) = delete;
+    counted& operator=(const counted&) = delete;
+    counted& operator=(counted&&) = delete;
+    ~counted() { (*alive_)--; }
+};
+} // namespace
+
 TEST_CASE("simple pipeline", "[pipeline]") {
     constexpr int num_items = 50;
     std::array<int, num_items> items{};
@@ -348,9 +372,10 @@ TEST_CASE("pipeline uses the given executor", "[pipeline]") {
     REQUIRE(bounded_wait());
 
     // Check that we used our executor for all items, and all stages
+    // The two concurrent stages are fused, so they are executed by the same task
     REQUIRE(cnt1.load() == num_items);
     REQUIRE(cnt2.load() == num_items);
-    REQUIRE(num_executed.load() == 2 * num_items);
+    REQUIRE(num_executed.load() == num_items);
 }
 
 TEST_CASE("pipeline stages can modify the line data", "[pipeline]") {
@@ -427,3 +452,626 @@ TEST_CASE("pipeline stages can be decomposed into other tasks", "[pipeline]") {
     // Wait for all the tasks to complete
     REQUIRE(bounded_wait());
 }
+
+TEST_CASE("pipeline accepts move-only line data", "[pipeline]") {
+    constexpr int num_items = 100;
+    std::atomic<int> sum{0};
+
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<std::unique_ptr<int>>(8)
+        | concore::stage_ordering::concurrent
+        | [](std::unique_ptr<int>& data) { (*data)++; }
+        | concore::stage_ordering::in_order
+        | [&](std::unique_ptr<int>& data) { sum += *data; }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(std::make_unique<int>(i));
+
+    REQUIRE(bounded_wait());
+    REQUIRE(sum.load() == num_items * (num_items + 1) / 2);
+}
+
+TEST_CASE("pipeline destroys the line data after the last stage", "[pipeline]") {
+    constexpr int num_items = 200;
+    std::atomic<int> num_alive{0};
+
+    constexpr int max_concurrency = 4;
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<counted>(max_concurrency)
+        | concore::stage_ordering::concurrent
+        | [&](counted& data) { REQUIRE(data.alive_ == &num_alive); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(counted{&num_alive});
+
+    REQUIRE(bounded_wait());
+    REQUIRE(num_alive.load() == 0);
+}
+
+TEST_CASE("cancelled pipelines with in_order stages destroy all the lines", "[pipeline]") {
+    constexpr int num_items = 50;
+    std::atomic<int> num_alive{0};
+    std::atomic<int> num_started{0};
+
+    auto grp = concore::task_group::create();
+    {
+        // clang-format off
+        auto my_pipeline = concore::pipeline_builder<counted>(3, grp)
+            | concore::stage_ordering::concurrent
+            | [&](counted&) {
+                if (num_started++ == 5)
+                    grp.cancel();
+                std::this_thread::sleep_for(100us);
+            }
+            | concore::stage_ordering::in_order
+            | [](counted&) {}
+            | concore::stage_ordering::in_order
+            | [](counted&) {}
+            | concore::pipeline_end;
+        // clang-format on
+
+        for (int i = 0; i < num_items; i++)
+            my_pipeline.push(counted{&num_alive});
+        concore::wait(grp);
+    }
+
+    REQUIRE(num_started.load() < num_items);
+    REQUIRE(num_alive.load() == 0);
+}
+
+TEST_CASE("in_order pipeline stages keep the order with many lines in flight", "[pipeline]") {
+    constexpr int num_items = 2000;
+    constexpr int max_concurrency = 100;
+    std::atomic<int> cur_idx{0};
+    std::atomic<int> num_errors{0};
+
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(max_concurrency)
+        | concore::stage_ordering::concurrent
+        | [&](int idx) {
+            // Delay some of the lines, so that the next ones need to wait in the reorder window
+            if (idx % 37 == 0)
+                std::this_thread::sleep_for(200us);
+        }
+        | concore::stage_ordering::in_order
+        | [&](int idx) {
+            if (idx != cur_idx++)
+                num_errors++;
+        }
+        | concore::stage_ordering::in_order
+        | [&](int idx) {
+            if (idx % 53 == 0)
+                std::this_thread::sleep_for(100us);
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+
+    REQUIRE(bounded_wait());
+    REQUIRE(cur_idx.load() == num_items);
+    REQUIRE(num_errors.load() == 0);
+}
+
+TEST_CASE("consecutive concurrent pipeline stages run in the same task", "[pipeline]") {
+    constexpr int num_items = 50;
+    std::atomic<int> num_same{0};
+
+    struct line {
+        concore::task* first_task_{nullptr};
+        int cnt_{0};
+    };
+    auto check_same_task = [&](line& l) {
+        if (concore::task::current_task() == l.first_task_)
+            num_same++;
+        l.cnt_++;
+    };
+
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<line>(num_items)
+        | concore::stage_ordering::concurrent
+        | [](line& l) { l.first_task_ = concore::task::current_task(); }
+        | check_same_task
+        | check_same_task
+        | concore::stage_ordering::out_of_order
+        | [](line& l) { l.cnt_++; }
+        | concore::stage_ordering::concurrent
+        | [](line& l) { REQUIRE(l.cnt_ == 3); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(line{});
+
+    REQUIRE(bounded_wait());
+    REQUIRE(num_same.load() == 2 * num_items);
+}
+
+TEST_CASE("concurrent pipeline stages can take over the continuation", "[pipeline]") {
+    constexpr int num_items = 50;
+    std::atomic<int> num_ok{0};
+
+    // The stage finishes asynchronously; the next concurrent stage must wait for it
+    auto async_stage = [](int& data) {
+        auto* cur_task = concore::task::current_task();
+        REQUIRE(cur_task != nullptr);
+        auto cur_cont = cur_task->get_continuation();
+        cur_task->set_continuation({});
+        concore::spawn(concore::task{[&data, cont = std::move(cur_cont)] {
+            std::this_thread::sleep_for(100us);
+            data = 1;
+            cont({});
+        }});
+    };
+
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(num_items)
+        | concore::stage_ordering::concurrent
+        | async_stage
+        | [&](int data) {
+            if (data == 1)
+                num_ok++;
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(0);
+
+    REQUIRE(bounded_wait());
+    REQUIRE(num_ok.load() == num_items);
+}
+
+//! Keeps track of the number of lines in flight, and the maximum number of lines in flight
+struct in_flight_counter {
+    std::atomic<int> cur_{0};
+    std::atomic<int> max_{0};
+
+    void inc() {
+        int val = ++cur_;
+        int prev = max_.load();
+        while (val > prev && !max_.compare_exchange_weak(prev, val))
+            ;
+    }
+    void dec() { cur_--; }
+};
+
+TEST_CASE("pipeline can pull items from a generator", "[pipeline]") {
+    constexpr int num_items = 500;
+    constexpr int max_concurrency = 4;
+    in_flight_counter counter;
+    std::atomic<int> sum{0};
+    int next = 0;
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(max_concurrency, grp)
+        | concore::stage_ordering::concurrent
+        | [](int& x) { x *= 2; }
+        | concore::stage_ordering::in_order
+        | [&](int x) {
+            sum += x;
+            counter.dec();
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    my_pipeline.pull_from([&]() -> std::optional<int> {
+        if (next == num_items)
+            return {};
+        counter.inc();
+        return next++;
+    });
+    concore::wait(grp);
+
+    REQUIRE(next == num_items);
+    REQUIRE(sum.load() == num_items * (num_items - 1));
+    // The generator is called only when there is a free slot
+    REQUIRE(counter.max_.load() <= max_concurrency);
+}
+
+TEST_CASE("pipeline generator exceptions are passed to the task_group", "[pipeline]") {
+    std::atomic<int> num_exceptions{0};
+    std::atomic<int> num_processed{0};
+    int next = 0;
+
+    auto grp = concore::task_group::create();
+    grp.set_exception_handler([&](std::exception_ptr) { num_exceptions++; });
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(2, grp)
+        | concore::stage_ordering::concurrent
+        | [&](int) { num_processed++; }
+        | concore::pipeline_end;
+    // clang-format on
+
+    my_pipeline.pull_from([&]() -> std::optional<int> {
+        if (next == 10)
+            throw std::runtime_error("generator failure");
+        return next++;
+    });
+    concore::wait(grp);
+
+    REQUIRE(num_exceptions.load() == 1);
+    REQUIRE(num_processed.load() == 10);
+}
+
+TEST_CASE("pipeline keeps pulling from the generator after a cancellation", "[pipeline]") {
+    constexpr int num_items = 100;
+    std::atomic<int> next{0};
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(2, grp)
+        | concore::stage_ordering::concurrent
+        | [&](int x) {
+            if (x == 10)
+                grp.cancel();
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    my_pipeline.pull_from([&]() -> std::optional<int> {
+        if (next == num_items)
+            return {};
+        return next++;
+    });
+    concore::wait(grp);
+    REQUIRE(grp.is_cancelled());
+    REQUIRE(next.load() < num_items);
+
+    // Once the cancellation is cleared, finishing a line asks the generator for more items
+    grp.clear_cancel();
+    my_pipeline.push(-1);
+    concore::wait(grp);
+    REQUIRE(next.load() == num_items);
+}
+
+TEST_CASE("pipeline try_push fails when the concurrency limit is reached", "[pipeline]") {
+    constexpr int max_concurrency = 2;
+    std::atomic<bool> release{false};
+    std::atomic<int> num_done{0};
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<std::unique_ptr<int>>(max_concurrency, grp)
+        | concore::stage_ordering::concurrent
+        | [&](std::unique_ptr<int>&) {
+            while (!release.load())
+                std::this_thread::sleep_for(100us);
+            num_done++;
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < max_concurrency; i++)
+        REQUIRE(my_pipeline.try_push(std::make_unique<int>(i)));
+
+    // All the slots are taken; the data is not consumed
+    auto extra = std::make_unique<int>(100);
+    REQUIRE_FALSE(my_pipeline.try_push(std::move(extra)));
+    REQUIRE(extra);
+
+    release = true;
+    concore::wait(grp);
+    REQUIRE(my_pipeline.try_push(std::move(extra)));
+    concore::wait(grp);
+    REQUIRE(num_done.load() == max_concurrency + 1);
+}
+
+TEST_CASE("pipeline blocking_push bounds the number of lines in flight", "[pipeline]") {
+    constexpr int num_items = 300;
+    constexpr int max_concurrency = 3;
+    in_flight_counter counter;
+    std::atomic<int> num_done{0};
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(max_concurrency, grp)
+        | concore::stage_ordering::concurrent
+        | [&](int x) {
+            if (x % 10 == 0)
+                std::this_thread::sleep_for(100us);
+        }
+        | concore::stage_ordering::out_of_order
+        | [&](int) {
+            num_done++;
+            counter.dec();
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++) {
+        counter.inc();
+        my_pipeline.blocking_push(int(i));
+    }
+    concore::wait(grp);
+
+    REQUIRE(num_done.load() == num_items);
+    // The counter is incremented before pushing, so it can go one over the limit
+    REQUIRE(counter.max_.load() <= max_concurrency + 1);
+}
+
+TEST_CASE("pipeline filter stages drop lines", "[pipeline]") {
+    constexpr int num_items = 200;
+    std::vector<int> out;
+    std::atomic<int> num_after_filter{0};
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(16, grp)
+        | concore::stage_ordering::concurrent
+        | concore::filter_stage([](int x) { return x % 3 != 0; })
+        | [&](int) { num_after_filter++; }
+        | concore::stage_ordering::in_order
+        | [&](int x) { out.push_back(x); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+    concore::wait(grp);
+
+    std::vector<int> expected;
+    for (int i = 0; i < num_items; i++)
+        if (i % 3 != 0)
+            expected.push_back(i);
+    REQUIRE(num_after_filter.load() == int(expected.size()));
+    REQUIRE(out == expected);
+}
+
+TEST_CASE("pipeline flat-map stages emit lines in order", "[pipeline]") {
+    PROPERTY(([]() {
+        constexpr int num_items = 60;
+        std::array<int, num_items> counts{};
+        for (int i = 0; i < num_items; i++)
+            counts[i] = *rc::gen::inRange(0, 5);
+        std::vector<int> out;
+
+        auto grp = concore::task_group::create();
+        // clang-format off
+        auto my_pipeline = concore::pipeline_builder<int>(8, grp)
+            | concore::stage_ordering::concurrent
+            | concore::flat_map_stage([&](int x, concore::pipeline_emitter<int>& emit) {
+                for (int k = 0; k < counts[x]; k++) {
+                    if (k == 1)
+                        std::this_thread::sleep_for(10us);
+                    emit(x * 10 + k);
+                }
+            })
+            | [](int x) {
+                // Random wait here, to change the order in which the in_order stage sees lines
+                if (x % 7 == 0)
+                    std::this_thread::sleep_for(50us);
+            }
+            | concore::stage_ordering::in_order
+            | [&](int x) { out.push_back(x); }
+            | concore::pipeline_end;
+        // clang-format on
+
+        for (int i = 0; i < num_items; i++)
+            my_pipeline.push(i);
+        concore::wait(grp);
+
+        // The output is in input order, and then in emission order
+        std::vector<int> expected;
+        for (int i = 0; i < num_items; i++)
+            for (int k = 0; k < counts[i]; k++)
+                expected.push_back(i * 10 + k);
+        RC_ASSERT(out == expected);
+    }));
+}
+
+TEST_CASE("pipeline flat-map stages can be chained through in_order stages", "[pipeline]") {
+    constexpr int num_items = 30;
+    std::vector<int> out;
+    std::atomic<int> num_filtered{0};
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(4, grp)
+        | concore::stage_ordering::concurrent
+        | concore::flat_map_stage([](int x, auto& emit) {
+            emit(x * 100);
+            emit(x * 100 + 10);
+        })
+        | concore::stage_ordering::in_order
+        | concore::filter_stage([&](int x) {
+            if (x % 300 != 0)
+                return true;
+            num_filtered++;
+            return false;
+        })
+        | concore::stage_ordering::concurrent
+        | concore::flat_map_stage([](int x, auto& emit) {
+            emit(x);
+            emit(x + 1);
+        })
+        | concore::stage_ordering::in_order
+        | [&](int x) { out.push_back(x); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+    concore::wait(grp);
+
+    std::vector<int> expected;
+    for (int i = 0; i < num_items; i++) {
+        for (int v : {i * 100, i * 100 + 10}) {
+            if (v % 300 == 0)
+                continue;
+            expected.push_back(v);
+            expected.push_back(v + 1);
+        }
+    }
+    REQUIRE(num_filtered.load() == 10);
+    REQUIRE(out == expected);
+}
+
+namespace {
+//! Executor that keeps the tasks, so that the test can execute them in the desired order
+struct manual_executor {
+    std::vector<concore::task> tasks_;
+
+    concore::delegating_executor executor() {
+        return concore::delegating_executor{[this](concore::task t) {
+            tasks_.push_back(std::move(t));
+        }};
+    }
+
+    //! Executes the tasks, always picking the last enqueued task first
+    void run_all_lifo() {
+        while (!tasks_.empty()) {
+            auto t = std::move(tasks_.back());
+            tasks_.pop_back();
+            t();
+        }
+    }
+};
+} // namespace
+
+TEST_CASE("pipeline flat-map stages limit the emitted lines in flight", "[pipeline]") {
+    manual_executor exe;
+    constexpr int max_concurrency = 2;
+    constexpr int num_items = 3;
+    constexpr int num_emitted = 100;
+    int num_in_flight = 0;
+    int max_in_flight = 0;
+    std::vector<int> out;
+
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(max_concurrency, exe.executor())
+        | concore::stage_ordering::concurrent
+        | concore::flat_map_stage([](int x, auto& emit) {
+            for (int k = 0; k < num_emitted; k++)
+                emit(x * num_emitted + k);
+        })
+        | [&](int) { max_in_flight = std::max(max_in_flight, ++num_in_flight); }
+        | concore::stage_ordering::in_order
+        | [&](int x) {
+            out.push_back(x);
+            num_in_flight--;
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+
+    // The last line is expanded first; its emitted lines need to wait for the ones of the first
+    // line, but only a few of them are started
+    exe.run_all_lifo();
+    REQUIRE(max_in_flight <= max_concurrency * max_concurrency);
+
+    std::vector<int> expected(num_items * num_emitted);
+    std::iota(expected.begin(), expected.end(), 0);
+    REQUIRE(out == expected);
+}
+
+TEST_CASE("pipeline collects per-stage stats", "[pipeline]") {
+    manual_executor exe;
+    std::vector<int> out;
+
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(10, exe.executor())
+        | concore::stage_ordering::concurrent
+        | [](int x) {
+            if (x == 0)
+                std::this_thread::sleep_for(2ms);
+        }
+        | concore::filter_stage([](int x) { return x % 2 == 0; })
+        | concore::stage_ordering::in_order
+        | [&](int x) { out.push_back(x); }
+        | concore::pipeline_end;
+    // clang-format on
+    my_pipeline.set_collect_stats(true);
+
+    for (int i = 0; i < 4; i++)
+        my_pipeline.push(i);
+
+    // The lines that are started last arrive first at the in_order stage; they need to wait there
+    // for the first line, which is slow
+    exe.run_all_lifo();
+    REQUIRE(out == std::vector<int>{0, 2});
+
+    auto stats = my_pipeline.stats();
+    REQUIRE(stats.stages_.size() == 3);
+    REQUIRE(stats.stages_[0].ordering_ == concore::stage_ordering::concurrent);
+    REQUIRE(stats.stages_[1].ordering_ == concore::stage_ordering::concurrent);
+    REQUIRE(stats.stages_[2].ordering_ == concore::stage_ordering::in_order);
+    REQUIRE(stats.stages_[0].num_processed_ == 4);
+    REQUIRE(stats.stages_[1].num_processed_ == 4);
+    REQUIRE(stats.stages_[2].num_processed_ == 2); // the filtered lines skip the stage
+    REQUIRE(stats.stages_[0].busy_time_ >= 2ms);
+    REQUIRE(stats.stages_[0].in_order_wait_time_.count() == 0);
+    REQUIRE(stats.stages_[2].in_order_wait_time_ >= 2ms);
+    for (const auto& st : stats.stages_)
+        REQUIRE(st.backlog_ == 0);
+    REQUIRE(stats.num_active_lines_ == 0);
+    REQUIRE(stats.num_waiting_lines_ == 0);
+}
+
+TEST_CASE("pipeline stats report the backlog of the stages", "[pipeline]") {
+    manual_executor exe;
+    constexpr int num_items = 5;
+
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(2, exe.executor())
+        | concore::stage_ordering::out_of_order
+        | [](int) {}
+        | concore::stage_ordering::concurrent
+        | [](int) {}
+        | concore::pipeline_end;
+    // clang-format on
+    my_pipeline.set_collect_stats(true);
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+
+    // Only two lines can be active; they are both waiting for the first stage
+    auto stats = my_pipeline.stats();
+    REQUIRE(stats.stages_[0].backlog_ == 2);
+    REQUIRE(stats.stages_[1].backlog_ == 0);
+    REQUIRE(stats.num_active_lines_ == 2);
+    REQUIRE(stats.num_waiting_lines_ == num_items - 2);
+
+    exe.run_all_lifo();
+    stats = my_pipeline.stats();
+    REQUIRE(stats.stages_[0].backlog_ == 0);
+    REQUIRE(stats.stages_[1].backlog_ == 0);
+    REQUIRE(stats.stages_[0].num_processed_ == num_items);
+    REQUIRE(stats.stages_[1].num_processed_ == num_items);
+    REQUIRE(stats.num_active_lines_ == 0);
+    REQUIRE(stats.num_waiting_lines_ == 0);
+}
+
+TEST_CASE("pipeline doesn't collect per-stage stats by default", "[pipeline]") {
+    manual_executor exe;
+
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(4, exe.executor())
+        | concore::stage_ordering::concurrent
+        | [](int) {}
+        | concore::stage_ordering::in_order
+        | [](int) {}
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < 10; i++)
+        my_pipeline.push(i);
+    exe.run_all_lifo();
+
+    auto stats = my_pipeline.stats();
+    REQUIRE(stats.stages_.size() == 2);
+    for (const auto& st : stats.stages_) {
+        REQUIRE(st.num_processed_ == 0);
+        REQUIRE(st.busy_time_.count() == 0);
+        REQUIRE(st.in_order_wait_time_.count() == 0);
+        REQUIRE(st.backlog_ == 0);
+    }
+}
@@ -149,3 +149,31 @@ TEST_CASE("wait does work on the calling thread", "[spawn]") {
     // Reset the number of workers
     concore::shutdown();
 }
+
+TEST_CASE("tasks spawned to particular workers are executed", "[spawn]") {
+    auto& ctx = concore::detail::get_exec_context();
+    int num_workers = concore::detail::num_worker_threads(ctx);
+    constexpr int tasks_per_worker = 10;
+    task_countdown tc{num_workers * tasks_per_worker};
+    std::atomic<int> num_on_target{0};
+    std::atomic<int> num_non_workers{0};
+
+    for (int w = 0; w < num_workers; w++) {
+        for (int i = 0; i < tasks_per_worker; i++) {
+            concore::task t{[&tc, &num_on_target, &num_non_workers, w] {
+                // Other workers may steal the task, but it needs to run on a worker thread
+                int cur = concore::detail::current_worker_index();
+                if (cur < 0)
+                    num_non_workers++;
+                if (cur == w)
+                    num_on_target++;
+                tc.task_finished();
+            }};
+            concore::detail::do_spawn_to(ctx, w, std::move(t));
+        }
+    }
+
+    REQUIRE(tc.wait_for_all());
+    REQUIRE(num_non_workers.load() == 0);
+    REQUIRE(num_on_target.load() > 0);
+}
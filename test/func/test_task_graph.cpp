@@ -4,12 +4,22 @@
 #include <concore/inline_executor.hpp>
 #include <concore/profiling.hpp>
 #include <concore/spawn.hpp>
+#include <concore/init.hpp>
+#include <concore/execution.hpp>
+#include <concore/sender_algo/transform.hpp>
+#include <concore/sender_algo/sync_wait.hpp>
 
 #include "test_common/task_countdown.hpp"
 #include "test_common/task_utils.hpp"
 #include "test_common/throwing_executor.hpp"
+#include "test_common/queue_executor.hpp"
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 TEST_CASE("one can define a simple linear chain of tasks", "[task_graph]") {
     CONCORE_PROFILING_FUNCTION();
@@ -515,3 +525,485 @@ TEST_CASE("chained_task works (somehow) with an executor that throws", "[task_gr
     REQUIRE_FALSE(executed[3]);
     REQUIRE(executed[4]);
 }
+
+TEST_CASE("task_graph executes nodes in dependency order", "[task_graph]") {
+    constexpr int num_nodes = 10;
+    std::atomic<int> counter{0};
+    std::array<int, num_nodes> res{};
+
+    concore::task_graph_builder builder;
+    for (int i = 0; i < num_nodes; i++)
+        builder.add_node([&, i]() { res[i] = counter++; });
+    for (int i = 1; i < num_nodes; i++)
+        builder.add_edge(i - 1, i);
+    concore::task_graph graph = builder.build();
+    REQUIRE(graph);
+    REQUIRE(graph.num_nodes() == num_nodes);
+
+    graph.run_and_wait();
+    for (int i = 0; i < num_nodes; i++)
+        REQUIRE(res[i] == i);
+}
+
+TEST_CASE("task_graph can be executed multiple times", "[task_graph]") {
+    // Diamond-like graph: 0 -> {1, 2, 3} -> 4
+    std::atomic<int> counter{0};
+    std::array<std::atomic<int>, 5> num_execs{};
+    std::array<int, 5> order{};
+    concore::task_graph_builder builder;
+    for (int i = 0; i < 5; i++)
+        builder.add_node([&, i]() {
+            num_execs[i]++;
+            order[i] = counter++;
+        });
+    for (int i = 1; i < 4; i++) {
+        builder.add_edge(0, i);
+        builder.add_edge(i, 4);
+    }
+    concore::task_graph graph = builder.build();
+
+    constexpr int num_runs = 20;
+    for (int r = 0; r < num_runs; r++) {
+        graph.run_and_wait();
+        REQUIRE(order[0] == r * 5);
+        REQUIRE(order[4] == r * 5 + 4);
+    }
+    for (int i = 0; i < 5; i++)
+        REQUIRE(num_execs[i].load() == num_runs);
+}
+
+TEST_CASE("task_graph with no nodes can be run", "[task_graph]") {
+    concore::task_graph graph = concore::task_graph_builder{}.build();
+    REQUIRE(graph.num_nodes() == 0);
+    graph.run_and_wait();
+}
+
+TEST_CASE("building a task_graph with cycles throws", "[task_graph]") {
+    concore::task_graph_builder builder;
+    int t1 = builder.add_node([] {});
+    int t2 = builder.add_node([] {});
+    int t3 = builder.add_node([] {});
+    builder.add_edge(t1, t2);
+    builder.add_edge(t2, t3);
+    builder.add_edge(t3, t2);
+    REQUIRE_THROWS_AS(builder.build(), std::invalid_argument);
+}
+
+TEST_CASE("exceptions in task_graph nodes are caught by the group", "[task_graph]") {
+    std::atomic<int> ex_count{0};
+    auto grp = concore::task_group::create();
+    grp.set_exception_handler([&](std::exception_ptr) { ex_count++; });
+
+    std::atomic<bool> last_executed{false};
+    concore::task_graph_builder builder{grp};
+    int t1 = builder.add_node([] { throw std::logic_error("err"); });
+    int t2 = builder.add_node([&] { last_executed = true; });
+    builder.add_edge(t1, t2);
+    concore::task_graph graph = builder.build();
+
+    graph.run_and_wait();
+    REQUIRE(ex_count.load() == 1);
+    REQUIRE(last_executed.load());
+}
+
+TEST_CASE("task_graph can be used as a sender", "[task_graph]") {
+    std::atomic<int> counter{0};
+    concore::task_graph_builder builder{concore::global_executor{}};
+    int t1 = builder.add_node([&] { counter++; });
+    int t2 = builder.add_node([&] { counter++; });
+    int t3 = builder.add_node([&] { counter++; });
+    builder.add_edge(t1, t3);
+    builder.add_edge(t2, t3);
+    concore::task_graph graph = builder.build();
+
+    for (int i = 0; i < 3; i++) {
+        int res = concore::sync_wait(concore::transform(graph, [&] { return counter.load(); }));
+        REQUIRE(res == 3 * (i + 1));
+    }
+}
+
+TEST_CASE("task_graph sender reports exceptions through set_error", "[task_graph]") {
+    concore::task_graph_builder builder;
+    int t1 = builder.add_node([] { throw std::logic_error("err"); });
+    int t2 = builder.add_node([] {});
+    builder.add_edge(t1, t2);
+    concore::task_graph graph = builder.build();
+
+    REQUIRE_THROWS_AS(concore::sync_wait(concore::transform(graph, [] { return 0; })),
+            std::logic_error);
+}
+
+TEST_CASE("task_graph computes the upward rank of the nodes", "[task_graph]") {
+    // 0 -> 1 -> 2 -> 3
+    //  \-> 4
+    concore::task_graph_builder builder;
+    int n0 = builder.add_node([] {});
+    int n1 = builder.add_node([] {});
+    int n2 = builder.add_node([] {});
+    int n3 = builder.add_node([] {}, 5.0);
+    int n4 = builder.add_node([] {}, 2.0);
+    builder.add_edge(n0, n1);
+    builder.add_edge(n1, n2);
+    builder.add_edge(n2, n3);
+    builder.add_edge(n0, n4);
+    concore::task_graph graph = builder.build();
+
+    REQUIRE(graph.node_rank(n3) == 5.0);
+    REQUIRE(graph.node_rank(n2) == 6.0);
+    REQUIRE(graph.node_rank(n1) == 7.0);
+    REQUIRE(graph.node_rank(n4) == 2.0);
+    REQUIRE(graph.node_rank(n0) == 8.0);
+}
+
+TEST_CASE("task_graph starts the nodes on the critical path first", "[task_graph]") {
+    std::deque<concore::task> tasks;
+    std::vector<int> order;
+
+    // Root 0 is followed by a short branch (1) and a long branch (2 -> 3 -> 4).
+    // Root 5 is independent and cheap; root 6 is expensive.
+    concore::task_graph_builder builder{concore::any_executor{queue_executor{&tasks}}};
+    for (int i = 0; i < 7; i++)
+        builder.add_node([&order, i] { order.push_back(i); }, i == 6 ? 10.0 : 1.0);
+    builder.add_edge(0, 1);
+    builder.add_edge(0, 2);
+    builder.add_edge(2, 3);
+    builder.add_edge(3, 4);
+    concore::task_graph graph = builder.build();
+
+    for (int k = 0; k < 2; k++) {
+        order.clear();
+        graph.run();
+        while (!tasks.empty()) {
+            auto t = std::move(tasks.front());
+            tasks.pop_front();
+            t();
+        }
+        REQUIRE(order == std::vector<int>{6, 0, 5, 2, 1, 3, 4});
+    }
+}
+
+TEST_CASE("task_graph started from a non-worker thread starts the critical root first",
+        "[task_graph]") {
+    concore::init_data config;
+    config.num_workers_ = 1;
+    concore::shutdown();
+    concore::init(config);
+
+    // Keep the only worker busy while the roots are added to the global queue
+    std::atomic<bool> worker_busy{false};
+    std::atomic<bool> release{false};
+    concore::global_executor{}.execute([&] {
+        worker_busy = true;
+        while (!release.load())
+            std::this_thread::yield();
+    });
+    while (!worker_busy.load())
+        std::this_thread::yield();
+
+    std::mutex bottleneck;
+    std::vector<int> order;
+    std::atomic<int> num_done{0};
+    concore::task_graph_builder builder;
+    for (int i = 0; i < 4; i++)
+        builder.add_node(
+                [&, i] {
+                    std::lock_guard<std::mutex> lock{bottleneck};
+                    order.push_back(i);
+                    num_done++;
+                },
+                double(i + 1));
+    concore::task_graph graph = builder.build();
+
+    graph.run();
+    release = true;
+    // Don't help executing the tasks, so that the worker takes them in the queue order
+    while (num_done.load() < 4)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    graph.wait();
+    REQUIRE(order == std::vector<int>{3, 2, 1, 0});
+
+    // Let the next tests use the default configuration
+    concore::shutdown();
+}
+
+TEST_CASE("task_graph can use measured node costs", "[task_graph]") {
+    // Two independent nodes; the second one is much slower
+    concore::task_graph_builder builder;
+    int n0 = builder.add_node([] {});
+    int n1 = builder.add_node([] { std::this_thread::sleep_for(std::chrono::milliseconds(5)); });
+    builder.set_measure_costs(true);
+    concore::task_graph graph = builder.build();
+    REQUIRE(graph.node_rank(n0) == graph.node_rank(n1));
+
+    graph.run_and_wait();
+    REQUIRE(graph.node_rank(n1) > graph.node_rank(n0));
+    REQUIRE(graph.node_rank(n1) >= 5'000'000.0);
+}
+
+TEST_CASE("task_graph scales the given costs of the nodes that were not measured",
+        "[task_graph]") {
+    auto grp = concore::task_group::create();
+    grp.set_exception_handler([](std::exception_ptr) {});
+
+    // The first node is measured; the second one throws, so it is never measured. Its given cost
+    // is larger, and it should remain larger after the measured costs replace the given ones.
+    concore::task_graph_builder builder{grp};
+    int n0 = builder.add_node(
+            [] { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }, 1.0);
+    int n1 = builder.add_node([] { throw std::logic_error("err"); }, 10.0);
+    builder.set_measure_costs(true);
+    concore::task_graph graph = builder.build();
+
+    graph.run_and_wait();
+    REQUIRE(graph.node_rank(n0) >= 1'000'000.0);
+    REQUIRE(graph.node_rank(n1) > graph.node_rank(n0));
+}
+
+TEST_CASE("task_graph optimizations fuse chains of nodes", "[task_graph]") {
+    std::vector<int> order;
+    concore::task_graph_builder builder;
+    constexpr int num_nodes = 10;
+    for (int i = 0; i < num_nodes; i++) {
+        builder.add_node([&order, i] { order.push_back(i); });
+        if (i > 0)
+            builder.add_edge(i - 1, i);
+    }
+    builder.set_optimizations(concore::task_graph_optimizations{});
+    concore::task_graph graph = builder.build();
+    REQUIRE(graph.num_nodes() == num_nodes);
+    REQUIRE(graph.num_tasks() == 1);
+
+    for (int k = 0; k < 3; k++) {
+        order.clear();
+        graph.run_and_wait();
+        REQUIRE(order == std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+    }
+}
+
+TEST_CASE("task_graph optimizations remove transitive edges", "[task_graph]") {
+    std::vector<int> order;
+    concore::task_graph_builder builder;
+    int a = builder.add_node([&order] { order.push_back(0); });
+    int b = builder.add_node([&order] { order.push_back(1); });
+    int c = builder.add_node([&order] { order.push_back(2); });
+    builder.add_edge(a, b);
+    builder.add_edge(b, c);
+    builder.add_edge(a, c); // implied by a -> b -> c
+    builder.add_edge(a, b); // duplicate
+    builder.set_optimizations(concore::task_graph_optimizations{});
+    concore::task_graph graph = builder.build();
+    REQUIRE(graph.num_tasks() == 1);
+
+    graph.run_and_wait();
+    REQUIRE(order == std::vector<int>{0, 1, 2});
+}
+
+TEST_CASE("task_graph optimizations can merge small sibling nodes", "[task_graph]") {
+    std::atomic<int> num_small{0};
+    std::atomic<int> last_val{0};
+    concore::task_graph_builder builder;
+    int root = builder.add_node([] {});
+    int sink = builder.add_node([&] { last_val = num_small.load(); });
+    for (int i = 0; i < 8; i++) {
+        int n = builder.add_node([&] { num_small++; });
+        builder.add_edge(root, n);
+        builder.add_edge(n, sink);
+    }
+    concore::task_graph_optimizations opts;
+    opts.merge_threshold_ = 4.5;
+    builder.set_optimizations(opts);
+    concore::task_graph graph = builder.build();
+    REQUIRE(graph.num_nodes() == 10);
+    REQUIRE(graph.num_tasks() == 4); // root, sink, 2 groups of 4 siblings
+
+    graph.run_and_wait();
+    REQUIRE(num_small.load() == 8);
+    REQUIRE(last_val.load() == 8);
+}
+
+TEST_CASE("exceptions in fused task_graph nodes don't stop the chain", "[task_graph]") {
+    std::atomic<int> ex_count{0};
+    auto grp = concore::task_group::create();
+    grp.set_exception_handler([&](std::exception_ptr) { ex_count++; });
+
+    std::atomic<int> num_executed{0};
+    concore::task_graph_builder builder{grp};
+    int prev = -1;
+    for (int i = 0; i < 5; i++) {
+        int cur = builder.add_node([&num_executed, i] {
+            num_executed++;
+            if (i % 2 == 1)
+                throw std::logic_error("err");
+        });
+        if (prev >= 0)
+            builder.add_edge(prev, cur);
+        prev = cur;
+    }
+    builder.set_optimizations(concore::task_graph_optimizations{});
+    concore::task_graph graph = builder.build();
+    REQUIRE(graph.num_tasks() == 1);
+
+    graph.run_and_wait();
+    REQUIRE(num_executed.load() == 5);
+    REQUIRE(ex_count.load() == 2);
+
+    REQUIRE_THROWS_AS(concore::sync_wait(concore::transform(graph, [] { return 0; })),
+            std::logic_error);
+}
+
+TEST_CASE("optimized task_graph respects all the dependencies", "[task_graph]") {
+    constexpr int num_nodes = 200;
+    std::array<std::atomic<int>, num_nodes> seq;
+    std::atomic<int> counter{0};
+
+    // Generate a random DAG; edges always go from lower indices to higher indices
+    srand(0);
+    std::vector<std::pair<int, int>> edges;
+    for (int i = 1; i < num_nodes; i++) {
+        int num_preds = rand() % 4;
+        for (int k = 0; k < num_preds; k++)
+            edges.emplace_back(rand() % i, i);
+        if (rand() % 3 == 0)
+            edges.emplace_back(i - 1, i);
+    }
+
+    concore::task_graph_builder builder;
+    for (int i = 0; i < num_nodes; i++)
+        builder.add_node([&seq, &counter, i] { seq[i] = counter++; }, 1.0 + rand() % 3);
+    for (auto e : edges)
+        builder.add_edge(e.first, e.second);
+    concore::task_graph_optimizations opts;
+    opts.merge_threshold_ = 5.0;
+    builder.set_optimizations(opts);
+    concore::task_graph graph = builder.build();
+    REQUIRE(graph.num_tasks() < num_nodes);
+
+    for (int k = 0; k < 5; k++) {
+        for (auto& s : seq)
+            s = -1;
+        graph.run_and_wait();
+        for (const auto& s : seq)
+            REQUIRE(s.load() >= 0);
+        for (auto e : edges)
+            REQUIRE(seq[e.first].load() < seq[e.second].load());
+    }
+}
+
+TEST_CASE("dataflow_task graphs respect the dependencies", "[task_graph]") {
+    task_countdown tc{4};
+    std::vector<int> order;
+    auto e = concore::global_executor{};
+    auto make_task = [&](int idx) {
+        return concore::dataflow_task(
+                [&, idx] {
+                    order.push_back(idx);
+                    tc.task_finished();
+                },
+                e);
+    };
+    // t0 -> t1 -> t2 -> t3, and t0 -> t3
+    auto t0 = make_task(0);
+    auto t1 = make_task(1);
+    auto t2 = make_task(2);
+    auto t3 = make_task(3);
+    concore::add_dependency(t0, t1);
+    concore::add_dependency(t1, t2);
+    concore::add_dependencies({t0, t2}, t3);
+
+    // Start the tasks in reverse order; they still need to run in dependency order
+    t3.start();
+    t2.start();
+    t1.start();
+    REQUIRE(!t0.is_done());
+    t0.start();
+    REQUIRE(tc.wait_for_all());
+    REQUIRE(order == std::vector<int>{0, 1, 2, 3});
+}
+
+TEST_CASE("adding a dependency on a completed dataflow_task has no effect", "[task_graph]") {
+    task_countdown tc{1};
+    concore::dataflow_task t1([&] { tc.task_finished(); });
+    t1.start();
+    REQUIRE(tc.wait_for_all());
+    while (!t1.is_done())
+        std::this_thread::yield();
+
+    tc.reset(1);
+    concore::dataflow_task t2([&] { tc.task_finished(); });
+    concore::add_dependency(t1, t2);
+    t2.start();
+    REQUIRE(tc.wait_for_all());
+}
+
+TEST_CASE("dataflow_task successors can be added while the predecessor runs", "[task_graph]") {
+    // The first task adds successors to itself while running
+    constexpr int num_succ = 100;
+    task_countdown tc{num_succ + 1};
+    std::atomic<bool> first_done{false};
+    std::atomic<int> num_wrong_order{0};
+
+    concore::dataflow_task first;
+    first = concore::dataflow_task([&] {
+        for (int i = 0; i < num_succ; i++) {
+            concore::dataflow_task succ([&] {
+                if (!first_done.load())
+                    num_wrong_order++;
+                tc.task_finished();
+            });
+            concore::add_dependency(first, succ);
+            succ.start();
+        }
+        first_done = true;
+        tc.task_finished();
+    });
+    first.start();
+    REQUIRE(tc.wait_for_all());
+    REQUIRE(num_wrong_order.load() == 0);
+    first = {}; // break the reference cycle
+}
+
+TEST_CASE("dataflow_task dependencies can be added concurrently from multiple threads",
+        "[task_graph]") {
+    constexpr int num_threads = 4;
+    constexpr int num_per_thread = 500;
+    constexpr int num_preds = 8;
+    task_countdown tc{num_threads * num_per_thread};
+    std::atomic<int> num_late_preds_done{0};
+    std::atomic<int> num_wrong_order{0};
+
+    std::vector<concore::dataflow_task> preds;
+    for (int i = 0; i < num_preds; i++)
+        preds.emplace_back([&, i] {
+            if (i >= num_preds / 2)
+                num_late_preds_done++;
+        });
+    // Start half of the predecessors right away; they will complete while we add dependencies
+    for (int i = 0; i < num_preds / 2; i++)
+        preds[i].start();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < num_per_thread; i++) {
+                int p = (t + i) % num_preds;
+                concore::dataflow_task succ([&] {
+                    // All the predecessors started late must be complete before this
+                    if (num_late_preds_done.load() < num_preds / 2)
+                        num_wrong_order++;
+                    tc.task_finished();
+                });
+                concore::add_dependency(preds[p], succ);
+                // Depend on all the predecessors that are not yet started
+                for (int k = num_preds / 2; k < num_preds; k++)
+                    concore::add_dependency(preds[k], succ);
+                succ.start();
+            }
+        });
+    }
+    for (auto& th : threads)
+        th.join();
+    for (int i = num_preds / 2; i < num_preds; i++)
+        preds[i].start();
+    REQUIRE(tc.wait_for_all());
+    REQUIRE(num_wrong_order.load() == 0);
+}
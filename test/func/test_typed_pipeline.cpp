@@ -0,0 +1,279 @@
+#include <catch2/catch.hpp>
+#include <concore/typed_pipeline.hpp>
+#include <concore/spawn.hpp>
+
+#include "test_common/task_utils.hpp"
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+struct record {
+    int key_;
+    std::string value_;
+};
+} // namespace
+
+TEST_CASE("typed pipeline stages can change the line type", "[pipeline]") {
+    constexpr int num_items = 100;
+    std::vector<std::string> out;
+
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<std::string>(20)
+        | concore::stage_ordering::concurrent
+        | [](std::string raw) { return record{std::stoi(raw), raw}; }
+        | [](record r) {
+            r.value_ += "!";
+            return r;
+        }
+        | [](const record& r) { return std::to_string(r.key_ * 2) + ":" + r.value_; }
+        | concore::stage_ordering::in_order
+        | [&](const std::string& res) { out.push_back(res); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(std::to_string(i));
+
+    REQUIRE(bounded_wait());
+
+    // The in_order stage sees the items in the order they were pushed
+    REQUIRE(out.size() == num_items);
+    for (int i = 0; i < num_items; i++)
+        REQUIRE(out[i] == std::to_string(i * 2) + ":" + std::to_string(i) + "!");
+}
+
+TEST_CASE("typed pipeline stages returning void modify the data in place", "[pipeline]") {
+    constexpr int num_items = 50;
+    std::atomic<int> sum{0};
+    std::atomic<int> num_bad{0};
+
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<int>()
+        | concore::stage_ordering::concurrent
+        | [](int& x) { x *= 10; }
+        | [](int x) { return double(x) + 0.5; }
+        | [](double& x) { x *= 2; }
+        | concore::stage_ordering::out_of_order
+        | [&](double x) {
+            if (int(x) % 20 != 1)
+                num_bad++;
+            sum += int(x);
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+
+    REQUIRE(bounded_wait());
+    REQUIRE(num_bad.load() == 0);
+    REQUIRE(sum.load() == 20 * num_items * (num_items - 1) / 2 + num_items);
+}
+
+TEST_CASE("typed pipeline can move move-only data between stages", "[pipeline]") {
+    constexpr int num_items = 50;
+    std::atomic<int> sum{0};
+
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<std::unique_ptr<int>>(4)
+        | concore::stage_ordering::concurrent
+        | [](std::unique_ptr<int> p) { return std::make_unique<long>(*p + 1); }
+        | concore::stage_ordering::in_order
+        | [&](const std::unique_ptr<long>& p) { sum += int(*p); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(std::make_unique<int>(i));
+
+    REQUIRE(bounded_wait());
+    REQUIRE(sum.load() == num_items * (num_items + 1) / 2);
+}
+
+TEST_CASE("typed pipeline skips the next stages when a stage throws", "[pipeline]") {
+    constexpr int num_items = 30;
+    std::atomic<int> num_done{0};
+    std::vector<int> order;
+
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<int>()
+        | concore::stage_ordering::concurrent
+        | [](int x) {
+            if (x % 3 == 0)
+                throw std::runtime_error("bad item");
+            return std::to_string(x);
+        }
+        | concore::stage_ordering::in_order
+        | [&](const std::string& s) {
+            order.push_back(std::stoi(s));
+            num_done++;
+        }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+
+    REQUIRE(bounded_wait());
+    REQUIRE(num_done.load() == num_items - num_items / 3);
+    for (size_t i = 1; i < order.size(); i++)
+        REQUIRE(order[i - 1] < order[i]);
+}
+
+TEST_CASE("typed pipeline can pull items from a generator", "[pipeline]") {
+    constexpr int num_items = 200;
+    std::vector<std::string> out;
+    int next = 0;
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<int>(8, grp)
+        | concore::stage_ordering::concurrent
+        | [](int x) { return std::to_string(x); }
+        | concore::stage_ordering::in_order
+        | [&](std::string s) { out.push_back(std::move(s)); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    my_pipeline.pull_from([&]() -> std::optional<int> {
+        if (next == num_items)
+            return {};
+        return next++;
+    });
+    concore::wait(grp);
+
+    REQUIRE(out.size() == num_items);
+    for (int i = 0; i < num_items; i++)
+        REQUIRE(out[i] == std::to_string(i));
+}
+
+TEST_CASE("typed pipeline can have filter and flat-map stages", "[pipeline]") {
+    std::vector<std::string> chunks{"a bb", "", "ccc d ee", "f", "gg hhh"};
+    std::vector<size_t> out;
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<std::string>(2, grp)
+        | concore::stage_ordering::concurrent
+        | concore::flat_map_stage<std::string>([](const std::string& chunk, auto& emit) {
+            size_t start = 0;
+            while (start < chunk.size()) {
+                size_t end = chunk.find(' ', start);
+                end = end == std::string::npos ? chunk.size() : end;
+                emit(chunk.substr(start, end - start));
+                start = end + 1;
+            }
+        })
+        | [](const std::string& word) { return word.size(); }
+        | concore::filter_stage([](size_t len) { return len > 1; })
+        | concore::stage_ordering::in_order
+        | [&](size_t len) { out.push_back(len); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    for (auto& c : chunks)
+        my_pipeline.push(c);
+    concore::wait(grp);
+
+    REQUIRE(out == std::vector<size_t>{2, 3, 2, 2, 3});
+}
+
+TEST_CASE("typed pipeline collects per-stage stats", "[pipeline]") {
+    constexpr int num_items = 20;
+    std::vector<size_t> out;
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<int>(4, grp)
+        | concore::stage_ordering::concurrent
+        | [](int x) { return std::to_string(x); }
+        | concore::stage_ordering::in_order
+        | [&](const std::string& s) { out.push_back(s.size()); }
+        | concore::pipeline_end;
+    // clang-format on
+    my_pipeline.set_collect_stats(true);
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+    concore::wait(grp);
+
+    auto stats = my_pipeline.stats();
+    REQUIRE(out.size() == num_items);
+    REQUIRE(stats.stages_.size() == 2);
+    REQUIRE(stats.stages_[0].num_processed_ == num_items);
+    REQUIRE(stats.stages_[1].num_processed_ == num_items);
+    REQUIRE(stats.stages_[1].backlog_ == 0);
+}
+
+TEST_CASE("typed pipeline fuses consecutive concurrent stages", "[pipeline]") {
+    constexpr int num_items = 50;
+    std::vector<std::string> out;
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<int>(4, grp)
+        | concore::stage_ordering::concurrent
+        | [](int x) { return x * 2; }
+        | concore::filter_stage([](int x) { return x % 3 != 0; })
+        | [](int x) { return std::to_string(x); }
+        | [](std::string& s) { s += "!"; }
+        | concore::stage_ordering::in_order
+        | [&](std::string s) { out.push_back(std::move(s)); }
+        | concore::pipeline_end;
+    // clang-format on
+    my_pipeline.set_collect_stats(true);
+
+    for (int i = 0; i < num_items; i++)
+        my_pipeline.push(i);
+    concore::wait(grp);
+
+    std::vector<std::string> expected;
+    for (int i = 0; i < num_items; i++)
+        if ((i * 2) % 3 != 0)
+            expected.push_back(std::to_string(i * 2) + "!");
+    REQUIRE(out == expected);
+
+    // The first four stages are fused into one stage
+    auto stats = my_pipeline.stats();
+    REQUIRE(stats.stages_.size() == 2);
+    REQUIRE(stats.stages_[0].num_processed_ == num_items);
+    REQUIRE(stats.stages_[1].num_processed_ == expected.size());
+}
+
+TEST_CASE("typed pipeline accepts pushing const items", "[pipeline]") {
+    constexpr int num_items = 20;
+    std::vector<std::string> out;
+
+    auto grp = concore::task_group::create();
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<std::string>(2, grp)
+        | concore::stage_ordering::in_order
+        | [&](std::string s) { out.push_back(std::move(s)); }
+        | concore::pipeline_end;
+    // clang-format on
+
+    std::vector<std::string> items;
+    for (int i = 0; i < num_items; i++)
+        items.push_back(std::to_string(i));
+    for (int i = 0; i < num_items; i++) {
+        const std::string& item = items[i];
+        if (i % 2 == 0)
+            my_pipeline.blocking_push(item);
+        else
+            while (!my_pipeline.try_push(item))
+                std::this_thread::sleep_for(1ms);
+    }
+    concore::wait(grp);
+
+    // The pushed items are copied, not moved from
+    REQUIRE(out == items);
+    for (int i = 0; i < num_items; i++)
+        REQUIRE(items[i] == std::to_string(i));
+}
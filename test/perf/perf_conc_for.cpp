@@ -1,6 +1,7 @@
 
 #include "benchmark_helpers.hpp"
 #include <concore/conc_for.hpp>
+#include <concore/granularity_tuner.hpp>
 #include <concore/integral_iterator.hpp>
 #include <concore/profiling.hpp>
 #if CONCORE_USE_TBB
@@ -326,6 +327,27 @@ static void BM_fresnel_conc_for_upfront(benchmark::State& state) {
     }
 }
 
+static void BM_fresnel_conc_for_range(benchmark::State& state) {
+    const int data_size = state.range(0);
+
+    vec_array incidence, normals;
+    std::vector<float> out_vec(data_size);
+    generate_fresnel_test_data(data_size, incidence, normals);
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        // The body sees the whole loop, so the compiler can vectorize it
+        concore::conc_for_range(0, data_size, [&](int b, int e) {
+            const glm::vec4* in = incidence.data();
+            const glm::vec4* n = normals.data();
+            float* out = out_vec.data();
+            for (int idx = b; idx < e; idx++)
+                out[idx] = fresnel(in[idx], n[idx], 1.0f);
+        });
+    }
+}
+
 #if CONCORE_USE_TBB
 static void BM_fresnel_tbb_parallel_for(benchmark::State& state) {
     const int data_size = state.range(0);
@@ -363,6 +385,251 @@ static void BM_fresnel_omp_for(benchmark::State& state) {
 #endif
 #endif // CONCORE_USE_GLM
 
+//! Simple arithmetic kernel (polynomial evaluation), that the compiler can vectorize when it sees
+//! the whole loop
+inline float poly_eval(float a, float x, float y) {
+    float p = a;
+    for (int k = 0; k < 16; k++)
+        p = p * x + y;
+    return p;
+}
+
+static void BM_poly_conc_for(benchmark::State& state) {
+    const int data_size = state.range(0);
+
+    std::vector<float> xs, ys;
+    generate_simple_test_data(data_size, xs);
+    generate_simple_test_data(data_size, ys);
+    std::vector<float> out_vec(data_size);
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        concore::conc_for(
+                0, data_size, [&](int idx) { out_vec[idx] = poly_eval(2.0f, xs[idx], ys[idx]); });
+        benchmark::ClobberMemory();
+    }
+}
+
+static void BM_poly_conc_for_range(benchmark::State& state) {
+    const int data_size = state.range(0);
+
+    std::vector<float> xs, ys;
+    generate_simple_test_data(data_size, xs);
+    generate_simple_test_data(data_size, ys);
+    std::vector<float> out_vec(data_size);
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        concore::conc_for_range(0, data_size, [&](int b, int e) {
+            const float* x = xs.data();
+            const float* y = ys.data();
+            float* out = out_vec.data();
+            for (int idx = b; idx < e; idx++)
+                out[idx] = poly_eval(2.0f, x[idx], y[idx]);
+        });
+        benchmark::ClobberMemory();
+    }
+}
+
+//! A granularity hint that is too coarse (only two chunks), fixed or not by the tuner
+static void run_poly_coarse(benchmark::State& state, bool use_tuner) {
+    const int data_size = state.range(0);
+
+    std::vector<float> xs, ys;
+    generate_simple_test_data(data_size, xs);
+    generate_simple_test_data(data_size, ys);
+    std::vector<float> out_vec(data_size);
+
+    static concore::granularity_tuner tuner;
+    concore::partition_hints hints;
+    hints.granularity_ = data_size / 2;
+    if (use_tuner)
+        hints.tuner_ = &tuner;
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        concore::conc_for(
+                0, data_size,
+                [&](int idx) { out_vec[idx] = poly_eval(2.0f, xs[idx], ys[idx]); }, hints);
+        benchmark::ClobberMemory();
+    }
+}
+
+static void BM_poly_conc_for_coarse(benchmark::State& state) { run_poly_coarse(state, false); }
+static void BM_poly_conc_for_coarse_tuned(benchmark::State& state) {
+    run_poly_coarse(state, true);
+}
+
+//! Runs the same conc_for over the same data multiple times, as in a simulation with time steps
+static void run_time_steps(benchmark::State& state, concore::partition_hints hints) {
+    const int data_size = state.range(0);
+    constexpr int num_steps = 20;
+
+    std::vector<float> data;
+    generate_simple_test_data(data_size, data);
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        for (int step = 0; step < num_steps; step++)
+            concore::conc_for(
+                    0, data_size, [&](int idx) { data[idx] = data[idx] * 0.99f + 0.01f; }, hints);
+        benchmark::ClobberMemory();
+    }
+}
+
+static void BM_time_steps_conc_for(benchmark::State& state) { run_time_steps(state, {}); }
+
+static void BM_time_steps_conc_for_affinity(benchmark::State& state) {
+    concore::affinity_state affinity;
+    concore::partition_hints hints;
+    hints.method_ = concore::partition_method::affinity_partition;
+    hints.affinity_ = &affinity;
+    run_time_steps(state, hints);
+}
+
+//! Nested conc_for calls, with the granularity given as benchmark argument
+static void run_nested(benchmark::State& state, concore::partition_method method) {
+    constexpr int num_rows = 100;
+    constexpr int row_size = 10'000;
+    std::vector<float> data;
+    generate_simple_test_data(num_rows * row_size, data);
+
+    concore::partition_hints hints;
+    hints.method_ = method;
+    hints.granularity_ = int(state.range(0));
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        concore::conc_for(
+                0, num_rows,
+                [&](int i) {
+                    float* row = &data[size_t(i) * row_size];
+                    concore::conc_for(
+                            0, row_size, [row](int j) { row[j] = simple_transform(row[j]); },
+                            hints);
+                },
+                hints);
+    }
+}
+
+static void BM_nested_conc_for_auto(benchmark::State& state) {
+    run_nested(state, concore::partition_method::auto_partition);
+}
+static void BM_nested_conc_for_lazy(benchmark::State& state) {
+    run_nested(state, concore::partition_method::lazy_partition);
+}
+
+//! An irregular loop: the cost of an iteration decreases linearly with its index
+static void run_irregular(benchmark::State& state, concore::partition_method method) {
+    const int data_size = state.range(0);
+    std::vector<float> data;
+    generate_simple_test_data(data_size, data);
+    std::vector<float> out_vec(data_size);
+
+    concore::partition_hints hints;
+    hints.method_ = method;
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        concore::conc_for(
+                0, data_size,
+                [&](int i) {
+                    float val = data[i];
+                    for (int k = 0; k < (data_size - i) / 10; k++)
+                        val = simple_transform(val);
+                    out_vec[i] = val;
+                },
+                hints);
+    }
+}
+
+static void BM_irregular_conc_for_auto(benchmark::State& state) {
+    run_irregular(state, concore::partition_method::auto_partition);
+}
+static void BM_irregular_conc_for_iterative(benchmark::State& state) {
+    run_irregular(state, concore::partition_method::iterative_partition);
+}
+static void BM_irregular_conc_for_guided(benchmark::State& state) {
+    run_irregular(state, concore::partition_method::guided_partition);
+}
+static void BM_irregular_conc_for_factoring(benchmark::State& state) {
+    run_irregular(state, concore::partition_method::factoring_partition);
+}
+
+//! A grid for the Jacobi benchmarks; the border values are fixed
+struct jacobi_grid {
+    int n_;
+    std::vector<float> in_;
+    std::vector<float> out_;
+
+    explicit jacobi_grid(int n)
+        : n_(n)
+        , in_(size_t(n) * n, 0.0f)
+        , out_(size_t(n) * n, 0.0f) {
+        srand(0); // Same values each time
+        std::generate(in_.begin(), in_.end(), &rand_float);
+        out_ = in_;
+    }
+
+    //! Computes one point of the 5-point stencil
+    void update(int i, int j) {
+        size_t idx = size_t(i) * n_ + j;
+        out_[idx] = 0.25f * (in_[idx - n_] + in_[idx + n_] + in_[idx - 1] + in_[idx + 1]);
+    }
+};
+
+static void BM_jacobi_serial(benchmark::State& state) {
+    jacobi_grid grid(int(state.range(0)));
+    const int n = grid.n_;
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        for (int i = 1; i < n - 1; i++)
+            for (int j = 1; j < n - 1; j++)
+                grid.update(i, j);
+        benchmark::ClobberMemory();
+    }
+}
+
+//! 1D version: the interior points are flattened into a single index range
+static void BM_jacobi_conc_for_1d(benchmark::State& state) {
+    jacobi_grid grid(int(state.range(0)));
+    const int n = grid.n_;
+    const int m = n - 2;
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        concore::conc_for(0, m * m, [&](int idx) { grid.update(1 + idx / m, 1 + idx % m); });
+        benchmark::ClobberMemory();
+    }
+}
+
+//! 2D version: the body receives tiles of the grid
+static void BM_jacobi_conc_for_2d(benchmark::State& state) {
+    jacobi_grid grid(int(state.range(0)));
+    const int n = grid.n_;
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        concore::blocked_range2d<int> range{1, n - 1, 64, 1, n - 1, 256};
+        concore::conc_for(range, [&](const concore::blocked_range2d<int>& tile) {
+            for (int i = tile.rows().begin(); i < tile.rows().end(); i++)
+                for (int j = tile.cols().begin(); j < tile.cols().end(); j++)
+                    grid.update(i, j);
+        });
+        benchmark::ClobberMemory();
+    }
+}
+
 #define BENCHMARK_CASE(fun) BENCHMARK(fun)->Unit(benchmark::kMillisecond)->Arg(1'000'000);
 
 BENCHMARK_CASE(BM_simple_std_for_each);
@@ -385,6 +652,7 @@ BENCHMARK_PAUSE();
 BENCHMARK_CASE(BM_fresnel_std_for_each);
 BENCHMARK_CASE(BM_fresnel_conc_for);
 BENCHMARK_CASE(BM_fresnel_conc_for_upfront);
+BENCHMARK_CASE(BM_fresnel_conc_for_range);
 #if CONCORE_USE_TBB
 BENCHMARK_CASE(BM_fresnel_tbb_parallel_for);
 #endif
@@ -393,4 +661,39 @@ BENCHMARK_CASE(BM_fresnel_omp_for);
 #endif
 #endif // CONCORE_USE_GLM
 
+#define BENCHMARK_CASE_GRID(fun) BENCHMARK(fun)->Unit(benchmark::kMillisecond)->Arg(8192);
+
+BENCHMARK_PAUSE();
+BENCHMARK_CASE(BM_poly_conc_for);
+BENCHMARK_CASE(BM_poly_conc_for_range);
+BENCHMARK_CASE(BM_poly_conc_for_coarse);
+BENCHMARK_CASE(BM_poly_conc_for_coarse_tuned);
+
+#define BENCHMARK_CASE_GRAN(fun)                                                                   \
+    BENCHMARK(fun)->Unit(benchmark::kMillisecond)->Arg(1)->Arg(100)->Arg(10'000);
+
+BENCHMARK_PAUSE();
+BENCHMARK_CASE_GRAN(BM_nested_conc_for_auto);
+BENCHMARK_CASE_GRAN(BM_nested_conc_for_lazy);
+
+#define BENCHMARK_CASE_IRREGULAR(fun) BENCHMARK(fun)->Unit(benchmark::kMillisecond)->Arg(10'000);
+
+BENCHMARK_PAUSE();
+BENCHMARK_CASE_IRREGULAR(BM_irregular_conc_for_auto);
+BENCHMARK_CASE_IRREGULAR(BM_irregular_conc_for_iterative);
+BENCHMARK_CASE_IRREGULAR(BM_irregular_conc_for_guided);
+BENCHMARK_CASE_IRREGULAR(BM_irregular_conc_for_factoring);
+
+// Data that fits in the caches of the workers
+#define BENCHMARK_CASE_STEPS(fun) BENCHMARK(fun)->Unit(benchmark::kMillisecond)->Arg(1 << 18);
+
+BENCHMARK_PAUSE();
+BENCHMARK_CASE_STEPS(BM_time_steps_conc_for);
+BENCHMARK_CASE_STEPS(BM_time_steps_conc_for_affinity);
+
+BENCHMARK_PAUSE();
+BENCHMARK_CASE_GRID(BM_jacobi_serial);
+BENCHMARK_CASE_GRID(BM_jacobi_conc_for_1d);
+BENCHMARK_CASE_GRID(BM_jacobi_conc_for_2d);
+
 BENCHMARK_MAIN();
@@ -0,0 +1,84 @@
+#include "benchmark_helpers.hpp"
+#include <concore/conc_for_file.hpp>
+#include <concore/profiling.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace {
+
+//! Generates (once) a local file with the given number of lines; each line contains numbers
+const std::string& test_file(int num_lines) {
+    static std::string path;
+    static int generated_lines = 0;
+    if (generated_lines != num_lines) {
+        path = (std::filesystem::temp_directory_path() / "concore_perf_file.txt").string();
+        std::ofstream f(path, std::ios::binary);
+        srand(0); // Same values each time
+        for (int i = 0; i < num_lines; i++)
+            f << i << ',' << rand() << ',' << rand() % 1000 << ",some text for the record\n";
+        generated_lines = num_lines;
+    }
+    return path;
+}
+
+//! The work done for each line: parse the last number of the line
+int parse_line(std::string_view line) {
+    auto comma = line.rfind(',');
+    auto prev = line.rfind(',', comma - 1);
+    int val = 0;
+    std::from_chars(line.data() + prev + 1, line.data() + comma, val);
+    return val;
+}
+
+void BM_file_serial_getline(benchmark::State& state) {
+    const auto& path = test_file(int(state.range(0)));
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        std::ifstream f(path);
+        std::string line;
+        long long sum = 0;
+        while (std::getline(f, line))
+            sum += parse_line(line);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_file_conc_for_file(benchmark::State& state) {
+    const auto& path = test_file(int(state.range(0)));
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        std::atomic<long long> sum{0};
+        concore::conc_for_file_chunks(path.c_str(), [&](std::string_view chunk) {
+            long long chunk_sum = 0;
+            while (!chunk.empty()) {
+                auto nl = chunk.find('\n');
+                chunk_sum += parse_line(chunk.substr(0, nl));
+                chunk.remove_prefix(nl + 1);
+            }
+            sum += chunk_sum;
+        });
+        benchmark::DoNotOptimize(sum.load());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+} // namespace
+
+#define BENCHMARK_CASE(fun) BENCHMARK(fun)->Unit(benchmark::kMillisecond)->Arg(2'000'000)
+
+BENCHMARK_CASE(BM_file_serial_getline);
+BENCHMARK_CASE(BM_file_conc_for_file);
+
+BENCHMARK_MAIN();
@@ -1,6 +1,7 @@
 
 #include "benchmark_helpers.hpp"
 #include <concore/conc_reduce.hpp>
+#include <concore/reduce_ops.hpp>
 #include <concore/profiling.hpp>
 #if CONCORE_USE_TBB
 #include <tbb/parallel_reduce.h>
@@ -12,6 +13,7 @@
 #endif
 
 #include <benchmark/benchmark.h>
+#include <limits>
 #include <numeric>
 
 //! Produces a integer in range [-100, 100]
@@ -103,6 +105,48 @@ static void BM_conc_reduce_it(benchmark::State& state) {
     }
 }
 
+//! Sums floats. If the second argument is 1, we use `std::plus`, which is recognized and executed
+//! with the SIMD kernels; otherwise we use a lambda, and the elements are added one by one.
+static void BM_conc_reduce_float_sum(benchmark::State& state) {
+    const int data_size = state.range(0);
+    std::vector<int> int_data = generate_test_data(data_size);
+    std::vector<float> data(int_data.begin(), int_data.end());
+    auto plus = [](float lhs, float rhs) { return lhs + rhs; };
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        float res = state.range(1) == 1
+                            ? concore::conc_reduce(data.begin(), data.end(), 0.0f, std::plus<>(),
+                                      std::plus<>())
+                            : concore::conc_reduce(data.begin(), data.end(), 0.0f, plus, plus);
+        benchmark::DoNotOptimize(res);
+    }
+}
+
+//! Computes the minimum and the maximum of integers. If the second argument is 1, we use
+//! `minmax_op`, which is executed with the SIMD kernels; otherwise we use an equivalent lambda.
+static void BM_conc_reduce_minmax(benchmark::State& state) {
+    const int data_size = state.range(0);
+    std::vector<int> data = generate_test_data(data_size);
+    using lim = std::numeric_limits<int>;
+    auto init = std::make_pair(lim::max(), lim::min());
+    auto op = [](std::pair<int, int> acc, int x) { return concore::minmax_op{}(acc, x); };
+    auto reduction = [](std::pair<int, int> lhs, std::pair<int, int> rhs) {
+        return concore::minmax_op{}(lhs, rhs);
+    };
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        auto res = state.range(1) == 1
+                           ? concore::conc_reduce(data.begin(), data.end(), init,
+                                     concore::minmax_op{}, concore::minmax_op{})
+                           : concore::conc_reduce(data.begin(), data.end(), init, op, reduction);
+        benchmark::DoNotOptimize(res);
+    }
+}
+
 #if CONCORE_USE_TBB
 static void BM_tbb_parallel_reduce(benchmark::State& state) {
     const int data_size = state.range(0);
@@ -264,9 +308,14 @@ BENCHMARK_CASE1(BM_std_accumulate, 0);
 BENCHMARK_CASE1(BM_conc_reduce, concore::partition_method::auto_partition);
 BENCHMARK_CASE1(BM_conc_reduce, concore::partition_method::upfront_partition);
 BENCHMARK_CASE1(BM_conc_reduce, concore::partition_method::iterative_partition);
+BENCHMARK_CASE1(BM_conc_reduce, concore::partition_method::deterministic_partition);
 BENCHMARK_CASE1(BM_conc_reduce_it, concore::partition_method::auto_partition);
 BENCHMARK_CASE1(BM_conc_reduce_it, concore::partition_method::upfront_partition);
 BENCHMARK_CASE1(BM_conc_reduce_it, concore::partition_method::iterative_partition);
+BENCHMARK_CASE1(BM_conc_reduce_float_sum, 0);
+BENCHMARK_CASE1(BM_conc_reduce_float_sum, 1);
+BENCHMARK_CASE1(BM_conc_reduce_minmax, 0);
+BENCHMARK_CASE1(BM_conc_reduce_minmax, 1);
 #if CONCORE_USE_TBB
 BENCHMARK_CASE1(BM_tbb_parallel_reduce, 0);
 #endif
@@ -279,6 +328,7 @@ BENCHMARK_CASE2(BM_string_std_accumulate, 0);
 BENCHMARK_CASE2(BM_string_conc_reduce, concore::partition_method::auto_partition);
 BENCHMARK_CASE2(BM_string_conc_reduce, concore::partition_method::upfront_partition);
 BENCHMARK_CASE2(BM_string_conc_reduce, concore::partition_method::iterative_partition);
+BENCHMARK_CASE2(BM_string_conc_reduce, concore::partition_method::deterministic_partition);
 BENCHMARK_CASE2(BM_string_conc_reduce_it, concore::partition_method::auto_partition);
 BENCHMARK_CASE2(BM_string_conc_reduce_it, concore::partition_method::upfront_partition);
 BENCHMARK_CASE2(BM_string_conc_reduce_it, concore::partition_method::iterative_partition);
@@ -0,0 +1,94 @@
+// Measures the heap allocations made by conc_reduce. This is kept apart from the other benchmarks,
+// as it replaces the global allocation functions, adding a counter to each allocation.
+#include "benchmark_helpers.hpp"
+#include <concore/conc_reduce.hpp>
+#include <concore/profiling.hpp>
+
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+//! The number of heap allocations made by the process, from all the threads
+static std::atomic<int64_t> num_allocations{0};
+
+//! Allocates memory for the replaced `operator new` functions; returns null on failure
+static void* counted_alloc(std::size_t size, std::size_t align = 0) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    if (align == 0)
+        return std::malloc(size);
+    // The size must be a multiple of the alignment
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+//! Allocates memory for the replaced `operator new` functions; throws on failure
+static void* counted_alloc_or_throw(std::size_t size, std::size_t align = 0) {
+    if (void* p = counted_alloc(size, align))
+        return p;
+    throw std::bad_alloc{};
+}
+
+// All the replaceable allocation functions, so that all the allocations are counted, and the memory
+// is always released with the matching function
+
+void* operator new(std::size_t size) { return counted_alloc_or_throw(size); }
+void* operator new[](std::size_t size) { return counted_alloc_or_throw(size); }
+void* operator new(std::size_t size, std::align_val_t al) {
+    return counted_alloc_or_throw(size, std::size_t(al));
+}
+void* operator new[](std::size_t size, std::align_val_t al) {
+    return counted_alloc_or_throw(size, std::size_t(al));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_alloc(size);
+}
+void* operator new(std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, std::size_t(al));
+}
+void* operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return counted_alloc(size, std::size_t(al));
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+//! Measures the number of heap allocations per call; the second argument controls the number of
+//! chunks (and thus the number of splits)
+static void BM_conc_reduce_allocs(benchmark::State& state) {
+    const int data_size = state.range(0);
+    concore::partition_hints hints;
+    hints.tasks_per_worker_ = static_cast<int>(state.range(1));
+
+    std::vector<int> data(data_size, 1);
+
+    int64_t allocs = 0;
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        int64_t before = num_allocations.load(std::memory_order_relaxed);
+        auto res = concore::conc_reduce(
+                data.begin(), data.end(), int64_t(0), std::plus<>(), std::plus<>(), hints);
+        benchmark::DoNotOptimize(res);
+        allocs += num_allocations.load(std::memory_order_relaxed) - before;
+    }
+    state.counters["allocs_per_call"] =
+            benchmark::Counter(double(allocs), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(BM_conc_reduce_allocs)->Unit(benchmark::kMicrosecond)->Args({1'000'000, 20});
+BENCHMARK(BM_conc_reduce_allocs)->Unit(benchmark::kMicrosecond)->Args({1'000'000, 1000});
+
+BENCHMARK_MAIN();
@@ -65,6 +65,28 @@ static void BM_conc_scan(benchmark::State& state) {
     }
 }
 
+//! Prefix sums of 32-bit integers. If the second argument is 1, we use `std::plus`, which is
+//! recognized and executed with the SIMD kernels; otherwise we use a lambda, and the elements are
+//! added one by one.
+static void BM_conc_scan_int32(benchmark::State& state) {
+    const int data_size = state.range(0);
+    std::vector<int> int_data = generate_test_data(data_size);
+    std::vector<int32_t> data(int_data.begin(), int_data.end());
+    std::vector<int32_t> out(data_size, 0);
+    auto plus = [](int32_t lhs, int32_t rhs) { return lhs + rhs; };
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        if (state.range(1) == 1)
+            concore::conc_scan(
+                    data.begin(), data.end(), out.begin(), int32_t(0), std::plus<int32_t>());
+        else
+            concore::conc_scan(data.begin(), data.end(), out.begin(), int32_t(0), plus);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+
 #if CONCORE_USE_TBB
 template <typename T>
 struct scan_body {
@@ -151,6 +173,8 @@ static void BM_string_tbb_parallel_scan(benchmark::State& state) {
 
 BENCHMARK_CASE(BM_std_partial_sum);
 BENCHMARK_CASE(BM_conc_scan);
+BENCHMARK(BM_conc_scan_int32)->Unit(benchmark::kMillisecond)->Args({10'000'000, 0});
+BENCHMARK(BM_conc_scan_int32)->Unit(benchmark::kMillisecond)->Args({10'000'000, 1});
 #if CONCORE_USE_TBB
 BENCHMARK_CASE(BM_tbb_parallel_scan);
 #endif
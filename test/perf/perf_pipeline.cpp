@@ -0,0 +1,86 @@
+#include "benchmark_helpers.hpp"
+#include <concore/pipeline.hpp>
+#include <concore/typed_pipeline.hpp>
+#include <concore/spawn.hpp>
+#include <concore/profiling.hpp>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+uint64_t bad_fib(uint64_t n) { return n < 2 ? n : bad_fib(n - 1) + bad_fib(n - 2); }
+
+//! Pushes lines through a pipeline with 5 cheap stages. The middle stage has the ordering given as
+//! argument; all the other stages are concurrent.
+void BM_pipeline_cheap_stages(benchmark::State& state) {
+    const int num_lines = 10000;
+    auto mid_ord = static_cast<concore::stage_ordering>(state.range(0));
+    auto grp = concore::task_group::create();
+
+    auto cheap_work = [](int& data) { benchmark::DoNotOptimize(data += int(bad_fib(8))); };
+    // clang-format off
+    auto my_pipeline = concore::pipeline_builder<int>(64, grp)
+        | concore::stage_ordering::concurrent
+        | cheap_work
+        | cheap_work
+        | mid_ord
+        | cheap_work
+        | concore::stage_ordering::concurrent
+        | cheap_work
+        | cheap_work
+        | concore::pipeline_end;
+    // clang-format on
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        for (int i = 0; i < num_lines; i++)
+            my_pipeline.push(i);
+        concore::wait(grp);
+    }
+    state.SetItemsProcessed(state.iterations() * num_lines);
+}
+
+//! Same as BM_pipeline_cheap_stages, but with a typed pipeline; the consecutive concurrent stages
+//! are fused, so this can be compared with the untyped pipeline.
+void BM_typed_pipeline_cheap_stages(benchmark::State& state) {
+    const int num_lines = 10000;
+    auto mid_ord = static_cast<concore::stage_ordering>(state.range(0));
+    auto grp = concore::task_group::create();
+
+    auto cheap_work = [](int& data) { benchmark::DoNotOptimize(data += int(bad_fib(8))); };
+    // clang-format off
+    auto my_pipeline = concore::typed_pipeline_builder<int>(64, grp)
+        | concore::stage_ordering::concurrent
+        | cheap_work
+        | cheap_work
+        | mid_ord
+        | cheap_work
+        | concore::stage_ordering::concurrent
+        | cheap_work
+        | cheap_work
+        | concore::pipeline_end;
+    // clang-format on
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        for (int i = 0; i < num_lines; i++)
+            my_pipeline.push(i);
+        concore::wait(grp);
+    }
+    state.SetItemsProcessed(state.iterations() * num_lines);
+}
+
+} // namespace
+
+#define BENCHMARK_CASE(fun, m) BENCHMARK(fun)->Unit(benchmark::kMillisecond)->Arg((int)(m))
+
+BENCHMARK_CASE(BM_pipeline_cheap_stages, concore::stage_ordering::concurrent);
+BENCHMARK_CASE(BM_pipeline_cheap_stages, concore::stage_ordering::out_of_order);
+BENCHMARK_CASE(BM_pipeline_cheap_stages, concore::stage_ordering::in_order);
+BENCHMARK_CASE(BM_typed_pipeline_cheap_stages, concore::stage_ordering::concurrent);
+BENCHMARK_CASE(BM_typed_pipeline_cheap_stages, concore::stage_ordering::out_of_order);
+BENCHMARK_CASE(BM_typed_pipeline_cheap_stages, concore::stage_ordering::in_order);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,103 @@
+#include "benchmark_helpers.hpp"
+#include <concore/task_graph.hpp>
+#include <concore/profiling.hpp>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+uint64_t bad_fib(uint64_t n) { return n < 2 ? n : bad_fib(n - 1) + bad_fib(n - 2); }
+
+//! How the costs of the nodes are given to the graph
+enum class cost_mode {
+    none,     //!< All nodes have the same cost (no information about the critical path)
+    given,    //!< The costs are given when building the graph
+    measured, //!< The costs are measured while running the graph
+};
+
+/**
+ * Builds an unbalanced graph: a long chain of expensive nodes (the critical path), where each node
+ * of the chain also starts a number of short side branches. The side branches are added first,
+ * so that without rank information they would be started before the next node of the chain.
+ */
+concore::task_graph build_unbalanced_graph(
+        int chain_len, int num_side, int chain_work, int side_work, cost_mode mode) {
+    concore::task_graph_builder builder;
+    builder.set_measure_costs(mode == cost_mode::measured);
+    auto cost = [mode](int work) { return mode == cost_mode::given ? double(1 << work) : 0.0; };
+
+    int prev_chain = -1;
+    for (int i = 0; i < chain_len; i++) {
+        std::vector<int> side(num_side);
+        for (int j = 0; j < num_side; j++)
+            side[j] = builder.add_node(
+                    [side_work] { benchmark::DoNotOptimize(bad_fib(side_work)); }, cost(side_work));
+        int cur = builder.add_node(
+                [chain_work] { benchmark::DoNotOptimize(bad_fib(chain_work)); }, cost(chain_work));
+        if (prev_chain >= 0) {
+            for (int s : side)
+                builder.add_edge(prev_chain, s);
+            builder.add_edge(prev_chain, cur);
+        }
+        prev_chain = cur;
+    }
+    return builder.build();
+}
+
+void BM_task_graph_unbalanced(benchmark::State& state) {
+    auto mode = static_cast<cost_mode>(state.range(0));
+    concore::task_graph graph = build_unbalanced_graph(64, 16, 22, 16, mode);
+
+    // Warm up; this also measures the costs, if needed
+    graph.run_and_wait();
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        graph.run_and_wait();
+    }
+}
+
+void BM_task_graph_chains(benchmark::State& state) {
+    // Many independent chains of small nodes, with redundant edges
+    const int num_chains = 64;
+    const int chain_len = 32;
+    concore::task_graph_builder builder;
+    for (int i = 0; i < num_chains; i++) {
+        int first = -1;
+        int prev = -1;
+        for (int j = 0; j < chain_len; j++) {
+            int cur = builder.add_node([] { benchmark::DoNotOptimize(bad_fib(10)); });
+            if (prev >= 0)
+                builder.add_edge(prev, cur);
+            if (first >= 0 && j > 1)
+                builder.add_edge(first, cur); // transitive edge
+            first = first < 0 ? cur : first;
+            prev = cur;
+        }
+    }
+    if (state.range(0) != 0)
+        builder.set_optimizations(concore::task_graph_optimizations{});
+    concore::task_graph graph = builder.build();
+    graph.run_and_wait();
+
+    // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
+    for (auto _ : state) {
+        CONCORE_PROFILING_SCOPE_N("test iter");
+        graph.run_and_wait();
+    }
+}
+
+} // namespace
+
+#define BENCHMARK_CASE(fun, m) BENCHMARK(fun)->Unit(benchmark::kMillisecond)->Arg((int)(m))
+
+BENCHMARK_CASE(BM_task_graph_unbalanced, cost_mode::none);
+BENCHMARK_CASE(BM_task_graph_unbalanced, cost_mode::given);
+BENCHMARK_CASE(BM_task_graph_unbalanced, cost_mode::measured);
+BENCHMARK_PAUSE();
+
+BENCHMARK_CASE(BM_task_graph_chains, 0);
+BENCHMARK_CASE(BM_task_graph_chains, 1);
+
+BENCHMARK_MAIN();
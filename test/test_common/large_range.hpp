@@ -0,0 +1,42 @@
+#pragma once
+
+#include <concore/integral_iterator.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+//! The number of elements used for testing ranges that don't fit into 32-bit integers
+constexpr int64_t large_range_size = 3'000'000'000LL;
+
+//! Index iterator that can cover large ranges
+using large_iterator = concore::integral_iterator<int64_t>;
+
+//! Keeps track of the ranges of indices covered by an algorithm, in constant time per range.
+//! Besides the number of covered indices, we keep the sum of all the indices (modulo 2^64); if
+//! some indices are covered multiple times, and others are not covered, the sum will most likely
+//! be different from the expected one.
+struct range_coverage {
+    uint64_t count_{0};
+    uint64_t sum_{0};
+
+    //! Adds the range [first, last) to the coverage
+    void add(int64_t first, int64_t last) {
+        auto n = uint64_t(last - first);
+        auto s = uint64_t(first + last - 1);
+        // One of the two is even; divide that one to avoid overflowing before the division
+        sum_ += (n % 2 == 0) ? (n / 2) * s : n * (s / 2);
+        count_ += n;
+    }
+
+    void add(const range_coverage& other) {
+        count_ += other.count_;
+        sum_ += other.sum_;
+    }
+
+    //! Checks if this covers exactly all the indices in [0, n)
+    bool covers_exactly(int64_t n) const {
+        range_coverage expected;
+        expected.add(0, n);
+        return count_ == expected.count_ && sum_ == expected.sum_;
+    }
+};
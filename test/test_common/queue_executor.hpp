@@ -0,0 +1,22 @@
+#pragma once
+
+#include <concore/task.hpp>
+
+#include <deque>
+
+//! Executor that just stores the tasks in a FIFO queue, to be executed later (manually)
+struct queue_executor {
+    std::deque<concore::task>* tasks_;
+
+    template <typename F>
+    void execute(F&& f) const {
+        tasks_->emplace_back(std::forward<F>(f));
+    }
+    void execute(concore::task&& t) const noexcept { tasks_->emplace_back(std::move(t)); }
+    void operator()(concore::task t) const { execute(std::move(t)); }
+
+    friend inline bool operator==(queue_executor l, queue_executor r) {
+        return l.tasks_ == r.tasks_;
+    }
+    friend inline bool operator!=(queue_executor l, queue_executor r) { return !(l == r); }
+};